@@ -27,6 +27,7 @@
 #include "tool_box.h"
 #include "smart_file.h"
 #include "err_trckr.h"
+#include "round_store.h"
 
 #define ERR_APPEND_KSI_ERR_EXT_MSG(err, res, ref_err, msg) \
 		if (res == ref_err) { \
@@ -384,6 +385,25 @@ int KSITOOL_SignatureVerify_with_publications_file_or_calendar(ERR_TRCKR *err, K
     return res;
 }
 
+int KSITOOL_SignatureVerify_with_publications_file_or_internally(ERR_TRCKR *err, KSI_Signature *sig, KSI_CTX *ctx, KSI_DataHash *hsh, KSI_PublicationsFile* pubFile,
+                                          KSI_PolicyVerificationResult **result) {
+	int res;
+
+	if (err == NULL || sig == NULL || ctx == NULL || result == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		return res;
+	}
+
+	/* Extending is not permitted, so the extender is never asked for a calendar hash chain. */
+	if (KSITOOL_Signature_isPublicationRecordPresent(sig)) {
+		res = KSITOOL_SignatureVerify_publicationsFileBased(err, sig, ctx, hsh, pubFile, 0, result);
+	} else {
+		res = KSITOOL_SignatureVerify_internally(err, sig, ctx, hsh, result);
+	}
+
+	return res;
+}
+
 int KSITOOL_SignatureVerify_general(ERR_TRCKR *err, KSI_Signature *sig, KSI_CTX *ctx, KSI_DataHash *hsh, KSI_PublicationsFile* pubFile,
 														 KSI_PublicationData *pubdata, int extperm,
 														 KSI_PolicyVerificationResult **result){
@@ -554,6 +574,109 @@ int KSITOOL_BlockSigner_addLeaf(ERR_TRCKR *err, KSI_CTX *ctx, KSI_BlockSigner *s
 	return res;
 }
 
+int KSITOOL_AsyncService_addRequest(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncService *service, KSI_AsyncHandle *handle) {
+	int res;
+
+	if (err == NULL || ctx == NULL || service == NULL || handle == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		return res;
+	}
+
+	res = KSI_AsyncService_addRequest(service, handle);
+	if (res != KSI_OK) KSITOOL_KSI_ERRTrace_save(ctx);
+
+	if (appendBaseErrorIfPresent(err, res, ctx, __LINE__) == 0) {
+		appendNetworkErrors(err, res);
+	}
+	return res;
+}
+
+int KSITOOL_AsyncService_run(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncService *service, KSI_AsyncHandle **handle, size_t *waiting) {
+	int res;
+
+	if (err == NULL || ctx == NULL || service == NULL || handle == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		return res;
+	}
+
+	res = KSI_AsyncService_run(service, handle, waiting);
+	if (res != KSI_OK) KSITOOL_KSI_ERRTrace_save(ctx);
+
+	if (appendBaseErrorIfPresent(err, res, ctx, __LINE__) == 0) {
+		appendNetworkErrors(err, res);
+		appendAggreErrors(err, res);
+	}
+	return res;
+}
+
+int KSITOOL_ExtendingAsyncService_run(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncService *service, KSI_AsyncHandle **handle, size_t *waiting) {
+	int res;
+
+	if (err == NULL || ctx == NULL || service == NULL || handle == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		return res;
+	}
+
+	res = KSI_AsyncService_run(service, handle, waiting);
+	if (res != KSI_OK) KSITOOL_KSI_ERRTrace_save(ctx);
+
+	if (appendBaseErrorIfPresent(err, res, ctx, __LINE__) == 0) {
+		appendNetworkErrors(err, res);
+		appendExtenderErrors(err, res);
+	}
+	return res;
+}
+
+int KSITOOL_AsyncHandle_getSignature(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncHandle *handle, KSI_Signature **sig) {
+	int res;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+
+	if (err == NULL || ctx == NULL || handle == NULL || sig == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		return res;
+	}
+
+	res = KSI_AsyncHandle_getState(handle, &state);
+	if (res == KSI_OK && state == KSI_ASYNC_STATE_ERROR) {
+		/* The request failed, return the error code of the request. */
+		if (KSI_AsyncHandle_getError(handle, &res) != KSI_OK || res == KSI_OK) res = KSI_UNKNOWN_ERROR;
+	} else if (res == KSI_OK) {
+		res = KSI_AsyncHandle_getSignature(handle, sig);
+	}
+	if (res != KSI_OK) KSITOOL_KSI_ERRTrace_save(ctx);
+
+	if (appendBaseErrorIfPresent(err, res, ctx, __LINE__) == 0) {
+		appendNetworkErrors(err, res);
+		appendAggreErrors(err, res);
+	}
+	return res;
+}
+
+int KSITOOL_AsyncHandle_getExtendedSignature(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncHandle *handle, KSI_Signature **ext) {
+	int res;
+	int state = KSI_ASYNC_STATE_UNDEFINED;
+
+	if (err == NULL || ctx == NULL || handle == NULL || ext == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		return res;
+	}
+
+	res = KSI_AsyncHandle_getState(handle, &state);
+	if (res == KSI_OK && state == KSI_ASYNC_STATE_ERROR) {
+		/* The request failed, return the error code of the request. */
+		if (KSI_AsyncHandle_getError(handle, &res) != KSI_OK || res == KSI_OK) res = KSI_UNKNOWN_ERROR;
+	} else if (res == KSI_OK) {
+		res = KSI_AsyncHandle_getSignature(handle, ext);
+	}
+	if (res != KSI_OK) KSITOOL_KSI_ERRTrace_save(ctx);
+
+	if (appendBaseErrorIfPresent(err, res, ctx, __LINE__) == 0) {
+		appendNetworkErrors(err, res);
+		appendExtenderErrors(err, res);
+	}
+	return res;
+}
+
 
 int KSITOOL_receivePublicationsFile(ERR_TRCKR *err, KSI_CTX *ctx, KSI_PublicationsFile **pubFile) {
 	int res;
@@ -929,6 +1052,122 @@ int KSI_OBJ_loadSignature(ERR_TRCKR *err, KSI_CTX *ksi, const char *fname, const
 	return res;
 }
 
+/**
+ * Reconstructs the serialized signature from the entry of a bundle in the round
+ * store format (see round_store.h). Only the shared block of the round the entry
+ * refers to is read from the bundle.
+ */
+static int load_round_store_entry(ERR_TRCKR *err, BUNDLE *bundle, const char *name, const unsigned char *data, size_t data_len, unsigned char *buf, size_t buf_len, size_t *sig_len) {
+	int res;
+	unsigned char *shared = NULL;
+	KSI_uint64_t shared_offset = 0;
+	size_t shared_len = 0;
+
+	res = ROUND_STORE_getSharedLocation(data, data_len, &shared_offset, &shared_len);
+	ERR_CATCH_MSG(err, res, "Error: Invalid round store entry '%s'.", name);
+
+	if (shared_len > buf_len) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_INPUT_FORMAT, "Error: Shared block of entry '%s' too long for a valid KSI Signature.", name);
+		goto cleanup;
+	}
+
+	shared = (unsigned char*)KSI_malloc(shared_len + 1);
+	if (shared == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	res = BUNDLE_readAt(bundle, shared_offset, shared, shared_len);
+	if (res == KT_INDEX_OVF) res = KT_INVALID_INPUT_FORMAT;
+	ERR_CATCH_MSG(err, res, "Error: Unable to read the shared block of entry '%s'.", name);
+
+	res = ROUND_STORE_decode(data, data_len, shared, shared_len, buf, buf_len, sig_len);
+	if (res == KT_INDEX_OVF) res = KT_INVALID_INPUT_FORMAT;
+	ERR_CATCH_MSG(err, res, "Error: Unable to reconstruct the signature of entry '%s'.", name);
+
+cleanup:
+
+	KSI_free(shared);
+
+	return res;
+}
+
+/**
+ * Loads the signature from the bundle. The entry is looked up by \c name and,
+ * if there is no entry with that name, by the document hash \c hsh (optional).
+ * Only the requested entry is read from the file. Entries in the round store
+ * format are reconstructed to standard signatures.
+ */
+int KSI_OBJ_loadSignatureFromBundle(ERR_TRCKR *err, KSI_CTX *ksi, BUNDLE *bundle, const char *name, KSI_DataHash *hsh, KSI_Signature **sig) {
+	int res;
+	unsigned char buf[0xffff + 4];
+	unsigned char *sig_buf = NULL;
+	size_t data_len = 0;
+	size_t entry = 0;
+	int isFound = 0;
+	KSI_Signature *tmp = NULL;
+
+	if (err == NULL || ksi == NULL || bundle == NULL || name == NULL || sig == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		return res;
+	}
+
+	/* Entries are looked up by name first, as hash imprints are also valid names. */
+	isFound = BUNDLE_findByName(bundle, name, &entry);
+
+	if (!isFound && hsh != NULL) {
+		const unsigned char *imprint = NULL;
+		size_t imprint_len = 0;
+
+		res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to get hash imprint.");
+
+		isFound = BUNDLE_findByImprint(bundle, imprint, imprint_len, &entry);
+	}
+
+	if (!isFound) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_INPUT_FORMAT, "Error: There is no entry '%s' in the bundle '%s'.", name, BUNDLE_getFname(bundle));
+		goto cleanup;
+	}
+
+	res = BUNDLE_read(bundle, entry, buf, sizeof(buf), &data_len);
+	if (res == KT_INDEX_OVF) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_INPUT_FORMAT, "Error: Entry '%s' too long for a valid KSI Signature.", name);
+		goto cleanup;
+	}
+	ERR_CATCH_MSG(err, res, "Error: Unable to read entry '%s' from the bundle '%s'.", name, BUNDLE_getFname(bundle));
+
+	if (ROUND_STORE_isEncoded(buf, data_len)) {
+		size_t sig_len = 0;
+
+		sig_buf = (unsigned char*)KSI_malloc(sizeof(buf));
+		if (sig_buf == NULL) {
+			ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		res = load_round_store_entry(err, bundle, name, buf, data_len, sig_buf, sizeof(buf), &sig_len);
+		if (res != KT_OK) goto cleanup;
+
+		memcpy(buf, sig_buf, sig_len);
+		data_len = sig_len;
+	}
+
+	res = KSI_Signature_parseWithPolicy(ksi, buf, (unsigned)data_len, KSI_VERIFICATION_POLICY_EMPTY, NULL, &tmp);
+	ERR_CATCH_MSG(err, res, "Error: Unable to parse KSI Signature of entry '%s'.", name);
+
+	*sig = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	KSI_free(sig_buf);
+	KSI_Signature_free(tmp);
+
+	return res;
+}
+
 int KSI_OBJ_isSignatureExtended(const KSI_Signature *sig) {
 	KSI_PublicationRecord *pubRec = NULL;
 
@@ -23,8 +23,10 @@
 #include "ksitool_err.h"
 #include <ksi/ksi.h>
 #include <ksi/blocksigner.h>
+#include <ksi/net_async.h>
 #include <ksi/policy.h>
 #include "err_trckr.h"
+#include "bundle.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -54,6 +56,11 @@ int KSITOOL_Signature_isPublicationRecordPresent(const KSI_Signature *sig);
 int KSITOOL_KSI_BlockSigner_new(ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm algoId, KSI_DataHash *prevLeaf, KSI_OctetString *initVal, KSI_BlockSigner **signer);
 int KSITOOL_BlockSigner_closeAndSign(ERR_TRCKR *err, KSI_CTX *ctx, KSI_BlockSigner *signer);
 int KSITOOL_BlockSigner_addLeaf(ERR_TRCKR *err, KSI_CTX *ctx, KSI_BlockSigner *signer, KSI_DataHash *hsh, int level, KSI_MetaData *metaData, KSI_BlockSignerHandle **handle);
+int KSITOOL_AsyncService_addRequest(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncService *service, KSI_AsyncHandle *handle);
+int KSITOOL_AsyncService_run(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncService *service, KSI_AsyncHandle **handle, size_t *waiting);
+int KSITOOL_ExtendingAsyncService_run(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncService *service, KSI_AsyncHandle **handle, size_t *waiting);
+int KSITOOL_AsyncHandle_getSignature(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncHandle *handle, KSI_Signature **sig);
+int KSITOOL_AsyncHandle_getExtendedSignature(ERR_TRCKR *err, KSI_CTX *ctx, KSI_AsyncHandle *handle, KSI_Signature **ext);
 int KSITOOL_receivePublicationsFile(ERR_TRCKR *err ,KSI_CTX *ctx, KSI_PublicationsFile **pubFile);
 int KSITOOL_verifyPublicationsFile(ERR_TRCKR *err, KSI_CTX *ctx, KSI_PublicationsFile *pubfile);
 void KSITOOL_KSI_ERRTrace_save(KSI_CTX *ctx);
@@ -67,6 +74,7 @@ int KSITOOL_SignatureVerify_keyBased(ERR_TRCKR *err, KSI_Signature *sig, KSI_CTX
 int KSITOOL_SignatureVerify_publicationsFileBased(ERR_TRCKR *err, KSI_Signature *sig, KSI_CTX *ctx, KSI_DataHash *hsh, KSI_PublicationsFile* pubFile, int extperm, KSI_PolicyVerificationResult **result);
 int KSITOOL_SignatureVerify_userProvidedPublicationBased(ERR_TRCKR *err, KSI_Signature *sig, KSI_CTX *ctx, KSI_DataHash *hsh, KSI_PublicationData *pubdata, int extperm, KSI_PolicyVerificationResult **result);
 int KSITOOL_SignatureVerify_with_publications_file_or_calendar(ERR_TRCKR *err, KSI_Signature *sig, KSI_CTX *ctx, KSI_DataHash *hsh, KSI_PublicationsFile* pubFile, int extperm, KSI_PolicyVerificationResult **result);
+int KSITOOL_SignatureVerify_with_publications_file_or_internally(ERR_TRCKR *err, KSI_Signature *sig, KSI_CTX *ctx, KSI_DataHash *hsh, KSI_PublicationsFile* pubFile, KSI_PolicyVerificationResult **result);
 
 char *KSITOOL_DataHash_toString(KSI_DataHash *hsh, char *buf, size_t buf_len);
 char *KSITOOL_PublicationData_toString(KSI_PublicationData *data, char *buf, size_t buf_len);
@@ -75,6 +83,7 @@ char *KSITOOL_PublicationRecord_toString(KSI_PublicationRecord *rec, char *buf,
 int KSI_OBJ_saveSignature(ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sign, const char *mode, const char *fname, char *f, size_t f_len);
 int KSI_OBJ_savePublicationsFile(ERR_TRCKR *err, KSI_CTX *ksi, KSI_PublicationsFile *pubfile, const char *mode, const char *fname) ;
 int KSI_OBJ_loadSignature(ERR_TRCKR *err, KSI_CTX *ksi, const char *fname, const char* mode, KSI_Signature **sig);
+int KSI_OBJ_loadSignatureFromBundle(ERR_TRCKR *err, KSI_CTX *ksi, BUNDLE *bundle, const char *name, KSI_DataHash *hsh, KSI_Signature **sig);
 int KSI_OBJ_isSignatureExtended(const KSI_Signature *sig);
 
 int KSITOOL_LOG_SmartFile(void *logCtx, int logLevel, const char *message);
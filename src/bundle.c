@@ -0,0 +1,726 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <ksi/ksi.h>
+#include "bundle.h"
+#include "ksitool_err.h"
+
+/**
+ * Bundle file layout (all integers are big-endian):
+ * <header magic> <segment>...
+ * where every segment is written at a commit point (see BUNDLE_commit):
+ * <entry data>... <index> <index offset (u64)> <entry count (u64)> <end of the previous segment (u64)> <index magic>
+ * The index of a segment only covers the entries added since the previous
+ * commit and is a sequence of records:
+ * <name length (u16)> <name> <imprint length (u8)> <imprint> <data offset (u64)> <data length (u64)>
+ * The end of the previous segment is 0 for the first segment. The segments are
+ * loaded by following these links back from the last trailer. If the file does
+ * not end with a valid trailer (e.g. the run was interrupted), the last valid
+ * trailer is searched backwards, so only the entries of the last uncommitted
+ * segment are lost.
+ */
+#define BUNDLE_MAGIC "KSIBNDL1"
+#define BUNDLE_INDEX_MAGIC "KSIBNDX2"
+#define BUNDLE_MAGIC_LEN 8
+#define BUNDLE_TRAILER_LEN (8 + 8 + 8 + BUNDLE_MAGIC_LEN)
+#define BUNDLE_NAME_MAX 0xffff
+#define BUNDLE_INDEX_MIN 1024
+#define BUNDLE_SCAN_BUF 0x10000
+
+#ifdef _WIN32
+#  define bundle_seek(f, off, whence) _fseeki64((f), (__int64)(off), (whence))
+#  define bundle_tell(f) _ftelli64(f)
+#else
+#  define bundle_seek(f, off, whence) fseeko((f), (off_t)(off), (whence))
+#  define bundle_tell(f) ftello(f)
+#endif
+
+typedef struct BUNDLE_ENTRY_st {
+	char *name;
+	unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+	size_t imprint_len;
+	KSI_uint64_t offset;
+	KSI_uint64_t length;
+} BUNDLE_ENTRY;
+
+struct BUNDLE_st {
+	char *fname;
+	FILE *file;
+	int isWritable;
+
+	/* Offset of the end of the file, where the next entry is written. */
+	KSI_uint64_t end;
+
+	/* Offset of the index of the last segment of the existing bundle, i.e. the end of its data. */
+	KSI_uint64_t data_end;
+
+	/* End of the last valid segment, 0 if there is none. */
+	KSI_uint64_t segment_end;
+
+	/* Count of the entries covered by the indexes already written. */
+	size_t committed;
+
+	/* Set if data is written after the last segment, so the next commit must write an index. */
+	int isModified;
+
+	/**
+	 * Entries and open addressing hash indexes of entry numbers + 1 by name
+	 * and by imprint (0 marks an empty slot).
+	 */
+	BUNDLE_ENTRY *entries;
+	size_t count;
+	size_t count_max;
+	size_t *name_index;
+	size_t *imprint_index;
+	size_t index_size;
+};
+
+static size_t bundle_hash(const unsigned char *data, size_t len) {
+	/* FNV-1a. */
+	size_t h = (size_t)2166136261u;
+	size_t i = 0;
+
+	for (i = 0; i < len; i++) {
+		h ^= data[i];
+		h *= (size_t)16777619u;
+	}
+
+	return h;
+}
+
+static size_t bundle_nameHash(const char *name) {
+	return bundle_hash((const unsigned char*)name, strlen(name));
+}
+
+static void bundle_putU64(unsigned char *buf, KSI_uint64_t val) {
+	int i;
+	for (i = 7; i >= 0; i--) {
+		buf[i] = (unsigned char)(val & 0xff);
+		val >>= 8;
+	}
+}
+
+static KSI_uint64_t bundle_getU64(const unsigned char *buf) {
+	KSI_uint64_t val = 0;
+	int i;
+	for (i = 0; i < 8; i++) val = (val << 8) | buf[i];
+	return val;
+}
+
+/**
+ * Inserts the entry into the hash indexes. An earlier entry with the same name
+ * or imprint is replaced in the index.
+ */
+static void bundle_insert(size_t *name_index, size_t *imprint_index, size_t index_size, BUNDLE_ENTRY *entries, size_t n) {
+	size_t mask = index_size - 1;
+	size_t slot = bundle_nameHash(entries[n].name) & mask;
+
+	while (name_index[slot] != 0 && strcmp(entries[name_index[slot] - 1].name, entries[n].name) != 0) {
+		slot = (slot + 1) & mask;
+	}
+	name_index[slot] = n + 1;
+
+	slot = bundle_hash(entries[n].imprint, entries[n].imprint_len) & mask;
+	while (imprint_index[slot] != 0) {
+		BUNDLE_ENTRY *other = &entries[imprint_index[slot] - 1];
+		if (other->imprint_len == entries[n].imprint_len && memcmp(other->imprint, entries[n].imprint, other->imprint_len) == 0) break;
+		slot = (slot + 1) & mask;
+	}
+	imprint_index[slot] = n + 1;
+}
+
+static int bundle_reindex(BUNDLE *bundle, size_t index_size) {
+	size_t *names = NULL;
+	size_t *imprints = NULL;
+	size_t i = 0;
+
+	names = (size_t*)KSI_calloc(index_size, sizeof(size_t));
+	imprints = (size_t*)KSI_calloc(index_size, sizeof(size_t));
+	if (names == NULL || imprints == NULL) {
+		KSI_free(names);
+		KSI_free(imprints);
+		return KT_OUT_OF_MEMORY;
+	}
+
+	for (i = 0; i < bundle->count; i++) {
+		bundle_insert(names, imprints, index_size, bundle->entries, i);
+	}
+
+	KSI_free(bundle->name_index);
+	KSI_free(bundle->imprint_index);
+	bundle->name_index = names;
+	bundle->imprint_index = imprints;
+	bundle->index_size = index_size;
+
+	return KT_OK;
+}
+
+static int bundle_append(BUNDLE *bundle, const char *name, const unsigned char *imprint, size_t imprint_len, KSI_uint64_t offset, KSI_uint64_t length) {
+	int res;
+	BUNDLE_ENTRY *entry = NULL;
+	size_t name_len = strlen(name);
+
+	if (name_len > BUNDLE_NAME_MAX || imprint_len > KSI_MAX_IMPRINT_LEN) return KT_INVALID_ARGUMENT;
+
+	if (bundle->count == bundle->count_max) {
+		size_t count_max = bundle->count_max * 2;
+		BUNDLE_ENTRY *tmp = (BUNDLE_ENTRY*)realloc(bundle->entries, count_max * sizeof(BUNDLE_ENTRY));
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+		bundle->entries = tmp;
+		bundle->count_max = count_max;
+	}
+
+	/* Keep the index at most half full. */
+	if ((bundle->count + 1) * 2 > bundle->index_size) {
+		res = bundle_reindex(bundle, bundle->index_size * 2);
+		if (res != KT_OK) return res;
+	}
+
+	entry = &bundle->entries[bundle->count];
+	entry->name = (char*)KSI_malloc(name_len + 1);
+	if (entry->name == NULL) return KT_OUT_OF_MEMORY;
+	memcpy(entry->name, name, name_len + 1);
+	memcpy(entry->imprint, imprint, imprint_len);
+	entry->imprint_len = imprint_len;
+	entry->offset = offset;
+	entry->length = length;
+
+	bundle_insert(bundle->name_index, bundle->imprint_index, bundle->index_size, bundle->entries, bundle->count);
+	bundle->count++;
+
+	return KT_OK;
+}
+
+/**
+ * Reads the trailer that ends at the given offset. Returns KT_INVALID_INPUT_FORMAT
+ * if there is no valid trailer.
+ */
+static int bundle_readTrailer(BUNDLE *bundle, KSI_uint64_t trailer_end, KSI_uint64_t *index_offset, KSI_uint64_t *count, KSI_uint64_t *prev_end) {
+	unsigned char trailer[BUNDLE_TRAILER_LEN];
+	KSI_uint64_t trailer_start = 0;
+
+	if (trailer_end < BUNDLE_MAGIC_LEN + BUNDLE_TRAILER_LEN) return KT_INVALID_INPUT_FORMAT;
+	trailer_start = trailer_end - BUNDLE_TRAILER_LEN;
+
+	if (bundle_seek(bundle->file, trailer_start, SEEK_SET) != 0 ||
+			fread(trailer, 1, sizeof(trailer), bundle->file) != sizeof(trailer)) {
+		return KT_IO_ERROR;
+	}
+
+	if (memcmp(trailer + 24, BUNDLE_INDEX_MAGIC, BUNDLE_MAGIC_LEN) != 0) return KT_INVALID_INPUT_FORMAT;
+
+	*index_offset = bundle_getU64(trailer);
+	*count = bundle_getU64(trailer + 8);
+	*prev_end = bundle_getU64(trailer + 16);
+
+	if (*index_offset < BUNDLE_MAGIC_LEN || *index_offset > trailer_start) return KT_INVALID_INPUT_FORMAT;
+	if (*prev_end != 0 && (*prev_end < BUNDLE_MAGIC_LEN + BUNDLE_TRAILER_LEN || *prev_end > *index_offset)) return KT_INVALID_INPUT_FORMAT;
+
+	return KT_OK;
+}
+
+/**
+ * Loads the index of the segment that ends with the trailer at trailer_end.
+ */
+static int bundle_loadSegment(BUNDLE *bundle, KSI_uint64_t trailer_end) {
+	int res;
+	unsigned char *index = NULL;
+	KSI_uint64_t index_offset = 0;
+	KSI_uint64_t count = 0;
+	KSI_uint64_t prev_end = 0;
+	size_t index_len = 0;
+	size_t pos = 0;
+	KSI_uint64_t i = 0;
+
+	res = bundle_readTrailer(bundle, trailer_end, &index_offset, &count, &prev_end);
+	if (res != KT_OK) return res;
+
+	index_len = (size_t)(trailer_end - BUNDLE_TRAILER_LEN - index_offset);
+	index = (unsigned char*)KSI_malloc(index_len + 1);
+	if (index == NULL) return KT_OUT_OF_MEMORY;
+
+	if (bundle_seek(bundle->file, index_offset, SEEK_SET) != 0 ||
+			fread(index, 1, index_len, bundle->file) != index_len) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	for (i = 0; i < count; i++) {
+		char name[BUNDLE_NAME_MAX + 1];
+		size_t name_len = 0;
+		size_t imprint_len = 0;
+		const unsigned char *imprint = NULL;
+		KSI_uint64_t offset = 0;
+		KSI_uint64_t length = 0;
+
+		if (index_len - pos < 2) goto invalid;
+		name_len = ((size_t)index[pos] << 8) | index[pos + 1];
+		pos += 2;
+
+		if (index_len - pos < name_len + 1) goto invalid;
+		memcpy(name, index + pos, name_len);
+		name[name_len] = '\0';
+		pos += name_len;
+
+		imprint_len = index[pos++];
+		if (imprint_len > KSI_MAX_IMPRINT_LEN || index_len - pos < imprint_len + 16) goto invalid;
+		imprint = index + pos;
+		pos += imprint_len;
+
+		offset = bundle_getU64(index + pos);
+		length = bundle_getU64(index + pos + 8);
+		pos += 16;
+
+		if (offset < BUNDLE_MAGIC_LEN || offset > index_offset || length > index_offset - offset) goto invalid;
+
+		res = bundle_append(bundle, name, imprint, imprint_len, offset, length);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	if (pos != index_len) goto invalid;
+
+	res = KT_OK;
+	goto cleanup;
+
+invalid:
+
+	res = KT_INVALID_INPUT_FORMAT;
+
+cleanup:
+
+	KSI_free(index);
+
+	return res;
+}
+
+static void bundle_clearEntries(BUNDLE *bundle) {
+	size_t i = 0;
+
+	for (i = 0; i < bundle->count; i++) KSI_free(bundle->entries[i].name);
+	bundle->count = 0;
+	memset(bundle->name_index, 0, bundle->index_size * sizeof(size_t));
+	memset(bundle->imprint_index, 0, bundle->index_size * sizeof(size_t));
+}
+
+/**
+ * Loads all the segments of the bundle that ends with the trailer at
+ * trailer_end, from the first segment to the last one, so that the later entries
+ * take precedence.
+ */
+static int bundle_loadChain(BUNDLE *bundle, KSI_uint64_t trailer_end) {
+	int res;
+	KSI_uint64_t *ends = NULL;
+	size_t end_count = 0;
+	size_t end_max = 0;
+	KSI_uint64_t end = trailer_end;
+
+	while (end != 0) {
+		KSI_uint64_t index_offset = 0;
+		KSI_uint64_t count = 0;
+		KSI_uint64_t prev_end = 0;
+
+		res = bundle_readTrailer(bundle, end, &index_offset, &count, &prev_end);
+		if (res != KT_OK) goto cleanup;
+
+		if (end_count == end_max) {
+			size_t tmp_max = end_max == 0 ? 64 : end_max * 2;
+			KSI_uint64_t *tmp = (KSI_uint64_t*)realloc(ends, tmp_max * sizeof(KSI_uint64_t));
+			if (tmp == NULL) {
+				res = KT_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+			ends = tmp;
+			end_max = tmp_max;
+		}
+
+		ends[end_count++] = end;
+		if (end_count == 1) bundle->data_end = index_offset;
+		end = prev_end;
+	}
+
+	while (end_count > 0) {
+		res = bundle_loadSegment(bundle, ends[--end_count]);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	bundle->segment_end = trailer_end;
+	res = KT_OK;
+
+cleanup:
+
+	free(ends);
+
+	return res;
+}
+
+/**
+ * Loads the index of an existing bundle. If the file does not end with a valid
+ * segment, the last valid one is searched backwards. A bundle without any valid
+ * segment is empty. The file position is undefined afterwards.
+ */
+static int bundle_load(BUNDLE *bundle, KSI_uint64_t file_size) {
+	int res;
+	unsigned char *buf = NULL;
+	KSI_uint64_t hi = file_size;
+
+	res = bundle_loadChain(bundle, file_size);
+	if (res != KT_INVALID_INPUT_FORMAT) return res;
+
+	buf = (unsigned char*)KSI_malloc(BUNDLE_SCAN_BUF);
+	if (buf == NULL) return KT_OUT_OF_MEMORY;
+
+	/* Scan the window [lo, hi) for the index magic, the windows overlap by the length of the magic. */
+	while (hi >= BUNDLE_MAGIC_LEN + BUNDLE_TRAILER_LEN) {
+		KSI_uint64_t lo = (hi - BUNDLE_MAGIC_LEN > BUNDLE_SCAN_BUF) ? hi - BUNDLE_SCAN_BUF : BUNDLE_MAGIC_LEN;
+		size_t len = (size_t)(hi - lo);
+		size_t pos = 0;
+
+		if (bundle_seek(bundle->file, lo, SEEK_SET) != 0 || fread(buf, 1, len, bundle->file) != len) {
+			res = KT_IO_ERROR;
+			goto cleanup;
+		}
+
+		for (pos = len - BUNDLE_MAGIC_LEN + 1; pos-- > 0;) {
+			KSI_uint64_t trailer_end = lo + pos + BUNDLE_MAGIC_LEN;
+
+			if (memcmp(buf + pos, BUNDLE_INDEX_MAGIC, BUNDLE_MAGIC_LEN) != 0 || trailer_end == file_size) continue;
+
+			bundle_clearEntries(bundle);
+			res = bundle_loadChain(bundle, trailer_end);
+			if (res != KT_INVALID_INPUT_FORMAT) goto cleanup;
+		}
+
+		if (lo == BUNDLE_MAGIC_LEN) break;
+		hi = lo + BUNDLE_MAGIC_LEN - 1;
+	}
+
+	/* Nothing was committed to the bundle. */
+	bundle_clearEntries(bundle);
+	bundle->data_end = BUNDLE_MAGIC_LEN;
+	bundle->segment_end = 0;
+	res = KT_OK;
+
+cleanup:
+
+	KSI_free(buf);
+
+	return res;
+}
+
+static int bundle_write(BUNDLE *bundle, const unsigned char *data, size_t data_len) {
+	if (data_len > 0 && fwrite(data, 1, data_len, bundle->file) != data_len) return KT_IO_ERROR;
+	bundle->end += data_len;
+	return KT_OK;
+}
+
+static int bundle_writeIndex(BUNDLE *bundle) {
+	int res;
+	KSI_uint64_t index_offset = bundle->end;
+	unsigned char buf[2 + BUNDLE_NAME_MAX + 1 + KSI_MAX_IMPRINT_LEN + 16];
+	unsigned char trailer[BUNDLE_TRAILER_LEN];
+	size_t i = 0;
+
+	for (i = bundle->committed; i < bundle->count; i++) {
+		const BUNDLE_ENTRY *entry = &bundle->entries[i];
+		size_t name_len = strlen(entry->name);
+		size_t len = 0;
+
+		buf[len++] = (unsigned char)(name_len >> 8);
+		buf[len++] = (unsigned char)(name_len & 0xff);
+		memcpy(buf + len, entry->name, name_len);
+		len += name_len;
+		buf[len++] = (unsigned char)entry->imprint_len;
+		memcpy(buf + len, entry->imprint, entry->imprint_len);
+		len += entry->imprint_len;
+		bundle_putU64(buf + len, entry->offset);
+		bundle_putU64(buf + len + 8, entry->length);
+		len += 16;
+
+		res = bundle_write(bundle, buf, len);
+		if (res != KT_OK) return res;
+	}
+
+	bundle_putU64(trailer, index_offset);
+	bundle_putU64(trailer + 8, (KSI_uint64_t)(bundle->count - bundle->committed));
+	bundle_putU64(trailer + 16, bundle->segment_end);
+	memcpy(trailer + 24, BUNDLE_INDEX_MAGIC, BUNDLE_MAGIC_LEN);
+
+	res = bundle_write(bundle, trailer, sizeof(trailer));
+	if (res != KT_OK) return res;
+
+	bundle->segment_end = bundle->end;
+	bundle->committed = bundle->count;
+
+	return KT_OK;
+}
+
+static void bundle_free(BUNDLE *bundle) {
+	size_t i = 0;
+
+	if (bundle == NULL) return;
+
+	if (bundle->file != NULL) fclose(bundle->file);
+	for (i = 0; i < bundle->count; i++) KSI_free(bundle->entries[i].name);
+	free(bundle->entries);
+	KSI_free(bundle->name_index);
+	KSI_free(bundle->imprint_index);
+	KSI_free(bundle->fname);
+	KSI_free(bundle);
+}
+
+int BUNDLE_open(const char *fname, int forWriting, BUNDLE **bundle) {
+	int res;
+	BUNDLE *tmp = NULL;
+	KSI_uint64_t file_size = 0;
+	size_t fname_len = 0;
+
+	if (fname == NULL || bundle == NULL) return KT_INVALID_ARGUMENT;
+
+	tmp = (BUNDLE*)KSI_malloc(sizeof(BUNDLE));
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	tmp->fname = NULL;
+	tmp->file = NULL;
+	tmp->isWritable = forWriting;
+	tmp->end = 0;
+	tmp->data_end = 0;
+	tmp->segment_end = 0;
+	tmp->committed = 0;
+	tmp->isModified = 0;
+	tmp->entries = NULL;
+	tmp->count = 0;
+	tmp->count_max = BUNDLE_INDEX_MIN / 2;
+	tmp->name_index = NULL;
+	tmp->imprint_index = NULL;
+	tmp->index_size = 0;
+
+	fname_len = strlen(fname);
+	tmp->fname = (char*)KSI_malloc(fname_len + 1);
+	tmp->entries = (BUNDLE_ENTRY*)malloc(tmp->count_max * sizeof(BUNDLE_ENTRY));
+	if (tmp->fname == NULL || tmp->entries == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	memcpy(tmp->fname, fname, fname_len + 1);
+
+	res = bundle_reindex(tmp, BUNDLE_INDEX_MIN);
+	if (res != KT_OK) goto cleanup;
+
+	tmp->file = fopen(fname, forWriting ? "r+b" : "rb");
+	if (tmp->file == NULL && forWriting) tmp->file = fopen(fname, "w+b");
+	if (tmp->file == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	if (bundle_seek(tmp->file, 0, SEEK_END) != 0 || bundle_tell(tmp->file) < 0) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+	file_size = (KSI_uint64_t)bundle_tell(tmp->file);
+
+	if (file_size == 0 && forWriting) {
+		/* A new bundle. */
+		res = bundle_write(tmp, (const unsigned char*)BUNDLE_MAGIC, BUNDLE_MAGIC_LEN);
+		if (res != KT_OK) goto cleanup;
+		tmp->isModified = 1;
+	} else {
+		unsigned char magic[BUNDLE_MAGIC_LEN];
+
+		if (bundle_seek(tmp->file, 0, SEEK_SET) != 0 || fread(magic, 1, sizeof(magic), tmp->file) != sizeof(magic) ||
+				memcmp(magic, BUNDLE_MAGIC, BUNDLE_MAGIC_LEN) != 0) {
+			res = KT_INVALID_INPUT_FORMAT;
+			goto cleanup;
+		}
+
+		res = bundle_load(tmp, file_size);
+		if (res != KT_OK) goto cleanup;
+		tmp->committed = tmp->count;
+
+		/* Switching from reading to writing requires a seek. */
+		if (forWriting && bundle_seek(tmp->file, 0, SEEK_END) != 0) {
+			res = KT_IO_ERROR;
+			goto cleanup;
+		}
+		tmp->end = file_size;
+	}
+
+	*bundle = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	bundle_free(tmp);
+
+	return res;
+}
+
+int BUNDLE_commit(BUNDLE *bundle) {
+	int res;
+
+	if (bundle == NULL || !bundle->isWritable) return KT_INVALID_ARGUMENT;
+	if (!bundle->isModified) return KT_OK;
+
+	res = bundle_writeIndex(bundle);
+	if (res != KT_OK) return res;
+
+	if (fflush(bundle->file) != 0) return KT_IO_ERROR;
+	bundle->isModified = 0;
+
+	return KT_OK;
+}
+
+int BUNDLE_close(BUNDLE *bundle) {
+	int res = KT_OK;
+
+	if (bundle == NULL) return KT_OK;
+
+	if (bundle->isWritable) res = BUNDLE_commit(bundle);
+
+	if (fclose(bundle->file) != 0 && res == KT_OK) res = KT_IO_ERROR;
+	bundle->file = NULL;
+	bundle_free(bundle);
+
+	return res;
+}
+
+int BUNDLE_add(BUNDLE *bundle, const char *name, const unsigned char *imprint, size_t imprint_len, const unsigned char *data, size_t data_len) {
+	int res;
+	KSI_uint64_t offset = 0;
+
+	if (bundle == NULL || !bundle->isWritable || name == NULL || imprint == NULL || data == NULL) return KT_INVALID_ARGUMENT;
+
+	offset = bundle->end;
+	bundle->isModified = 1;
+
+	res = bundle_write(bundle, data, data_len);
+	if (res != KT_OK) return res;
+
+	return bundle_append(bundle, name, imprint, imprint_len, offset, (KSI_uint64_t)data_len);
+}
+
+int BUNDLE_addAlias(BUNDLE *bundle, const char *name) {
+	BUNDLE_ENTRY *last = NULL;
+
+	if (bundle == NULL || !bundle->isWritable || name == NULL || bundle->count == 0) return KT_INVALID_ARGUMENT;
+
+	last = &bundle->entries[bundle->count - 1];
+	bundle->isModified = 1;
+
+	return bundle_append(bundle, name, last->imprint, last->imprint_len, last->offset, last->length);
+}
+
+int BUNDLE_addData(BUNDLE *bundle, const unsigned char *data, size_t data_len, KSI_uint64_t *offset) {
+	if (bundle == NULL || !bundle->isWritable || data == NULL || offset == NULL) return KT_INVALID_ARGUMENT;
+
+	*offset = bundle->end;
+	bundle->isModified = 1;
+
+	return bundle_write(bundle, data, data_len);
+}
+
+int BUNDLE_findByName(BUNDLE *bundle, const char *name, size_t *entry) {
+	size_t mask = 0;
+	size_t slot = 0;
+
+	if (bundle == NULL || name == NULL || entry == NULL) return 0;
+
+	mask = bundle->index_size - 1;
+	slot = bundle_nameHash(name) & mask;
+
+	while (bundle->name_index[slot] != 0) {
+		size_t n = bundle->name_index[slot] - 1;
+		if (strcmp(bundle->entries[n].name, name) == 0) {
+			*entry = n;
+			return 1;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return 0;
+}
+
+int BUNDLE_findByImprint(BUNDLE *bundle, const unsigned char *imprint, size_t imprint_len, size_t *entry) {
+	size_t mask = 0;
+	size_t slot = 0;
+
+	if (bundle == NULL || imprint == NULL || entry == NULL) return 0;
+
+	mask = bundle->index_size - 1;
+	slot = bundle_hash(imprint, imprint_len) & mask;
+
+	while (bundle->imprint_index[slot] != 0) {
+		size_t n = bundle->imprint_index[slot] - 1;
+		if (bundle->entries[n].imprint_len == imprint_len && memcmp(bundle->entries[n].imprint, imprint, imprint_len) == 0) {
+			*entry = n;
+			return 1;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return 0;
+}
+
+int BUNDLE_readAt(BUNDLE *bundle, KSI_uint64_t offset, unsigned char *buf, size_t len) {
+	KSI_uint64_t data_end = 0;
+
+	if (bundle == NULL || buf == NULL) return KT_INVALID_ARGUMENT;
+
+	data_end = bundle->isWritable ? bundle->end : bundle->data_end;
+	if (offset < BUNDLE_MAGIC_LEN || offset > data_end || len > data_end - offset) return KT_INDEX_OVF;
+
+	if (bundle_seek(bundle->file, offset, SEEK_SET) != 0 || fread(buf, 1, len, bundle->file) != len) {
+		return KT_IO_ERROR;
+	}
+
+	/* Restore the position for appending. */
+	if (bundle->isWritable && bundle_seek(bundle->file, bundle->end, SEEK_SET) != 0) return KT_IO_ERROR;
+
+	return KT_OK;
+}
+
+int BUNDLE_read(BUNDLE *bundle, size_t entry, unsigned char *buf, size_t buf_len, size_t *data_len) {
+	int res;
+	const BUNDLE_ENTRY *e = NULL;
+
+	if (bundle == NULL || buf == NULL || data_len == NULL) return KT_INVALID_ARGUMENT;
+	if (entry >= bundle->count || bundle->entries[entry].length > buf_len) return KT_INDEX_OVF;
+
+	e = &bundle->entries[entry];
+
+	res = BUNDLE_readAt(bundle, e->offset, buf, (size_t)e->length);
+	if (res != KT_OK) return res;
+
+	*data_len = (size_t)e->length;
+	return KT_OK;
+}
+
+size_t BUNDLE_getCount(BUNDLE *bundle) {
+	return bundle == NULL ? 0 : bundle->count;
+}
+
+const char *BUNDLE_getFname(BUNDLE *bundle) {
+	return bundle == NULL ? NULL : bundle->fname;
+}
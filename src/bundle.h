@@ -0,0 +1,158 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+
+#ifndef BUNDLE_H
+#define	BUNDLE_H
+
+#include <stddef.h>
+#include <ksi/ksi.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct BUNDLE_st BUNDLE;
+
+/**
+ * Opens a signature bundle: an append-only container of serialized signatures
+ * and indexes of the entries. Every entry has a name (e.g. the name of the signed
+ * file) and the imprint of the signed document hash. The entries are written
+ * sequentially and the index of the entries added since the previous commit is
+ * written by #BUNDLE_commit and #BUNDLE_close. If the bundle is opened for
+ * writing and the file already exists, the new entries and indexes are appended
+ * after the existing data, which is never modified. For reading only the indexes
+ * are loaded, the entries are read on demand. If the bundle does not end with
+ * an index (e.g. the process was killed), the entries committed before are still
+ * loaded and the uncommitted ones are ignored.
+ * \param fname			Path to the bundle.
+ * \param forWriting	If not 0, the bundle is opened for adding entries and
+ *						created if it does not exist.
+ * \param bundle		Output parameter for the bundle.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the file is not a
+ * valid bundle, error code otherwise.
+ */
+int BUNDLE_open(const char *fname, int forWriting, BUNDLE **bundle);
+
+/**
+ * Writes the index of the entries added since the previous commit and flushes
+ * the bundle, so that these entries can be read even if the bundle is not closed.
+ * Does nothing if nothing is added.
+ * \param bundle		Bundle opened for writing.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int BUNDLE_commit(BUNDLE *bundle);
+
+/**
+ * Commits the bundle opened for writing (see #BUNDLE_commit) and closes it.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int BUNDLE_close(BUNDLE *bundle);
+
+/**
+ * Appends the entry to the bundle. A later entry with the same name or imprint
+ * takes precedence over the earlier ones when looked up.
+ * \param bundle		Bundle opened for writing.
+ * \param name			Name of the entry.
+ * \param imprint		Imprint of the document hash.
+ * \param imprint_len	Length of the imprint.
+ * \param data			Serialized signature.
+ * \param data_len		Length of the serialized signature.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int BUNDLE_add(BUNDLE *bundle, const char *name, const unsigned char *imprint, size_t imprint_len, const unsigned char *data, size_t data_len);
+
+/**
+ * Adds a new name for the data of the most recently added entry without
+ * writing the data again (e.g. for files with identical content).
+ * \param bundle		Bundle opened for writing.
+ * \param name			Name of the entry.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int BUNDLE_addAlias(BUNDLE *bundle, const char *name);
+
+/**
+ * Appends the data that is not an entry (e.g. the shared block of a round, see
+ * round_store.h) to the bundle. The data is not indexed and can only be read by
+ * its offset.
+ * \param bundle		Bundle opened for writing.
+ * \param data			Data.
+ * \param data_len		Length of the data.
+ * \param offset		Output parameter for the offset of the data.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int BUNDLE_addData(BUNDLE *bundle, const unsigned char *data, size_t data_len, KSI_uint64_t *offset);
+
+/**
+ * Looks up the entry by its name.
+ * \param bundle		Bundle.
+ * \param name			Name of the entry.
+ * \param entry			Output parameter for the index of the entry.
+ * \return 1 if found, 0 otherwise.
+ */
+int BUNDLE_findByName(BUNDLE *bundle, const char *name, size_t *entry);
+
+/**
+ * Looks up the entry by the imprint of the document hash.
+ * \param bundle		Bundle.
+ * \param imprint		Imprint of the document hash.
+ * \param imprint_len	Length of the imprint.
+ * \param entry			Output parameter for the index of the entry.
+ * \return 1 if found, 0 otherwise.
+ */
+int BUNDLE_findByImprint(BUNDLE *bundle, const unsigned char *imprint, size_t imprint_len, size_t *entry);
+
+/**
+ * Reads the data of the entry.
+ * \param bundle		Bundle.
+ * \param entry			Index of the entry.
+ * \param buf			Buffer for the data.
+ * \param buf_len		Size of the buffer.
+ * \param data_len		Output parameter for the length of the data.
+ * \return KT_OK if successful, KT_INDEX_OVF if the entry does not exist or
+ * does not fit into the buffer, error code otherwise.
+ */
+int BUNDLE_read(BUNDLE *bundle, size_t entry, unsigned char *buf, size_t buf_len, size_t *data_len);
+
+/**
+ * Reads the data at the given offset (see #BUNDLE_addData).
+ * \param bundle		Bundle.
+ * \param offset		Offset of the data.
+ * \param buf			Buffer for the data.
+ * \param len			Length of the data.
+ * \return KT_OK if successful, KT_INDEX_OVF if the data is not within the
+ * entries of the bundle, error code otherwise.
+ */
+int BUNDLE_readAt(BUNDLE *bundle, KSI_uint64_t offset, unsigned char *buf, size_t len);
+
+/**
+ * Returns the count of entries in the bundle.
+ */
+size_t BUNDLE_getCount(BUNDLE *bundle);
+
+/**
+ * Returns the path of the bundle.
+ */
+const char *BUNDLE_getFname(BUNDLE *bundle);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* BUNDLE_H */
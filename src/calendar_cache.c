@@ -0,0 +1,697 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ksi/ksi.h>
+#include "calendar_cache.h"
+#include "ksitool_err.h"
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <io.h>
+#  define calendar_cache_seek(f, off, whence) _fseeki64((f), (__int64)(off), (whence))
+#  define calendar_cache_tell(f) _ftelli64(f)
+#else
+#  include <errno.h>
+#  include <unistd.h>
+#  include <sys/types.h>
+#  include <sys/file.h>
+#  define calendar_cache_seek(f, off, whence) fseeko((f), (off_t)(off), (whence))
+#  define calendar_cache_tell(f) ftello(f)
+#endif
+
+/**
+ * Calendar cache file layout (all integers are big-endian):
+ * <magic> <entry>...
+ * where an entry is:
+ * <aggregation time (u64)> <publication time (u64)> <data length (u32)> <data>
+ * and the data is the calendar hash chain TLV followed by the publication record
+ * TLV if the signature was extended to a publication. A process that crashed
+ * while appending may leave an incomplete entry at the end of the file. It is
+ * ignored by the readers and cut off by the next writer. An entry with a header
+ * that is not valid (the data length is out of range or the publication time
+ * precedes the aggregation time) can not be skipped, as the start of the next
+ * entry is not known. The entries before it are used, but the file is never cut
+ * or appended to, so the entries after it are not lost.
+ */
+#define CALENDAR_CACHE_MAGIC "KSICALC1"
+#define CALENDAR_CACHE_MAGIC_LEN 8
+#define CALENDAR_CACHE_ENTRY_HDR_LEN (8 + 8 + 4)
+#define CALENDAR_CACHE_DATA_MAX (2 * (0xffff + 4))
+#define CALENDAR_CACHE_INDEX_MIN 1024
+
+#define CALENDAR_CACHE_TLV16 0x80
+#define CALENDAR_CACHE_TYPE_SIGNATURE 0x0800
+#define CALENDAR_CACHE_TYPE_CALENDAR_CHAIN 0x0802
+#define CALENDAR_CACHE_TYPE_PUBLICATION 0x0803
+#define CALENDAR_CACHE_TYPE_CALENDAR_AUTH 0x0805
+
+typedef struct CALENDAR_CACHE_ENTRY_st {
+	KSI_uint64_t aggr_time;
+	KSI_uint64_t pub_time;
+	KSI_uint64_t offset;
+	size_t length;
+} CALENDAR_CACHE_ENTRY;
+
+struct CALENDAR_CACHE_st {
+	FILE *file;
+
+	/* End of the last complete entry read or written. */
+	KSI_uint64_t end;
+
+	/* Set if the entry at the end is not valid (see #CALENDAR_CACHE_isDamaged). */
+	int isDamaged;
+
+	/* Entries and open addressing hash index of entry numbers + 1 (0 marks an empty slot). */
+	CALENDAR_CACHE_ENTRY *entries;
+	size_t count;
+	size_t count_max;
+	size_t *index;
+	size_t index_size;
+};
+
+static void calendar_cache_putU64(unsigned char *buf, KSI_uint64_t val) {
+	int i;
+	for (i = 7; i >= 0; i--) {
+		buf[i] = (unsigned char)(val & 0xff);
+		val >>= 8;
+	}
+}
+
+static KSI_uint64_t calendar_cache_getU64(const unsigned char *buf) {
+	KSI_uint64_t val = 0;
+	int i;
+	for (i = 0; i < 8; i++) val = (val << 8) | buf[i];
+	return val;
+}
+
+static void calendar_cache_putU32(unsigned char *buf, size_t val) {
+	buf[0] = (unsigned char)((val >> 24) & 0xff);
+	buf[1] = (unsigned char)((val >> 16) & 0xff);
+	buf[2] = (unsigned char)((val >> 8) & 0xff);
+	buf[3] = (unsigned char)(val & 0xff);
+}
+
+static size_t calendar_cache_getU32(const unsigned char *buf) {
+	return ((size_t)buf[0] << 24) | ((size_t)buf[1] << 16) | ((size_t)buf[2] << 8) | buf[3];
+}
+
+/**
+ * Locks the whole file. The lock is advisory and is only respected by the
+ * other instances of the calendar cache.
+ */
+static int calendar_cache_lock(FILE *f, int exclusive) {
+#ifdef _WIN32
+	OVERLAPPED ov;
+	HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+
+	memset(&ov, 0, sizeof(ov));
+	return LockFileEx(h, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD, &ov) ? KT_OK : KT_IO_ERROR;
+#else
+	int res;
+
+	do {
+		res = flock(fileno(f), exclusive ? LOCK_EX : LOCK_SH);
+	} while (res != 0 && errno == EINTR);
+
+	return res == 0 ? KT_OK : KT_IO_ERROR;
+#endif
+}
+
+static void calendar_cache_unlock(FILE *f) {
+#ifdef _WIN32
+	OVERLAPPED ov;
+	HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+
+	memset(&ov, 0, sizeof(ov));
+	UnlockFileEx(h, 0, MAXDWORD, MAXDWORD, &ov);
+#else
+	flock(fileno(f), LOCK_UN);
+#endif
+}
+
+static int calendar_cache_truncate(FILE *f, KSI_uint64_t size) {
+	if (fflush(f) != 0) return KT_IO_ERROR;
+#ifdef _WIN32
+	return _chsize_s(_fileno(f), (__int64)size) == 0 ? KT_OK : KT_IO_ERROR;
+#else
+	return ftruncate(fileno(f), (off_t)size) == 0 ? KT_OK : KT_IO_ERROR;
+#endif
+}
+
+static size_t calendar_cache_hash(KSI_uint64_t aggr_time, KSI_uint64_t pub_time) {
+	/* FNV-1a. */
+	unsigned char key[16];
+	size_t h = (size_t)2166136261u;
+	size_t i = 0;
+
+	calendar_cache_putU64(key, aggr_time);
+	calendar_cache_putU64(key + 8, pub_time);
+
+	for (i = 0; i < sizeof(key); i++) {
+		h ^= key[i];
+		h *= (size_t)16777619u;
+	}
+
+	return h;
+}
+
+/**
+ * Inserts the entry into the hash index. An earlier entry with the same times
+ * is replaced in the index.
+ */
+static void calendar_cache_insert(size_t *index, size_t index_size, const CALENDAR_CACHE_ENTRY *entries, size_t n) {
+	size_t mask = index_size - 1;
+	size_t slot = calendar_cache_hash(entries[n].aggr_time, entries[n].pub_time) & mask;
+
+	while (index[slot] != 0) {
+		const CALENDAR_CACHE_ENTRY *other = &entries[index[slot] - 1];
+		if (other->aggr_time == entries[n].aggr_time && other->pub_time == entries[n].pub_time) break;
+		slot = (slot + 1) & mask;
+	}
+	index[slot] = n + 1;
+}
+
+static int calendar_cache_reindex(CALENDAR_CACHE *cache, size_t index_size) {
+	size_t *index = NULL;
+	size_t i = 0;
+
+	index = (size_t*)KSI_calloc(index_size, sizeof(size_t));
+	if (index == NULL) return KT_OUT_OF_MEMORY;
+
+	for (i = 0; i < cache->count; i++) {
+		calendar_cache_insert(index, index_size, cache->entries, i);
+	}
+
+	KSI_free(cache->index);
+	cache->index = index;
+	cache->index_size = index_size;
+
+	return KT_OK;
+}
+
+static int calendar_cache_append(CALENDAR_CACHE *cache, KSI_uint64_t aggr_time, KSI_uint64_t pub_time, KSI_uint64_t offset, size_t length) {
+	int res;
+	CALENDAR_CACHE_ENTRY *entry = NULL;
+
+	if (cache->count == cache->count_max) {
+		size_t count_max = cache->count_max * 2;
+		CALENDAR_CACHE_ENTRY *tmp = (CALENDAR_CACHE_ENTRY*)realloc(cache->entries, count_max * sizeof(CALENDAR_CACHE_ENTRY));
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+		cache->entries = tmp;
+		cache->count_max = count_max;
+	}
+
+	/* Keep the index at most half full. */
+	if ((cache->count + 1) * 2 > cache->index_size) {
+		res = calendar_cache_reindex(cache, cache->index_size * 2);
+		if (res != KT_OK) return res;
+	}
+
+	entry = &cache->entries[cache->count];
+	entry->aggr_time = aggr_time;
+	entry->pub_time = pub_time;
+	entry->offset = offset;
+	entry->length = length;
+
+	calendar_cache_insert(cache->index, cache->index_size, cache->entries, cache->count);
+	cache->count++;
+
+	return KT_OK;
+}
+
+static const CALENDAR_CACHE_ENTRY *calendar_cache_find(const CALENDAR_CACHE *cache, KSI_uint64_t aggr_time, KSI_uint64_t pub_time) {
+	size_t mask = cache->index_size - 1;
+	size_t slot = calendar_cache_hash(aggr_time, pub_time) & mask;
+
+	while (cache->index[slot] != 0) {
+		const CALENDAR_CACHE_ENTRY *entry = &cache->entries[cache->index[slot] - 1];
+		if (entry->aggr_time == aggr_time && entry->pub_time == pub_time) return entry;
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/**
+ * Reads the entries appended after the last known entry. The file must be
+ * locked. Returns the size of the file in \c file_size.
+ */
+static int calendar_cache_scan(CALENDAR_CACHE *cache, KSI_uint64_t *file_size) {
+	int res;
+	KSI_uint64_t size = 0;
+	KSI_uint64_t pos = cache->end;
+
+	/* The entries after a damaged entry can not be found. */
+	if (cache->isDamaged) {
+		if (file_size != NULL) *file_size = cache->end;
+		return KT_OK;
+	}
+
+	if (calendar_cache_seek(cache->file, 0, SEEK_END) != 0 || calendar_cache_tell(cache->file) < 0) return KT_IO_ERROR;
+	size = (KSI_uint64_t)calendar_cache_tell(cache->file);
+
+	if (pos < size && calendar_cache_seek(cache->file, pos, SEEK_SET) != 0) return KT_IO_ERROR;
+
+	while (pos + CALENDAR_CACHE_ENTRY_HDR_LEN <= size) {
+		unsigned char hdr[CALENDAR_CACHE_ENTRY_HDR_LEN];
+		KSI_uint64_t aggr_time = 0;
+		KSI_uint64_t pub_time = 0;
+		size_t length = 0;
+
+		if (fread(hdr, 1, sizeof(hdr), cache->file) != sizeof(hdr)) return KT_IO_ERROR;
+
+		aggr_time = calendar_cache_getU64(hdr);
+		pub_time = calendar_cache_getU64(hdr + 8);
+		length = calendar_cache_getU32(hdr + 16);
+
+		if (length == 0 || length > CALENDAR_CACHE_DATA_MAX || pub_time < aggr_time) {
+			cache->isDamaged = 1;
+			break;
+		}
+
+		/* An incomplete entry at the end of the file. */
+		if (pos + CALENDAR_CACHE_ENTRY_HDR_LEN + length > size) break;
+
+		res = calendar_cache_append(cache, aggr_time, pub_time, pos + CALENDAR_CACHE_ENTRY_HDR_LEN, length);
+		if (res != KT_OK) return res;
+
+		pos += CALENDAR_CACHE_ENTRY_HDR_LEN + length;
+		if (calendar_cache_seek(cache->file, pos, SEEK_SET) != 0) return KT_IO_ERROR;
+	}
+
+	cache->end = pos;
+	if (file_size != NULL) *file_size = cache->isDamaged ? pos : size;
+
+	return KT_OK;
+}
+
+static void calendar_cache_free(CALENDAR_CACHE *cache) {
+	if (cache == NULL) return;
+	if (cache->file != NULL) fclose(cache->file);
+	free(cache->entries);
+	KSI_free(cache->index);
+	KSI_free(cache);
+}
+
+int CALENDAR_CACHE_open(const char *fname, CALENDAR_CACHE **cache) {
+	int res;
+	CALENDAR_CACHE *tmp = NULL;
+	FILE *create = NULL;
+	KSI_uint64_t file_size = 0;
+	int isLocked = 0;
+
+	if (fname == NULL || cache == NULL) return KT_INVALID_ARGUMENT;
+
+	tmp = (CALENDAR_CACHE*)KSI_malloc(sizeof(CALENDAR_CACHE));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->file = NULL;
+	tmp->end = CALENDAR_CACHE_MAGIC_LEN;
+	tmp->isDamaged = 0;
+	tmp->count = 0;
+	tmp->count_max = CALENDAR_CACHE_INDEX_MIN / 2;
+	tmp->index = NULL;
+	tmp->index_size = 0;
+
+	tmp->entries = (CALENDAR_CACHE_ENTRY*)malloc(tmp->count_max * sizeof(CALENDAR_CACHE_ENTRY));
+	if (tmp->entries == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = calendar_cache_reindex(tmp, CALENDAR_CACHE_INDEX_MIN);
+	if (res != KT_OK) goto cleanup;
+
+	/* Create the file without truncating it, as an other process may be using it. */
+	create = fopen(fname, "ab");
+	if (create == NULL || fclose(create) != 0) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	tmp->file = fopen(fname, "r+b");
+	if (tmp->file == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	res = calendar_cache_lock(tmp->file, 1);
+	if (res != KT_OK) goto cleanup;
+	isLocked = 1;
+
+	if (calendar_cache_seek(tmp->file, 0, SEEK_END) != 0 || calendar_cache_tell(tmp->file) < 0) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+	file_size = (KSI_uint64_t)calendar_cache_tell(tmp->file);
+
+	if (file_size == 0) {
+		if (fwrite(CALENDAR_CACHE_MAGIC, 1, CALENDAR_CACHE_MAGIC_LEN, tmp->file) != CALENDAR_CACHE_MAGIC_LEN || fflush(tmp->file) != 0) {
+			res = KT_IO_ERROR;
+			goto cleanup;
+		}
+	} else {
+		unsigned char magic[CALENDAR_CACHE_MAGIC_LEN];
+
+		if (calendar_cache_seek(tmp->file, 0, SEEK_SET) != 0 || fread(magic, 1, sizeof(magic), tmp->file) != sizeof(magic) ||
+				memcmp(magic, CALENDAR_CACHE_MAGIC, CALENDAR_CACHE_MAGIC_LEN) != 0) {
+			res = KT_INVALID_INPUT_FORMAT;
+			goto cleanup;
+		}
+
+		res = calendar_cache_scan(tmp, NULL);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	calendar_cache_unlock(tmp->file);
+	isLocked = 0;
+
+	*cache = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	if (isLocked) calendar_cache_unlock(tmp->file);
+	calendar_cache_free(tmp);
+
+	return res;
+}
+
+void CALENDAR_CACHE_close(CALENDAR_CACHE *cache) {
+	calendar_cache_free(cache);
+}
+
+int CALENDAR_CACHE_get(CALENDAR_CACHE *cache, KSI_uint64_t aggr_time, KSI_uint64_t pub_time, unsigned char **data, size_t *data_len) {
+	int res;
+	const CALENDAR_CACHE_ENTRY *entry = NULL;
+	unsigned char *tmp = NULL;
+
+	if (cache == NULL || data == NULL || data_len == NULL) return KT_INVALID_ARGUMENT;
+
+	*data = NULL;
+	*data_len = 0;
+
+	entry = calendar_cache_find(cache, aggr_time, pub_time);
+
+	/* Look for the entries appended by the other processes. */
+	if (entry == NULL) {
+		res = calendar_cache_lock(cache->file, 0);
+		if (res != KT_OK) return res;
+
+		res = calendar_cache_scan(cache, NULL);
+		calendar_cache_unlock(cache->file);
+		if (res != KT_OK) return res;
+
+		entry = calendar_cache_find(cache, aggr_time, pub_time);
+		if (entry == NULL) return KT_OK;
+	}
+
+	/* Complete entries are never modified, so these can be read without the lock. */
+	tmp = (unsigned char*)KSI_malloc(entry->length);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	if (calendar_cache_seek(cache->file, entry->offset, SEEK_SET) != 0 || fread(tmp, 1, entry->length, cache->file) != entry->length) {
+		KSI_free(tmp);
+		return KT_IO_ERROR;
+	}
+
+	*data = tmp;
+	*data_len = entry->length;
+
+	return KT_OK;
+}
+
+int CALENDAR_CACHE_put(CALENDAR_CACHE *cache, KSI_uint64_t aggr_time, KSI_uint64_t pub_time, const unsigned char *data, size_t data_len) {
+	int res;
+	unsigned char hdr[CALENDAR_CACHE_ENTRY_HDR_LEN];
+	KSI_uint64_t file_size = 0;
+	KSI_uint64_t offset = 0;
+
+	if (cache == NULL || data == NULL || data_len == 0 || data_len > CALENDAR_CACHE_DATA_MAX) return KT_INVALID_ARGUMENT;
+
+	res = calendar_cache_lock(cache->file, 1);
+	if (res != KT_OK) return res;
+
+	/* Skip the entries appended by the other processes and cut off an incomplete entry. */
+	res = calendar_cache_scan(cache, &file_size);
+	if (res != KT_OK) goto cleanup;
+
+	/* Appending after a damaged entry would cut off the entries following it. */
+	if (cache->isDamaged) {
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	if (file_size > cache->end) {
+		res = calendar_cache_truncate(cache->file, cache->end);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	calendar_cache_putU64(hdr, aggr_time);
+	calendar_cache_putU64(hdr + 8, pub_time);
+	calendar_cache_putU32(hdr + 16, data_len);
+
+	offset = cache->end;
+	if (calendar_cache_seek(cache->file, offset, SEEK_SET) != 0 ||
+			fwrite(hdr, 1, sizeof(hdr), cache->file) != sizeof(hdr) ||
+			fwrite(data, 1, data_len, cache->file) != data_len ||
+			fflush(cache->file) != 0) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	cache->end = offset + CALENDAR_CACHE_ENTRY_HDR_LEN + data_len;
+
+	res = calendar_cache_append(cache, aggr_time, pub_time, offset + CALENDAR_CACHE_ENTRY_HDR_LEN, data_len);
+
+cleanup:
+
+	calendar_cache_unlock(cache->file);
+
+	return res;
+}
+
+size_t CALENDAR_CACHE_getCount(const CALENDAR_CACHE *cache) {
+	return cache == NULL ? 0 : cache->count;
+}
+
+int CALENDAR_CACHE_isDamaged(const CALENDAR_CACHE *cache) {
+	return cache == NULL ? 0 : cache->isDamaged;
+}
+
+/**
+ * Parses the TLV header. Returns 0 if the header or the value does not fit
+ * into the available data.
+ */
+static int calendar_cache_tlv(const unsigned char *data, size_t avail, unsigned *type, size_t *hdr_len, size_t *value_len) {
+	if (avail < 2) return 0;
+
+	if (data[0] & CALENDAR_CACHE_TLV16) {
+		if (avail < 4) return 0;
+		*type = ((unsigned)(data[0] & 0x1f) << 8) | data[1];
+		*hdr_len = 4;
+		*value_len = ((size_t)data[2] << 8) | data[3];
+	} else {
+		*type = data[0] & 0x1f;
+		*hdr_len = 2;
+		*value_len = data[1];
+	}
+
+	return avail - *hdr_len >= *value_len;
+}
+
+static int calendar_cache_getBody(const unsigned char *sig, size_t sig_len, const unsigned char **body, size_t *body_len) {
+	unsigned type = 0;
+	size_t hdr_len = 0;
+	size_t value_len = 0;
+
+	if (!calendar_cache_tlv(sig, sig_len, &type, &hdr_len, &value_len) || hdr_len + value_len != sig_len ||
+			type != CALENDAR_CACHE_TYPE_SIGNATURE) return KT_INVALID_INPUT_FORMAT;
+
+	*body = sig + hdr_len;
+	*body_len = value_len;
+
+	return KT_OK;
+}
+
+int CALENDAR_CACHE_extract(const unsigned char *sig, size_t sig_len, unsigned char **data, size_t *data_len) {
+	int res;
+	const unsigned char *body = NULL;
+	size_t body_len = 0;
+	size_t pos = 0;
+	size_t len = 0;
+	int hasChain = 0;
+	unsigned char *tmp = NULL;
+
+	if (sig == NULL || data == NULL || data_len == NULL) return KT_INVALID_ARGUMENT;
+
+	res = calendar_cache_getBody(sig, sig_len, &body, &body_len);
+	if (res != KT_OK) return res;
+
+	tmp = (unsigned char*)KSI_malloc(body_len > 0 ? body_len : 1);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	while (pos < body_len) {
+		unsigned type = 0;
+		size_t hdr_len = 0;
+		size_t value_len = 0;
+
+		if (!calendar_cache_tlv(body + pos, body_len - pos, &type, &hdr_len, &value_len)) {
+			KSI_free(tmp);
+			return KT_INVALID_INPUT_FORMAT;
+		}
+
+		if (type == CALENDAR_CACHE_TYPE_CALENDAR_CHAIN || type == CALENDAR_CACHE_TYPE_PUBLICATION) {
+			if (type == CALENDAR_CACHE_TYPE_CALENDAR_CHAIN) hasChain = 1;
+			memcpy(tmp + len, body + pos, hdr_len + value_len);
+			len += hdr_len + value_len;
+		}
+
+		pos += hdr_len + value_len;
+	}
+
+	if (!hasChain) {
+		KSI_free(tmp);
+		return KT_INVALID_INPUT_FORMAT;
+	}
+
+	*data = tmp;
+	*data_len = len;
+
+	return KT_OK;
+}
+
+/**
+ * Copies the elements of the cache entry to the buffer. If \c withPublication
+ * is not set, only the calendar hash chain is copied. Returns the count of bytes
+ * copied.
+ */
+static size_t calendar_cache_copyEntry(const unsigned char *data, size_t data_len, int withPublication, unsigned char *buf) {
+	size_t pos = 0;
+	size_t len = 0;
+
+	while (pos < data_len) {
+		unsigned type = 0;
+		size_t hdr_len = 0;
+		size_t value_len = 0;
+
+		if (!calendar_cache_tlv(data + pos, data_len - pos, &type, &hdr_len, &value_len)) break;
+
+		if (type == CALENDAR_CACHE_TYPE_CALENDAR_CHAIN || (withPublication && type == CALENDAR_CACHE_TYPE_PUBLICATION)) {
+			memcpy(buf + len, data + pos, hdr_len + value_len);
+			len += hdr_len + value_len;
+		}
+
+		pos += hdr_len + value_len;
+	}
+
+	return len;
+}
+
+int CALENDAR_CACHE_apply(const unsigned char *sig, size_t sig_len, const unsigned char *data, size_t data_len, int withPublication, unsigned char **out, size_t *out_len) {
+	int res;
+	const unsigned char *body = NULL;
+	size_t body_len = 0;
+	size_t pos = 0;
+	size_t len = 4;
+	int hasChain = 0;
+	int hasPublication = 0;
+	int isInserted = 0;
+	unsigned char *tmp = NULL;
+
+	if (sig == NULL || data == NULL || out == NULL || out_len == NULL) return KT_INVALID_ARGUMENT;
+
+	*out = NULL;
+	*out_len = 0;
+
+	res = calendar_cache_getBody(sig, sig_len, &body, &body_len);
+	if (res != KT_OK) return res;
+
+	/* Check the entry. */
+	while (pos < data_len) {
+		unsigned type = 0;
+		size_t hdr_len = 0;
+		size_t value_len = 0;
+
+		if (!calendar_cache_tlv(data + pos, data_len - pos, &type, &hdr_len, &value_len)) return KT_INVALID_INPUT_FORMAT;
+		if (type == CALENDAR_CACHE_TYPE_CALENDAR_CHAIN) hasChain = 1;
+		if (type == CALENDAR_CACHE_TYPE_PUBLICATION) hasPublication = 1;
+		pos += hdr_len + value_len;
+	}
+
+	if (!hasChain) return KT_INVALID_INPUT_FORMAT;
+	if (withPublication && !hasPublication) return KT_OK;
+
+	tmp = (unsigned char*)KSI_malloc(4 + body_len + data_len);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	/**
+	 * The elements of the entry replace the calendar hash chain and the records
+	 * of the signature. These follow the aggregation hash chains, so the entry
+	 * is inserted before the first element that is not an aggregation chain.
+	 */
+	pos = 0;
+	while (pos < body_len) {
+		unsigned type = 0;
+		size_t hdr_len = 0;
+		size_t value_len = 0;
+
+		if (!calendar_cache_tlv(body + pos, body_len - pos, &type, &hdr_len, &value_len)) {
+			KSI_free(tmp);
+			return KT_INVALID_INPUT_FORMAT;
+		}
+
+		if (!isInserted && type >= CALENDAR_CACHE_TYPE_CALENDAR_CHAIN) {
+			len += calendar_cache_copyEntry(data, data_len, withPublication, tmp + len);
+			isInserted = 1;
+		}
+
+		if (type != CALENDAR_CACHE_TYPE_CALENDAR_CHAIN && type != CALENDAR_CACHE_TYPE_PUBLICATION && type != CALENDAR_CACHE_TYPE_CALENDAR_AUTH) {
+			memcpy(tmp + len, body + pos, hdr_len + value_len);
+			len += hdr_len + value_len;
+		}
+
+		pos += hdr_len + value_len;
+	}
+
+	if (!isInserted) len += calendar_cache_copyEntry(data, data_len, withPublication, tmp + len);
+
+	if (len - 4 > 0xffff) {
+		KSI_free(tmp);
+		return KT_INVALID_INPUT_FORMAT;
+	}
+
+	/* The same type and flags as the original signature. */
+	tmp[0] = sig[0];
+	tmp[1] = sig[1];
+	tmp[2] = (unsigned char)(((len - 4) >> 8) & 0xff);
+	tmp[3] = (unsigned char)((len - 4) & 0xff);
+
+	*out = tmp;
+	*out_len = len;
+
+	return KT_OK;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef CALENDAR_CACHE_H
+#define	CALENDAR_CACHE_H
+
+#include <stddef.h>
+#include <ksi/ksi.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Calendar cache is a persistent store of the calendar hash chains received
+ * from the extender. All the signatures with the same aggregation time are
+ * extended with the same calendar hash chain to the same publication time, so
+ * the chain is requested once and then taken from the cache. An entry holds the
+ * calendar hash chain and the publication record (if any) of an extended
+ * signature as serialized TLV elements.
+ *
+ * The cache file is shared by concurrent processes. Entries are only appended
+ * under an exclusive file lock and the entries appended by other processes are
+ * read under a shared lock when an entry is not found.
+ */
+typedef struct CALENDAR_CACHE_st CALENDAR_CACHE;
+
+/**
+ * Opens the calendar cache file and reads its index. The file is created if
+ * it does not exist.
+ * \param fname		Path to the cache file.
+ * \param cache		Output parameter for the cache.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the file is not a
+ * calendar cache, KT_IO_ERROR if the file can not be opened or locked.
+ */
+int CALENDAR_CACHE_open(const char *fname, CALENDAR_CACHE **cache);
+
+/**
+ * Closes the cache file and frees the cache.
+ */
+void CALENDAR_CACHE_close(CALENDAR_CACHE *cache);
+
+/**
+ * Gets the entry of the aggregation and publication time. The entries appended
+ * by other processes since the cache was opened are read if the entry is not
+ * known.
+ * \param cache			Calendar cache.
+ * \param aggr_time		Aggregation time of the signature.
+ * \param pub_time		Publication time the signature is extended to.
+ * \param data			Output parameter for the entry. Must be freed with KSI_free.
+ *						Set to NULL if there is no entry.
+ * \param data_len		Output parameter for the length of the entry.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int CALENDAR_CACHE_get(CALENDAR_CACHE *cache, KSI_uint64_t aggr_time, KSI_uint64_t pub_time, unsigned char **data, size_t *data_len);
+
+/**
+ * Appends the entry to the cache file. A later entry with the same times
+ * replaces the earlier one. Nothing is appended if the cache is damaged (see
+ * #CALENDAR_CACHE_isDamaged).
+ * \param cache			Calendar cache.
+ * \param aggr_time		Aggregation time of the signature.
+ * \param pub_time		Publication time the signature is extended to.
+ * \param data			Entry created with #CALENDAR_CACHE_extract.
+ * \param data_len		Length of the entry.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int CALENDAR_CACHE_put(CALENDAR_CACHE *cache, KSI_uint64_t aggr_time, KSI_uint64_t pub_time, const unsigned char *data, size_t data_len);
+
+/**
+ * Extracts the calendar hash chain and the publication record of the serialized
+ * extended signature as the cache entry.
+ * \param sig			Serialized signature.
+ * \param sig_len		Length of the serialized signature.
+ * \param data			Output parameter for the entry. Must be freed with KSI_free.
+ * \param data_len		Output parameter for the length of the entry.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the signature is not
+ * a valid TLV or it has no calendar hash chain.
+ */
+int CALENDAR_CACHE_extract(const unsigned char *sig, size_t sig_len, unsigned char **data, size_t *data_len);
+
+/**
+ * Creates the serialized extended signature by replacing the calendar hash
+ * chain, the publication record and the calendar authentication record of the
+ * serialized signature with the elements of the cache entry. The result must be
+ * verified, as the entry is not checked against the signature.
+ * \param sig				Serialized signature.
+ * \param sig_len			Length of the serialized signature.
+ * \param data				Cache entry.
+ * \param data_len			Length of the cache entry.
+ * \param withPublication	If set, the publication record of the entry is
+ *							included, otherwise only the calendar hash chain.
+ * \param out				Output parameter for the extended signature. Must be
+ *							freed with KSI_free. Set to NULL if the publication
+ *							record is requested, but the entry has none.
+ * \param out_len			Output parameter for the length of the extended signature.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the signature or the
+ * entry is not valid or the result is too long.
+ */
+int CALENDAR_CACHE_apply(const unsigned char *sig, size_t sig_len, const unsigned char *data, size_t data_len, int withPublication, unsigned char **out, size_t *out_len);
+
+/**
+ * Returns the count of entries known in the cache.
+ */
+size_t CALENDAR_CACHE_getCount(const CALENDAR_CACHE *cache);
+
+/**
+ * Returns 1 if an entry with a header that is not valid was found in the cache
+ * file, 0 otherwise. Only the entries before it are used and the file is not
+ * changed, so that the entries after it are not lost.
+ */
+int CALENDAR_CACHE_isDamaged(const CALENDAR_CACHE *cache);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CALENDAR_CACHE_H */
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ksi/ksi.h>
+#include "data_tee.h"
+#include "smart_file.h"
+#include "thread_pool.h"
+#include "ksitool_err.h"
+
+#ifdef __linux__
+#  define DATA_TEE_SPLICE
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/stat.h>
+#endif
+
+/** Size of the chunk that is read, hashed and written at once. */
+#define DATA_TEE_CHUNK (1024 * 1024)
+
+typedef struct DATA_TEE_WRITER_st {
+	SMART_FILE *out;
+	char *buf;
+	size_t buf_len;
+} DATA_TEE_WRITER;
+
+static int data_tee_writeJob(void *job_ctx, size_t worker, size_t job) {
+	DATA_TEE_WRITER *writer = job_ctx;
+	size_t count = 0;
+	int res;
+
+	(void)worker;
+	(void)job;
+
+	res = SMART_FILE_write(writer->out, writer->buf, writer->buf_len, &count);
+	if (res != SMART_FILE_OK || count != writer->buf_len) return KT_INVALID_IO_WRITE;
+
+	return KT_OK;
+}
+
+/**
+ * Reads the input into one of the two buffers, while the writer thread writes
+ * the other one. A buffer is not reused before its write has completed.
+ */
+static int data_tee_copyBuffered(SMART_FILE *in, SMART_FILE *out, DATA_TEE_SINK sink, void *sink_ctx) {
+	int res;
+	THREAD_POOL *pool = NULL;
+	DATA_TEE_WRITER writer;
+	char *buf[2] = {NULL, NULL};
+	int current = 0;
+	int isWriting = 0;
+
+	buf[0] = (char*)malloc(DATA_TEE_CHUNK);
+	buf[1] = (char*)malloc(DATA_TEE_CHUNK);
+	if (buf[0] == NULL || buf[1] == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = THREAD_POOL_new(1, &pool);
+	if (res != KT_OK) goto cleanup;
+
+	writer.out = out;
+
+	for (;;) {
+		size_t read_count = 0;
+
+		res = SMART_FILE_read(in, buf[current], DATA_TEE_CHUNK, &read_count);
+		if (res != SMART_FILE_OK) goto cleanup;
+
+		/* Only a read of 0 bytes marks the end of the input, so every chunk read is written. */
+		if (read_count == 0) break;
+
+		res = sink(sink_ctx, buf[current], read_count);
+		if (res != KT_OK) goto cleanup;
+
+		if (isWriting) {
+			isWriting = 0;
+			res = THREAD_POOL_wait(pool);
+			if (res != KT_OK) goto cleanup;
+		}
+
+		writer.buf = buf[current];
+		writer.buf_len = read_count;
+
+		res = THREAD_POOL_start(pool, 1, data_tee_writeJob, &writer);
+		if (res != KT_OK) goto cleanup;
+		isWriting = 1;
+
+		current ^= 1;
+	}
+
+	if (isWriting) {
+		isWriting = 0;
+		res = THREAD_POOL_wait(pool);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	if (isWriting) THREAD_POOL_wait(pool);
+	THREAD_POOL_free(pool);
+	free(buf[0]);
+	free(buf[1]);
+
+	return res;
+}
+
+#ifdef DATA_TEE_SPLICE
+
+static int data_tee_isSpliceable(int in_fd, int out_fd) {
+	struct stat st;
+	int flags;
+
+	/* tee(2) requires the input to be a pipe. */
+	if (fstat(in_fd, &st) != 0 || !S_ISFIFO(st.st_mode)) return 0;
+
+	if (fstat(out_fd, &st) != 0) return 0;
+	if (!S_ISFIFO(st.st_mode) && !S_ISREG(st.st_mode) && !S_ISSOCK(st.st_mode)) return 0;
+
+	/* splice(2) fails on files opened in append mode. */
+	flags = fcntl(out_fd, F_GETFL);
+	if (flags == -1 || (flags & O_APPEND)) return 0;
+
+	return 1;
+}
+
+/**
+ * Duplicates the data in the input pipe into a private pipe with tee(2), moves
+ * the original to the output with splice(2) and gives the duplicate to the sink.
+ * Returns KT_COMPONENT_HAS_NO_IMPLEMENTATION if the kernel rejects the calls
+ * before any data is consumed, so that the caller can fall back.
+ */
+static int data_tee_copySpliced(int in_fd, int out_fd, DATA_TEE_SINK sink, void *sink_ctx) {
+	int res;
+	int dup_pipe[2] = {-1, -1};
+	char *buf = NULL;
+	int isStarted = 0;
+
+	if (pipe(dup_pipe) != 0) {
+		res = KT_COMPONENT_HAS_NO_IMPLEMENTATION;
+		goto cleanup;
+	}
+
+#ifdef F_SETPIPE_SZ
+	/* Fewer and larger chunks. The default size is used if the limit is lower. */
+	fcntl(dup_pipe[1], F_SETPIPE_SZ, DATA_TEE_CHUNK);
+#endif
+
+	buf = (char*)malloc(DATA_TEE_CHUNK);
+	if (buf == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	for (;;) {
+		ssize_t count;
+		size_t moved = 0;
+		size_t received = 0;
+
+		count = tee(in_fd, dup_pipe[1], DATA_TEE_CHUNK, 0);
+		if (count < 0 && errno == EINTR) continue;
+		if (count < 0) {
+			res = isStarted ? KT_INVALID_IO_READ : KT_COMPONENT_HAS_NO_IMPLEMENTATION;
+			goto cleanup;
+		}
+
+		/* No writers and no data left in the input pipe. */
+		if (count == 0) break;
+
+		while (moved < (size_t)count) {
+			ssize_t n = splice(in_fd, NULL, out_fd, NULL, (size_t)count - moved, SPLICE_F_MOVE);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) {
+				res = (!isStarted && moved == 0 && n < 0 && (errno == EINVAL || errno == ENOSYS))
+						? KT_COMPONENT_HAS_NO_IMPLEMENTATION : KT_INVALID_IO_WRITE;
+				goto cleanup;
+			}
+			moved += (size_t)n;
+			isStarted = 1;
+		}
+
+		while (received < (size_t)count) {
+			ssize_t n = read(dup_pipe[0], buf + received, (size_t)count - received);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) {
+				res = KT_INVALID_IO_READ;
+				goto cleanup;
+			}
+			received += (size_t)n;
+		}
+
+		res = sink(sink_ctx, buf, received);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	if (dup_pipe[0] != -1) close(dup_pipe[0]);
+	if (dup_pipe[1] != -1) close(dup_pipe[1]);
+	free(buf);
+
+	return res;
+}
+
+#endif
+
+int DATA_TEE_copy(SMART_FILE *in, SMART_FILE *out, DATA_TEE_SINK sink, void *sink_ctx) {
+#ifdef DATA_TEE_SPLICE
+	int res;
+	int in_fd;
+	int out_fd;
+#endif
+
+	if (in == NULL || out == NULL || sink == NULL) return KT_INVALID_ARGUMENT;
+
+#ifdef DATA_TEE_SPLICE
+	in_fd = SMART_FILE_getDescriptor(in);
+	out_fd = SMART_FILE_getDescriptor(out);
+
+	/* Data buffered in the output stream must precede the spliced data. */
+	if (in_fd != -1 && out_fd != -1 && data_tee_isSpliceable(in_fd, out_fd) && SMART_FILE_flush(out) == SMART_FILE_OK) {
+		res = data_tee_copySpliced(in_fd, out_fd, sink, sink_ctx);
+		if (res != KT_COMPONENT_HAS_NO_IMPLEMENTATION) return res;
+	}
+#endif
+
+	return data_tee_copyBuffered(in, out, sink, sink_ctx);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef DATA_TEE_H
+#define	DATA_TEE_H
+
+#include <stddef.h>
+#include "smart_file.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Consumer of the data that is forwarded by #DATA_TEE_copy.
+ * \param sink_ctx	Context given to #DATA_TEE_copy.
+ * \param data		Chunk of the data.
+ * \param data_len	Length of the chunk.
+ * \return KT_OK (or KSI_OK) if successful, error code otherwise.
+ */
+typedef int (*DATA_TEE_SINK)(void *sink_ctx, const char *data, size_t data_len);
+
+/**
+ * Forwards all the data from \c in to \c out and gives the same data to the
+ * \c sink (e.g. a data hasher). On Linux, if the input is a pipe, the data is
+ * moved to the output with tee(2) and splice(2) without copying it through the
+ * user space and the sink reads the duplicate of the data. Otherwise the data is
+ * read into one buffer while the previous buffer is written by a separate
+ * thread, so that reading and writing are overlapped.
+ * \param in		Input file.
+ * \param out		Output file.
+ * \param sink		Consumer of the data.
+ * \param sink_ctx	Context for the \c sink.
+ * \return KT_OK if successful, error code otherwise. If the output can not be
+ * written, KT_INVALID_IO_WRITE is returned.
+ */
+int DATA_TEE_copy(SMART_FILE *in, SMART_FILE *out, DATA_TEE_SINK sink, void *sink_ctx);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* DATA_TEE_H */
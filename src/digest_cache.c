@@ -0,0 +1,248 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <ksi/ksi.h>
+#include <ksi/compatibility.h>
+#include "digest_cache.h"
+
+#ifndef _WIN32
+#  ifdef HAVE_CONFIG_H
+#    include "config.h"
+#  endif
+#endif
+
+#if defined(HAVE_SYS_XATTR_H) || (!defined(HAVE_CONFIG_H) && (defined(__linux__) || defined(__APPLE__)))
+#  define DIGEST_CACHE_XATTR
+#  include <sys/xattr.h>
+#endif
+
+/**
+ * The cached digest is stored as a text value:
+ * <version> <size> <mtime s> <mtime ns> <ctime s> <ctime ns> <write time> <imprint in hex>
+ * where ctime is the change time of the file before the attribute was written.
+ * As writing the attribute changes the ctime itself, the entry is valid if the
+ * current ctime is not earlier than the recorded one and not later than the
+ * write time + DIGEST_CACHE_SLACK seconds. Any later change of the file content
+ * or metadata (including restoring the mtime with utime) moves the ctime out of
+ * that window. This only detects accidental changes: the attribute is not
+ * authenticated, so anyone who can write the file can also write a matching
+ * entry with a forged imprint.
+ */
+#define DIGEST_CACHE_VERSION 1
+#define DIGEST_CACHE_ATTR_PREFIX "user.ksi."
+#define DIGEST_CACHE_VALUE_MAX (7 * 21 + 2 * KSI_MAX_IMPRINT_LEN + 1)
+
+/**
+ * Time in seconds that covers the granularity of file system timestamps. Files
+ * modified more recently are not cached, as a following modification within the
+ * same time unit may leave the mtime unchanged. The minimum age can be lowered
+ * with the environment variable DIGEST_CACHE_MIN_AGE_ENV (e.g. by the tests, to
+ * cache freshly created files without waiting).
+ */
+#define DIGEST_CACHE_SLACK 2
+#define DIGEST_CACHE_MIN_AGE_ENV "KSI_DIGEST_CACHE_MIN_AGE"
+
+int DIGEST_CACHE_isSupported(void) {
+#ifdef DIGEST_CACHE_XATTR
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+#ifdef DIGEST_CACHE_XATTR
+
+static int digest_cache_attrName(KSI_HashAlgorithm algo, char *buf, size_t buf_len) {
+	const char *name = KSI_getHashAlgorithmName(algo);
+
+	if (name == NULL || strlen(DIGEST_CACHE_ATTR_PREFIX) + strlen(name) >= buf_len) return 0;
+	KSI_snprintf(buf, buf_len, "%s%s", DIGEST_CACHE_ATTR_PREFIX, name);
+	return 1;
+}
+
+static ssize_t digest_cache_getxattr(const char *path, const char *name, char *value, size_t size) {
+#ifdef __APPLE__
+	return getxattr(path, name, value, size, 0, 0);
+#else
+	return getxattr(path, name, value, size);
+#endif
+}
+
+static int digest_cache_setxattr(const char *path, const char *name, const char *value, size_t size) {
+#ifdef __APPLE__
+	return setxattr(path, name, value, size, 0, 0);
+#else
+	return setxattr(path, name, value, size, 0);
+#endif
+}
+
+static KSI_uint64_t digest_cache_minAge(void) {
+	const char *env = getenv(DIGEST_CACHE_MIN_AGE_ENV);
+	char *end = NULL;
+	long age;
+
+	if (env == NULL || *env == '\0') return DIGEST_CACHE_SLACK;
+
+	age = strtol(env, &end, 10);
+	if (*end != '\0' || age < 0 || age > DIGEST_CACHE_SLACK) return DIGEST_CACHE_SLACK;
+
+	return (KSI_uint64_t)age;
+}
+
+static int digest_cache_hexToBin(const char *hex, unsigned char *bin, size_t bin_max, size_t *bin_len) {
+	size_t len = strlen(hex);
+	size_t i;
+
+	if (len % 2 != 0 || len / 2 > bin_max || len == 0) return 0;
+
+	for (i = 0; i < len / 2; i++) {
+		unsigned int byte;
+
+		if (sscanf(hex + 2 * i, "%2x", &byte) != 1) return 0;
+		bin[i] = (unsigned char)byte;
+	}
+
+	*bin_len = len / 2;
+	return 1;
+}
+
+#endif
+
+void DIGEST_CACHE_getStamp(const char *path, DIGEST_CACHE_STAMP *stamp) {
+#ifdef DIGEST_CACHE_XATTR
+	struct stat st;
+#endif
+
+	if (stamp == NULL) return;
+	memset(stamp, 0, sizeof(DIGEST_CACHE_STAMP));
+
+#ifdef DIGEST_CACHE_XATTR
+	if (path == NULL || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return;
+
+	stamp->size = (KSI_uint64_t)st.st_size;
+	stamp->mtime_sec = (KSI_uint64_t)st.st_mtime;
+	stamp->ctime_sec = (KSI_uint64_t)st.st_ctime;
+#  ifdef __APPLE__
+	stamp->mtime_nsec = (KSI_uint64_t)st.st_mtimespec.tv_nsec;
+	stamp->ctime_nsec = (KSI_uint64_t)st.st_ctimespec.tv_nsec;
+#  else
+	stamp->mtime_nsec = (KSI_uint64_t)st.st_mtim.tv_nsec;
+	stamp->ctime_nsec = (KSI_uint64_t)st.st_ctim.tv_nsec;
+#  endif
+	stamp->isValid = 1;
+#else
+	(void)path;
+#endif
+}
+
+void DIGEST_CACHE_get(const char *path, KSI_HashAlgorithm algo, unsigned char *imprint, size_t *imprint_len) {
+#ifdef DIGEST_CACHE_XATTR
+	char name[64];
+	char value[DIGEST_CACHE_VALUE_MAX + 1];
+	char hex[132];
+	ssize_t value_len;
+	unsigned int version = 0;
+	unsigned long long size, mtime_sec, mtime_nsec, ctime_sec, ctime_nsec, written;
+	DIGEST_CACHE_STAMP now;
+	size_t len = 0;
+#endif
+
+	if (imprint_len == NULL) return;
+	*imprint_len = 0;
+
+#ifdef DIGEST_CACHE_XATTR
+	if (path == NULL || imprint == NULL || !digest_cache_attrName(algo, name, sizeof(name))) return;
+
+	DIGEST_CACHE_getStamp(path, &now);
+	if (!now.isValid) return;
+
+	value_len = digest_cache_getxattr(path, name, value, DIGEST_CACHE_VALUE_MAX);
+	if (value_len <= 0) return;
+	value[value_len] = '\0';
+
+	if (sscanf(value, "%u %llu %llu %llu %llu %llu %llu %131s",
+			&version, &size, &mtime_sec, &mtime_nsec, &ctime_sec, &ctime_nsec, &written, hex) != 8) return;
+	if (version != DIGEST_CACHE_VERSION) return;
+
+	/* The content must be unchanged. */
+	if (now.size != size || now.mtime_sec != mtime_sec || now.mtime_nsec != mtime_nsec) return;
+
+	/* Nothing but the attribute itself may have changed since the digest was cached. */
+	if (now.ctime_sec < ctime_sec || (now.ctime_sec == ctime_sec && now.ctime_nsec < ctime_nsec)) return;
+	if (now.ctime_sec > written + DIGEST_CACHE_SLACK) return;
+
+	if (!digest_cache_hexToBin(hex, imprint, KSI_MAX_IMPRINT_LEN, &len)) return;
+	if (imprint[0] != (unsigned char)algo || len != KSI_getHashLength(algo) + 1) return;
+
+	*imprint_len = len;
+#else
+	(void)path;
+	(void)algo;
+	(void)imprint;
+#endif
+}
+
+void DIGEST_CACHE_put(const char *path, const DIGEST_CACHE_STAMP *before, const unsigned char *imprint, size_t imprint_len) {
+#ifdef DIGEST_CACHE_XATTR
+	char name[64];
+	char value[DIGEST_CACHE_VALUE_MAX + 1];
+	size_t value_len;
+	size_t i;
+	DIGEST_CACHE_STAMP after;
+	KSI_uint64_t written;
+	KSI_uint64_t min_age;
+
+	if (path == NULL || before == NULL || !before->isValid || imprint == NULL || imprint_len == 0 || imprint_len > KSI_MAX_IMPRINT_LEN) return;
+	if (!digest_cache_attrName((KSI_HashAlgorithm)imprint[0], name, sizeof(name))) return;
+
+	/* The file must not have changed while it was hashed. */
+	DIGEST_CACHE_getStamp(path, &after);
+	if (!after.isValid || memcmp(before, &after, sizeof(after)) != 0) return;
+
+	written = (KSI_uint64_t)time(NULL);
+	min_age = digest_cache_minAge();
+	if (after.mtime_sec + min_age > written || after.ctime_sec + min_age > written) return;
+
+	value_len = KSI_snprintf(value, sizeof(value), "%u %llu %llu %llu %llu %llu %llu ",
+			(unsigned)DIGEST_CACHE_VERSION,
+			(unsigned long long)after.size,
+			(unsigned long long)after.mtime_sec, (unsigned long long)after.mtime_nsec,
+			(unsigned long long)after.ctime_sec, (unsigned long long)after.ctime_nsec,
+			(unsigned long long)written);
+
+	for (i = 0; i < imprint_len; i++) {
+		KSI_snprintf(value + value_len, sizeof(value) - value_len, "%02x", imprint[i]);
+		value_len += 2;
+	}
+
+	/* The cache is only an optimization, errors (e.g. ENOTSUP, EACCES) are ignored. */
+	digest_cache_setxattr(path, name, value, value_len);
+#else
+	(void)path;
+	(void)before;
+	(void)imprint;
+	(void)imprint_len;
+#endif
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef DIGEST_CACHE_H
+#define	DIGEST_CACHE_H
+
+#include <stddef.h>
+#include <ksi/ksi.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Modes of the digest cache. The cache is disabled if neither of the flags is set.
+ */
+enum DIGEST_CACHE_MODE_en {
+	DIGEST_CACHE_OFF = 0x00,
+
+	/** Cached digests are trusted if the file has not changed. */
+	DIGEST_CACHE_READ = 0x01,
+
+	/** Digests calculated from the file content are stored in the cache. */
+	DIGEST_CACHE_WRITE = 0x02
+};
+
+/**
+ * Snapshot of the file metadata that must be unchanged for the cached digest to
+ * be valid.
+ */
+typedef struct DIGEST_CACHE_STAMP_st {
+	/** Set to 0 if the file is not a regular file or the cache is not supported. */
+	int isValid;
+	KSI_uint64_t size;
+	KSI_uint64_t mtime_sec;
+	KSI_uint64_t mtime_nsec;
+	KSI_uint64_t ctime_sec;
+	KSI_uint64_t ctime_nsec;
+} DIGEST_CACHE_STAMP;
+
+/**
+ * Returns 1 if extended attributes are supported on this platform, 0 otherwise.
+ * On platforms without support all the functions succeed, but nothing is cached.
+ */
+int DIGEST_CACHE_isSupported(void);
+
+/**
+ * Takes the metadata snapshot of the file. Must be called before the file is
+ * read, so that #DIGEST_CACHE_put can detect modifications made during hashing.
+ * \param path		Path to the file.
+ * \param stamp		Output parameter for the snapshot.
+ */
+void DIGEST_CACHE_getStamp(const char *path, DIGEST_CACHE_STAMP *stamp);
+
+/**
+ * Reads the cached digest of the file from the extended attribute
+ * \c user.ksi.<algorithm name>. The digest is returned only if the size,
+ * modification time and change time of the file are the same as they were when
+ * the digest was cached.
+ * \param path			Path to the file.
+ * \param algo			Hash algorithm.
+ * \param imprint		Buffer for the imprint, at least #KSI_MAX_IMPRINT_LEN bytes.
+ * \param imprint_len	Output parameter for the length of the imprint. Set to 0
+ *						if there is no valid digest in the cache.
+ */
+void DIGEST_CACHE_get(const char *path, KSI_HashAlgorithm algo, unsigned char *imprint, size_t *imprint_len);
+
+/**
+ * Stores the digest of the file in its extended attribute. Nothing is stored if
+ * the file has changed since \c before was taken or it was modified so recently
+ * that a following modification may leave the modification time unchanged.
+ * Failures (e.g. the file system does not support extended attributes or the
+ * file is read-only) are silently ignored, as the cache is only an optimization.
+ * \param path			Path to the file.
+ * \param before		Snapshot taken before the file was hashed.
+ * \param imprint		Imprint of the file.
+ * \param imprint_len	Length of the imprint.
+ */
+void DIGEST_CACHE_put(const char *path, const DIGEST_CACHE_STAMP *before, const unsigned char *imprint, size_t imprint_len);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* DIGEST_CACHE_H */
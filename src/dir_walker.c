@@ -0,0 +1,645 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <ksi/ksi.h>
+#include <ksi/compatibility.h>
+#include "dir_walker.h"
+#include "thread_pool.h"
+#include "ksitool_err.h"
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <errno.h>
+#	include <dirent.h>
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#endif
+
+/* Maximum count of found files waiting to be consumed. */
+#define DIR_WALKER_QUEUE_SIZE 4096
+
+struct DIR_WALKER_st {
+	THREAD_POOL *pool;
+
+	/* Filters. */
+	char **patterns;
+	size_t pattern_count;
+	KSI_uint64_t min_size;
+	KSI_uint64_t max_size;
+
+	/* Directories given by the user. These must be readable. */
+	char **roots;
+	size_t root_count;
+
+	/* Subdirectories that could not be read and the count of these returned by DIR_WALKER_nextSkipped. */
+	char **skipped;
+	size_t skipped_count;
+	size_t skipped_taken;
+
+	/* Directories waiting to be read, used as a stack to keep the walk depth first. */
+	char **dirs;
+	size_t dir_count;
+	size_t dir_count_max;
+
+	/* Count of directories being read by the workers. */
+	size_t active;
+
+	/* Ring buffer of files found. */
+	char *files[DIR_WALKER_QUEUE_SIZE];
+	size_t file_first;
+	size_t file_count;
+
+	/* File returned by DIR_WALKER_next. */
+	char *current;
+
+	int isStarted;
+	int isDone;
+	int isCancelled;
+	int res;
+	char err_path[DIR_WALKER_PATH_MAX];
+
+	THREAD_LOCK lock;
+	THREAD_COND dirs_cond;
+	THREAD_COND files_cond;
+	THREAD_COND space_cond;
+};
+
+static char *dir_walker_strdup(const char *str) {
+	size_t len = strlen(str) + 1;
+	char *tmp = (char*)KSI_malloc(len);
+
+	if (tmp != NULL) memcpy(tmp, str, len);
+	return tmp;
+}
+
+/**
+ * Matches the file name against a glob pattern with wildcards * and ?. On
+ * Windows the file names are not case sensitive.
+ */
+static int dir_walker_glob_match(const char *pattern, const char *str) {
+	const char *p_star = NULL;
+	const char *s_star = NULL;
+
+	while (*str != '\0') {
+#ifdef _WIN32
+		int isEqual = tolower((unsigned char)*pattern) == tolower((unsigned char)*str);
+#else
+		int isEqual = *pattern == *str;
+#endif
+		if (*pattern == '*') {
+			p_star = pattern++;
+			s_star = str;
+		} else if (*pattern == '?' || (*pattern != '\0' && isEqual)) {
+			pattern++;
+			str++;
+		} else if (p_star != NULL) {
+			pattern = p_star + 1;
+			str = ++s_star;
+		} else {
+			return 0;
+		}
+	}
+
+	while (*pattern == '*') pattern++;
+
+	return *pattern == '\0';
+}
+
+static int dir_walker_is_match(DIR_WALKER *walker, const char *name, KSI_uint64_t size) {
+	size_t i = 0;
+
+	if (size < walker->min_size) return 0;
+	if (walker->max_size > 0 && size > walker->max_size) return 0;
+	if (walker->pattern_count == 0) return 1;
+
+	for (i = 0; i < walker->pattern_count; i++) {
+		if (dir_walker_glob_match(walker->patterns[i], name)) return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Stops the walk with an error. Must be called with the lock held.
+ */
+static void dir_walker_set_error(DIR_WALKER *walker, int res, const char *path) {
+	if (walker->res != KT_OK) return;
+
+	walker->res = res;
+	KSI_strncpy(walker->err_path, path, sizeof(walker->err_path));
+
+	THREAD_COND_broadcast(&walker->dirs_cond);
+	THREAD_COND_broadcast(&walker->files_cond);
+	THREAD_COND_broadcast(&walker->space_cond);
+}
+
+static int dir_walker_push_dir(DIR_WALKER *walker, const char *path) {
+	int res;
+	char *tmp = NULL;
+
+	tmp = dir_walker_strdup(path);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	THREAD_LOCK_acquire(&walker->lock);
+
+	if (walker->dir_count == walker->dir_count_max) {
+		size_t count_max = walker->dir_count_max == 0 ? 64 : walker->dir_count_max * 2;
+		char **dirs = (char**)realloc(walker->dirs, count_max * sizeof(char*));
+
+		if (dirs == NULL) {
+			res = KT_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+
+		walker->dirs = dirs;
+		walker->dir_count_max = count_max;
+	}
+
+	walker->dirs[walker->dir_count++] = tmp;
+	tmp = NULL;
+	THREAD_COND_signal(&walker->dirs_cond);
+	res = KT_OK;
+
+cleanup:
+
+	THREAD_LOCK_release(&walker->lock);
+	KSI_free(tmp);
+
+	return res;
+}
+
+static int dir_walker_is_root(DIR_WALKER *walker, const char *path) {
+	size_t i = 0;
+
+	for (i = 0; i < walker->root_count; i++) {
+		if (strcmp(walker->roots[i], path) == 0) return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Records a subdirectory that could not be read, so that the walk continues
+ * without it. An unreadable root directory stops the walk with an error.
+ */
+static int dir_walker_skip_dir(DIR_WALKER *walker, const char *path) {
+	int res;
+	char *tmp = NULL;
+	char **skipped = NULL;
+
+	if (dir_walker_is_root(walker, path)) return KT_IO_ERROR;
+
+	tmp = dir_walker_strdup(path);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	THREAD_LOCK_acquire(&walker->lock);
+
+	skipped = (char**)realloc(walker->skipped, (walker->skipped_count + 1) * sizeof(char*));
+	if (skipped == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	skipped[walker->skipped_count++] = tmp;
+	walker->skipped = skipped;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	THREAD_LOCK_release(&walker->lock);
+	KSI_free(tmp);
+
+	return res;
+}
+
+static int dir_walker_push_file(DIR_WALKER *walker, const char *path) {
+	int res;
+	char *tmp = NULL;
+
+	tmp = dir_walker_strdup(path);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	THREAD_LOCK_acquire(&walker->lock);
+
+	while (walker->file_count == DIR_WALKER_QUEUE_SIZE && !walker->isCancelled && walker->res == KT_OK) {
+		THREAD_COND_wait(&walker->space_cond, &walker->lock);
+	}
+
+	if (!walker->isCancelled && walker->res == KT_OK) {
+		walker->files[(walker->file_first + walker->file_count) % DIR_WALKER_QUEUE_SIZE] = tmp;
+		walker->file_count++;
+		tmp = NULL;
+		THREAD_COND_signal(&walker->files_cond);
+	}
+
+	res = KT_OK;
+
+	THREAD_LOCK_release(&walker->lock);
+	KSI_free(tmp);
+
+	return res;
+}
+
+/**
+ * Joins the directory and the file name. Returns KT_INDEX_OVF if the path is
+ * too long.
+ */
+static int dir_walker_join(const char *dir, const char *name, char *buf, size_t buf_len) {
+	size_t dir_len = strlen(dir);
+	int is_slash = dir_len > 0 && dir[dir_len - 1] == '/';
+
+	if (dir_len + strlen(name) + 2 > buf_len) return KT_INDEX_OVF;
+
+	KSI_snprintf(buf, buf_len, "%s%s%s", dir, is_slash ? "" : "/", name);
+	return KT_OK;
+}
+
+#ifdef _WIN32
+static int dir_walker_read_dir(DIR_WALKER *walker, const char *dir) {
+	int res;
+	char path[DIR_WALKER_PATH_MAX];
+	WIN32_FIND_DATAA data;
+	HANDLE h = INVALID_HANDLE_VALUE;
+
+	res = dir_walker_join(dir, "*", path, sizeof(path));
+	if (res != KT_OK) goto cleanup;
+
+	h = FindFirstFileA(path, &data);
+	if (h == INVALID_HANDLE_VALUE) {
+		res = GetLastError() == ERROR_FILE_NOT_FOUND ? KT_OK : dir_walker_skip_dir(walker, dir);
+		goto cleanup;
+	}
+
+	do {
+		const char *name = data.cFileName;
+
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+		res = dir_walker_join(dir, name, path, sizeof(path));
+		if (res != KT_OK) goto cleanup;
+
+		/* Do not follow links to avoid loops. */
+		if ((data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) && (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) continue;
+
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			res = dir_walker_push_dir(walker, path);
+			if (res != KT_OK) goto cleanup;
+		} else if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DEVICE)) {
+			KSI_uint64_t size = ((KSI_uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+
+			if (dir_walker_is_match(walker, name, size)) {
+				res = dir_walker_push_file(walker, path);
+				if (res != KT_OK) goto cleanup;
+			}
+		}
+	} while (FindNextFileA(h, &data));
+
+	res = GetLastError() == ERROR_NO_MORE_FILES ? KT_OK : KT_IO_ERROR;
+
+cleanup:
+
+	if (h != INVALID_HANDLE_VALUE) FindClose(h);
+
+	return res;
+}
+#else
+static int dir_walker_read_dir(DIR_WALKER *walker, const char *dir) {
+	int res;
+	char path[DIR_WALKER_PATH_MAX];
+	DIR *dp = NULL;
+	struct dirent *entry = NULL;
+
+	dp = opendir(dir);
+	if (dp == NULL) {
+		res = dir_walker_skip_dir(walker, dir);
+		goto cleanup;
+	}
+
+	while ((entry = readdir(dp)) != NULL) {
+		const char *name = entry->d_name;
+		struct stat st;
+
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+		res = dir_walker_join(dir, name, path, sizeof(path));
+		if (res != KT_OK) goto cleanup;
+
+		if (lstat(path, &st) != 0) {
+			/* The file was removed after the directory was read. */
+			if (errno == ENOENT) continue;
+			res = KT_IO_ERROR;
+			goto cleanup;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			res = dir_walker_push_dir(walker, path);
+			if (res != KT_OK) goto cleanup;
+			continue;
+		}
+
+		/* Follow links to files, but not to directories to avoid loops. */
+		if (S_ISLNK(st.st_mode) && stat(path, &st) != 0) continue;
+
+		if (S_ISREG(st.st_mode) && dir_walker_is_match(walker, name, (KSI_uint64_t)st.st_size)) {
+			res = dir_walker_push_file(walker, path);
+			if (res != KT_OK) goto cleanup;
+		}
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	if (dp != NULL) closedir(dp);
+
+	return res;
+}
+#endif
+
+/**
+ * Takes the next directory to be read. Sets dir to NULL if the walk is finished.
+ */
+static void dir_walker_take_dir(DIR_WALKER *walker, char **dir) {
+	THREAD_LOCK_acquire(&walker->lock);
+
+	while (walker->dir_count == 0 && walker->active > 0 && !walker->isCancelled && walker->res == KT_OK) {
+		THREAD_COND_wait(&walker->dirs_cond, &walker->lock);
+	}
+
+	if (walker->dir_count > 0 && !walker->isCancelled && walker->res == KT_OK) {
+		*dir = walker->dirs[--walker->dir_count];
+		walker->active++;
+	} else {
+		*dir = NULL;
+	}
+
+	THREAD_LOCK_release(&walker->lock);
+}
+
+static void dir_walker_finish_dir(DIR_WALKER *walker, char *dir, int res) {
+	THREAD_LOCK_acquire(&walker->lock);
+
+	walker->active--;
+	if (res != KT_OK) dir_walker_set_error(walker, res, dir);
+
+	/* Nothing is being read and nothing is left to be read. */
+	if (walker->active == 0 && walker->dir_count == 0) {
+		walker->isDone = 1;
+		THREAD_COND_broadcast(&walker->dirs_cond);
+		THREAD_COND_broadcast(&walker->files_cond);
+	}
+
+	THREAD_LOCK_release(&walker->lock);
+
+	KSI_free(dir);
+}
+
+static int dir_walker_job(void *job_ctx, size_t worker, size_t job) {
+	DIR_WALKER *walker = (DIR_WALKER*)job_ctx;
+	char *dir = NULL;
+	(void)worker;
+	(void)job;
+
+	for (;;) {
+		dir_walker_take_dir(walker, &dir);
+		if (dir == NULL) break;
+
+		dir_walker_finish_dir(walker, dir, dir_walker_read_dir(walker, dir));
+	}
+
+	/* Errors are returned to the consumer by DIR_WALKER_next. */
+	return KT_OK;
+}
+
+int DIR_WALKER_new(size_t worker_count, DIR_WALKER **walker) {
+	int res;
+	DIR_WALKER *tmp = NULL;
+
+	if (worker_count < 1 || walker == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (DIR_WALKER*)KSI_calloc(1, sizeof(DIR_WALKER));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->pool = NULL;
+	tmp->patterns = NULL;
+	tmp->pattern_count = 0;
+	tmp->min_size = 0;
+	tmp->max_size = 0;
+	tmp->roots = NULL;
+	tmp->root_count = 0;
+	tmp->skipped = NULL;
+	tmp->skipped_count = 0;
+	tmp->skipped_taken = 0;
+	tmp->dirs = NULL;
+	tmp->dir_count = 0;
+	tmp->dir_count_max = 0;
+	tmp->active = 0;
+	tmp->file_first = 0;
+	tmp->file_count = 0;
+	tmp->current = NULL;
+	tmp->isStarted = 0;
+	tmp->isDone = 0;
+	tmp->isCancelled = 0;
+	tmp->res = KT_OK;
+	tmp->err_path[0] = '\0';
+
+	THREAD_LOCK_init(&tmp->lock);
+	THREAD_COND_init(&tmp->dirs_cond);
+	THREAD_COND_init(&tmp->files_cond);
+	THREAD_COND_init(&tmp->space_cond);
+
+	res = THREAD_POOL_new(worker_count, &tmp->pool);
+	if (res != KT_OK) goto cleanup;
+
+	*walker = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	DIR_WALKER_free(tmp);
+
+	return res;
+}
+
+void DIR_WALKER_free(DIR_WALKER *walker) {
+	size_t i = 0;
+
+	if (walker == NULL) return;
+
+	/* Stop the workers that may be waiting for the consumer. */
+	THREAD_LOCK_acquire(&walker->lock);
+	walker->isCancelled = 1;
+	THREAD_COND_broadcast(&walker->dirs_cond);
+	THREAD_COND_broadcast(&walker->space_cond);
+	THREAD_LOCK_release(&walker->lock);
+
+	THREAD_POOL_free(walker->pool);
+
+	for (i = 0; i < walker->pattern_count; i++) KSI_free(walker->patterns[i]);
+	for (i = 0; i < walker->root_count; i++) KSI_free(walker->roots[i]);
+	for (i = 0; i < walker->skipped_count; i++) KSI_free(walker->skipped[i]);
+	for (i = 0; i < walker->dir_count; i++) KSI_free(walker->dirs[i]);
+	for (i = 0; i < walker->file_count; i++) KSI_free(walker->files[(walker->file_first + i) % DIR_WALKER_QUEUE_SIZE]);
+
+	free(walker->patterns);
+	free(walker->roots);
+	free(walker->skipped);
+	free(walker->dirs);
+	KSI_free(walker->current);
+
+	THREAD_COND_destroy(&walker->dirs_cond);
+	THREAD_COND_destroy(&walker->files_cond);
+	THREAD_COND_destroy(&walker->space_cond);
+	THREAD_LOCK_destroy(&walker->lock);
+
+	KSI_free(walker);
+}
+
+int DIR_WALKER_addRoot(DIR_WALKER *walker, const char *path) {
+	char **roots = NULL;
+	char *tmp = NULL;
+
+	if (walker == NULL || path == NULL || walker->isStarted) return KT_INVALID_ARGUMENT;
+	if (strlen(path) >= DIR_WALKER_PATH_MAX) return KT_INDEX_OVF;
+
+	tmp = dir_walker_strdup(path);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	roots = (char**)realloc(walker->roots, (walker->root_count + 1) * sizeof(char*));
+	if (roots == NULL) {
+		KSI_free(tmp);
+		return KT_OUT_OF_MEMORY;
+	}
+
+	roots[walker->root_count++] = tmp;
+	walker->roots = roots;
+
+	return dir_walker_push_dir(walker, path);
+}
+
+int DIR_WALKER_addPattern(DIR_WALKER *walker, const char *pattern) {
+	char **patterns = NULL;
+	char *tmp = NULL;
+
+	if (walker == NULL || pattern == NULL || walker->isStarted) return KT_INVALID_ARGUMENT;
+
+	tmp = dir_walker_strdup(pattern);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	patterns = (char**)realloc(walker->patterns, (walker->pattern_count + 1) * sizeof(char*));
+	if (patterns == NULL) {
+		KSI_free(tmp);
+		return KT_OUT_OF_MEMORY;
+	}
+
+	patterns[walker->pattern_count++] = tmp;
+	walker->patterns = patterns;
+
+	return KT_OK;
+}
+
+void DIR_WALKER_setSizeLimits(DIR_WALKER *walker, KSI_uint64_t min_size, KSI_uint64_t max_size) {
+	if (walker == NULL || walker->isStarted) return;
+
+	walker->min_size = min_size;
+	walker->max_size = max_size;
+}
+
+int DIR_WALKER_start(DIR_WALKER *walker) {
+	int res;
+
+	if (walker == NULL || walker->isStarted) return KT_INVALID_ARGUMENT;
+
+	walker->isStarted = 1;
+
+	if (walker->dir_count == 0) {
+		walker->isDone = 1;
+		return KT_OK;
+	}
+
+	/* Every worker runs until the walk is finished. */
+	res = THREAD_POOL_start(walker->pool, THREAD_POOL_getWorkerCount(walker->pool), dir_walker_job, walker);
+	if (res != KT_OK) return res;
+
+	return KT_OK;
+}
+
+int DIR_WALKER_next(DIR_WALKER *walker, const char **path) {
+	int res;
+
+	if (walker == NULL || path == NULL || !walker->isStarted) return KT_INVALID_ARGUMENT;
+
+	KSI_free(walker->current);
+	walker->current = NULL;
+
+	THREAD_LOCK_acquire(&walker->lock);
+
+	while (walker->file_count == 0 && !walker->isDone && walker->res == KT_OK) {
+		THREAD_COND_wait(&walker->files_cond, &walker->lock);
+	}
+
+	if (walker->res != KT_OK) {
+		res = walker->res;
+		goto cleanup;
+	}
+
+	if (walker->file_count > 0) {
+		walker->current = walker->files[walker->file_first];
+		walker->file_first = (walker->file_first + 1) % DIR_WALKER_QUEUE_SIZE;
+		walker->file_count--;
+		THREAD_COND_signal(&walker->space_cond);
+	}
+
+	*path = walker->current;
+	res = KT_OK;
+
+cleanup:
+
+	THREAD_LOCK_release(&walker->lock);
+
+	return res;
+}
+
+const char *DIR_WALKER_nextSkipped(DIR_WALKER *walker) {
+	const char *path = NULL;
+
+	if (walker == NULL) return NULL;
+
+	THREAD_LOCK_acquire(&walker->lock);
+	if (walker->skipped_taken < walker->skipped_count) path = walker->skipped[walker->skipped_taken++];
+	THREAD_LOCK_release(&walker->lock);
+
+	return path;
+}
+
+const char *DIR_WALKER_getErrorPath(DIR_WALKER *walker) {
+	return walker == NULL ? "" : walker->err_path;
+}
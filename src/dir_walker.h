@@ -0,0 +1,113 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef DIR_WALKER_H
+#define	DIR_WALKER_H
+
+#include <stddef.h>
+#include <ksi/ksi.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum length of a path found by the directory walker, including the
+ * terminating NUL character.
+ */
+#define DIR_WALKER_PATH_MAX 4096
+
+typedef struct DIR_WALKER_st DIR_WALKER;
+
+/**
+ * Creates a directory walker that searches regular files from the directory
+ * trees in parallel. Directories are read by worker threads, so that the
+ * traversal of the file system metadata overlaps with the processing of the
+ * files already found. The order in which the files are returned is not defined.
+ *
+ * Symbolic links to regular files are followed, but symbolic links to
+ * directories (and reparse points on Windows) are not, to avoid loops.
+ *
+ * \param worker_count	Count of worker threads, must be at least 1.
+ * \param walker		Output parameter for the walker.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int DIR_WALKER_new(size_t worker_count, DIR_WALKER **walker);
+
+/**
+ * Stops the worker threads and frees the walker.
+ */
+void DIR_WALKER_free(DIR_WALKER *walker);
+
+/**
+ * Adds a directory to be walked. Must be called before #DIR_WALKER_start.
+ */
+int DIR_WALKER_addRoot(DIR_WALKER *walker, const char *path);
+
+/**
+ * Adds a glob pattern (\c * and \c ?) that is matched against the file name
+ * (not the path). If patterns are added, only the files matching at least one
+ * of the patterns are returned. Must be called before #DIR_WALKER_start.
+ */
+int DIR_WALKER_addPattern(DIR_WALKER *walker, const char *pattern);
+
+/**
+ * Limits the size of the files returned. Must be called before #DIR_WALKER_start.
+ * \param walker	Directory walker.
+ * \param min_size	Minimum size of the file in bytes.
+ * \param max_size	Maximum size of the file in bytes. Use 0 for no limit.
+ */
+void DIR_WALKER_setSizeLimits(DIR_WALKER *walker, KSI_uint64_t min_size, KSI_uint64_t max_size);
+
+/**
+ * Starts the worker threads and returns immediately.
+ */
+int DIR_WALKER_start(DIR_WALKER *walker);
+
+/**
+ * Returns the next regular file found. Blocks until a file is found or the walk
+ * is finished. Only a limited count of found files is queued, so the workers
+ * wait if the files are not consumed.
+ * \param walker	Directory walker.
+ * \param path		Output parameter for the path of the file. Set to NULL if the
+ *					walk is finished. The path is valid until the next call.
+ * \return KT_OK if successful, error code if a directory could not be read
+ * (see #DIR_WALKER_getErrorPath).
+ */
+int DIR_WALKER_next(DIR_WALKER *walker, const char **path);
+
+/**
+ * Returns the next subdirectory that could not be read (e.g. because of missing
+ * permissions) and was skipped, or NULL if there are no new ones. The walk is
+ * not stopped by such directories, but a root directory (see #DIR_WALKER_addRoot)
+ * that can not be read stops the walk with an error. The path is valid until
+ * the walker is freed.
+ */
+const char *DIR_WALKER_nextSkipped(DIR_WALKER *walker);
+
+/**
+ * Returns the path that caused the walk to fail or an empty string.
+ */
+const char *DIR_WALKER_getErrorPath(DIR_WALKER *walker);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* DIR_WALKER_H */
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ksi/ksi.h>
+#include <ksi/compatibility.h>
+#include "durable.h"
+#include "smart_file.h"
+#include "thread_pool.h"
+#include "ksitool_err.h"
+
+#define DURABLE_TEMP_SUFFIX ".tmp"
+#define DURABLE_PATH_MAX 1024
+
+typedef struct DURABLE_ENTRY_st {
+	char temp_path[DURABLE_PATH_MAX];
+	char path[DURABLE_PATH_MAX];
+	int isUnique;
+	int isCommitted;
+
+	/* Result of flushing the temporary file. */
+	int res;
+} DURABLE_ENTRY;
+
+struct DURABLE_BATCH_st {
+	THREAD_POOL *pool;
+	DURABLE_ENTRY *entries;
+	size_t count;
+	size_t count_max;
+};
+
+static void durable_getDir(const char *path, char *buf, size_t buf_len) {
+	const char *sep = NULL;
+	const char *p = NULL;
+
+	for (p = path; *p != '\0'; p++) {
+		if (*p == '/' || *p == '\\') sep = p;
+	}
+
+	if (sep == NULL) {
+		KSI_strncpy(buf, ".", buf_len);
+	} else if (sep == path) {
+		KSI_strncpy(buf, "/", buf_len);
+	} else {
+		KSI_snprintf(buf, buf_len, "%.*s", (int)(sep - path), path);
+	}
+}
+
+static int durable_sync_job(void *job_ctx, size_t worker, size_t job) {
+	DURABLE_BATCH *batch = (DURABLE_BATCH*)job_ctx;
+	DURABLE_ENTRY *entry = &batch->entries[job];
+
+	(void)worker;
+
+	entry->res = SMART_FILE_sync(entry->temp_path);
+
+	return entry->res;
+}
+
+int DURABLE_BATCH_new(size_t sync_threads, DURABLE_BATCH **batch) {
+	int res;
+	DURABLE_BATCH *tmp = NULL;
+
+	if (sync_threads < 1 || batch == NULL) return KT_INVALID_ARGUMENT;
+
+	tmp = (DURABLE_BATCH*)KSI_malloc(sizeof(DURABLE_BATCH));
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	tmp->pool = NULL;
+	tmp->entries = NULL;
+	tmp->count = 0;
+	tmp->count_max = 0;
+
+	res = THREAD_POOL_new(sync_threads, &tmp->pool);
+	if (res != KT_OK) goto cleanup;
+
+	*batch = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	DURABLE_BATCH_free(tmp);
+
+	return res;
+}
+
+void DURABLE_BATCH_free(DURABLE_BATCH *batch) {
+	if (batch == NULL) return;
+
+	DURABLE_BATCH_reset(batch);
+	THREAD_POOL_free(batch->pool);
+	free(batch->entries);
+	KSI_free(batch);
+}
+
+char *DURABLE_getTempName(const char *path, char *buf, size_t buf_len) {
+	KSI_snprintf(buf, buf_len, "%s%s", path, DURABLE_TEMP_SUFFIX);
+	return buf;
+}
+
+int DURABLE_BATCH_add(DURABLE_BATCH *batch, const char *temp_path, const char *path, int isUnique) {
+	DURABLE_ENTRY *entry = NULL;
+
+	if (batch == NULL || temp_path == NULL || path == NULL) return KT_INVALID_ARGUMENT;
+	if (strlen(temp_path) >= DURABLE_PATH_MAX || strlen(path) >= DURABLE_PATH_MAX) return KT_INDEX_OVF;
+
+	if (batch->count == batch->count_max) {
+		size_t count_max = (batch->count_max == 0) ? 64 : batch->count_max * 2;
+		DURABLE_ENTRY *tmp = (DURABLE_ENTRY*)realloc(batch->entries, count_max * sizeof(DURABLE_ENTRY));
+
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+		batch->entries = tmp;
+		batch->count_max = count_max;
+	}
+
+	entry = &batch->entries[batch->count++];
+	KSI_strncpy(entry->temp_path, temp_path, sizeof(entry->temp_path));
+	KSI_strncpy(entry->path, path, sizeof(entry->path));
+	entry->isUnique = isUnique;
+	entry->isCommitted = 0;
+	entry->res = KT_UNKNOWN_ERROR;
+
+	return KT_OK;
+}
+
+size_t DURABLE_BATCH_getCount(DURABLE_BATCH *batch) {
+	return (batch == NULL) ? 0 : batch->count;
+}
+
+int DURABLE_BATCH_commit(DURABLE_BATCH *batch, size_t *failed) {
+	int res;
+	size_t i = 0;
+	size_t n = 0;
+	size_t committed = 0;
+	char dir[DURABLE_PATH_MAX];
+	char prev_dir[DURABLE_PATH_MAX] = "";
+
+	if (batch == NULL || failed == NULL) return KT_INVALID_ARGUMENT;
+	*failed = 0;
+
+	/**
+	 * Flush the content of all the files at once. The jobs are taken in the
+	 * order of the files, so the files before the first failed one are flushed.
+	 */
+	if (batch->count > 0) {
+		res = THREAD_POOL_run(batch->pool, batch->count, durable_sync_job, batch);
+		if (res == KT_THREAD_ERROR || res == KT_OUT_OF_MEMORY) goto cleanup;
+	}
+
+	/* Move the files to their final names in the order they were added. */
+	for (i = 0; i < batch->count; i++) {
+		DURABLE_ENTRY *entry = &batch->entries[i];
+
+		if (entry->isCommitted) continue;
+
+		res = entry->res;
+		if (res != SMART_FILE_OK) break;
+
+		if (entry->isUnique && SMART_FILE_doFileExist(entry->path)) {
+			char buf[DURABLE_PATH_MAX];
+
+			if (generate_not_existing_file_name(entry->path, buf, sizeof(buf), 1) == NULL) {
+				res = KT_INDEX_OVF;
+				break;
+			}
+			KSI_strncpy(entry->path, buf, sizeof(entry->path));
+
+			res = SMART_FILE_rename(entry->temp_path, entry->path);
+		} else {
+			res = SMART_FILE_replace(entry->temp_path, entry->path);
+		}
+		if (res != SMART_FILE_OK) break;
+
+		entry->isCommitted = 1;
+		committed = i + 1;
+	}
+
+	/**
+	 * Flush the directories of the renamed files. Usually all the files are in
+	 * the same directory, so only a change of the directory is looked for.
+	 */
+	for (n = 0; n < committed; n++) {
+		int sync_res;
+
+		durable_getDir(batch->entries[n].path, dir, sizeof(dir));
+		if (strcmp(dir, prev_dir) == 0) continue;
+
+		sync_res = SMART_FILE_syncDir(dir);
+		if (sync_res != SMART_FILE_OK) {
+			res = sync_res;
+			i = n;
+			goto cleanup;
+		}
+		KSI_strncpy(prev_dir, dir, sizeof(prev_dir));
+	}
+
+	if (i < batch->count) goto cleanup;
+
+	res = KT_OK;
+
+cleanup:
+
+	*failed = i;
+
+	return res;
+}
+
+const char *DURABLE_BATCH_getFname(DURABLE_BATCH *batch, size_t i) {
+	if (batch == NULL || i >= batch->count) return NULL;
+	return batch->entries[i].path;
+}
+
+void DURABLE_BATCH_reset(DURABLE_BATCH *batch) {
+	size_t i = 0;
+
+	if (batch == NULL) return;
+
+	for (i = 0; i < batch->count; i++) {
+		if (!batch->entries[i].isCommitted) SMART_FILE_remove(batch->entries[i].temp_path);
+	}
+
+	batch->count = 0;
+}
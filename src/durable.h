@@ -0,0 +1,121 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+
+#ifndef DURABLE_H
+#define	DURABLE_H
+
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Group commit of output files. Every file is first written to a temporary file
+ * next to its final location and is added to the batch. When the batch is
+ * committed, the temporary files are flushed to the storage device in parallel,
+ * renamed to their final names in the order they were added and the directories
+ * are flushed once per batch, so that a crash never leaves a partially written
+ * file under the final name.
+ */
+typedef struct DURABLE_BATCH_st DURABLE_BATCH;
+
+/**
+ * Default count of threads flushing the files of a batch.
+ */
+#define DURABLE_SYNC_THREADS 4
+
+/**
+ * Default count of files committed at once.
+ */
+#define DURABLE_BATCH_SIZE 256
+
+/**
+ * Creates a new batch.
+ * \param sync_threads	Count of threads flushing the files, must be at least 1.
+ * \param batch			Output parameter for the batch.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int DURABLE_BATCH_new(size_t sync_threads, DURABLE_BATCH **batch);
+
+/**
+ * Removes the temporary files that are not committed and frees the batch.
+ * \param batch	Batch.
+ */
+void DURABLE_BATCH_free(DURABLE_BATCH *batch);
+
+/**
+ * Gets the name of the temporary file that is written instead of \c path. The
+ * file must be opened with SMART_FILE mode 'i' and the actual name of the file
+ * must be added to the batch.
+ * \param path		Final path of the file.
+ * \param buf		Buffer for the temporary file name.
+ * \param buf_len	Size of the buffer.
+ * \return \c buf.
+ */
+char *DURABLE_getTempName(const char *path, char *buf, size_t buf_len);
+
+/**
+ * Adds a written temporary file to the batch.
+ * \param batch		Batch.
+ * \param temp_path	Temporary file that is written and closed.
+ * \param path		Final path of the file.
+ * \param isUnique	If set and \c path exists when committed, the file gets a new
+ *					name as with SMART_FILE mode 'i'. Otherwise an existing file
+ *					is replaced.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int DURABLE_BATCH_add(DURABLE_BATCH *batch, const char *temp_path, const char *path, int isUnique);
+
+/**
+ * Returns the count of files in the batch.
+ */
+size_t DURABLE_BATCH_getCount(DURABLE_BATCH *batch);
+
+/**
+ * Flushes the temporary files, renames them to their final names and flushes
+ * the directories. If some of the files fails, the files added before it are
+ * committed and the rest are left to be removed by #DURABLE_BATCH_reset or
+ * #DURABLE_BATCH_free.
+ * \param batch		Batch.
+ * \param failed	Output parameter for the index of the file that failed. Set to
+ *					the count of files if all the files are committed.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int DURABLE_BATCH_commit(DURABLE_BATCH *batch, size_t *failed);
+
+/**
+ * Returns the path of the file with the given index after the commit (that may
+ * differ from the path given to #DURABLE_BATCH_add if \c isUnique was set) or
+ * the final path given to #DURABLE_BATCH_add if it is not committed.
+ */
+const char *DURABLE_BATCH_getFname(DURABLE_BATCH *batch, size_t i);
+
+/**
+ * Removes the temporary files that are not committed and empties the batch.
+ * \param batch	Batch.
+ */
+void DURABLE_BATCH_reset(DURABLE_BATCH *batch);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* DURABLE_H */
@@ -127,6 +127,21 @@ void ERR_TRCKR_addWarning(ERR_TRCKR *err, const char *info, ...) {
 	return;
 }
 
+void ERR_TRCKR_append(ERR_TRCKR *err, ERR_TRCKR *from) {
+	unsigned i;
+
+	if (err == NULL || from == NULL) return;
+
+	for (i = 0; i < from->count && err->count < MAX_ERROR_COUNT; i++) {
+		err->err[err->count++] = from->err[i];
+	}
+
+	if (from->additionalInfo_len > 0) ERR_TRCKR_addAdditionalInfo(err, "%s", from->additionalInfo);
+	if (from->warnings_len > 0) ERR_TRCKR_addWarning(err, "%s", from->warnings);
+
+	return;
+}
+
 void ERR_TRCKR_reset(ERR_TRCKR *err) {
 	if (err == NULL) return;
 	err->count = 0;
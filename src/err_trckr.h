@@ -37,6 +37,12 @@ ERR_TRCKR *ERR_TRCKR_new(int (*printErrors)(const char*, ...), const char *(*err
 void ERR_TRCKR_free(ERR_TRCKR *obj);
 void ERR_TRCKR_add(ERR_TRCKR *err, int code, const char *fname, int lineN, const char *msg, ...);
 void ERR_TRCKR_reset(ERR_TRCKR *err);
+
+/**
+ * Appends errors, additional info and warnings from another error tracker. Can
+ * be used to collect errors from a tracker that was used by a worker thread.
+ */
+void ERR_TRCKR_append(ERR_TRCKR *err, ERR_TRCKR *from);
 void ERR_TRCKR_addAdditionalInfo(ERR_TRCKR *err, const char *info, ...);
 void ERR_TRCKR_addWarning(ERR_TRCKR *err, const char *info, ...);
 void ERR_TRCKR_printErrors(ERR_TRCKR *err);
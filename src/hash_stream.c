@@ -0,0 +1,318 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ksi/ksi.h>
+#include "hash_stream.h"
+#include "ksitool_err.h"
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <unistd.h>
+#endif
+
+#define HASH_STREAM_BUF_SIZE 0xffff
+
+struct HASH_STREAM_st {
+#ifdef _WIN32
+	HANDLE handle;
+	int isPipe;
+#else
+	int fd;
+#endif
+	int mustBeClosed;
+
+	/* Length of a binary record or 0 if the stream consists of text lines. */
+	size_t record_len;
+
+	/* Raw data read from the stream and the position of the next unprocessed byte. */
+	unsigned char buf[HASH_STREAM_BUF_SIZE + 1];
+	size_t buf_len;
+	size_t buf_pos;
+
+	size_t count;
+	int isEof;
+};
+
+#ifdef _WIN32
+static int hash_stream_wait(HASH_STREAM *stream, long timeout_ms, int *ready) {
+	DWORD start = GetTickCount();
+
+	/* Only pipes can be polled, reading from a file or console just blocks. */
+	if (!stream->isPipe || timeout_ms < 0) {
+		*ready = 1;
+		return KT_OK;
+	}
+
+	for (;;) {
+		DWORD available = 0;
+		DWORD elapsed = 0;
+
+		if (!PeekNamedPipe(stream->handle, NULL, 0, NULL, &available, NULL)) {
+			/* Writer has closed the pipe, let the read detect the end of the stream. */
+			if (GetLastError() == ERROR_BROKEN_PIPE) {
+				*ready = 1;
+				return KT_OK;
+			}
+			return KT_IO_ERROR;
+		}
+
+		if (available > 0) {
+			*ready = 1;
+			return KT_OK;
+		}
+
+		elapsed = GetTickCount() - start;
+		if (elapsed >= (DWORD)timeout_ms) {
+			*ready = 0;
+			return KT_OK;
+		}
+
+		Sleep((DWORD)timeout_ms - elapsed < 10 ? (DWORD)timeout_ms - elapsed : 10);
+	}
+}
+
+static int hash_stream_read(HASH_STREAM *stream, unsigned char *buf, size_t buf_len, size_t *count) {
+	DWORD read_count = 0;
+
+	if (!ReadFile(stream->handle, buf, (DWORD)buf_len, &read_count, NULL)) {
+		if (GetLastError() != ERROR_BROKEN_PIPE) return KT_IO_ERROR;
+		read_count = 0;
+	}
+
+	*count = (size_t)read_count;
+	return KT_OK;
+}
+#else
+static int hash_stream_wait(HASH_STREAM *stream, long timeout_ms, int *ready) {
+	struct pollfd pfd;
+	int ret = 0;
+
+	pfd.fd = stream->fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	ret = poll(&pfd, 1, timeout_ms < 0 ? -1 : (int)timeout_ms);
+	if (ret < 0) {
+		/* Interrupted by a signal, let the caller check its deadline. */
+		if (errno != EINTR) return KT_IO_ERROR;
+		ret = 0;
+	}
+
+	/* Hang up and errors are also reported by read. */
+	*ready = ret > 0;
+	return KT_OK;
+}
+
+static int hash_stream_read(HASH_STREAM *stream, unsigned char *buf, size_t buf_len, size_t *count) {
+	ssize_t ret = 0;
+
+	do {
+		ret = read(stream->fd, buf, buf_len);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) return KT_IO_ERROR;
+
+	*count = (size_t)ret;
+	return KT_OK;
+}
+#endif
+
+int HASH_STREAM_open(const char *fname, size_t record_len, HASH_STREAM **stream) {
+	int res;
+	HASH_STREAM *tmp = NULL;
+	int isStdin = 0;
+
+	if (fname == NULL || stream == NULL || record_len > HASH_STREAM_BUF_SIZE) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (HASH_STREAM*)KSI_calloc(1, sizeof(HASH_STREAM));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->mustBeClosed = 0;
+	tmp->record_len = record_len;
+	tmp->buf_len = 0;
+	tmp->buf_pos = 0;
+	tmp->count = 0;
+	tmp->isEof = 0;
+
+	isStdin = strcmp(fname, "-") == 0;
+
+#ifdef _WIN32
+	tmp->handle = isStdin
+			? GetStdHandle(STD_INPUT_HANDLE)
+			: CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (tmp->handle == INVALID_HANDLE_VALUE || tmp->handle == NULL) {
+		tmp->handle = NULL;
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+	tmp->isPipe = GetFileType(tmp->handle) == FILE_TYPE_PIPE;
+#else
+	tmp->fd = isStdin ? STDIN_FILENO : open(fname, O_RDONLY);
+	if (tmp->fd < 0) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+#endif
+	tmp->mustBeClosed = !isStdin;
+
+	*stream = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	HASH_STREAM_close(tmp);
+
+	return res;
+}
+
+void HASH_STREAM_close(HASH_STREAM *stream) {
+	if (stream == NULL) return;
+
+	if (stream->mustBeClosed) {
+#ifdef _WIN32
+		CloseHandle(stream->handle);
+#else
+		close(stream->fd);
+#endif
+	}
+
+	KSI_free(stream);
+}
+
+/**
+ * Takes the next complete entry from the buffer. Returns 0 if more data must be
+ * read first.
+ */
+static int hash_stream_take(HASH_STREAM *stream, const unsigned char **entry, size_t *len) {
+	if (stream->record_len > 0) {
+		if (stream->buf_len - stream->buf_pos < stream->record_len) return 0;
+
+		*entry = stream->buf + stream->buf_pos;
+		*len = stream->record_len;
+		stream->buf_pos += stream->record_len;
+		return 1;
+	}
+
+	while (stream->buf_pos < stream->buf_len) {
+		unsigned char *line = stream->buf + stream->buf_pos;
+		unsigned char *nl = (unsigned char*)memchr(line, '\n', stream->buf_len - stream->buf_pos);
+		size_t line_len = 0;
+
+		if (nl == NULL) {
+			/* The last line may not be terminated. */
+			if (!stream->isEof) return 0;
+			nl = stream->buf + stream->buf_len;
+		}
+
+		line_len = (size_t)(nl - line);
+		stream->buf_pos += line_len + (nl < stream->buf + stream->buf_len ? 1 : 0);
+
+		/* Remove the carriage return of Windows line endings and skip empty lines. */
+		if (line_len > 0 && line[line_len - 1] == '\r') line_len--;
+		if (line_len == 0) continue;
+
+		line[line_len] = '\0';
+		*entry = line;
+		*len = line_len;
+		return 1;
+	}
+
+	return 0;
+}
+
+int HASH_STREAM_next(HASH_STREAM *stream, long timeout_ms, const unsigned char **entry, size_t *len) {
+	int res;
+	int ready = 0;
+	size_t count = 0;
+
+	if (stream == NULL || entry == NULL || len == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	*entry = NULL;
+	*len = 0;
+
+	if (hash_stream_take(stream, entry, len)) {
+		stream->count++;
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	if (stream->isEof) {
+		/* Partial binary record can not be interpreted. */
+		res = (stream->buf_pos < stream->buf_len) ? KT_INVALID_INPUT_FORMAT : KT_OK;
+		goto cleanup;
+	}
+
+	/* Move the incomplete entry to the beginning of the buffer. */
+	if (stream->buf_pos > 0) {
+		memmove(stream->buf, stream->buf + stream->buf_pos, stream->buf_len - stream->buf_pos);
+		stream->buf_len -= stream->buf_pos;
+		stream->buf_pos = 0;
+	}
+
+	if (stream->record_len == 0 && stream->buf_len >= HASH_STREAM_LINE_MAX - 1) {
+		res = KT_INDEX_OVF;
+		goto cleanup;
+	}
+
+	res = hash_stream_wait(stream, timeout_ms, &ready);
+	if (res != KT_OK || !ready) goto cleanup;
+
+	res = hash_stream_read(stream, stream->buf + stream->buf_len, HASH_STREAM_BUF_SIZE - stream->buf_len, &count);
+	if (res != KT_OK) goto cleanup;
+
+	if (count == 0) stream->isEof = 1;
+	stream->buf_len += count;
+
+	if (hash_stream_take(stream, entry, len)) {
+		stream->count++;
+	} else if (stream->isEof && stream->buf_pos < stream->buf_len) {
+		res = KT_INVALID_INPUT_FORMAT;
+		goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+int HASH_STREAM_isEof(HASH_STREAM *stream) {
+	return stream == NULL || (stream->isEof && stream->buf_pos == stream->buf_len);
+}
+
+size_t HASH_STREAM_getCount(HASH_STREAM *stream) {
+	return stream == NULL ? 0 : stream->count;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef HASH_STREAM_H
+#define	HASH_STREAM_H
+
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum length of a single line in the hash stream, including the terminating
+ * NUL character.
+ */
+#define HASH_STREAM_LINE_MAX 1024
+
+typedef struct HASH_STREAM_st HASH_STREAM;
+
+/**
+ * Opens a stream of hash values for reading. In contrast to #SMART_FILE the
+ * stream is read without buffering by the C library, so it is possible to wait
+ * for the next entry with a timeout (see #HASH_STREAM_next).
+ * \param fname			Path to the stream or \c - to read from stdin.
+ * \param record_len	If 0, the stream consists of text lines (hash imprints), empty
+ *						lines are ignored. Otherwise the stream consists of raw binary
+ *						records with the given length (digests without the algorithm).
+ * \param stream		Output parameter for the stream.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int HASH_STREAM_open(const char *fname, size_t record_len, HASH_STREAM **stream);
+
+void HASH_STREAM_close(HASH_STREAM *stream);
+
+/**
+ * Reads the next entry from the stream. If there is no complete entry buffered,
+ * waits until more data is available, but at most \c timeout_ms milliseconds.
+ * Note that the function may also return before the timeout if the data read
+ * did not complete an entry, so the caller must check its own deadline and call
+ * the function again.
+ * \param stream		Hash stream.
+ * \param timeout_ms	Maximum time to wait for data. A negative value waits until
+ *						data is available or the stream is closed.
+ * \param entry			Output parameter for the entry. Set to NULL if no entry is
+ *						available yet or the end of the stream is reached (see
+ *						#HASH_STREAM_isEof). A text entry is NUL terminated. The entry is
+ *						valid until the next call.
+ * \param len			Output parameter for the length of the entry.
+ * \return KT_OK if successful, KT_INDEX_OVF if a line is longer than
+ * #HASH_STREAM_LINE_MAX, KT_INVALID_INPUT_FORMAT if the stream ends with an
+ * incomplete binary record, error code otherwise.
+ */
+int HASH_STREAM_next(HASH_STREAM *stream, long timeout_ms, const unsigned char **entry, size_t *len);
+
+/**
+ * Returns non-zero value if the end of the stream is reached and all the entries
+ * are read.
+ */
+int HASH_STREAM_isEof(HASH_STREAM *stream);
+
+/**
+ * Returns the count of entries read from the stream so far.
+ */
+size_t HASH_STREAM_getCount(HASH_STREAM *stream);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* HASH_STREAM_H */
@@ -0,0 +1,388 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "input_index.h"
+#include "ksitool_err.h"
+
+#define INPUT_INDEX_FLAGS_MAX 256
+
+typedef struct INPUT_INDEX_VALUES_st {
+	/* Parameter names of the flags, pointing to the buffer. */
+	char buf[INPUT_INDEX_FLAGS_MAX];
+	const char *name[INPUT_INDEX_PARAM_MAX];
+	size_t name_count;
+
+	/* Resolved values and the index of the parameter name of every value. */
+	const char **value;
+	unsigned char *param;
+	size_t count;
+	size_t count_max;
+
+	/* Copies of the values owned by the index (see #INPUT_INDEX_copyRange). */
+	char *copy;
+	size_t copy_max;
+} INPUT_INDEX_VALUES;
+
+struct INPUT_INDEX_st {
+	INPUT_INDEX_VALUES in;
+	INPUT_INDEX_VALUES out;
+	INPUT_INDEX_EXTRACTOR extractors[INPUT_INDEX_PARAM_MAX];
+};
+
+static int input_index_parseFlags(const char *flags, INPUT_INDEX_VALUES *values) {
+	char *p = NULL;
+
+	values->name_count = 0;
+	if (flags == NULL) return KT_OK;
+	if (strlen(flags) >= sizeof(values->buf)) return KT_INVALID_ARGUMENT;
+
+	strcpy(values->buf, flags);
+
+	for (p = values->buf; *p != '\0'; ) {
+		char *comma = strchr(p, ',');
+
+		if (values->name_count == INPUT_INDEX_PARAM_MAX) return KT_INVALID_ARGUMENT;
+		values->name[values->name_count++] = p;
+
+		if (comma == NULL) break;
+		*comma = '\0';
+		p = comma + 1;
+	}
+
+	return KT_OK;
+}
+
+static int input_index_reserve(INPUT_INDEX_VALUES *values, size_t count) {
+	const char **tmp_value = NULL;
+	unsigned char *tmp_param = NULL;
+
+	if (count <= values->count_max) return KT_OK;
+
+	tmp_value = (const char**)realloc((void*)values->value, count * sizeof(const char*));
+	if (tmp_value == NULL) return KT_OUT_OF_MEMORY;
+	values->value = tmp_value;
+
+	tmp_param = (unsigned char*)realloc(values->param, count);
+	if (tmp_param == NULL) return KT_OUT_OF_MEMORY;
+	values->param = tmp_param;
+
+	values->count_max = count;
+
+	return KT_OK;
+}
+
+static int input_index_copyValues(INPUT_INDEX_VALUES *dst, const INPUT_INDEX_VALUES *src, size_t first, size_t count) {
+	int res;
+	size_t k = 0;
+	size_t n = 0;
+	size_t len = 0;
+	char *p = NULL;
+
+	memcpy(dst->buf, src->buf, sizeof(dst->buf));
+	for (k = 0; k < src->name_count; k++) {
+		dst->name[k] = dst->buf + (src->name[k] - src->buf);
+	}
+	dst->name_count = src->name_count;
+
+	for (n = 0; n < count; n++) {
+		len += strlen(src->value[first + n]) + 1;
+	}
+
+	res = input_index_reserve(dst, count);
+	if (res != KT_OK) return res;
+
+	if (len > dst->copy_max) {
+		char *tmp = (char*)realloc(dst->copy, len);
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+		dst->copy = tmp;
+		dst->copy_max = len;
+	}
+
+	p = dst->copy;
+	for (n = 0; n < count; n++) {
+		size_t value_len = strlen(src->value[first + n]) + 1;
+
+		memcpy(p, src->value[first + n], value_len);
+		dst->value[n] = p;
+		dst->param[n] = src->param[first + n];
+		p += value_len;
+	}
+	dst->count = count;
+
+	return KT_OK;
+}
+
+static int input_index_resolve(PARAM_SET *set, INPUT_INDEX_VALUES *values) {
+	int res;
+	size_t k = 0;
+	size_t total = 0;
+	int counts[INPUT_INDEX_PARAM_MAX];
+
+	values->count = 0;
+
+	for (k = 0; k < values->name_count; k++) {
+		res = PARAM_SET_getValueCount(set, values->name[k], NULL, PST_PRIORITY_NONE, &counts[k]);
+		if (res != PST_OK) return res;
+		total += (size_t)counts[k];
+	}
+
+	res = input_index_reserve(values, total);
+	if (res != KT_OK) return res;
+
+	/**
+	 * The values of every parameter are read in order, from the first to the
+	 * last. Libparamset (1.1 and later, see configure.ac) keeps an iterator at the
+	 * value fetched last from a parameter, and a lookup of the next index
+	 * continues from it instead of walking the value list from the beginning.
+	 * The walk over all the values is therefore linear. Any other order (e.g.
+	 * interleaving the parameters or going backwards) would restart the walk for
+	 * every value. See test/benchmark-inputs.sh for the measurement.
+	 */
+	for (k = 0; k < values->name_count; k++) {
+		int n = 0;
+
+		for (n = 0; n < counts[k]; n++) {
+			char *value = NULL;
+
+			res = PARAM_SET_getStr(set, values->name[k], NULL, PST_PRIORITY_NONE, n, &value);
+			if (res != PST_OK) return res;
+
+			values->value[values->count] = value;
+			values->param[values->count] = (unsigned char)k;
+			values->count++;
+		}
+	}
+
+	return KT_OK;
+}
+
+int INPUT_INDEX_new(const char *in_flags, const INPUT_INDEX_EXTRACTOR *extractors, const char *out_flags, INPUT_INDEX **index) {
+	int res;
+	size_t k = 0;
+	INPUT_INDEX *tmp = NULL;
+
+	if (in_flags == NULL || index == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (INPUT_INDEX*)calloc(1, sizeof(INPUT_INDEX));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = input_index_parseFlags(in_flags, &tmp->in);
+	if (res != KT_OK) goto cleanup;
+
+	res = input_index_parseFlags(out_flags, &tmp->out);
+	if (res != KT_OK) goto cleanup;
+
+	for (k = 0; extractors != NULL && k < tmp->in.name_count; k++) {
+		tmp->extractors[k] = extractors[k];
+	}
+
+	*index = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	INPUT_INDEX_free(tmp);
+
+	return res;
+}
+
+void INPUT_INDEX_free(INPUT_INDEX *index) {
+	if (index == NULL) return;
+
+	free((void*)index->in.value);
+	free(index->in.param);
+	free(index->in.copy);
+	free((void*)index->out.value);
+	free(index->out.param);
+	free(index->out.copy);
+	free(index);
+}
+
+int INPUT_INDEX_update(INPUT_INDEX *index, PARAM_SET *set) {
+	int res;
+
+	if (index == NULL || set == NULL) return KT_INVALID_ARGUMENT;
+
+	res = input_index_resolve(set, &index->in);
+	if (res != KT_OK) return res;
+
+	return input_index_resolve(set, &index->out);
+}
+
+int INPUT_INDEX_updateInOrder(INPUT_INDEX *index, PARAM_SET *set, const unsigned char *order, size_t order_len) {
+	int res;
+	size_t start[INPUT_INDEX_PARAM_MAX];
+	size_t next[INPUT_INDEX_PARAM_MAX];
+	const char **value = NULL;
+	size_t total = 0;
+	size_t k = 0;
+	size_t n = 0;
+
+	if (index == NULL || set == NULL) return KT_INVALID_ARGUMENT;
+
+	res = INPUT_INDEX_update(index, set);
+	if (res != KT_OK) return res;
+
+	if (index->in.count == 0) return KT_OK;
+	if (order == NULL || order_len < index->in.count) return KT_INVALID_ARGUMENT;
+
+	/* The resolved values are grouped by the parameter, find where every group starts. */
+	memset(next, 0, sizeof(next));
+	for (n = 0; n < index->in.count; n++) {
+		if (order[n] >= index->in.name_count) return KT_INVALID_ARGUMENT;
+		next[order[n]]++;
+	}
+
+	for (k = 0; k < index->in.name_count; k++) {
+		start[k] = total;
+		total += next[k];
+		next[k] = 0;
+	}
+
+	for (n = 0; n < index->in.count; n++) {
+		k = index->in.param[n];
+		if (n < start[k] || (k + 1 < index->in.name_count && n >= start[k + 1])) return KT_INVALID_ARGUMENT;
+	}
+
+	value = (const char**)malloc(index->in.count * sizeof(const char*));
+	if (value == NULL) return KT_OUT_OF_MEMORY;
+
+	for (n = 0; n < index->in.count; n++) {
+		k = order[n];
+		value[n] = index->in.value[start[k] + next[k]++];
+	}
+
+	memcpy((void*)index->in.value, value, index->in.count * sizeof(const char*));
+	memcpy(index->in.param, order, index->in.count);
+	free((void*)value);
+
+	return KT_OK;
+}
+
+int INPUT_INDEX_copyRange(const INPUT_INDEX *src, size_t first, size_t count, INPUT_INDEX **dst) {
+	int res;
+	INPUT_INDEX *tmp = NULL;
+
+	if (src == NULL || first + count > src->in.count || dst == NULL) return KT_INVALID_ARGUMENT;
+
+	if (*dst == NULL) {
+		tmp = (INPUT_INDEX*)calloc(1, sizeof(INPUT_INDEX));
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+	} else {
+		tmp = *dst;
+	}
+
+	memcpy(tmp->extractors, src->extractors, sizeof(tmp->extractors));
+
+	res = input_index_copyValues(&tmp->in, &src->in, first, count);
+	if (res != KT_OK) goto cleanup;
+
+	res = input_index_copyValues(&tmp->out, &src->out, 0, src->out.count);
+	if (res != KT_OK) goto cleanup;
+
+	*dst = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	/* A reused index is left to the caller. */
+	if (tmp != *dst) INPUT_INDEX_free(tmp);
+
+	return res;
+}
+
+int INPUT_INDEX_removeInputs(INPUT_INDEX *index, const unsigned char *isRemoved) {
+	size_t n = 0;
+	size_t kept = 0;
+
+	if (index == NULL || isRemoved == NULL) return KT_INVALID_ARGUMENT;
+
+	/* An output given for every input is removed together with its input. */
+	if (index->out.count == index->in.count) {
+		for (n = 0; n < index->out.count; n++) {
+			if (isRemoved[n]) continue;
+
+			index->out.value[kept] = index->out.value[n];
+			index->out.param[kept] = index->out.param[n];
+			kept++;
+		}
+		index->out.count = kept;
+		kept = 0;
+	}
+
+	for (n = 0; n < index->in.count; n++) {
+		if (isRemoved[n]) continue;
+
+		index->in.value[kept] = index->in.value[n];
+		index->in.param[kept] = index->in.param[n];
+		kept++;
+	}
+	index->in.count = kept;
+
+	return KT_OK;
+}
+
+size_t INPUT_INDEX_getCount(const INPUT_INDEX *index) {
+	return (index == NULL) ? 0 : index->in.count;
+}
+
+const char *INPUT_INDEX_getName(const INPUT_INDEX *index, size_t i) {
+	if (index == NULL || i >= index->in.count) return NULL;
+	return index->in.value[i];
+}
+
+size_t INPUT_INDEX_getParam(const INPUT_INDEX *index, size_t i) {
+	if (index == NULL || i >= index->in.count) return 0;
+	return index->in.param[i];
+}
+
+size_t INPUT_INDEX_getOutCount(const INPUT_INDEX *index) {
+	return (index == NULL) ? 0 : index->out.count;
+}
+
+const char *INPUT_INDEX_getOutName(const INPUT_INDEX *index, size_t i) {
+	if (index == NULL || i >= index->out.count) return NULL;
+	return index->out.value[i];
+}
+
+int INPUT_INDEX_getObj(const INPUT_INDEX *index, PARAM_SET *set, size_t i, void *extra, void **obj) {
+	INPUT_INDEX_EXTRACTOR extractor = NULL;
+	void *extras[2];
+
+	if (index == NULL || i >= index->in.count || obj == NULL) return KT_INVALID_ARGUMENT;
+
+	extractor = index->extractors[index->in.param[i]];
+	if (extractor == NULL) return KT_INVALID_ARGUMENT;
+
+	/* The extractor gets the parameter set and the extra parameter as PARAM_SET_getObjExtended gives them. */
+	extras[0] = (void*)set;
+	extras[1] = extra;
+
+	return extractor(extras, index->in.value[i], obj);
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef INPUT_INDEX_H
+#define	INPUT_INDEX_H
+
+#include <stddef.h>
+#include "param_set/param_set.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum count of parameter names in the input or output flags of the index.
+ */
+#define INPUT_INDEX_PARAM_MAX 8
+
+/**
+ * Object extractor of a parameter, the same function that is given to
+ * PARAM_SET_addControl.
+ */
+typedef int (*INPUT_INDEX_EXTRACTOR)(void **extra, const char *str, void **obj);
+
+/**
+ * Input and output values of a tool resolved from the parameter set into arrays.
+ * The parameter set returns values by index and every indexed lookup walks the
+ * value list of the parameter, so a loop over the inputs that looks the values
+ * up by index is quadratic. The index is filled once and the values are read
+ * from the arrays afterwards.
+ */
+typedef struct INPUT_INDEX_st INPUT_INDEX;
+
+/**
+ * Creates an empty index. Use #INPUT_INDEX_update to resolve the values.
+ * \param in_flags		Input flags e.g. (i,input).
+ * \param extractors	Object extractors of the input flags in the same order or NULL
+ *						if #INPUT_INDEX_getObj is not used.
+ * \param out_flags		Output flags e.g. (o). Can be NULL.
+ * \param index			Output parameter for the index.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int INPUT_INDEX_new(const char *in_flags, const INPUT_INDEX_EXTRACTOR *extractors, const char *out_flags, INPUT_INDEX **index);
+
+void INPUT_INDEX_free(INPUT_INDEX *index);
+
+/**
+ * Resolves the values of the input and output flags in the order the values are
+ * returned by the parameter set. The arrays are reused, so the index can be
+ * updated after the inputs in the set have changed. The names point to the
+ * values in the set and are valid until the values are changed.
+ * \param index		Input index.
+ * \param set		Parameter set.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int INPUT_INDEX_update(INPUT_INDEX *index, PARAM_SET *set);
+
+/**
+ * Resolves the values as #INPUT_INDEX_update does, but puts the inputs in the
+ * given order of the parameters instead of grouping them by the parameter. The
+ * values of every parameter keep their order. As the parameter set does not
+ * record the order the values of different parameters were added in, the
+ * caller that adds them must record it (e.g. the inputs read from a list).
+ * \param index		Input index.
+ * \param set		Parameter set.
+ * \param order		The position of the parameter in the input flags for every
+ *					input, e.g. {1, 0, 1} for input, i, input if the flags are
+ *					i,input.
+ * \param order_len	Count of elements in \c order, at least the count of inputs.
+ * \return KT_OK if successful, KT_INVALID_ARGUMENT if \c order does not match
+ * the values in the set, error code otherwise.
+ */
+int INPUT_INDEX_updateInOrder(INPUT_INDEX *index, PARAM_SET *set, const unsigned char *order, size_t order_len);
+
+/**
+ * Copies the inputs \c first ... \c first + \c count - 1 and all the outputs of
+ * \c src into \c dst. The names are copied, so \c dst stays valid after the
+ * values in the parameter set are changed. If \c dst points to an index created
+ * by an earlier copy, its buffers are reused.
+ * \param src		Source index.
+ * \param first		Index of the first input to be copied.
+ * \param count		Count of inputs to be copied.
+ * \param dst		Pointer to the receiving index, or to NULL to create a new one.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int INPUT_INDEX_copyRange(const INPUT_INDEX *src, size_t first, size_t count, INPUT_INDEX **dst);
+
+/**
+ * Removes the inputs marked in \c isRemoved from the index. The order of the
+ * remaining inputs is kept. If there is an output for every input, the outputs
+ * of the removed inputs are removed as well. The values in the
+ * parameter set are not changed, so the removed inputs are back after the next
+ * #INPUT_INDEX_update.
+ * \param index		Input index.
+ * \param isRemoved	An array of #INPUT_INDEX_getCount elements, a non-zero
+ *					element marks the input to be removed.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int INPUT_INDEX_removeInputs(INPUT_INDEX *index, const unsigned char *isRemoved);
+
+/**
+ * Returns the count of inputs.
+ */
+size_t INPUT_INDEX_getCount(const INPUT_INDEX *index);
+
+/**
+ * Returns the name of the i-th input or NULL if out of range.
+ */
+const char *INPUT_INDEX_getName(const INPUT_INDEX *index, size_t i);
+
+/**
+ * Returns the position of the parameter of the i-th input in the input flags
+ * (e.g. 0 for i and 1 for input if the flags are i,input).
+ */
+size_t INPUT_INDEX_getParam(const INPUT_INDEX *index, size_t i);
+
+/**
+ * Returns the count of outputs.
+ */
+size_t INPUT_INDEX_getOutCount(const INPUT_INDEX *index);
+
+/**
+ * Returns the name of the i-th output or NULL if out of range.
+ */
+const char *INPUT_INDEX_getOutName(const INPUT_INDEX *index, size_t i);
+
+/**
+ * Extracts the object of the i-th input with the extractor of its parameter, as
+ * PARAM_SET_getObjExtended does, but without looking the value up from the set.
+ * \param index		Input index.
+ * \param set		Parameter set, given to the extractor.
+ * \param i			Index of the input.
+ * \param extra		Extra parameter given to the extractor.
+ * \param obj		Output parameter for the object.
+ * \return Return value of the extractor, KT_INVALID_ARGUMENT if the input
+ * does not exist or has no extractor.
+ */
+int INPUT_INDEX_getObj(const INPUT_INDEX *index, PARAM_SET *set, size_t i, void *extra, void **obj);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* INPUT_INDEX_H */
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ksi/ksi.h>
+#include "input_list.h"
+#include "smart_file.h"
+#include "ksitool_err.h"
+
+#define INPUT_LIST_BUF_SIZE 0xffff
+
+struct INPUT_LIST_st {
+	SMART_FILE *file;
+
+	/* If not NULL, the entries are taken from the directory walker instead of the file. */
+	DIR_WALKER *walker;
+
+	/* Raw data read from the file and the position of the next unprocessed byte. */
+	char buf[INPUT_LIST_BUF_SIZE];
+	size_t buf_len;
+	size_t buf_pos;
+
+	/* The entry returned by INPUT_LIST_next. */
+	char entry[INPUT_LIST_ENTRY_MAX];
+
+	size_t count;
+	int isEof;
+
+	/* Set when the separator of the entries is known and if it is the NUL character only. */
+	int isSeparatorKnown;
+	int isNulSeparated;
+};
+
+int INPUT_LIST_open(const char *fname, INPUT_LIST **list) {
+	int res;
+	INPUT_LIST *tmp = NULL;
+
+	if (fname == NULL || list == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (INPUT_LIST*)KSI_calloc(1, sizeof(INPUT_LIST));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->file = NULL;
+	tmp->walker = NULL;
+	tmp->buf_len = 0;
+	tmp->buf_pos = 0;
+	tmp->count = 0;
+	tmp->isEof = 0;
+	tmp->isSeparatorKnown = 0;
+	tmp->isNulSeparated = 0;
+
+	res = SMART_FILE_open(fname, "rbs", &tmp->file);
+	if (res != SMART_FILE_OK) goto cleanup;
+
+	*list = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	INPUT_LIST_close(tmp);
+
+	return res;
+}
+
+int INPUT_LIST_fromWalker(DIR_WALKER *walker, INPUT_LIST **list) {
+	INPUT_LIST *tmp = NULL;
+
+	if (walker == NULL || list == NULL) return KT_INVALID_ARGUMENT;
+
+	tmp = (INPUT_LIST*)KSI_calloc(1, sizeof(INPUT_LIST));
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	tmp->file = NULL;
+	tmp->walker = walker;
+	tmp->buf_len = 0;
+	tmp->buf_pos = 0;
+	tmp->count = 0;
+	tmp->isEof = 0;
+	tmp->isSeparatorKnown = 0;
+	tmp->isNulSeparated = 0;
+
+	*list = tmp;
+
+	return KT_OK;
+}
+
+void INPUT_LIST_close(INPUT_LIST *list) {
+	if (list == NULL) return;
+
+	SMART_FILE_close(list->file);
+	DIR_WALKER_free(list->walker);
+	KSI_free(list);
+}
+
+/**
+ * A list that contains a NUL character is separated by NUL characters only, so
+ * that the names are kept byte for byte (including newlines and carriage
+ * returns). As an entry can not be longer than INPUT_LIST_ENTRY_MAX, the first
+ * NUL of such a list is within as many bytes from its beginning, so the
+ * separator is known after the buffer is filled with them.
+ */
+static int input_list_detectSeparator(INPUT_LIST *list) {
+	int res;
+
+	while (!list->isEof && list->buf_len < INPUT_LIST_ENTRY_MAX) {
+		size_t count = 0;
+
+		res = SMART_FILE_read(list->file, list->buf + list->buf_len, sizeof(list->buf) - list->buf_len, &count);
+		if (res != SMART_FILE_OK) return res;
+
+		if (count == 0) list->isEof = 1;
+		list->buf_len += count;
+	}
+
+	list->isNulSeparated = memchr(list->buf, '\0', list->buf_len) != NULL;
+	list->isSeparatorKnown = 1;
+
+	return KT_OK;
+}
+
+int INPUT_LIST_next(INPUT_LIST *list, const char **entry) {
+	int res;
+	size_t len = 0;
+
+	if (list == NULL || entry == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (list->walker != NULL) {
+		res = DIR_WALKER_next(list->walker, entry);
+		if (res == KT_OK && *entry != NULL) list->count++;
+		goto cleanup;
+	}
+
+	if (!list->isSeparatorKnown) {
+		res = input_list_detectSeparator(list);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	for (;;) {
+		char c;
+
+		/* Refill the buffer. */
+		if (list->buf_pos == list->buf_len) {
+			if (list->isEof) break;
+
+			res = SMART_FILE_read(list->file, list->buf, sizeof(list->buf), &list->buf_len);
+			if (res != SMART_FILE_OK) goto cleanup;
+
+			list->buf_pos = 0;
+			if (list->buf_len == 0) {
+				list->isEof = 1;
+				break;
+			}
+		}
+
+		c = list->buf[list->buf_pos++];
+
+		if (c == '\0' || (c == '\n' && !list->isNulSeparated)) {
+			/* Remove the carriage return of Windows line endings and skip empty entries. */
+			if (!list->isNulSeparated && len > 0 && list->entry[len - 1] == '\r') len--;
+			if (len == 0) continue;
+			break;
+		}
+
+		if (len + 1 >= sizeof(list->entry)) {
+			res = KT_INDEX_OVF;
+			goto cleanup;
+		}
+
+		list->entry[len++] = c;
+	}
+
+	/* The last entry may not be terminated. */
+	if (!list->isNulSeparated && len > 0 && list->entry[len - 1] == '\r') len--;
+	list->entry[len] = '\0';
+
+	if (len == 0) {
+		*entry = NULL;
+	} else {
+		list->count++;
+		*entry = list->entry;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+size_t INPUT_LIST_getCount(INPUT_LIST *list) {
+	return list == NULL ? 0 : list->count;
+}
+
+const char *INPUT_LIST_getErrorPath(INPUT_LIST *list) {
+	return (list == NULL || list->walker == NULL) ? "" : DIR_WALKER_getErrorPath(list->walker);
+}
+
+const char *INPUT_LIST_nextSkipped(INPUT_LIST *list) {
+	return (list == NULL || list->walker == NULL) ? NULL : DIR_WALKER_nextSkipped(list->walker);
+}
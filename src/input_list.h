@@ -0,0 +1,94 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef INPUT_LIST_H
+#define	INPUT_LIST_H
+
+#include <stddef.h>
+#include "dir_walker.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum length of a single entry in the input list, including the terminating
+ * NUL character.
+ */
+#define INPUT_LIST_ENTRY_MAX 4096
+
+typedef struct INPUT_LIST_st INPUT_LIST;
+
+/**
+ * Opens a list of inputs (file paths or hash imprints) for reading. Entries are
+ * separated by newline characters (a carriage return before the newline is
+ * removed) or, if the list contains a NUL character within the first
+ * #INPUT_LIST_ENTRY_MAX bytes, by NUL characters only. So both plain text files
+ * and the output of \c find \c -print0 can be used, and the names in the latter
+ * are kept byte for byte. Empty entries are ignored.
+ * \param fname		Path to the list or \c - to read the list from stdin.
+ * \param list		Output parameter for the input list.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int INPUT_LIST_open(const char *fname, INPUT_LIST **list);
+
+/**
+ * Creates a list of inputs from the regular files found by a directory walker.
+ * The walker must be started and is owned by the list afterwards.
+ * \param walker		Directory walker.
+ * \param list		Output parameter for the input list.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int INPUT_LIST_fromWalker(DIR_WALKER *walker, INPUT_LIST **list);
+
+void INPUT_LIST_close(INPUT_LIST *list);
+
+/**
+ * Reads the next entry from the list. The list is read incrementally, so only
+ * a small buffer is held in memory regardless of the size of the list.
+ * \param list		Input list.
+ * \param entry		Output parameter for the entry. Set to NULL if there are no more
+ *					entries. The entry is valid until the next call.
+ * \return KT_OK if successful, KT_INDEX_OVF if the entry is longer than
+ * #INPUT_LIST_ENTRY_MAX, error code otherwise.
+ */
+int INPUT_LIST_next(INPUT_LIST *list, const char **entry);
+
+/**
+ * Returns the count of entries read from the list so far.
+ */
+size_t INPUT_LIST_getCount(INPUT_LIST *list);
+
+/**
+ * Returns the path of the directory that could not be read by the directory
+ * walker (see #INPUT_LIST_fromWalker) or an empty string.
+ */
+const char *INPUT_LIST_getErrorPath(INPUT_LIST *list);
+
+/**
+ * Returns the next directory skipped by the directory walker (see
+ * #DIR_WALKER_nextSkipped) or NULL.
+ */
+const char *INPUT_LIST_nextSkipped(INPUT_LIST *list);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* INPUT_LIST_H */
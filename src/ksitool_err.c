@@ -35,6 +35,7 @@ static int ksitool_ErrToExitcode(int error_code) {
 		case KT_INVALID_ARGUMENT:
 		case KT_COMPONENT_HAS_NO_IMPLEMENTATION:
 		case KT_INDEX_OVF:
+		case KT_THREAD_ERROR:
 		case KT_UNKNOWN_ERROR:
 			return EXIT_FAILURE;
 		case KT_UNABLE_TO_SET_STREAM_MODE:
@@ -137,6 +138,8 @@ static const char* ksitoolErrToString(int error_code) {
 			return "Local aggregation tree size exceeds service configuration limit.";
 		case KT_EXT_CAL_TIME_OUT_OF_LIMIT:
 			return "Extend to time is out of extender calendar time limit.";
+		case KT_THREAD_ERROR:
+			return "Unable to create or manage a worker thread.";
 
 		case KT_UNKNOWN_ERROR:
 		default:
@@ -74,6 +74,7 @@ enum Ksitool_errors {
 	KT_AGGR_LVL_EXCEED_LIMIT,
 	KT_EXT_CAL_TIME_OUT_OF_LIMIT,
 	KT_VERIFICATION_INCONCLUSIVE,
+	KT_THREAD_ERROR,
 	KT_UNKNOWN_ERROR,
 };
 
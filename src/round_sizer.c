@@ -0,0 +1,88 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <string.h>
+#include "round_sizer.h"
+
+/* Weight of the last round in the smoothed estimates. */
+#define ROUND_SIZER_WEIGHT 0.5
+
+/* A round may grow at most this many times compared to the previous one. */
+#define ROUND_SIZER_MAX_GROWTH 4
+
+void ROUND_SIZER_init(ROUND_SIZER *sizer, size_t max_size, KSI_uint64_t target_ms) {
+	if (sizer == NULL) return;
+
+	memset(sizer, 0, sizeof(ROUND_SIZER));
+	sizer->max_size = max_size > 0 ? max_size : 1;
+	sizer->target_us = target_ms * 1000;
+}
+
+size_t ROUND_SIZER_next(const ROUND_SIZER *sizer, size_t remaining, size_t rounds_left) {
+	size_t size = 0;
+	size_t min_size = 1;
+
+	if (sizer == NULL || remaining == 0) return 0;
+
+	if (!sizer->isMeasured) {
+		size = ROUND_SIZER_FIRST_ROUND;
+	} else if (sizer->sign_us >= (double)sizer->target_us) {
+		/* Smaller rounds would only add round trips. */
+		size = sizer->max_size;
+	} else {
+		double budget = (double)sizer->target_us - sizer->sign_us;
+		double estimate = sizer->input_us > 0 ? budget / sizer->input_us : (double)sizer->max_size;
+
+		size = estimate >= (double)sizer->max_size ? sizer->max_size : (size_t)estimate;
+
+		/* A single fast round must not make the next one take much longer than the target. */
+		if (sizer->last_size > 0 && size / ROUND_SIZER_MAX_GROWTH > sizer->last_size) {
+			size = sizer->last_size * ROUND_SIZER_MAX_GROWTH;
+		}
+	}
+
+	/* The remaining inputs must fit into the remaining rounds. */
+	if (rounds_left > 0) min_size = (remaining + rounds_left - 1) / rounds_left;
+
+	if (size < min_size) size = min_size;
+	if (size < 1) size = 1;
+	if (size > sizer->max_size) size = sizer->max_size;
+	if (size > remaining) size = remaining;
+
+	return size;
+}
+
+void ROUND_SIZER_update(ROUND_SIZER *sizer, size_t size, KSI_uint64_t prepare_us, KSI_uint64_t sign_us) {
+	double input_us = 0;
+
+	if (sizer == NULL || size == 0) return;
+
+	input_us = (double)prepare_us / (double)size;
+
+	if (!sizer->isMeasured) {
+		sizer->sign_us = (double)sign_us;
+		sizer->input_us = input_us;
+		sizer->isMeasured = 1;
+	} else {
+		sizer->sign_us = ROUND_SIZER_WEIGHT * (double)sign_us + (1 - ROUND_SIZER_WEIGHT) * sizer->sign_us;
+		sizer->input_us = ROUND_SIZER_WEIGHT * input_us + (1 - ROUND_SIZER_WEIGHT) * sizer->input_us;
+	}
+
+	sizer->last_size = size;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef ROUND_SIZER_H
+#define	ROUND_SIZER_H
+
+#include <stddef.h>
+#include <ksi/ksi.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Chooses the count of inputs of the next local aggregation round, so that a
+ * round (hashing the inputs, signing the tree and saving the signatures) takes
+ * about the target time. The estimate is based on the measured latency of
+ * signing a round and the time spent per input in the previous rounds.
+ */
+typedef struct ROUND_SIZER_st {
+	/* Largest round permitted by the maximum level of the tree. */
+	size_t max_size;
+
+	/* Target time of a round in microseconds. */
+	KSI_uint64_t target_us;
+
+	/* Smoothed latency of signing a round and time spent per input in microseconds. */
+	double sign_us;
+	double input_us;
+	int isMeasured;
+
+	/* Size of the last round. */
+	size_t last_size;
+} ROUND_SIZER;
+
+/**
+ * Size of the first round, that is signed before anything is measured. It is
+ * small, so that the first signatures are returned quickly.
+ */
+#define ROUND_SIZER_FIRST_ROUND 16
+
+/**
+ * Initializes the sizer.
+ * \param sizer		Round sizer.
+ * \param max_size	Maximum count of inputs in a round.
+ * \param target_ms	Target time of a round in milliseconds.
+ */
+void ROUND_SIZER_init(ROUND_SIZER *sizer, size_t max_size, KSI_uint64_t target_ms);
+
+/**
+ * Returns the count of inputs for the next round. The size is never larger than
+ * the maximum size and the remaining inputs, and it is large enough to sign the
+ * remaining inputs within the remaining rounds. If signing alone takes longer
+ * than the target, the target can not be met and full rounds are used to keep
+ * the throughput.
+ * \param sizer			Round sizer.
+ * \param remaining		Count of the inputs not signed yet.
+ * \param rounds_left	Count of the rounds permitted for the remaining inputs or 0 if unlimited.
+ * \return Count of inputs of the next round.
+ */
+size_t ROUND_SIZER_next(const ROUND_SIZER *sizer, size_t remaining, size_t rounds_left);
+
+/**
+ * Updates the estimates with the measurements of a finished round.
+ * \param sizer			Round sizer.
+ * \param size			Count of inputs in the round.
+ * \param prepare_us	Time spent on hashing the inputs, building the tree and saving the signatures.
+ * \param sign_us		Time spent on signing the tree.
+ */
+void ROUND_SIZER_update(ROUND_SIZER *sizer, size_t size, KSI_uint64_t prepare_us, KSI_uint64_t sign_us);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* ROUND_SIZER_H */
@@ -0,0 +1,282 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+
+#include <string.h>
+#include <ksi/ksi.h>
+#include "round_store.h"
+#include "ksitool_err.h"
+
+/**
+ * Encoded signature (all integers are big-endian):
+ * <magic> <shared offset (u64)> <shared length (u32)> <TLV header byte 0> <TLV header byte 1> <part count (u16)> <part>...
+ * where a part is either a reference to the shared block:
+ * 0x00 <offset in the shared block (u32)> <length (u32)>
+ * or the data of its own:
+ * 0x01 <length (u32)> <data>
+ * The signature is reconstructed by concatenating the parts and prepending the
+ * TLV header of the same type and flags as the original one.
+ */
+#define ROUND_STORE_MAGIC "KRS1"
+#define ROUND_STORE_MAGIC_LEN 4
+#define ROUND_STORE_HEADER_LEN (ROUND_STORE_MAGIC_LEN + 8 + 4 + 2 + 2)
+#define ROUND_STORE_PART_REF 0x00
+#define ROUND_STORE_PART_DATA 0x01
+#define ROUND_STORE_PART_MAX_LEN 9
+
+#define ROUND_STORE_TLV16 0x80
+
+static void round_store_putU32(unsigned char *buf, size_t val) {
+	buf[0] = (unsigned char)((val >> 24) & 0xff);
+	buf[1] = (unsigned char)((val >> 16) & 0xff);
+	buf[2] = (unsigned char)((val >> 8) & 0xff);
+	buf[3] = (unsigned char)(val & 0xff);
+}
+
+static size_t round_store_getU32(const unsigned char *buf) {
+	return ((size_t)buf[0] << 24) | ((size_t)buf[1] << 16) | ((size_t)buf[2] << 8) | buf[3];
+}
+
+/**
+ * Parses the TLV header. Returns 0 if the header or the value does not fit
+ * into the available data.
+ */
+static int round_store_tlv(const unsigned char *data, size_t avail, size_t *hdr_len, size_t *value_len) {
+	if (avail < 2) return 0;
+
+	if (data[0] & ROUND_STORE_TLV16) {
+		if (avail < 4) return 0;
+		*hdr_len = 4;
+		*value_len = ((size_t)data[2] << 8) | data[3];
+	} else {
+		*hdr_len = 2;
+		*value_len = data[1];
+	}
+
+	return avail - *hdr_len >= *value_len;
+}
+
+/**
+ * Finds the element in the shared block. Returns 1 and the offset of the
+ * element if found, 0 otherwise.
+ */
+static int round_store_findShared(const ROUND_STORE_SHARED *shared, const unsigned char *elem, size_t elem_len, size_t *offset) {
+	size_t pos = 0;
+
+	while (pos < shared->data_len) {
+		size_t hdr_len = 0;
+		size_t value_len = 0;
+
+		if (!round_store_tlv(shared->data + pos, shared->data_len - pos, &hdr_len, &value_len)) return 0;
+
+		if (hdr_len + value_len == elem_len && memcmp(shared->data + pos, elem, elem_len) == 0) {
+			*offset = pos;
+			return 1;
+		}
+
+		pos += hdr_len + value_len;
+	}
+
+	return 0;
+}
+
+int ROUND_STORE_getBody(const unsigned char *sig, size_t sig_len, const unsigned char **body, size_t *body_len) {
+	size_t hdr_len = 0;
+	size_t value_len = 0;
+
+	if (sig == NULL || body == NULL || body_len == NULL) return KT_INVALID_ARGUMENT;
+	if (!round_store_tlv(sig, sig_len, &hdr_len, &value_len) || hdr_len + value_len != sig_len) return KT_INVALID_INPUT_FORMAT;
+
+	*body = sig + hdr_len;
+	*body_len = value_len;
+
+	return KT_OK;
+}
+
+int ROUND_STORE_encode(const ROUND_STORE_SHARED *shared, const unsigned char *sig, size_t sig_len, unsigned char **out, size_t *out_len) {
+	int res;
+	const unsigned char *body = NULL;
+	size_t body_len = 0;
+	size_t pos = 0;
+	size_t elem_count = 0;
+	unsigned char *tmp = NULL;
+	size_t len = ROUND_STORE_HEADER_LEN;
+	size_t part_count = 0;
+	/* Position of the last part in the output and its kind. */
+	size_t last_part = 0;
+	int last_kind = -1;
+
+	if (shared == NULL || sig == NULL || out == NULL || out_len == NULL) return KT_INVALID_ARGUMENT;
+
+	res = ROUND_STORE_getBody(sig, sig_len, &body, &body_len);
+	if (res != KT_OK) return res;
+
+	/* Count the elements to get the upper limit of the encoded size. */
+	while (pos < body_len) {
+		size_t hdr_len = 0;
+		size_t value_len = 0;
+
+		if (!round_store_tlv(body + pos, body_len - pos, &hdr_len, &value_len)) return KT_INVALID_INPUT_FORMAT;
+		pos += hdr_len + value_len;
+		elem_count++;
+	}
+
+	tmp = (unsigned char*)KSI_malloc(ROUND_STORE_HEADER_LEN + elem_count * ROUND_STORE_PART_MAX_LEN + body_len);
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	memcpy(tmp, ROUND_STORE_MAGIC, ROUND_STORE_MAGIC_LEN);
+	round_store_putU32(tmp + ROUND_STORE_MAGIC_LEN, (size_t)((shared->offset >> 32) & 0xffffffff));
+	round_store_putU32(tmp + ROUND_STORE_MAGIC_LEN + 4, (size_t)(shared->offset & 0xffffffff));
+	round_store_putU32(tmp + ROUND_STORE_MAGIC_LEN + 8, shared->data_len);
+	tmp[ROUND_STORE_MAGIC_LEN + 12] = sig[0];
+	tmp[ROUND_STORE_MAGIC_LEN + 13] = (sig[0] & ROUND_STORE_TLV16) ? sig[1] : 0;
+
+	for (pos = 0; pos < body_len;) {
+		size_t hdr_len = 0;
+		size_t value_len = 0;
+		size_t elem_len = 0;
+		size_t offset = 0;
+
+		round_store_tlv(body + pos, body_len - pos, &hdr_len, &value_len);
+		elem_len = hdr_len + value_len;
+
+		if (round_store_findShared(shared, body + pos, elem_len, &offset)) {
+			/* Consecutive elements of the shared block are referred to at once. */
+			if (last_kind == ROUND_STORE_PART_REF && round_store_getU32(tmp + last_part + 1) + round_store_getU32(tmp + last_part + 5) == offset) {
+				round_store_putU32(tmp + last_part + 5, round_store_getU32(tmp + last_part + 5) + elem_len);
+			} else {
+				last_part = len;
+				last_kind = ROUND_STORE_PART_REF;
+				tmp[len] = ROUND_STORE_PART_REF;
+				round_store_putU32(tmp + len + 1, offset);
+				round_store_putU32(tmp + len + 5, elem_len);
+				len += 9;
+				part_count++;
+			}
+		} else {
+			/* Consecutive elements of its own are stored as a single part. */
+			if (last_kind == ROUND_STORE_PART_DATA) {
+				round_store_putU32(tmp + last_part + 1, round_store_getU32(tmp + last_part + 1) + elem_len);
+			} else {
+				last_part = len;
+				last_kind = ROUND_STORE_PART_DATA;
+				tmp[len] = ROUND_STORE_PART_DATA;
+				round_store_putU32(tmp + len + 1, elem_len);
+				len += 5;
+				part_count++;
+			}
+			memcpy(tmp + len, body + pos, elem_len);
+			len += elem_len;
+		}
+
+		pos += elem_len;
+	}
+
+	tmp[ROUND_STORE_MAGIC_LEN + 14] = (unsigned char)((part_count >> 8) & 0xff);
+	tmp[ROUND_STORE_MAGIC_LEN + 15] = (unsigned char)(part_count & 0xff);
+
+	*out = tmp;
+	*out_len = len;
+
+	return KT_OK;
+}
+
+int ROUND_STORE_isEncoded(const unsigned char *data, size_t data_len) {
+	return data != NULL && data_len >= ROUND_STORE_HEADER_LEN && memcmp(data, ROUND_STORE_MAGIC, ROUND_STORE_MAGIC_LEN) == 0;
+}
+
+int ROUND_STORE_getSharedLocation(const unsigned char *data, size_t data_len, KSI_uint64_t *offset, size_t *length) {
+	if (offset == NULL || length == NULL) return KT_INVALID_ARGUMENT;
+	if (!ROUND_STORE_isEncoded(data, data_len)) return KT_INVALID_INPUT_FORMAT;
+
+	*offset = ((KSI_uint64_t)round_store_getU32(data + ROUND_STORE_MAGIC_LEN) << 32) | round_store_getU32(data + ROUND_STORE_MAGIC_LEN + 4);
+	*length = round_store_getU32(data + ROUND_STORE_MAGIC_LEN + 8);
+
+	return KT_OK;
+}
+
+int ROUND_STORE_decode(const unsigned char *data, size_t data_len, const unsigned char *shared, size_t shared_len, unsigned char *buf, size_t buf_len, size_t *sig_len) {
+	unsigned char hdr0 = 0;
+	unsigned char hdr1 = 0;
+	size_t part_count = 0;
+	size_t hdr_len = 0;
+	size_t pos = ROUND_STORE_HEADER_LEN;
+	size_t len = 0;
+	size_t i = 0;
+
+	if (shared == NULL || buf == NULL || sig_len == NULL) return KT_INVALID_ARGUMENT;
+	if (!ROUND_STORE_isEncoded(data, data_len)) return KT_INVALID_INPUT_FORMAT;
+
+	hdr0 = data[ROUND_STORE_MAGIC_LEN + 12];
+	hdr1 = data[ROUND_STORE_MAGIC_LEN + 13];
+	part_count = ((size_t)data[ROUND_STORE_MAGIC_LEN + 14] << 8) | data[ROUND_STORE_MAGIC_LEN + 15];
+	hdr_len = (hdr0 & ROUND_STORE_TLV16) ? 4 : 2;
+
+	if (buf_len < hdr_len) return KT_INDEX_OVF;
+	len = hdr_len;
+
+	for (i = 0; i < part_count; i++) {
+		const unsigned char *src = NULL;
+		size_t part_len = 0;
+
+		if (data_len - pos < 5) return KT_INVALID_INPUT_FORMAT;
+
+		if (data[pos] == ROUND_STORE_PART_REF) {
+			size_t offset = 0;
+
+			if (data_len - pos < 9) return KT_INVALID_INPUT_FORMAT;
+			offset = round_store_getU32(data + pos + 1);
+			part_len = round_store_getU32(data + pos + 5);
+			if (offset > shared_len || part_len > shared_len - offset) return KT_INVALID_INPUT_FORMAT;
+			src = shared + offset;
+			pos += 9;
+		} else if (data[pos] == ROUND_STORE_PART_DATA) {
+			part_len = round_store_getU32(data + pos + 1);
+			pos += 5;
+			if (part_len > data_len - pos) return KT_INVALID_INPUT_FORMAT;
+			src = data + pos;
+			pos += part_len;
+		} else {
+			return KT_INVALID_INPUT_FORMAT;
+		}
+
+		if (part_len > buf_len - len) return KT_INDEX_OVF;
+		memcpy(buf + len, src, part_len);
+		len += part_len;
+	}
+
+	if (pos != data_len) return KT_INVALID_INPUT_FORMAT;
+
+	/* Restore the TLV header with the same type and flags. */
+	if (hdr0 & ROUND_STORE_TLV16) {
+		if (len - hdr_len > 0xffff) return KT_INVALID_INPUT_FORMAT;
+		buf[0] = hdr0;
+		buf[1] = hdr1;
+		buf[2] = (unsigned char)(((len - hdr_len) >> 8) & 0xff);
+		buf[3] = (unsigned char)((len - hdr_len) & 0xff);
+	} else {
+		if (len - hdr_len > 0xff) return KT_INVALID_INPUT_FORMAT;
+		buf[0] = hdr0;
+		buf[1] = (unsigned char)(len - hdr_len);
+	}
+
+	*sig_len = len;
+
+	return KT_OK;
+}
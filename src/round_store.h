@@ -0,0 +1,104 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+
+#ifndef ROUND_STORE_H
+#define	ROUND_STORE_H
+
+#include <stddef.h>
+#include <ksi/ksi.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Round store is a compact encoding of the signatures of a local aggregation
+ * round. All the signatures of a round share the upper aggregation hash chains,
+ * the calendar hash chain and the authentication records and differ only by the
+ * local aggregation hash chain. The elements of the first signature of the round
+ * are stored once as the shared block and every signature is encoded as a list
+ * of references to the shared block and the elements of its own.
+ */
+typedef struct ROUND_STORE_SHARED_st {
+	/** Elements of the first signature of the round (the signature without its TLV header). */
+	const unsigned char *data;
+	size_t data_len;
+
+	/** Offset of the shared block in the file that holds it. */
+	KSI_uint64_t offset;
+} ROUND_STORE_SHARED;
+
+/**
+ * Returns the elements of the serialized signature that are used as the shared
+ * block of the round.
+ * \param sig			Serialized signature.
+ * \param sig_len		Length of the serialized signature.
+ * \param body			Output parameter for the elements (points into \c sig).
+ * \param body_len		Output parameter for the length of the elements.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the signature is not a valid TLV.
+ */
+int ROUND_STORE_getBody(const unsigned char *sig, size_t sig_len, const unsigned char **body, size_t *body_len);
+
+/**
+ * Encodes the serialized signature against the shared block of its round.
+ * \param shared		Shared block of the round.
+ * \param sig			Serialized signature.
+ * \param sig_len		Length of the serialized signature.
+ * \param out			Output parameter for the encoded signature. Must be freed with KSI_free.
+ * \param out_len		Output parameter for the length of the encoded signature.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int ROUND_STORE_encode(const ROUND_STORE_SHARED *shared, const unsigned char *sig, size_t sig_len, unsigned char **out, size_t *out_len);
+
+/**
+ * Returns 1 if the data is an encoded signature, 0 if it is a serialized signature.
+ */
+int ROUND_STORE_isEncoded(const unsigned char *data, size_t data_len);
+
+/**
+ * Returns the location of the shared block the encoded signature refers to.
+ * \param data			Encoded signature.
+ * \param data_len		Length of the encoded signature.
+ * \param offset		Output parameter for the offset of the shared block.
+ * \param length		Output parameter for the length of the shared block.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT otherwise.
+ */
+int ROUND_STORE_getSharedLocation(const unsigned char *data, size_t data_len, KSI_uint64_t *offset, size_t *length);
+
+/**
+ * Reconstructs the serialized signature from the encoded signature and the
+ * shared block it refers to.
+ * \param data			Encoded signature.
+ * \param data_len		Length of the encoded signature.
+ * \param shared		Shared block.
+ * \param shared_len	Length of the shared block.
+ * \param buf			Buffer for the serialized signature.
+ * \param buf_len		Size of the buffer.
+ * \param sig_len		Output parameter for the length of the serialized signature.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the encoding is invalid,
+ * KT_INDEX_OVF if the signature does not fit into the buffer.
+ */
+int ROUND_STORE_decode(const unsigned char *data, size_t data_len, const unsigned char *shared, size_t shared_len, unsigned char *buf, size_t buf_len, size_t *sig_len);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* ROUND_STORE_H */
@@ -0,0 +1,617 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ksi/ksi.h>
+#include <ksi/compatibility.h>
+#include "sign_journal.h"
+#include "smart_file.h"
+#include "ksitool_err.h"
+
+/**
+ * Journal is a text file with a header line and a line that identifies the job,
+ * followed by the records of the started and finished rounds:
+ * J TAB <input count> TAB <hash algorithm id> TAB <fingerprint in hex>
+ * O TAB <round> TAB <output file name>	(one line per input of the round)
+ * S TAB <round> TAB <first input> TAB <input count>
+ * R TAB <round> TAB <first input> TAB <input count> TAB <status>
+ * The O lines and the S line record the output file names reserved for the
+ * inputs of the round before its signatures are saved. The R line records the
+ * finished round. File names are escaped as in the state file (see sign_state.c).
+ */
+#define SIGN_JOURNAL_HEADER "KSI-SIGN-JOURNAL 1"
+#define SIGN_JOURNAL_LINE_MAX 0x8000
+
+typedef struct SIGN_JOURNAL_ROUND_st {
+	size_t first_input;
+	size_t input_count;
+	int status;
+	int isRecorded;
+} SIGN_JOURNAL_ROUND;
+
+struct SIGN_JOURNAL_st {
+	char *fname;
+
+	/* Journal opened for appending the records. */
+	FILE *file;
+
+	/* Identity of the job. */
+	size_t input_count;
+	int algo_id;
+	KSI_uint64_t fingerprint;
+
+	/* Rounds recorded in the journal, indexed by the round. */
+	SIGN_JOURNAL_ROUND *rounds;
+	size_t round_count;
+
+	/* Output file names reserved for the inputs, indexed by the input (NULL if not reserved). */
+	char **names;
+
+	/* Names of the O lines that are not followed by the S line yet (while loading). */
+	char **pending;
+	size_t pending_count;
+	size_t pending_max;
+};
+
+static const char *sign_journal_statusToString(int status) {
+	return (status == SIGN_JOURNAL_SAVED) ? "saved" : "failed";
+}
+
+static char *sign_journal_strdup(const char *str) {
+	size_t len = strlen(str) + 1;
+	char *tmp = (char*)KSI_malloc(len);
+	if (tmp != NULL) memcpy(tmp, str, len);
+	return tmp;
+}
+
+static int sign_journal_writeEscaped(FILE *f, const char *str) {
+	for (; *str != '\0'; str++) {
+		const char *esc = NULL;
+
+		switch (*str) {
+			case '\\': esc = "\\\\"; break;
+			case '\t': esc = "\\t"; break;
+			case '\r': esc = "\\r"; break;
+			case '\n': esc = "\\n"; break;
+		}
+
+		if (esc != NULL) {
+			if (fputs(esc, f) == EOF) return 0;
+		} else if (fputc(*str, f) == EOF) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static char *sign_journal_unescape(char *str) {
+	char *r = str;
+	char *w = str;
+
+	while (*r != '\0') {
+		if (*r == '\\') {
+			r++;
+			switch (*r) {
+				case '\\': *w++ = '\\'; break;
+				case 't': *w++ = '\t'; break;
+				case 'r': *w++ = '\r'; break;
+				case 'n': *w++ = '\n'; break;
+				default: return NULL;
+			}
+			r++;
+		} else {
+			*w++ = *r++;
+		}
+	}
+
+	*w = '\0';
+	return str;
+}
+
+static int sign_journal_sync(SIGN_JOURNAL *journal) {
+	if (fflush(journal->file) != 0) return KT_IO_ERROR;
+	return SMART_FILE_sync(journal->fname) == SMART_FILE_OK ? KT_OK : KT_IO_ERROR;
+}
+
+static int sign_journal_putRound(SIGN_JOURNAL *journal, size_t round, size_t first_input, size_t input_count, int status) {
+	if (round >= journal->round_count) {
+		size_t round_count = (round + 1 > journal->round_count * 2) ? round + 1 : journal->round_count * 2;
+		SIGN_JOURNAL_ROUND *tmp = (SIGN_JOURNAL_ROUND*)realloc(journal->rounds, round_count * sizeof(SIGN_JOURNAL_ROUND));
+
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+		memset(tmp + journal->round_count, 0, (round_count - journal->round_count) * sizeof(SIGN_JOURNAL_ROUND));
+		journal->rounds = tmp;
+		journal->round_count = round_count;
+	}
+
+	journal->rounds[round].first_input = first_input;
+	journal->rounds[round].input_count = input_count;
+	journal->rounds[round].status = status;
+	journal->rounds[round].isRecorded = 1;
+
+	return KT_OK;
+}
+
+static void sign_journal_dropPending(SIGN_JOURNAL *journal) {
+	size_t n = 0;
+
+	for (n = 0; n < journal->pending_count; n++) KSI_free(journal->pending[n]);
+	journal->pending_count = 0;
+}
+
+static int sign_journal_addPending(SIGN_JOURNAL *journal, const char *name) {
+	if (journal->pending_count == journal->pending_max) {
+		size_t pending_max = (journal->pending_max == 0) ? 16 : journal->pending_max * 2;
+		char **tmp = (char**)realloc(journal->pending, pending_max * sizeof(char*));
+
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+		journal->pending = tmp;
+		journal->pending_max = pending_max;
+	}
+
+	journal->pending[journal->pending_count] = sign_journal_strdup(name);
+	if (journal->pending[journal->pending_count] == NULL) return KT_OUT_OF_MEMORY;
+	journal->pending_count++;
+
+	return KT_OK;
+}
+
+/**
+ * Stores the output file names reserved for the inputs of a round. A name
+ * reserved by a later round replaces the earlier one.
+ */
+static int sign_journal_putNames(SIGN_JOURNAL *journal, size_t first_input, size_t input_count, char **names, int takeOwnership) {
+	size_t n = 0;
+
+	if (first_input > journal->input_count || input_count > journal->input_count - first_input) return KT_INVALID_INPUT_FORMAT;
+
+	if (journal->names == NULL && input_count > 0) {
+		journal->names = (char**)calloc(journal->input_count, sizeof(char*));
+		if (journal->names == NULL) return KT_OUT_OF_MEMORY;
+	}
+
+	for (n = 0; n < input_count; n++) {
+		char *name = NULL;
+
+		if (names[n] != NULL && strcmp(names[n], "-") != 0) {
+			name = takeOwnership ? names[n] : sign_journal_strdup(names[n]);
+			if (name == NULL) return KT_OUT_OF_MEMORY;
+		} else if (takeOwnership) {
+			KSI_free(names[n]);
+		}
+		if (takeOwnership) names[n] = NULL;
+
+		KSI_free(journal->names[first_input + n]);
+		journal->names[first_input + n] = name;
+	}
+
+	return KT_OK;
+}
+
+static SIGN_JOURNAL *sign_journal_new(const char *fname) {
+	SIGN_JOURNAL *tmp = NULL;
+
+	tmp = (SIGN_JOURNAL*)KSI_calloc(1, sizeof(SIGN_JOURNAL));
+	if (tmp == NULL) return NULL;
+
+	tmp->fname = NULL;
+	tmp->file = NULL;
+	tmp->input_count = 0;
+	tmp->algo_id = 0;
+	tmp->fingerprint = 0;
+	tmp->rounds = NULL;
+	tmp->round_count = 0;
+	tmp->names = NULL;
+	tmp->pending = NULL;
+	tmp->pending_count = 0;
+	tmp->pending_max = 0;
+
+	tmp->fname = sign_journal_strdup(fname);
+	if (tmp->fname == NULL) {
+		KSI_free(tmp);
+		return NULL;
+	}
+
+	return tmp;
+}
+
+/**
+ * Parses a job, output file name or round line. The output file names are
+ * collected until the S line tells the inputs they are reserved for.
+ */
+static int sign_journal_parseLine(SIGN_JOURNAL *journal, char *line, int *isRound) {
+	int res;
+	unsigned long long a = 0;
+	unsigned long long b = 0;
+	unsigned long long c = 0;
+	char status[16];
+	int algo_id = 0;
+
+	*isRound = 0;
+
+	if (strncmp(line, "J\t", 2) == 0) {
+		if (sscanf(line + 2, "%llu\t%d\t%llx", &a, &algo_id, &b) != 3) return KT_INVALID_INPUT_FORMAT;
+		journal->input_count = (size_t)a;
+		journal->algo_id = algo_id;
+		journal->fingerprint = (KSI_uint64_t)b;
+		return KT_OK;
+	} else if (strncmp(line, "O\t", 2) == 0) {
+		char *name = strchr(line + 2, '\t');
+
+		if (sscanf(line + 2, "%llu\t", &a) != 1 || name == NULL || sign_journal_unescape(name + 1) == NULL) return KT_INVALID_INPUT_FORMAT;
+		return sign_journal_addPending(journal, name + 1);
+	} else if (strncmp(line, "S\t", 2) == 0) {
+		if (sscanf(line + 2, "%llu\t%llu\t%llu", &a, &b, &c) != 3 || (size_t)c != journal->pending_count) return KT_INVALID_INPUT_FORMAT;
+
+		*isRound = 1;
+		res = sign_journal_putNames(journal, (size_t)b, (size_t)c, journal->pending, 1);
+		sign_journal_dropPending(journal);
+		return res;
+	} else if (strncmp(line, "R\t", 2) == 0) {
+		if (sscanf(line + 2, "%llu\t%llu\t%llu\t%15s", &a, &b, &c, status) != 4 || journal->pending_count != 0) return KT_INVALID_INPUT_FORMAT;
+
+		*isRound = 1;
+		if (strcmp(status, "saved") == 0) {
+			return sign_journal_putRound(journal, (size_t)a, (size_t)b, (size_t)c, SIGN_JOURNAL_SAVED);
+		} else if (strcmp(status, "failed") == 0) {
+			return sign_journal_putRound(journal, (size_t)a, (size_t)b, (size_t)c, SIGN_JOURNAL_FAILED);
+		}
+	}
+
+	return KT_INVALID_INPUT_FORMAT;
+}
+
+/**
+ * Loads the journal. Sets complete_len to the length of the journal up to the
+ * end of the last complete record.
+ */
+static int sign_journal_load(SIGN_JOURNAL *journal, long *complete_len) {
+	int res;
+	FILE *f = NULL;
+	char *line = NULL;
+	int line_nr = 0;
+
+	*complete_len = 0;
+
+	f = fopen(journal->fname, "rb");
+	if (f == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	line = (char*)KSI_malloc(SIGN_JOURNAL_LINE_MAX);
+	if (line == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	while (fgets(line, SIGN_JOURNAL_LINE_MAX, f) != NULL) {
+		size_t len = strlen(line);
+		int isRound = 0;
+
+		/* The last line was not written completely. */
+		if (len == 0 || line[len - 1] != '\n') break;
+		line[len - 1] = '\0';
+
+		if (line_nr == 0) {
+			if (strcmp(line, SIGN_JOURNAL_HEADER) != 0) {
+				res = KT_INVALID_INPUT_FORMAT;
+				goto cleanup;
+			}
+		} else if (line_nr == 1 && strncmp(line, "J\t", 2) != 0) {
+			res = KT_INVALID_INPUT_FORMAT;
+			goto cleanup;
+		} else {
+			res = sign_journal_parseLine(journal, line, &isRound);
+			if (res != KT_OK) goto cleanup;
+		}
+
+		line_nr++;
+		if (line_nr == 2 || isRound) *complete_len = ftell(f);
+	}
+
+	if (ferror(f)) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	if (line_nr < 2) {
+		res = KT_INVALID_INPUT_FORMAT;
+		goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_free(line);
+
+	/* The names of an incomplete record are dropped with the record. */
+	sign_journal_dropPending(journal);
+
+	return res;
+}
+
+/**
+ * Drops the incomplete record from the end of the journal, as the records
+ * appended after it would be mixed up with it.
+ */
+static int sign_journal_truncate(SIGN_JOURNAL *journal, long len) {
+	int res;
+	FILE *in = NULL;
+	FILE *out = NULL;
+	char *tmp_name = NULL;
+	size_t tmp_name_len = 0;
+	char buf[0x1000];
+	long left = len;
+
+	tmp_name_len = strlen(journal->fname) + 5;
+	tmp_name = (char*)KSI_malloc(tmp_name_len);
+	if (tmp_name == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	KSI_snprintf(tmp_name, tmp_name_len, "%s.tmp", journal->fname);
+
+	in = fopen(journal->fname, "rb");
+	out = fopen(tmp_name, "wb");
+	if (in == NULL || out == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	while (left > 0) {
+		size_t count = fread(buf, 1, (left < (long)sizeof(buf)) ? (size_t)left : sizeof(buf), in);
+
+		if (count == 0 || fwrite(buf, 1, count, out) != count) {
+			res = KT_IO_ERROR;
+			goto cleanup;
+		}
+		left -= (long)count;
+	}
+
+	res = fclose(out) == 0 ? KT_OK : KT_IO_ERROR;
+	out = NULL;
+	if (res != KT_OK) goto cleanup;
+
+	res = SMART_FILE_sync(tmp_name);
+	if (res != SMART_FILE_OK) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	fclose(in);
+	in = NULL;
+
+	res = SMART_FILE_replace(tmp_name, journal->fname);
+	if (res != SMART_FILE_OK) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	if (in != NULL) fclose(in);
+	if (out != NULL) fclose(out);
+	if (res != KT_OK && tmp_name != NULL) remove(tmp_name);
+	KSI_free(tmp_name);
+
+	return res;
+}
+
+int SIGN_JOURNAL_create(const char *fname, size_t input_count, int algo_id, KSI_uint64_t fingerprint, SIGN_JOURNAL **journal) {
+	int res;
+	SIGN_JOURNAL *tmp = NULL;
+
+	if (fname == NULL || journal == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = sign_journal_new(fname);
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->input_count = input_count;
+	tmp->algo_id = algo_id;
+	tmp->fingerprint = fingerprint;
+
+	tmp->file = fopen(fname, "wb");
+	if (tmp->file == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	if (fprintf(tmp->file, "%s\nJ\t%llu\t%d\t%016llx\n", SIGN_JOURNAL_HEADER,
+			(unsigned long long)input_count, algo_id, (unsigned long long)fingerprint) < 0) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	res = sign_journal_sync(tmp);
+	if (res != KT_OK) goto cleanup;
+
+	*journal = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	SIGN_JOURNAL_close(tmp);
+
+	return res;
+}
+
+int SIGN_JOURNAL_open(const char *fname, SIGN_JOURNAL **journal) {
+	int res;
+	SIGN_JOURNAL *tmp = NULL;
+	long complete_len = 0;
+
+	if (fname == NULL || journal == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = sign_journal_new(fname);
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = sign_journal_load(tmp, &complete_len);
+	if (res != KT_OK) goto cleanup;
+
+	tmp->file = fopen(fname, "ab");
+	if (tmp->file == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	if (fseek(tmp->file, 0, SEEK_END) != 0) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	if (ftell(tmp->file) != complete_len) {
+		fclose(tmp->file);
+		tmp->file = NULL;
+
+		res = sign_journal_truncate(tmp, complete_len);
+		if (res != KT_OK) goto cleanup;
+
+		tmp->file = fopen(fname, "ab");
+		if (tmp->file == NULL) {
+			res = KT_IO_ERROR;
+			goto cleanup;
+		}
+	}
+
+	*journal = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	SIGN_JOURNAL_close(tmp);
+
+	return res;
+}
+
+void SIGN_JOURNAL_close(SIGN_JOURNAL *journal) {
+	if (journal == NULL) return;
+
+	if (journal->file != NULL) fclose(journal->file);
+
+	if (journal->names != NULL) {
+		size_t n = 0;
+
+		for (n = 0; n < journal->input_count; n++) KSI_free(journal->names[n]);
+		free(journal->names);
+	}
+
+	sign_journal_dropPending(journal);
+	free(journal->pending);
+	free(journal->rounds);
+	KSI_free(journal->fname);
+	KSI_free(journal);
+}
+
+int SIGN_JOURNAL_isSameJob(SIGN_JOURNAL *journal, size_t input_count, int algo_id, KSI_uint64_t fingerprint) {
+	if (journal == NULL) return 0;
+	return journal->input_count == input_count && journal->algo_id == algo_id && journal->fingerprint == fingerprint;
+}
+
+void SIGN_JOURNAL_getResumePoint(SIGN_JOURNAL *journal, size_t *round, size_t *input) {
+	size_t r = 0;
+	size_t i = 0;
+
+	if (journal != NULL) {
+		for (r = 0; r < journal->round_count; r++) {
+			const SIGN_JOURNAL_ROUND *rec = &journal->rounds[r];
+
+			if (!rec->isRecorded || rec->status != SIGN_JOURNAL_SAVED || rec->first_input != i) break;
+			i += rec->input_count;
+		}
+	}
+
+	if (round != NULL) *round = r;
+	if (input != NULL) *input = i;
+}
+
+int SIGN_JOURNAL_start(SIGN_JOURNAL *journal, size_t round, size_t first_input, size_t input_count, char **out_names) {
+	int res;
+	size_t n = 0;
+
+	if (journal == NULL || journal->file == NULL || out_names == NULL) return KT_INVALID_ARGUMENT;
+
+	for (n = 0; n < input_count; n++) {
+		if (fprintf(journal->file, "O\t%llu\t", (unsigned long long)round) < 0
+				|| !sign_journal_writeEscaped(journal->file, out_names[n] != NULL ? out_names[n] : "-")
+				|| fputc('\n', journal->file) == EOF) return KT_IO_ERROR;
+	}
+
+	if (fprintf(journal->file, "S\t%llu\t%llu\t%llu\n", (unsigned long long)round,
+			(unsigned long long)first_input, (unsigned long long)input_count) < 0) return KT_IO_ERROR;
+
+	res = sign_journal_sync(journal);
+	if (res != KT_OK) return res;
+
+	return sign_journal_putNames(journal, first_input, input_count, out_names, 0);
+}
+
+const char *SIGN_JOURNAL_getReservedName(SIGN_JOURNAL *journal, size_t input) {
+	if (journal == NULL || journal->names == NULL || input >= journal->input_count) return NULL;
+	return journal->names[input];
+}
+
+int SIGN_JOURNAL_record(SIGN_JOURNAL *journal, size_t round, size_t first_input, size_t input_count, int status) {
+	int res;
+
+	if (journal == NULL || journal->file == NULL) return KT_INVALID_ARGUMENT;
+
+	if (fprintf(journal->file, "R\t%llu\t%llu\t%llu\t%s\n", (unsigned long long)round,
+			(unsigned long long)first_input, (unsigned long long)input_count, sign_journal_statusToString(status)) < 0) return KT_IO_ERROR;
+
+	res = sign_journal_sync(journal);
+	if (res != KT_OK) return res;
+
+	return sign_journal_putRound(journal, round, first_input, input_count, status);
+}
+
+KSI_uint64_t SIGN_JOURNAL_addToFingerprint(KSI_uint64_t fingerprint, const char *name) {
+	/* FNV-1a, the name is terminated with 0 to separate the names. */
+	KSI_uint64_t h = (fingerprint == 0) ? 14695981039346656037ULL : fingerprint;
+
+	if (name == NULL) return h;
+
+	do {
+		h ^= (unsigned char)*name;
+		h *= 1099511628211ULL;
+	} while (*name++ != '\0');
+
+	return h;
+}
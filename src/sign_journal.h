@@ -0,0 +1,131 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef SIGN_JOURNAL_H
+#define	SIGN_JOURNAL_H
+
+#include <stddef.h>
+#include <ksi/ksi.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct SIGN_JOURNAL_st SIGN_JOURNAL;
+
+/**
+ * Status of a local aggregation round recorded in the journal.
+ */
+enum SIGN_JOURNAL_STATUS_en {
+	/** The round is signed and all its signatures are saved. */
+	SIGN_JOURNAL_SAVED = 0,
+
+	/** The round is signed, but some of its signatures could not be saved. */
+	SIGN_JOURNAL_FAILED
+};
+
+/**
+ * Creates a new journal of a multi-round signing job. The job is identified by
+ * the count of inputs, the hash algorithm and a fingerprint of the input names,
+ * so that the journal can not be resumed with different inputs. The journal
+ * must not exist.
+ * \param fname			Path to the journal.
+ * \param input_count	Count of inputs.
+ * \param algo_id		Hash algorithm (imprint id of the algorithm).
+ * \param fingerprint	Fingerprint of the input names.
+ * \param journal		Output parameter for the journal.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int SIGN_JOURNAL_create(const char *fname, size_t input_count, int algo_id, KSI_uint64_t fingerprint, SIGN_JOURNAL **journal);
+
+/**
+ * Opens an existing journal for resuming the job and loads the rounds recorded
+ * in it. A record that was not written completely (e.g. the previous run was
+ * killed while writing it) is dropped from the end of the journal.
+ * \param fname		Path to the journal.
+ * \param journal	Output parameter for the journal.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the file is not a
+ * valid journal, error code otherwise.
+ */
+int SIGN_JOURNAL_open(const char *fname, SIGN_JOURNAL **journal);
+
+/**
+ * Closes the journal.
+ */
+void SIGN_JOURNAL_close(SIGN_JOURNAL *journal);
+
+/**
+ * Returns 1 if the journal was created for the same job, 0 otherwise.
+ */
+int SIGN_JOURNAL_isSameJob(SIGN_JOURNAL *journal, size_t input_count, int algo_id, KSI_uint64_t fingerprint);
+
+/**
+ * Finds the first round that is not completed. The rounds are completed in
+ * order, so all the rounds and inputs before it can be skipped. A later record
+ * of the same round replaces the earlier one.
+ * \param journal	Journal.
+ * \param round		Output parameter for the index of the round.
+ * \param input		Output parameter for the index of the first input of the round.
+ */
+void SIGN_JOURNAL_getResumePoint(SIGN_JOURNAL *journal, size_t *round, size_t *input);
+
+/**
+ * Records the output file names reserved for the inputs of a round before its
+ * signatures are saved and flushes the journal to the storage device. If the
+ * round is not finished, the resumed job saves the signatures of the inputs to
+ * the same files (see #SIGN_JOURNAL_getReservedName).
+ * \param journal		Journal.
+ * \param round			Index of the round.
+ * \param first_input	Index of the first input of the round.
+ * \param input_count	Count of inputs in the round.
+ * \param out_names		Output file names of the inputs, NULL entries are recorded
+ *						as '-'.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int SIGN_JOURNAL_start(SIGN_JOURNAL *journal, size_t round, size_t first_input, size_t input_count, char **out_names);
+
+/**
+ * Returns the output file name reserved for the input by the latest round that
+ * contained it (see #SIGN_JOURNAL_start) or NULL if there is none.
+ */
+const char *SIGN_JOURNAL_getReservedName(SIGN_JOURNAL *journal, size_t input);
+
+/**
+ * Records a finished round and flushes the journal to the storage device, so
+ * that the record survives a crash.
+ * \param journal		Journal.
+ * \param round			Index of the round.
+ * \param first_input	Index of the first input of the round.
+ * \param input_count	Count of inputs in the round.
+ * \param status		Status of the round (see #SIGN_JOURNAL_STATUS_en).
+ * \return KT_OK if successful, error code otherwise.
+ */
+int SIGN_JOURNAL_record(SIGN_JOURNAL *journal, size_t round, size_t first_input, size_t input_count, int status);
+
+/**
+ * Returns the fingerprint of the input names, updated with the next name.
+ * Start with \c fingerprint set to 0.
+ */
+KSI_uint64_t SIGN_JOURNAL_addToFingerprint(KSI_uint64_t fingerprint, const char *name);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SIGN_JOURNAL_H */
@@ -0,0 +1,689 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <ksi/ksi.h>
+#include <ksi/compatibility.h>
+#include "sign_state.h"
+#include "smart_file.h"
+#include "ksitool_err.h"
+
+/**
+ * State file is a text file with a header line followed by one line per record:
+ * <dev> TAB <inode> TAB <size> TAB <mtime> TAB <imprint in hex> TAB <path> TAB <signature path>
+ * Paths are escaped, so that backslash, tab, carriage return and newline are
+ * written as \\, \t, \r and \n.
+ */
+#define SIGN_STATE_HEADER "KSI-SIGN-STATE 1"
+#define SIGN_STATE_FIELDS 7
+#define SIGN_STATE_LINE_MAX 0x8000
+#define SIGN_STATE_INDEX_MIN 1024
+
+typedef struct SIGN_STATE_RECORD_st {
+	char *path;
+	char *sig_path;
+	KSI_uint64_t dev;
+	KSI_uint64_t ino;
+	KSI_uint64_t size;
+	KSI_uint64_t mtime;
+	unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+	size_t imprint_len;
+} SIGN_STATE_RECORD;
+
+struct SIGN_STATE_st {
+	char *fname;
+
+	/* State file opened for appending the new records. */
+	FILE *file;
+
+	/* Records and an open addressing hash index of record numbers + 1 (0 marks an empty slot). */
+	SIGN_STATE_RECORD *records;
+	size_t count;
+	size_t count_max;
+	size_t *index;
+	size_t index_size;
+
+	/* Count of records in the file, including the superseded ones. */
+	size_t line_count;
+
+	/* Files modified after the start are not recorded. */
+	time_t start_time;
+
+	/* Imprint returned by SIGN_STATE_getImprint. */
+	unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+};
+
+static size_t sign_state_hash(const char *path) {
+	/* FNV-1a. */
+	size_t h = (size_t)2166136261u;
+
+	while (*path != '\0') {
+		h ^= (unsigned char)*path++;
+		h *= (size_t)16777619u;
+	}
+
+	return h;
+}
+
+static int sign_state_stat(const char *path, SIGN_STATE_RECORD *rec) {
+#ifdef _WIN32
+	struct _stat64 st;
+
+	if (_stat64(path, &st) != 0 || (st.st_mode & _S_IFREG) == 0) return 0;
+#else
+	struct stat st;
+
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+#endif
+
+	rec->dev = (KSI_uint64_t)st.st_dev;
+	rec->ino = (KSI_uint64_t)st.st_ino;
+	rec->size = (KSI_uint64_t)st.st_size;
+	rec->mtime = (KSI_uint64_t)st.st_mtime;
+	return 1;
+}
+
+static SIGN_STATE_RECORD *sign_state_find(SIGN_STATE *state, const char *path) {
+	size_t mask = state->index_size - 1;
+	size_t slot = sign_state_hash(path) & mask;
+
+	while (state->index[slot] != 0) {
+		SIGN_STATE_RECORD *rec = &state->records[state->index[slot] - 1];
+		if (strcmp(rec->path, path) == 0) return rec;
+		slot = (slot + 1) & mask;
+	}
+
+	return NULL;
+}
+
+static int sign_state_reindex(SIGN_STATE *state, size_t index_size) {
+	size_t *tmp = NULL;
+	size_t i = 0;
+
+	tmp = (size_t*)KSI_calloc(index_size, sizeof(size_t));
+	if (tmp == NULL) return KT_OUT_OF_MEMORY;
+
+	for (i = 0; i < state->count; i++) {
+		size_t slot = sign_state_hash(state->records[i].path) & (index_size - 1);
+		while (tmp[slot] != 0) slot = (slot + 1) & (index_size - 1);
+		tmp[slot] = i + 1;
+	}
+
+	KSI_free(state->index);
+	state->index = tmp;
+	state->index_size = index_size;
+
+	return KT_OK;
+}
+
+/**
+ * Adds a new record or replaces the existing record of the same path. Takes the
+ * ownership of the paths.
+ */
+static int sign_state_put(SIGN_STATE *state, SIGN_STATE_RECORD *rec) {
+	int res;
+	SIGN_STATE_RECORD *old = NULL;
+	size_t slot = 0;
+
+	old = sign_state_find(state, rec->path);
+	if (old != NULL) {
+		KSI_free(old->path);
+		KSI_free(old->sig_path);
+		*old = *rec;
+		return KT_OK;
+	}
+
+	if (state->count == state->count_max) {
+		size_t count_max = state->count_max * 2;
+		SIGN_STATE_RECORD *tmp = (SIGN_STATE_RECORD*)realloc(state->records, count_max * sizeof(SIGN_STATE_RECORD));
+		if (tmp == NULL) return KT_OUT_OF_MEMORY;
+		state->records = tmp;
+		state->count_max = count_max;
+	}
+
+	/* Keep the load factor of the index below 1/2. */
+	if ((state->count + 1) * 2 > state->index_size) {
+		res = sign_state_reindex(state, state->index_size * 2);
+		if (res != KT_OK) return res;
+	}
+
+	state->records[state->count] = *rec;
+	state->count++;
+
+	slot = sign_state_hash(rec->path) & (state->index_size - 1);
+	while (state->index[slot] != 0) slot = (slot + 1) & (state->index_size - 1);
+	state->index[slot] = state->count;
+
+	return KT_OK;
+}
+
+static int sign_state_parseUint(const char *str, KSI_uint64_t *value) {
+	KSI_uint64_t tmp = 0;
+
+	if (*str == '\0') return 0;
+
+	while (*str != '\0') {
+		if (*str < '0' || *str > '9' || tmp > (((KSI_uint64_t)-1) - 9) / 10) return 0;
+		tmp = tmp * 10 + (KSI_uint64_t)(*str++ - '0');
+	}
+
+	*value = tmp;
+	return 1;
+}
+
+static int sign_state_parseHex(const char *str, unsigned char *buf, size_t buf_len, size_t *len) {
+	size_t n = 0;
+
+	while (str[0] != '\0' && str[1] != '\0') {
+		char hex[3];
+		char *end = NULL;
+
+		if (n == buf_len) return 0;
+
+		hex[0] = str[0];
+		hex[1] = str[1];
+		hex[2] = '\0';
+		buf[n++] = (unsigned char)strtol(hex, &end, 16);
+		if (*end != '\0') return 0;
+		str += 2;
+	}
+
+	*len = n;
+	return *str == '\0' && n > 0;
+}
+
+static char *sign_state_unescape(char *str) {
+	char *r = str;
+	char *w = str;
+
+	while (*r != '\0') {
+		if (*r == '\\') {
+			r++;
+			switch (*r) {
+				case '\\': *w++ = '\\'; break;
+				case 't': *w++ = '\t'; break;
+				case 'r': *w++ = '\r'; break;
+				case 'n': *w++ = '\n'; break;
+				default: return NULL;
+			}
+			r++;
+		} else {
+			*w++ = *r++;
+		}
+	}
+
+	*w = '\0';
+	return str;
+}
+
+static int sign_state_writeEscaped(FILE *f, const char *str) {
+	for (; *str != '\0'; str++) {
+		const char *esc = NULL;
+
+		switch (*str) {
+			case '\\': esc = "\\\\"; break;
+			case '\t': esc = "\\t"; break;
+			case '\r': esc = "\\r"; break;
+			case '\n': esc = "\\n"; break;
+		}
+
+		if (esc != NULL) {
+			if (fputs(esc, f) == EOF) return 0;
+		} else if (fputc(*str, f) == EOF) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int sign_state_writeRecord(FILE *f, const SIGN_STATE_RECORD *rec) {
+	size_t i = 0;
+
+	if (fprintf(f, "%llu\t%llu\t%llu\t%llu\t",
+			(unsigned long long)rec->dev, (unsigned long long)rec->ino,
+			(unsigned long long)rec->size, (unsigned long long)rec->mtime) < 0) return KT_IO_ERROR;
+
+	for (i = 0; i < rec->imprint_len; i++) {
+		if (fprintf(f, "%02x", rec->imprint[i]) < 0) return KT_IO_ERROR;
+	}
+
+	if (fputc('\t', f) == EOF || !sign_state_writeEscaped(f, rec->path)
+			|| fputc('\t', f) == EOF || !sign_state_writeEscaped(f, rec->sig_path)
+			|| fputc('\n', f) == EOF) return KT_IO_ERROR;
+
+	return KT_OK;
+}
+
+static char *sign_state_strdup(const char *str) {
+	size_t len = strlen(str) + 1;
+	char *tmp = (char*)KSI_malloc(len);
+	if (tmp != NULL) memcpy(tmp, str, len);
+	return tmp;
+}
+
+static int sign_state_parseLine(SIGN_STATE *state, char *line) {
+	int res;
+	char *field[SIGN_STATE_FIELDS];
+	SIGN_STATE_RECORD rec;
+	size_t n = 0;
+
+	memset(&rec, 0, sizeof(rec));
+
+	field[n++] = line;
+	for (; *line != '\0'; line++) {
+		if (*line != '\t') continue;
+		if (n == SIGN_STATE_FIELDS) return KT_INVALID_INPUT_FORMAT;
+		*line = '\0';
+		field[n++] = line + 1;
+	}
+
+	if (n != SIGN_STATE_FIELDS
+			|| !sign_state_parseUint(field[0], &rec.dev)
+			|| !sign_state_parseUint(field[1], &rec.ino)
+			|| !sign_state_parseUint(field[2], &rec.size)
+			|| !sign_state_parseUint(field[3], &rec.mtime)
+			|| !sign_state_parseHex(field[4], rec.imprint, sizeof(rec.imprint), &rec.imprint_len)
+			|| sign_state_unescape(field[5]) == NULL || field[5][0] == '\0'
+			|| sign_state_unescape(field[6]) == NULL) {
+		return KT_INVALID_INPUT_FORMAT;
+	}
+
+	rec.path = sign_state_strdup(field[5]);
+	rec.sig_path = sign_state_strdup(field[6]);
+	if (rec.path == NULL || rec.sig_path == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = sign_state_put(state, &rec);
+	if (res != KT_OK) goto cleanup;
+
+	rec.path = NULL;
+	rec.sig_path = NULL;
+	state->line_count++;
+
+cleanup:
+
+	KSI_free(rec.path);
+	KSI_free(rec.sig_path);
+
+	return res;
+}
+
+/**
+ * Loads the records from the file. Sets isComplete to 0 if the last line of
+ * the file is not terminated.
+ */
+static int sign_state_load(SIGN_STATE *state, int *isComplete) {
+	int res;
+	FILE *f = NULL;
+	char *buf = NULL;
+	size_t buf_len = 0;
+	int isHeader = 1;
+	int isEof = 0;
+
+	*isComplete = 1;
+
+	f = fopen(state->fname, "rb");
+	if (f == NULL) {
+		res = SMART_FILE_doFileExist(state->fname) ? KT_IO_ERROR : KT_OK;
+		goto cleanup;
+	}
+
+	buf = (char*)KSI_malloc(SIGN_STATE_LINE_MAX + 1);
+	if (buf == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	while (!isEof || buf_len > 0) {
+		char *line = buf;
+		char *nl = NULL;
+
+		if (!isEof && buf_len < SIGN_STATE_LINE_MAX) {
+			size_t count = fread(buf + buf_len, 1, SIGN_STATE_LINE_MAX - buf_len, f);
+			if (count == 0) {
+				if (ferror(f)) {
+					res = KT_IO_ERROR;
+					goto cleanup;
+				}
+				isEof = 1;
+			}
+			buf_len += count;
+		}
+
+		/* Process all the complete lines in the buffer. */
+		while ((nl = (char*)memchr(line, '\n', buf_len - (size_t)(line - buf))) != NULL) {
+			*nl = '\0';
+
+			if (isHeader) {
+				if (strcmp(line, SIGN_STATE_HEADER) != 0) {
+					res = KT_INVALID_INPUT_FORMAT;
+					goto cleanup;
+				}
+				isHeader = 0;
+			} else {
+				res = sign_state_parseLine(state, line);
+				if (res != KT_OK) goto cleanup;
+			}
+
+			line = nl + 1;
+		}
+
+		buf_len -= (size_t)(line - buf);
+		memmove(buf, line, buf_len);
+
+		if (buf_len == SIGN_STATE_LINE_MAX) {
+			res = KT_INVALID_INPUT_FORMAT;
+			goto cleanup;
+		}
+
+		/* The last record was not written completely. */
+		if (isEof && buf_len > 0) {
+			*isComplete = 0;
+			break;
+		}
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	KSI_free(buf);
+
+	return res;
+}
+
+static int sign_state_writeHeader(FILE *f) {
+	return fputs(SIGN_STATE_HEADER "\n", f) == EOF ? KT_IO_ERROR : KT_OK;
+}
+
+/**
+ * Writes only the latest records to a temporary file and replaces the state
+ * file with it.
+ */
+static int sign_state_rewrite(SIGN_STATE *state) {
+	int res;
+	FILE *f = NULL;
+	char *tmp_name = NULL;
+	size_t tmp_name_len = 0;
+	size_t i = 0;
+
+	tmp_name_len = strlen(state->fname) + 5;
+	tmp_name = (char*)KSI_malloc(tmp_name_len);
+	if (tmp_name == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+	KSI_snprintf(tmp_name, tmp_name_len, "%s.tmp", state->fname);
+
+	f = fopen(tmp_name, "wb");
+	if (f == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	res = sign_state_writeHeader(f);
+	if (res != KT_OK) goto cleanup;
+
+	for (i = 0; i < state->count; i++) {
+		res = sign_state_writeRecord(f, &state->records[i]);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	res = fclose(f) == 0 ? KT_OK : KT_IO_ERROR;
+	f = NULL;
+	if (res != KT_OK) goto cleanup;
+
+#ifdef _WIN32
+	/* Windows does not replace the existing file. */
+	SMART_FILE_remove(state->fname);
+#endif
+	res = SMART_FILE_rename(tmp_name, state->fname);
+	if (res != SMART_FILE_OK) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	state->line_count = state->count;
+	res = KT_OK;
+
+cleanup:
+
+	if (f != NULL) fclose(f);
+	if (res != KT_OK && tmp_name != NULL) remove(tmp_name);
+	KSI_free(tmp_name);
+
+	return res;
+}
+
+int SIGN_STATE_open(const char *fname, SIGN_STATE **state) {
+	int res;
+	SIGN_STATE *tmp = NULL;
+	int isComplete = 1;
+	int isNew = 0;
+
+	if (fname == NULL || state == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (SIGN_STATE*)KSI_calloc(1, sizeof(SIGN_STATE));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->fname = NULL;
+	tmp->file = NULL;
+	tmp->records = NULL;
+	tmp->count = 0;
+	tmp->count_max = SIGN_STATE_INDEX_MIN / 2;
+	tmp->index = NULL;
+	tmp->index_size = 0;
+	tmp->line_count = 0;
+	tmp->start_time = time(NULL);
+
+	tmp->fname = sign_state_strdup(fname);
+	tmp->records = (SIGN_STATE_RECORD*)malloc(tmp->count_max * sizeof(SIGN_STATE_RECORD));
+	if (tmp->fname == NULL || tmp->records == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = sign_state_reindex(tmp, SIGN_STATE_INDEX_MIN);
+	if (res != KT_OK) goto cleanup;
+
+	isNew = !SMART_FILE_doFileExist(fname);
+
+	res = sign_state_load(tmp, &isComplete);
+	if (res != KT_OK) goto cleanup;
+
+	/* Appending after an incomplete record would corrupt the next record. */
+	if (!isComplete) {
+		res = sign_state_rewrite(tmp);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	tmp->file = fopen(fname, "ab");
+	if (tmp->file == NULL) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	if (isNew || ftell(tmp->file) == 0) {
+		res = sign_state_writeHeader(tmp->file);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	*state = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	SIGN_STATE_close(tmp);
+
+	return res;
+}
+
+void SIGN_STATE_close(SIGN_STATE *state) {
+	size_t i = 0;
+
+	if (state == NULL) return;
+
+	if (state->file != NULL) {
+		fclose(state->file);
+
+		/* Superseded records only slow down the loading. */
+		if (state->line_count > 2 * state->count + SIGN_STATE_INDEX_MIN) {
+			sign_state_rewrite(state);
+		}
+	}
+
+	if (state->records != NULL) {
+		for (i = 0; i < state->count; i++) {
+			KSI_free(state->records[i].path);
+			KSI_free(state->records[i].sig_path);
+		}
+	}
+
+	free(state->records);
+	KSI_free(state->index);
+	KSI_free(state->fname);
+	KSI_free(state);
+}
+
+/**
+ * Returns the record of the file if the file has not changed since the record
+ * was made, NULL otherwise.
+ */
+static SIGN_STATE_RECORD *sign_state_getUnchanged(SIGN_STATE *state, const char *path, int algo_id, int *status) {
+	SIGN_STATE_RECORD *rec = NULL;
+	SIGN_STATE_RECORD current;
+
+	*status = SIGN_STATE_NEW;
+
+	rec = sign_state_find(state, path);
+	if (rec == NULL || !sign_state_stat(path, &current)) return NULL;
+
+	if (rec->dev != current.dev || rec->ino != current.ino || rec->size != current.size
+			|| rec->mtime != current.mtime || rec->imprint_len == 0 || rec->imprint[0] != (unsigned char)algo_id) {
+		*status = SIGN_STATE_MODIFIED;
+		return NULL;
+	}
+
+	*status = SIGN_STATE_UNSIGNED;
+	return rec;
+}
+
+int SIGN_STATE_check(SIGN_STATE *state, const char *path, int algo_id, int *status) {
+	SIGN_STATE_RECORD *rec = NULL;
+
+	if (state == NULL || path == NULL || status == NULL) return KT_INVALID_ARGUMENT;
+
+	rec = sign_state_getUnchanged(state, path, algo_id, status);
+	if (rec != NULL && rec->sig_path[0] != '\0' && SMART_FILE_doFileExist(rec->sig_path)) {
+		*status = SIGN_STATE_UNCHANGED;
+	}
+
+	return KT_OK;
+}
+
+int SIGN_STATE_getImprint(SIGN_STATE *state, const char *path, int algo_id, const unsigned char **imprint, size_t *imprint_len) {
+	SIGN_STATE_RECORD *rec = NULL;
+	int status = SIGN_STATE_NEW;
+
+	if (state == NULL || path == NULL || imprint == NULL || imprint_len == NULL) return KT_INVALID_ARGUMENT;
+
+	*imprint = NULL;
+	*imprint_len = 0;
+
+	rec = sign_state_getUnchanged(state, path, algo_id, &status);
+	if (rec == NULL) return KT_OK;
+
+	memcpy(state->imprint, rec->imprint, rec->imprint_len);
+	*imprint = state->imprint;
+	*imprint_len = rec->imprint_len;
+
+	return KT_OK;
+}
+
+int SIGN_STATE_record(SIGN_STATE *state, const char *path, const unsigned char *imprint, size_t imprint_len, const char *sig_path) {
+	int res;
+	SIGN_STATE_RECORD rec;
+
+	if (state == NULL || path == NULL || imprint == NULL || imprint_len == 0 || imprint_len > KSI_MAX_IMPRINT_LEN || sig_path == NULL) {
+		return KT_INVALID_ARGUMENT;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+
+	/**
+	 * A file modified during the run may have been hashed before the
+	 * modification, so it is left to be signed again by the next run.
+	 */
+	if (!sign_state_stat(path, &rec) || rec.mtime >= (KSI_uint64_t)state->start_time) {
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	memcpy(rec.imprint, imprint, imprint_len);
+	rec.imprint_len = imprint_len;
+
+	rec.path = sign_state_strdup(path);
+	rec.sig_path = sign_state_strdup(sig_path);
+	if (rec.path == NULL || rec.sig_path == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = sign_state_writeRecord(state->file, &rec);
+	if (res != KT_OK) goto cleanup;
+
+	res = sign_state_put(state, &rec);
+	if (res != KT_OK) goto cleanup;
+
+	rec.path = NULL;
+	rec.sig_path = NULL;
+	state->line_count++;
+
+cleanup:
+
+	KSI_free(rec.path);
+	KSI_free(rec.sig_path);
+
+	return res;
+}
+
+int SIGN_STATE_flush(SIGN_STATE *state) {
+	if (state == NULL) return KT_INVALID_ARGUMENT;
+	return fflush(state->file) == 0 ? KT_OK : KT_IO_ERROR;
+}
+
+size_t SIGN_STATE_getCount(SIGN_STATE *state) {
+	return state == NULL ? 0 : state->count;
+}
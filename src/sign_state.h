@@ -0,0 +1,119 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef SIGN_STATE_H
+#define	SIGN_STATE_H
+
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct SIGN_STATE_st SIGN_STATE;
+
+/**
+ * State of a file compared to the record in the state file.
+ */
+enum SIGN_STATE_STATUS_en {
+	/** There is no record of the file or the file can not be examined. */
+	SIGN_STATE_NEW = 0,
+
+	/** The file or the hash algorithm has changed since the record was made. */
+	SIGN_STATE_MODIFIED,
+
+	/** The file has not changed, but its signature does not exist any more. The digest can be reused. */
+	SIGN_STATE_UNSIGNED,
+
+	/** The file has not changed and its signature exists. */
+	SIGN_STATE_UNCHANGED
+};
+
+/**
+ * Opens the state file of incremental signing and loads its records into a
+ * hash index. If the file does not exist, it is created. Every record holds the
+ * path, device, inode, size and modification time of a signed file, together
+ * with the imprint of the file and the path of its signature. Records are only
+ * appended to the file, a later record of the same path replaces the earlier
+ * one. An incomplete record at the end of the file (e.g. when the previous run
+ * was interrupted) is ignored.
+ * \param fname		Path to the state file.
+ * \param state		Output parameter for the state.
+ * \return KT_OK if successful, KT_INVALID_INPUT_FORMAT if the file is not a
+ * valid state file, error code otherwise.
+ */
+int SIGN_STATE_open(const char *fname, SIGN_STATE **state);
+
+/**
+ * Writes the records to the file and closes the state. If most of the records
+ * in the file are superseded by later records, the file is compacted.
+ */
+void SIGN_STATE_close(SIGN_STATE *state);
+
+/**
+ * Compares the file with its record.
+ * \param state		State of incremental signing.
+ * \param path		Path to the file.
+ * \param algo_id	Hash algorithm used for signing (imprint id of the algorithm).
+ * \param status	Output parameter for the status (see #SIGN_STATE_STATUS_en).
+ * \return KT_OK if successful, error code otherwise.
+ */
+int SIGN_STATE_check(SIGN_STATE *state, const char *path, int algo_id, int *status);
+
+/**
+ * Returns the imprint of an unchanged file, so that the file does not have to be
+ * read again.
+ * \param state			State of incremental signing.
+ * \param path			Path to the file.
+ * \param algo_id		Hash algorithm used for signing.
+ * \param imprint		Output parameter for the imprint. Set to NULL if the file has
+ *						changed or there is no record. Valid until the next call.
+ * \param imprint_len	Output parameter for the length of the imprint.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int SIGN_STATE_getImprint(SIGN_STATE *state, const char *path, int algo_id, const unsigned char **imprint, size_t *imprint_len);
+
+/**
+ * Records the signed file. The file is examined again, so the record reflects
+ * its current state. Files modified during the run are not recorded, as it is
+ * not known whether the digest was calculated before or after the modification.
+ * \param state			State of incremental signing.
+ * \param path			Path to the signed file.
+ * \param imprint		Imprint of the file that was signed.
+ * \param imprint_len	Length of the imprint.
+ * \param sig_path		Path of the signature.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int SIGN_STATE_record(SIGN_STATE *state, const char *path, const unsigned char *imprint, size_t imprint_len, const char *sig_path);
+
+/**
+ * Writes the buffered records to the file.
+ */
+int SIGN_STATE_flush(SIGN_STATE *state);
+
+/**
+ * Returns the count of records in the state.
+ */
+size_t SIGN_STATE_getCount(SIGN_STATE *state);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SIGN_STATE_H */
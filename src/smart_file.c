@@ -36,6 +36,7 @@
 #	define R_OK 4
 #else
 #	include <unistd.h>
+#	include <fcntl.h>
 #	define OPENF
 #endif
 
@@ -808,6 +809,18 @@ cleanup:
 	return res;
 }
 
+int SMART_FILE_flush(SMART_FILE *file) {
+	if (file == NULL) return SMART_FILE_INVALID_ARG;
+	if (file->file == NULL || !file->isOpen) return SMART_FILE_NOT_OPENED;
+
+#ifdef WIN_HANDLE
+	/* Data written with WriteFile is not buffered by the process. */
+	return SMART_FILE_OK;
+#else
+	return fflush((FILE*)file->file) == 0 ? SMART_FILE_OK : SMART_FILE_UNABLE_TO_WRITE;
+#endif
+}
+
 int SMART_FILE_read(SMART_FILE *file, char *raw, size_t raw_len, size_t *count) {
 	int res;
 	size_t c = 0;
@@ -847,6 +860,15 @@ const char *SMART_FILE_getFname(SMART_FILE *file) {
 	return file->fname;
 }
 
+int SMART_FILE_getDescriptor(SMART_FILE *file) {
+	if (file == NULL || file->file == NULL || !file->isOpen) return -1;
+#ifdef WIN_HANDLE
+	return -1;
+#else
+	return fileno((FILE*)file->file);
+#endif
+}
+
 int SMART_FILE_isEof(SMART_FILE *file) {
 	if (file == NULL) return 0;
 	if (file->isOpen == 0) return 0;
@@ -925,6 +947,102 @@ int SMART_FILE_rename(const char *old_path, const char *new_path) {
 	return res;
 }
 
+int SMART_FILE_replace(const char *old_path, const char *new_path) {
+	int res;
+
+	if (old_path == NULL || new_path == NULL) return SMART_FILE_INVALID_ARG;
+
+#ifdef _WIN32
+	res = MoveFileEx(old_path, new_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	res = (res == 0) ? smart_file_get_error_win(GetLastError()) : SMART_FILE_OK;
+#else
+	res = rename(old_path, new_path);
+	res = (res != 0) ? smart_file_get_error_unix() : SMART_FILE_OK;
+#endif
+
+	return res;
+}
+
+int SMART_FILE_sync(const char *path) {
+	int res;
+#ifdef _WIN32
+	HANDLE hfile = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+#endif
+
+	if (path == NULL) return SMART_FILE_INVALID_ARG;
+
+#ifdef _WIN32
+	hfile = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hfile == INVALID_HANDLE_VALUE) {
+		res = smart_file_get_error_win(GetLastError());
+		goto cleanup;
+	}
+
+	if (!FlushFileBuffers(hfile)) {
+		res = smart_file_get_error_win(GetLastError());
+		goto cleanup;
+	}
+#else
+	fd = open(path, O_WRONLY);
+	if (fd == -1) {
+		res = smart_file_get_error_unix();
+		goto cleanup;
+	}
+
+	if (fsync(fd) != 0) {
+		res = SMART_FILE_UNABLE_TO_WRITE;
+		goto cleanup;
+	}
+#endif
+
+	res = SMART_FILE_OK;
+
+cleanup:
+
+#ifdef _WIN32
+	if (hfile != INVALID_HANDLE_VALUE) CloseHandle(hfile);
+#else
+	if (fd != -1) close(fd);
+#endif
+
+	return res;
+}
+
+int SMART_FILE_syncDir(const char *path) {
+#ifdef _WIN32
+	/* Directory entries can not be flushed separately, see MOVEFILE_WRITE_THROUGH in SMART_FILE_replace. */
+	if (path == NULL) return SMART_FILE_INVALID_ARG;
+	return SMART_FILE_OK;
+#else
+	int res;
+	int fd = -1;
+
+	if (path == NULL) return SMART_FILE_INVALID_ARG;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		res = smart_file_get_error_unix();
+		goto cleanup;
+	}
+
+	/* Some file systems do not support syncing directories and have nothing to sync. */
+	if (fsync(fd) != 0 && errno != EINVAL && errno != ENOTSUP) {
+		res = SMART_FILE_UNABLE_TO_WRITE;
+		goto cleanup;
+	}
+
+	res = SMART_FILE_OK;
+
+cleanup:
+
+	if (fd != -1) close(fd);
+
+	return res;
+#endif
+}
+
 int SMART_FILE_remove(const char *fname) {
 	int res;
 
@@ -76,8 +76,26 @@ int SMART_FILE_open(const char *fname, const char *mode, SMART_FILE **file);
 void SMART_FILE_close(SMART_FILE *file);
 int SMART_FILE_write(SMART_FILE *file, char *raw, size_t raw_len, size_t *count);
 int SMART_FILE_read(SMART_FILE *file, char *raw, size_t raw_len, size_t *count);
+
+/**
+ * Writes the data buffered for the file or stream (e.g. stdout) to the underlying
+ * file, so that it becomes immediately available for the reader.
+ * \param file	A smart file object opened for writing.
+ * \return SMART_FILE_OK if successful, error code otherwise.
+ */
+int SMART_FILE_flush(SMART_FILE *file);
 const char *SMART_FILE_getFname(SMART_FILE *file);
 
+/**
+ * Returns the file descriptor of the file or stream, so that the data can be
+ * moved by the kernel (e.g. with splice) without copying it to the user space.
+ * Note that the data buffered by SMART_FILE_write must be flushed first.
+ * \param file	A smart file object.
+ * \return The file descriptor or -1 if the file is not opened or the platform
+ * does not use file descriptors.
+ */
+int SMART_FILE_getDescriptor(SMART_FILE *file);
+
 /**
  * \param file	A smart file object.
  * \return A non-zero value is returned in the case that the end-of-file indicator associated with the stream is set.
@@ -93,6 +111,32 @@ int SMART_FILE_isEof(SMART_FILE *file);
  */
 int SMART_FILE_rename(const char *old_path, const char *new_path);
 
+/**
+ * Same as #SMART_FILE_rename, but the file at \c new_path is replaced if it
+ * exists. On Windows the rename is written through to the disk before the
+ * function returns.
+ * \param old_path	Path to the file for rename and / or move.
+ * \param new_path	New path.
+ * \return SMART_FILE_OK if successful, error code otherwise.
+ */
+int SMART_FILE_replace(const char *old_path, const char *new_path);
+
+/**
+ * Flushes the content of the file from the operating system caches to the
+ * storage device (see fsync).
+ * \param path	Path to the file.
+ * \return SMART_FILE_OK if successful, error code otherwise.
+ */
+int SMART_FILE_sync(const char *path);
+
+/**
+ * Flushes the directory, so that the files created, renamed or removed in it
+ * survive a crash. On Windows nothing is done.
+ * \param path	Path to the directory.
+ * \return SMART_FILE_OK if successful, error code otherwise.
+ */
+int SMART_FILE_syncDir(const char *path);
+
 /**
  * A function to delete a file (do not work on directories).
  * \param fname	Path to the file that is going to be removed.
@@ -108,6 +152,17 @@ int SMART_FILE_isFileType(const char *path, int ftype);
 
 const char* SMART_FILE_errorToString(int error_code);
 
+/**
+ * Generates a file name \c <name>_<n>.<ext> that does not exist, as used by
+ * SMART_FILE_open mode 'i'.
+ * \param fname				File name that exists.
+ * \param buf				Buffer for the new file name.
+ * \param buf_len			Size of the buffer.
+ * \param use_binary_search	If set, the first free number is found with a binary search.
+ * \return \c buf if successful, NULL otherwise.
+ */
+const char *generate_not_existing_file_name(const char *fname, char *buf, size_t buf_len, int use_binary_search);
+
 #ifdef	__cplusplus
 }
 #endif
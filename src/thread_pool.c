@@ -0,0 +1,315 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ksi/ksi.h>
+#include "thread_pool.h"
+#include "ksitool_err.h"
+
+#ifdef _WIN32
+#	include <windows.h>
+#	define WIN_THREAD
+typedef HANDLE THREAD_HANDLE;
+#else
+#	include <pthread.h>
+typedef pthread_t THREAD_HANDLE;
+#endif
+
+typedef struct WORKER_st {
+	THREAD_POOL *pool;
+	size_t id;
+	THREAD_HANDLE thread;
+	int isRunning;
+} WORKER;
+
+struct THREAD_POOL_st {
+	WORKER *workers;
+	size_t worker_count;
+
+	/* Job description of the current batch. */
+	THREAD_POOL_JOB job;
+	void *job_ctx;
+	size_t job_count;
+
+	/* Index of the next job to be taken, protected by lock. */
+	size_t job_next;
+	int job_res;
+	THREAD_LOCK lock;
+
+	int isStarted;
+};
+
+/**
+ * Takes the next job index. Returns 0 if there is nothing left to do.
+ */
+static int thread_pool_take_job(THREAD_POOL *pool, size_t *job) {
+	int ret = 0;
+
+	THREAD_LOCK_acquire(&pool->lock);
+	if (pool->job_res == KT_OK && pool->job_next < pool->job_count) {
+		*job = pool->job_next++;
+		ret = 1;
+	}
+	THREAD_LOCK_release(&pool->lock);
+
+	return ret;
+}
+
+static void thread_pool_worker(WORKER *worker) {
+	THREAD_POOL *pool = worker->pool;
+	size_t job = 0;
+
+	while (thread_pool_take_job(pool, &job)) {
+		int res = pool->job(pool->job_ctx, worker->id, job);
+
+		if (res != KT_OK) {
+			THREAD_LOCK_acquire(&pool->lock);
+			if (pool->job_res == KT_OK) pool->job_res = res;
+			THREAD_LOCK_release(&pool->lock);
+		}
+	}
+}
+
+#ifdef WIN_THREAD
+static DWORD WINAPI thread_pool_worker_win(LPVOID arg) {
+	thread_pool_worker((WORKER*)arg);
+	return 0;
+}
+#else
+static void *thread_pool_worker_unix(void *arg) {
+	thread_pool_worker((WORKER*)arg);
+	return NULL;
+}
+#endif
+
+static int thread_start(WORKER *worker) {
+#ifdef WIN_THREAD
+	worker->thread = CreateThread(NULL, 0, thread_pool_worker_win, worker, 0, NULL);
+	if (worker->thread == NULL) return KT_THREAD_ERROR;
+#else
+	if (pthread_create(&worker->thread, NULL, thread_pool_worker_unix, worker) != 0) return KT_THREAD_ERROR;
+#endif
+	worker->isRunning = 1;
+	return KT_OK;
+}
+
+static void thread_join(WORKER *worker) {
+	if (!worker->isRunning) return;
+#ifdef WIN_THREAD
+	WaitForSingleObject(worker->thread, INFINITE);
+	CloseHandle(worker->thread);
+#else
+	pthread_join(worker->thread, NULL);
+#endif
+	worker->isRunning = 0;
+}
+
+int THREAD_POOL_new(size_t worker_count, THREAD_POOL **pool) {
+	int res;
+	THREAD_POOL *tmp = NULL;
+	size_t i = 0;
+
+	if (worker_count < 1 || pool == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (THREAD_POOL*)KSI_calloc(1, sizeof(THREAD_POOL));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->workers = (WORKER*)KSI_calloc(worker_count, sizeof(WORKER));
+	if (tmp->workers == NULL) {
+		KSI_free(tmp);
+		tmp = NULL;
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	for (i = 0; i < worker_count; i++) {
+		tmp->workers[i].pool = tmp;
+		tmp->workers[i].id = i;
+		tmp->workers[i].isRunning = 0;
+	}
+
+	tmp->worker_count = worker_count;
+	tmp->isStarted = 0;
+	tmp->job_res = KT_OK;
+	THREAD_LOCK_init(&tmp->lock);
+
+	*pool = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+void THREAD_POOL_free(THREAD_POOL *pool) {
+	if (pool == NULL) return;
+
+	THREAD_POOL_wait(pool);
+	THREAD_LOCK_destroy(&pool->lock);
+	KSI_free(pool->workers);
+	KSI_free(pool);
+}
+
+size_t THREAD_POOL_getWorkerCount(THREAD_POOL *pool) {
+	return pool == NULL ? 0 : pool->worker_count;
+}
+
+int THREAD_POOL_start(THREAD_POOL *pool, size_t job_count, THREAD_POOL_JOB job, void *job_ctx) {
+	int res;
+	size_t i = 0;
+	size_t threads = 0;
+
+	if (pool == NULL || job == NULL || pool->isStarted) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	pool->job = job;
+	pool->job_ctx = job_ctx;
+	pool->job_count = job_count;
+	pool->job_next = 0;
+	pool->job_res = KT_OK;
+	pool->isStarted = 1;
+
+	/* Do not start more threads than there are jobs. */
+	threads = job_count < pool->worker_count ? job_count : pool->worker_count;
+
+	for (i = 0; i < threads; i++) {
+		res = thread_start(&pool->workers[i]);
+		if (res != KT_OK) {
+			/* Stop the workers that are already running. */
+			THREAD_LOCK_acquire(&pool->lock);
+			pool->job_res = res;
+			THREAD_LOCK_release(&pool->lock);
+			THREAD_POOL_wait(pool);
+			goto cleanup;
+		}
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+int THREAD_POOL_wait(THREAD_POOL *pool) {
+	size_t i = 0;
+
+	if (pool == NULL) return KT_INVALID_ARGUMENT;
+	if (!pool->isStarted) return KT_OK;
+
+	for (i = 0; i < pool->worker_count; i++) {
+		thread_join(&pool->workers[i]);
+	}
+
+	pool->isStarted = 0;
+
+	return pool->job_res;
+}
+
+int THREAD_POOL_run(THREAD_POOL *pool, size_t job_count, THREAD_POOL_JOB job, void *job_ctx) {
+	int res;
+
+	res = THREAD_POOL_start(pool, job_count, job, job_ctx);
+	if (res != KT_OK) return res;
+
+	return THREAD_POOL_wait(pool);
+}
+
+void THREAD_LOCK_init(THREAD_LOCK *lock) {
+#ifdef WIN_THREAD
+	InitializeCriticalSection(lock);
+#else
+	pthread_mutex_init(lock, NULL);
+#endif
+}
+
+void THREAD_LOCK_destroy(THREAD_LOCK *lock) {
+#ifdef WIN_THREAD
+	DeleteCriticalSection(lock);
+#else
+	pthread_mutex_destroy(lock);
+#endif
+}
+
+void THREAD_LOCK_acquire(THREAD_LOCK *lock) {
+#ifdef WIN_THREAD
+	EnterCriticalSection(lock);
+#else
+	pthread_mutex_lock(lock);
+#endif
+}
+
+void THREAD_LOCK_release(THREAD_LOCK *lock) {
+#ifdef WIN_THREAD
+	LeaveCriticalSection(lock);
+#else
+	pthread_mutex_unlock(lock);
+#endif
+}
+
+void THREAD_COND_init(THREAD_COND *cond) {
+#ifdef WIN_THREAD
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_init(cond, NULL);
+#endif
+}
+
+void THREAD_COND_destroy(THREAD_COND *cond) {
+#ifdef WIN_THREAD
+	/* Windows condition variables do not need to be destroyed. */
+	(void)cond;
+#else
+	pthread_cond_destroy(cond);
+#endif
+}
+
+void THREAD_COND_wait(THREAD_COND *cond, THREAD_LOCK *lock) {
+#ifdef WIN_THREAD
+	SleepConditionVariableCS(cond, lock, INFINITE);
+#else
+	pthread_cond_wait(cond, lock);
+#endif
+}
+
+void THREAD_COND_signal(THREAD_COND *cond) {
+#ifdef WIN_THREAD
+	WakeConditionVariable(cond);
+#else
+	pthread_cond_signal(cond);
+#endif
+}
+
+void THREAD_COND_broadcast(THREAD_COND *cond) {
+#ifdef WIN_THREAD
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
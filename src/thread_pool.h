@@ -0,0 +1,118 @@
+/*
+ * Copyright 2013-2018 Guardtime, Inc.
+ *
+ * This file is part of the Guardtime client SDK.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ * "Guardtime" and "KSI" are trademarks or registered trademarks of
+ * Guardtime, Inc., and no license to trademarks is granted; Guardtime
+ * reserves and retains all trademark rights.
+ */
+
+#ifndef THREAD_POOL_H
+#define	THREAD_POOL_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#	include <windows.h>
+typedef CRITICAL_SECTION THREAD_LOCK;
+typedef CONDITION_VARIABLE THREAD_COND;
+#else
+#	include <pthread.h>
+typedef pthread_mutex_t THREAD_LOCK;
+typedef pthread_cond_t THREAD_COND;
+#endif
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct THREAD_POOL_st THREAD_POOL;
+
+/**
+ * A job function executed by the worker threads. Every job is called exactly
+ * once with its index in range [0, job_count). Jobs are distributed dynamically
+ * so there is no guarantee which worker executes which job.
+ *
+ * \param job_ctx	Context given to #THREAD_POOL_start.
+ * \param worker	Index of the worker executing the job in range [0, worker_count).
+ * \param job		Index of the job.
+ * \return KT_OK if successful. Any other value stops the workers from taking new jobs.
+ */
+typedef int (*THREAD_POOL_JOB)(void *job_ctx, size_t worker, size_t job);
+
+/**
+ * Creates a new thread pool. Note that threads are not started before
+ * #THREAD_POOL_start is called.
+ * \param worker_count	Count of worker threads, must be at least 1.
+ * \param pool			Output parameter for the thread pool.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int THREAD_POOL_new(size_t worker_count, THREAD_POOL **pool);
+
+/**
+ * Waits until the workers have finished (see #THREAD_POOL_wait) and frees the pool.
+ * \param pool	Thread pool.
+ */
+void THREAD_POOL_free(THREAD_POOL *pool);
+
+size_t THREAD_POOL_getWorkerCount(THREAD_POOL *pool);
+
+/**
+ * Starts the workers to execute jobs [0, job_count) and returns immediately. The
+ * calling thread may continue with other work (e.g. network communication) and
+ * must call #THREAD_POOL_wait before the next batch can be started.
+ * \param pool		Thread pool.
+ * \param job_count	Count of jobs to be executed.
+ * \param job		Job function.
+ * \param job_ctx	Context passed to every job.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int THREAD_POOL_start(THREAD_POOL *pool, size_t job_count, THREAD_POOL_JOB job, void *job_ctx);
+
+/**
+ * Blocks until all the jobs started with #THREAD_POOL_start are finished.
+ * \param pool	Thread pool.
+ * \return KT_OK if all jobs succeeded, the first error returned by a job or error
+ * code if the workers could not be managed.
+ */
+int THREAD_POOL_wait(THREAD_POOL *pool);
+
+/**
+ * Same as calling #THREAD_POOL_start and #THREAD_POOL_wait.
+ */
+int THREAD_POOL_run(THREAD_POOL *pool, size_t job_count, THREAD_POOL_JOB job, void *job_ctx);
+
+/**
+ * Portable lock (mutex) used by the thread pool and by the other modules that
+ * share data with the worker threads.
+ */
+void THREAD_LOCK_init(THREAD_LOCK *lock);
+void THREAD_LOCK_destroy(THREAD_LOCK *lock);
+void THREAD_LOCK_acquire(THREAD_LOCK *lock);
+void THREAD_LOCK_release(THREAD_LOCK *lock);
+
+/**
+ * Portable condition variable. #THREAD_COND_wait must be called with the lock
+ * acquired, the lock is released while waiting.
+ */
+void THREAD_COND_init(THREAD_COND *cond);
+void THREAD_COND_destroy(THREAD_COND *cond);
+void THREAD_COND_wait(THREAD_COND *cond, THREAD_LOCK *lock);
+void THREAD_COND_signal(THREAD_COND *cond);
+void THREAD_COND_broadcast(THREAD_COND *cond);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* THREAD_POOL_H */
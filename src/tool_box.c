@@ -33,6 +33,14 @@
 #include "api_wrapper.h"
 #include "common.h"
 
+#ifdef _WIN32
+#	include <windows.h>
+#	include <time.h>
+#else
+#	include <sys/time.h>
+#	include <time.h>
+#endif
+
 
 
 static char *OID_EMAIL[] = {KSI_CERT_EMAIL, "E", "email", "e-mail", "e_mail", "emailAddress", NULL};
@@ -400,6 +408,17 @@ const char *PATH_URI_getPathRelativeToFile(const char *refFilePath, const char *
 	return buf;
 }
 
+static int output_type(PARAM_SET *set, int in_count, int out_count, const char *out_file) {
+	if (PARAM_SET_isSetByName(set, "replace-existing")) return OUTPUT_OVERWRITE_INPUT;
+	if (in_count == 1 && out_count == 1 && strcmp(out_file, "-") == 0) return OUTPUT_TO_STDOUT;
+	else if (out_count != 1 && in_count == out_count) return OUTPUT_SPECIFIED_FILE;
+	else if (out_count == 1 && !SMART_FILE_isFileType(out_file, SMART_FILE_TYPE_DIR) && in_count == out_count) return OUTPUT_SPECIFIED_FILE;
+	else if (out_count == 1 && SMART_FILE_isFileType(out_file, SMART_FILE_TYPE_DIR)) return OUTPUT_TO_DIR;
+	else if (out_count == 0) return OUTPUT_NEXT_TO_INPUT;
+
+	return OUTPUT_UNKNOWN;
+}
+
 int how_is_output_saved_to(PARAM_SET *set, const char *in_flags, const char *out_flags) {
 	int res;
 	int ret = OUTPUT_UNKNOWN;
@@ -418,39 +437,31 @@ int how_is_output_saved_to(PARAM_SET *set, const char *in_flags, const char *out
 	res = PARAM_SET_getStr(set, out_flags, NULL, PST_PRIORITY_NONE, 0, &out_file);
 	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
 
-	if (PARAM_SET_isSetByName(set, "replace-existing")) return OUTPUT_OVERWRITE_INPUT;
-	if (in_count == 1 && out_count == 1 && strcmp(out_file, "-") == 0) return OUTPUT_TO_STDOUT;
-	else if (out_count != 1 && in_count == out_count) return OUTPUT_SPECIFIED_FILE;
-	else if (out_count == 1 && !SMART_FILE_isFileType(out_file, SMART_FILE_TYPE_DIR) && in_count == out_count) return OUTPUT_SPECIFIED_FILE;
-	else if (out_count == 1 && SMART_FILE_isFileType(out_file, SMART_FILE_TYPE_DIR)) return OUTPUT_TO_DIR;
-	else if (out_count == 0) return OUTPUT_NEXT_TO_INPUT;
-
-	res = KT_OK;
+	ret = output_type(set, in_count, out_count, out_file);
 
 cleanup:
 
 	return ret;
 }
 
-char* get_output_file_name(PARAM_SET *set, ERR_TRCKR *err,
-		const char *in_flags, const char *out_flags, int how_is_saved, int i, char *buf, size_t buf_len,
-		int (*generate_file_name)(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags, const char *out_flags, int i, char *buf, size_t buf_len)) {
+int how_is_output_saved_to_index(PARAM_SET *set, const INPUT_INDEX *inputs) {
+	if (set == NULL || inputs == NULL) return OUTPUT_UNKNOWN;
+
+	return output_type(set, (int)INPUT_INDEX_getCount(inputs), (int)INPUT_INDEX_getOutCount(inputs), INPUT_INDEX_getOutName(inputs, 0));
+}
+
+char* get_output_file_name(ERR_TRCKR *err, const INPUT_INDEX *inputs, int how_is_saved, size_t i, char *buf, size_t buf_len,
+		int (*generate_file_name)(const INPUT_INDEX *inputs, size_t i, char *buf, size_t buf_len)) {
 	char *ret = NULL;
 	int res;
-	char *in_file_name = NULL;
+	const char *in_file_name = NULL;
 	char generated_name[1024] = "";
-	int in_count = 0;
 
-	if (set == NULL || err == NULL || buf == NULL || buf_len == 0) goto cleanup;
-
-	res = PARAM_SET_getValueCount(set, in_flags, NULL, PST_PRIORITY_NONE, &in_count);
-	if (res != PST_OK) goto cleanup;
+	if (err == NULL || inputs == NULL || buf == NULL || buf_len == 0) goto cleanup;
 
-	res = PARAM_SET_getStr(set, in_flags, NULL, PST_PRIORITY_NONE, i, &in_file_name);
-	if (res != PST_OK && res != PST_PARAMETER_EMPTY && res != PST_PARAMETER_VALUE_NOT_FOUND) goto cleanup;
-
-	if (res == PST_PARAMETER_EMPTY || res == PST_PARAMETER_VALUE_NOT_FOUND) {
-		ERR_CATCH_MSG(err, res, "Error: Unable to get input file path.");
+	in_file_name = INPUT_INDEX_getName(inputs, i);
+	if (in_file_name == NULL) {
+		ERR_CATCH_MSG(err, (res = PST_PARAMETER_VALUE_NOT_FOUND), "Error: Unable to get input file path.");
 	}
 
 
@@ -458,7 +469,7 @@ char* get_output_file_name(PARAM_SET *set, ERR_TRCKR *err,
 	 * Output file name hast to be generated.
 	 */
 	if (how_is_saved == OUTPUT_NEXT_TO_INPUT || how_is_saved == OUTPUT_TO_DIR) {
-		res = generate_file_name(set, err, in_flags, out_flags, i, generated_name, sizeof(generated_name));
+		res = generate_file_name(inputs, i, generated_name, sizeof(generated_name));
 		ERR_CATCH_MSG(err, res, "Error: Unable to generate new file name.");
 	}
 
@@ -468,10 +479,9 @@ char* get_output_file_name(PARAM_SET *set, ERR_TRCKR *err,
 	if (how_is_saved == OUTPUT_NEXT_TO_INPUT) {
 		KSI_snprintf(buf, buf_len, "%s", generated_name);
 	} else if (how_is_saved == OUTPUT_SPECIFIED_FILE) {
-		char *out_file_name = NULL;
+		const char *out_file_name = INPUT_INDEX_getOutName(inputs, i);
 
-		res = PARAM_SET_getStr(set, out_flags, NULL, PST_PRIORITY_NONE, i, &out_file_name);
-		if (res != PST_OK) goto cleanup;
+		if (out_file_name == NULL) goto cleanup;
 
 		KSI_snprintf(buf, buf_len, "%s", out_file_name);
 	} else if (how_is_saved == OUTPUT_TO_DIR) {
@@ -479,12 +489,9 @@ char* get_output_file_name(PARAM_SET *set, ERR_TRCKR *err,
 		char *file_name = NULL;
 		int path_len = 0;
 		int is_slash = 0;
-		char *out_dir_name = NULL;
-
-
-		res = PARAM_SET_getStr(set, out_flags, NULL, PST_PRIORITY_NONE, 0, &out_dir_name);
-		if (res != PST_OK) goto cleanup;
+		const char *out_dir_name = INPUT_INDEX_getOutName(inputs, 0);
 
+		if (out_dir_name == NULL) goto cleanup;
 
 		file_name = STRING_extractAbstract(generated_name, "/", NULL, tmp, sizeof(tmp), find_charAfterLastStrn, NULL, NULL) == tmp ? tmp : generated_name;
 		path_len = (int)strlen(out_dir_name);
@@ -496,10 +503,9 @@ char* get_output_file_name(PARAM_SET *set, ERR_TRCKR *err,
 				is_slash ? "" : "/",
 				file_name);
 	} else if (how_is_saved == OUTPUT_TO_STDOUT) {
-		char *out_dir_name = NULL;
+		const char *out_dir_name = INPUT_INDEX_getOutName(inputs, 0);
 
-		res = PARAM_SET_getStr(set, out_flags, NULL, PST_PRIORITY_NONE, 0, &out_dir_name);
-		if (res != PST_OK) goto cleanup;
+		if (out_dir_name == NULL) goto cleanup;
 
 		KSI_snprintf(buf, buf_len, "%s", out_dir_name);
 	} else if (how_is_saved == OUTPUT_OVERWRITE_INPUT) {
@@ -531,25 +537,27 @@ int get_smart_file_mode(ERR_TRCKR *err, int how_to_save, const char **mode) {
 
 int check_general_io_errors(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags, const char *out_flags) {
 	int res;
-	int i = 0;
-	char *fname_in = NULL;
-	char *fname_out = NULL;
-	int in_count = 0;
-	int out_count = 0;
+	size_t i = 0;
+	const char *fname_in = NULL;
+	const char *fname_out = NULL;
+	size_t in_count = 0;
+	size_t out_count = 0;
+	INPUT_INDEX *inputs = NULL;
 
 	if (set == NULL || err == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-	res = PARAM_SET_getValueCount(set, in_flags, NULL, PST_PRIORITY_NONE, &in_count);
-	if (res != PST_OK) goto cleanup;
+	res = INPUT_INDEX_new(in_flags, NULL, out_flags, &inputs);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create input index.");
 
-	res = PARAM_SET_getValueCount(set, out_flags, NULL, PST_PRIORITY_NONE, &out_count);
-	if (res != PST_OK) goto cleanup;
+	res = INPUT_INDEX_update(inputs, set);
+	ERR_CATCH_MSG(err, res, "Error: Unable to resolve the inputs.");
 
-	res = PARAM_SET_getStr(set, out_flags, NULL, PST_PRIORITY_NONE, 0, &fname_out);
-	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+	in_count = INPUT_INDEX_getCount(inputs);
+	out_count = INPUT_INDEX_getOutCount(inputs);
+	fname_out = INPUT_INDEX_getOutName(inputs, 0);
 
 	/**
 	 * Examine if there is something wrong with the output.
@@ -573,8 +581,7 @@ int check_general_io_errors(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags
 
 
 	for (i = 0; out_count > 1 && i < out_count; i++) {
-		res = PARAM_SET_getStr(set, out_flags, NULL, PST_PRIORITY_NONE, i, &fname_out);
-		if (res != PST_OK) goto cleanup;
+		fname_out = INPUT_INDEX_getOutName(inputs, i);
 
 		if (SMART_FILE_isFileType(fname_out, SMART_FILE_TYPE_DIR)) {
 			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: There are multiple outputs specified and one output is directory '%s'.", fname_out);
@@ -587,8 +594,7 @@ int check_general_io_errors(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags
 	 * Check if there is something wrong with the input.
 	 */
 	for (i = 0; i < in_count; i++) {
-		res = PARAM_SET_getStr(set, in_flags, NULL, PST_PRIORITY_NONE, i, &fname_in);
-		if (res != PST_OK) goto cleanup;
+		fname_in = INPUT_INDEX_getName(inputs, i);
 
 		if (SMART_FILE_isFileType(fname_in, SMART_FILE_TYPE_DIR)) {
 			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Input can not be directory ('%s').", fname_in);
@@ -600,5 +606,42 @@ int check_general_io_errors(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags
 
 cleanup:
 
+	INPUT_INDEX_free(inputs);
+
 	return res;
 }
+
+KSI_uint64_t getTimeInMicros(void) {
+	KSI_uint64_t t = 0;
+#ifdef _WIN32
+	SYSTEMTIME t2;
+	KSI_uint64_t time_ms;
+	GetSystemTime(&t2);
+	time_ms = (KSI_uint64_t)time(NULL) * 1000 + t2.wMilliseconds;
+	t = time_ms * (KSI_uint64_t)1000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	t = (KSI_uint64_t)tv.tv_sec * 1000000 + (KSI_uint64_t)tv.tv_usec;
+#endif
+	return t;
+}
+
+void sleepWithBackoff(unsigned *delay_ms, unsigned max_ms) {
+#ifndef _WIN32
+	struct timespec ts;
+#endif
+
+	if (delay_ms == NULL) return;
+
+	*delay_ms = (*delay_ms == 0) ? 1 : *delay_ms * 2;
+	if (*delay_ms > max_ms) *delay_ms = max_ms;
+
+#ifdef _WIN32
+	Sleep((DWORD)*delay_ms);
+#else
+	ts.tv_sec = *delay_ms / 1000;
+	ts.tv_nsec = (long)(*delay_ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+#endif
+}
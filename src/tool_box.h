@@ -20,8 +20,10 @@
 #ifndef TOOL_BOX_H
 #define	TOOL_BOX_H
 
+#include <ksi/ksi.h>
 #include "param_set/param_set.h"
 #include "err_trckr.h"
+#include "input_index.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -200,13 +202,21 @@ const char *PATH_URI_getPathRelativeToFile(const char *refFilePath, const char *
  */
 int how_is_output_saved_to(PARAM_SET *set, const char *in_flags, const char *out_flags);
 
+/**
+ * Same as #how_is_output_saved_to, but the input and output counts are taken
+ * from the input index. Use it when the inputs of the index differ from the
+ * values in the parameter set (e.g. the unchanged inputs are removed).
+ * \param set			Parameter set.
+ * \param inputs		Input index with the input and output flags resolved.
+ * \return Output type.
+ */
+int how_is_output_saved_to_index(PARAM_SET *set, const INPUT_INDEX *inputs);
+
 /**
  * Generates output file name. Use how_is_output_saved_to determine the output
  * type.
- * \param set					Parameter set.
  * \param err					Error tracker.
- * \param in_flags				Input flags e.g. (i,input1,input2).
- * \param out_flags				Output flags e.g. (o). Only a single value makes sense.
+ * \param inputs				Input index with the input and output flags (e.g. i,input and o) resolved.
  * \param how_is_saved			Use how_is_output_saved_to to determine the output type.
  * \param i						The index of the file names requested.
  * \param buf					The buffer to be filled with the file name.
@@ -214,9 +224,8 @@ int how_is_output_saved_to(PARAM_SET *set, const char *in_flags, const char *out
  * \param generate_file_name	A function used to generate the file name.
  * \return buf if successful, NULL otherwise.
  */
-char* get_output_file_name(PARAM_SET *set, ERR_TRCKR *err,
-		const char *in_flags, const char *out_flags, int how_is_saved, int i, char *buf, size_t buf_len,
-		int (*generate_file_name)(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags, const char *out_flags, int i, char *buf, size_t buf_len));
+char* get_output_file_name(ERR_TRCKR *err, const INPUT_INDEX *inputs, int how_is_saved, size_t i, char *buf, size_t buf_len,
+		int (*generate_file_name)(const INPUT_INDEX *inputs, size_t i, char *buf, size_t buf_len));
 
 /**
  * Get SMART_FILE mode from the output save strategy. See how_is_output_saved_to
@@ -241,6 +250,21 @@ int get_smart_file_mode(ERR_TRCKR *err, int how_to_save, const char **mode);
  */
 int check_general_io_errors(PARAM_SET *set, ERR_TRCKR *err, const char *input_flags, const char *output_flag);
 
+/**
+ * Returns the current wall-clock time in microseconds.
+ */
+KSI_uint64_t getTimeInMicros(void);
+
+/**
+ * Sleeps for an increasing time while waiting for something that can only be
+ * polled (e.g. responses of the asynchronous service). The delay starts from
+ * 1 ms and is doubled on every call up to \c max_ms. Set \c delay_ms to 0 when
+ * the wait is over, so that the next wait starts with a short delay again.
+ * \param delay_ms	Delay of the previous call in milliseconds, updated.
+ * \param max_ms	Maximum delay in milliseconds.
+ */
+void sleepWithBackoff(unsigned *delay_ms, unsigned max_ms);
+
 #ifdef	__cplusplus
 }
 #endif
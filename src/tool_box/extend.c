@@ -33,6 +33,8 @@
 #include "tool_box/task_initializer.h"
 #include "tool_box.h"
 #include "smart_file.h"
+#include "durable.h"
+#include "calendar_cache.h"
 #include "err_trckr.h"
 #include "api_wrapper.h"
 #include "printer.h"
@@ -42,9 +44,71 @@
 #include "tool.h"
 #include "common.h"
 
-static int extend_to_nearest_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext);
-static int extend_to_specified_time(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, COMPOSITE *extra, KSI_Signature *sig, KSI_Signature **ext);
-static int extend_to_specified_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext);
+/**
+ * The publications file shared by all the signatures extended in a run. It is
+ * received and verified before the first signature is extended and received
+ * again only when it is older than --pubfile-max-age seconds.
+ */
+typedef struct PUBFILE_CACHE_st {
+	/* The verified publications file or NULL if it is not received yet. */
+	KSI_PublicationsFile *pubFile;
+
+	/* Time the publications file was received. */
+	time_t received;
+
+	/* Maximum age of the publications file in seconds. 0 if it is never refreshed. */
+	int max_age;
+
+	/* Count of times the publications file is received and verified. */
+	size_t receive_count;
+
+	/* Count of signatures the publications file is requested for. */
+	size_t use_count;
+
+	/* Total time spent on receiving and verifying the publications file in microseconds. */
+	KSI_uint64_t receive_time;
+
+	/* Part of receive_time spent on verifying the publications file in microseconds. */
+	KSI_uint64_t verify_time;
+} PUBFILE_CACHE;
+
+/**
+ * The calendar hash chains received from the extender. A signature with the same
+ * aggregation time extended to the same publication gets the same calendar hash
+ * chain, so the extender is asked only for the chains not received yet. The last
+ * chain received is shared by the group of signatures with the same signing time
+ * (see plan_extending) and all the chains can be kept in a file shared between
+ * the runs and the processes (see --calendar-cache).
+ */
+typedef struct CHAIN_CACHE_st {
+	/* The calendar cache or NULL if it is not used. */
+	CALENDAR_CACHE *cache;
+
+	/* The last chain received (see #CALENDAR_CACHE_extract), its aggregation time and publication time. */
+	unsigned char *last;
+	size_t last_len;
+	KSI_uint64_t last_aggr_time;
+	KSI_uint64_t last_pub_time;
+
+	/* Set if the last signature was extended by the extender and the chain must be stored. */
+	int pending;
+
+	/* Aggregation time and publication time of the last signature extended. */
+	KSI_uint64_t aggr_time;
+	KSI_uint64_t pub_time;
+
+	/* Count of signatures extended with the chain of the group and with a chain from the calendar cache. */
+	size_t group_hits;
+	size_t hits;
+
+	/* Count of extending and configuration requests sent to the extender. */
+	size_t ext_requests;
+	size_t conf_requests;
+} CHAIN_CACHE;
+
+static int extend_to_nearest_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, PUBFILE_CACHE *pubfiles, CHAIN_CACHE *chains, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext);
+static int extend_to_specified_time(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, COMPOSITE *extra, KSI_Signature *sig, CHAIN_CACHE *chains, KSI_Signature **ext);
+static int extend_to_specified_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, PUBFILE_CACHE *pubfiles, CHAIN_CACHE *chains, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext);
 static int generate_tasks_set(PARAM_SET *set, TASK_SET *task_set);
 static int check_pipe_errors(PARAM_SET *set, ERR_TRCKR *err);
 static int check_other_input_param_errors(PARAM_SET *set, ERR_TRCKR *err);
@@ -58,7 +122,13 @@ enum EXTEND_TASKS_en {
 	EXTENDER_DUMP_CONF
 };
 
-#define PARAMS "{i}{input}{o}{d}{x}{T}{pub-str}{dump}{dump-conf}{conf}{log}{h|help}{replace-existing}"
+/* Default count of extending requests in flight with --async. */
+#define EXTEND_ASYNC_WINDOW_DEFAULT 64
+
+/* Maximum time in milliseconds to sleep between polls of the asynchronous extending service. */
+#define EXTEND_ASYNC_POLL_MAX_MS 50
+
+#define PARAMS "{i}{input}{o}{d}{x}{T}{pub-str}{dump}{dump-conf}{conf}{log}{h|help}{replace-existing}{bundle}{durable}{pubfile-max-age}{calendar-cache}{async}{async-window}"
 
 int extend_run(int argc, char** argv, char **envp) {
 	int res;
@@ -86,6 +156,12 @@ int extend_run(int argc, char** argv, char **envp) {
 	res = TASK_INITIALIZER_getServiceInfo(set, argc, argv, envp);
 	if (res != PST_OK) goto cleanup;
 
+	/* With --bundle the inputs are names or hash imprints of the entries in the bundle, not files. */
+	if (PARAM_SET_isSetByName(set, "bundle")) {
+		PARAM_SET_addControl(set, "{i}", isFormatOk_inputFile, NULL, NULL, extract_inputSignature);
+		PARAM_SET_addControl(set, "{input}", isFormatOk_inputFile, NULL, NULL, extract_inputSignatureFromFile);
+	}
+
 	res = TASK_INITIALIZER_check_analyze_report(set, task_set, 0.5, 0.1, &task);
 	if (res != KT_OK) goto cleanup;
 
@@ -139,9 +215,15 @@ char *extend_help_toString(char *buf, size_t len) {
 	PARAM_SET_setPrintName(set, "input", "--", NULL); /* Temporary name change for formatting help text. */
 	PARAM_SET_setHelpText(set, "input", NULL, "If used everything specified after the token is interpreted as input file (command-line parameters (e.g. --conf, -d), stdin (-) and pre-calculated hash imprints (SHA-256:7647c6...) are all interpreted as regular files).");
 	PARAM_SET_setHelpText(set, "i", "<in.ksig>", "File path to the KSI signature file to be extended. Use '-' as the path to read the signature from stdin.\nFlag -i can be omitted when specifying the input. To interpret all inputs as regular files no matter what the file's name is see parameter --.");
+	PARAM_SET_setHelpText(set, "bundle", "<file>", "Read the signatures to be extended from the signature bundle created by sign --bundle. The inputs are then the names of the entries (e.g. the names of the signed files) or the document hash imprints (<alg>:<hash in hex>) of the signatures. Only the requested signatures are read from the bundle. The extended signatures are saved to separate files.");
 	PARAM_SET_setHelpText(set, "o", "<out.ksig>", "Specify the output file path for the extended signature. Use '-' as the path to redirect the signature binary stream to stdout. If not specified, the output is saved to the same directory where the input file is located. If specified as directory, all the signatures are saved there. When signature's output file name is not explicitly specified the signature is saved to <input[.E]>.ext.ksig or <input[.E]>.ext_<nr>.ksig where E is input file extension that is NOT equal to ksig and nr is auto-incremented counter if the output file already exists. If output file name is explicitly specified, will always overwrite the existing file.");
 	PARAM_SET_setHelpText(set, "pub-str", "<str>", "Publication string that denotes to existing publication record in KSI publications file to extend to.");
 	PARAM_SET_setHelpText(set, "replace-existing", NULL, "Replace input KSI signature with the successfully extended version.");
+	PARAM_SET_setHelpText(set, "durable", NULL, "Make sure that the extended signatures survive a crash or a power loss before they are reported as saved. Every signature is written to a temporary file, the files are flushed to the storage device in batches, renamed to their final names and the directory is flushed. With --replace-existing the input signature is replaced atomically. Can not be used when the signature is written to stdout.");
+	PARAM_SET_setHelpText(set, "pubfile-max-age", "<sec>", "The publications file is received and verified once and used for all the signatures extended. Receive and verify it again when it is older than the given count of seconds. By default the publications file is not refreshed during the run.");
+	PARAM_SET_setHelpText(set, "async", NULL, "Extend the signatures with asynchronous extending service. Up to --async-window extending requests are sent without waiting for the responses and every extended signature is verified and saved as its response arrives. Can not be combined with -T and --apply-remote-conf.");
+	PARAM_SET_setHelpText(set, "async-window", "<int>", "Maximum count of extending requests in flight when --async is used. Default is 64.");
+	PARAM_SET_setHelpText(set, "calendar-cache", "<file>", "Keep the calendar hash chains received from the extender in the given file and reuse them for the signatures with the same aggregation time extended to the same publication. A cached chain is used only if the extended signature passes the internal verification and the verification with the publications file. The file is created if it does not exist and can be shared by concurrent processes. Can not be combined with -T.");
 	PARAM_SET_setHelpText(set, "dump-conf", NULL, "Dump extender configuration to stdout.");
 	PARAM_SET_setHelpText(set, "apply-remote-conf", NULL, "Obtain and apply configuration data from extender service server. Following configuration is received from server:"
 																"\\>2\n*\\>4 Calendar first time - aggregation time of the oldest calendar record the extender has."
@@ -162,7 +244,7 @@ char *extend_help_toString(char *buf, size_t len) {
 			"[--pub-str <str>] [more_options] [--] input...\\>1\n\\>4"
 			"ksi extend -X <URL> [--ext-user <user> --ext-key <key>] --dump-conf\\>\n\n\n");
 
-	ret = PARAM_SET_helpToString(set, "i,o,X,ext-user,ext-key,ext-hmac-alg,P,cnstr,pub-str,replace-existing,V,input,d,dump,dump-conf,conf,apply-remote-conf,log", 1, 13, 80, buf + count, len - count);
+	ret = PARAM_SET_helpToString(set, "i,bundle,o,X,ext-user,ext-key,ext-hmac-alg,P,cnstr,pub-str,pubfile-max-age,calendar-cache,async,async-window,replace-existing,durable,V,input,d,dump,dump-conf,conf,apply-remote-conf,log", 1, 13, 80, buf + count, len - count);
 
 cleanup:
 	if (res != PST_OK || ret == NULL) {
@@ -176,7 +258,7 @@ const char *extend_get_desc(void) {
 	return "Extends existing KSI signature to the given publication.";
 }
 
-static int save_extended(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *ext, const char *fname, const char *mode) {
+static int save_extended(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *ext, const char *fname, const char *mode, DURABLE_BATCH *durable) {
 	int res = KT_UNKNOWN_ERROR;
 	char real_output_name[1024];
 	char temp_file_name[1024];
@@ -197,7 +279,30 @@ static int save_extended(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signa
 			ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Write mode specified '%s' do not contain f.", mode);
 			goto cleanup;
 		}
+	}
+
+	/**
+	 * The signature is written to a temporary file that replaces the original
+	 * (or gets its name) when the batch is committed, so no backup is needed.
+	 */
+	if (durable != NULL) {
+		print_progressDesc(d, "Saving signature... ");
+		res = KSI_OBJ_saveSignature(err, ksi, ext, "wbi", DURABLE_getTempName(fname, temp_file_name, sizeof(temp_file_name)), real_output_name, sizeof(real_output_name));
+		if (res != KT_OK) goto cleanup;
+
+		res = DURABLE_BATCH_add(durable, real_output_name, fname, strchr(mode, 'i') != NULL);
+		if (res != KT_OK) {
+			SMART_FILE_remove(real_output_name);
+			ERR_TRCKR_ADD(err, res, "Error: Unable to add signature file '%s' to the batch.", real_output_name);
+			goto cleanup;
+		}
+		print_progressResult(res);
 
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	if (is_replace) {
 		print_progressDesc(d, "Creating backup... ");
 
 		srand(0xffffffff & time(NULL));
@@ -243,7 +348,7 @@ cleanup:
 	return res;
 }
 
-static int verify_and_save(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *ext, KSI_PublicationsFile* pubFile, const char *fname, const char *mode, KSI_PolicyVerificationResult **result) {
+static int verify_and_save(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *ext, KSI_PublicationsFile* pubFile, int fromExtender, const char *fname, const char *mode, DURABLE_BATCH *durable, KSI_PolicyVerificationResult **result) {
 	int res;
 	int d;
 
@@ -255,12 +360,23 @@ static int verify_and_save(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Sig
 
 	d = PARAM_SET_isSetByName(set, "d");
 
+	/**
+	 * A signature extended to a publication is verified with the verified
+	 * publications file, so the extender is not asked again. A signature without
+	 * a publication record is verified internally only if its calendar hash chain
+	 * was just received from the extender. A chain from any other source (e.g. the
+	 * calendar cache shared with other processes) is checked with the extender.
+	 */
 	print_progressDesc(d, "Verifying extended signature... ");
-	res = KSITOOL_SignatureVerify_with_publications_file_or_calendar(err, ext, ksi, NULL, pubFile, 1, result);
+	if (fromExtender || KSITOOL_Signature_isPublicationRecordPresent(ext)) {
+		res = KSITOOL_SignatureVerify_with_publications_file_or_internally(err, ext, ksi, NULL, pubFile, result);
+	} else {
+		res = KSITOOL_SignatureVerify_with_publications_file_or_calendar(err, ext, ksi, NULL, pubFile, 0, result);
+	}
 	ERR_CATCH_MSG(err, res, "Error: Unable to verify extended signature.");
 	print_progressResult(res);
 
-	res = save_extended(set, err, ksi, ext, fname, mode);
+	res = save_extended(set, err, ksi, ext, fname, mode, durable);
 	if (res != KT_OK) goto cleanup;
 
 	res = KT_OK;
@@ -271,6 +387,37 @@ cleanup:
 	return res;
 }
 
+/**
+ * Commits the extended signatures saved since the last commit (see --durable)
+ * and reports the signatures that are saved.
+ */
+static int commit_durable(ERR_TRCKR *err, DURABLE_BATCH *durable, int d) {
+	int res;
+	size_t failed = 0;
+	size_t n = 0;
+
+	if (DURABLE_BATCH_getCount(durable) == 0) return KT_OK;
+
+	print_progressDesc(d, "Flushing %u signature%s... ", (unsigned)DURABLE_BATCH_getCount(durable), DURABLE_BATCH_getCount(durable) > 1 ? "s" : "");
+	res = DURABLE_BATCH_commit(durable, &failed);
+	print_progressResult(res);
+
+	for (n = 0; n < failed; n++) {
+		print_debug("Signature saved to '%s'.\n", DURABLE_BATCH_getFname(durable, n));
+	}
+
+	if (res != KT_OK) {
+		ERR_TRCKR_ADD(err, res, "Error: %s", KSITOOL_errToString(res));
+		if (failed < DURABLE_BATCH_getCount(durable)) {
+			ERR_TRCKR_ADD(err, res, "Error: Unable to make signature file '%s' durable.", DURABLE_BATCH_getFname(durable, failed));
+		}
+	}
+
+	DURABLE_BATCH_reset(durable);
+
+	return res;
+}
+
 static int obtain_remote_conf(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, size_t *calFirst, size_t *calLast) {
 	int res = KT_UNKNOWN_ERROR;
 	KSI_Config *config = NULL;
@@ -311,53 +458,443 @@ cleanup:
 	return res;
 }
 
-static int extend_to_nearest_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext) {
+/**
+ * Gets the publications file from the cache. The publications file is received
+ * and verified if it is not received yet or it is older than the maximum age.
+ * The returned publications file is owned by the cache and must not be freed.
+ */
+static int get_publications_file(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, PUBFILE_CACHE *pubfiles, KSI_PublicationsFile **pubFile) {
 	int res;
 	int d = 0;
-	KSI_Signature *tmp = NULL;
-	KSI_PublicationsFile *pubFile = NULL;
-	KSI_PublicationRecord *pubRec = NULL;
+	KSI_PublicationsFile *tmp = NULL;
+	KSI_uint64_t start = 0;
 
-	if (set == NULL || ksi == NULL || err == NULL || sig == NULL || ext == NULL) {
+	if (set == NULL || ksi == NULL || err == NULL || pubfiles == NULL || pubFile == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
 	d = PARAM_SET_isSetByName(set, "d");
+	pubfiles->use_count++;
+
+	if (pubfiles->pubFile != NULL && (pubfiles->max_age == 0 || time(NULL) - pubfiles->received < pubfiles->max_age)) {
+		*pubFile = pubfiles->pubFile;
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	start = getTimeInMicros();
+
+	/* The context keeps its own copy of the publications file, drop it to receive a new one. */
+	if (pubfiles->pubFile != NULL) {
+		print_debug("Publications file is older than %i seconds.\n", pubfiles->max_age);
+
+		res = KSI_CTX_setPublicationsFile(ksi, NULL);
+		ERR_CATCH_MSG(err, res, "Error: Unable to release the outdated publications file.");
+	}
 
 	print_progressDesc(d, "%s", getPublicationsFileRetrieveDescriptionString(set));
-	res = KSITOOL_receivePublicationsFile(err, ksi, &pubFile);
+	res = KSITOOL_receivePublicationsFile(err, ksi, &tmp);
 	ERR_CATCH_MSG(err, res, "Error: Unable receive publications file.");
 	print_progressResult(res);
 
 	if (!PARAM_SET_isSetByName(set, "publications-file-no-verify")) {
+		KSI_uint64_t verify_start = getTimeInMicros();
+
 		print_progressDesc(d, "Verifying publications file... ");
-		res = KSITOOL_verifyPublicationsFile(err, ksi, pubFile);
+		res = KSITOOL_verifyPublicationsFile(err, ksi, tmp);
 		ERR_CATCH_MSG(err, res, "Error: Unable to verify publications file.");
 		print_progressResult(res);
+
+		pubfiles->verify_time += getTimeInMicros() - verify_start;
 	}
 
-	/* Obtain configuration from server. */
-	if (PARAM_SET_isSetByName(set, "apply-remote-conf")) {
-		KSI_PublicationData *pubData = NULL;
-		KSI_Integer *sigTime = NULL;
-		KSI_Integer *pubTime = NULL;
-		size_t calFirst = 0;
-		size_t calLast = 0;
+	KSI_PublicationsFile_free(pubfiles->pubFile);
+	pubfiles->pubFile = tmp;
+	pubfiles->received = time(NULL);
+	pubfiles->receive_count++;
+	pubfiles->receive_time += getTimeInMicros() - start;
+	tmp = NULL;
+
+	*pubFile = pubfiles->pubFile;
+	res = KT_OK;
+
+cleanup:
+	print_progressResult(res);
+
+	KSI_PublicationsFile_free(tmp);
+
+	return res;
+}
+
+/**
+ * Applies the calendar hash chain (and the publication record if
+ * \c withPublication is set) to the signature. \c ext is set to NULL if the
+ * chain is not usable: the entry is corrupted, it has no publication record when
+ * one is needed or the extended signature does not pass the internal verification.
+ */
+static int apply_cached_chain(KSI_CTX *ksi, const unsigned char *raw, size_t raw_len, const unsigned char *data, size_t data_len, int withPublication, KSI_Signature **ext) {
+	int res;
+	unsigned char *out = NULL;
+	size_t out_len = 0;
+
+	*ext = NULL;
+
+	res = CALENDAR_CACHE_apply(raw, raw_len, data, data_len, withPublication, &out, &out_len);
+	if (res == KT_OK && out != NULL) {
+		KSI_Signature_parseWithPolicy(ksi, out, (unsigned)out_len, KSI_VERIFICATION_POLICY_INTERNAL, NULL, ext);
+	}
+
+	KSI_free(out);
+
+	return res == KT_OUT_OF_MEMORY ? res : KT_OK;
+}
+
+/**
+ * Extends the signature with the calendar hash chain of its group or the one
+ * found from the calendar cache. The extended signature must pass the internal
+ * verification, otherwise the cached chain is ignored. \c ext is set to NULL if
+ * the signature must be extended by the extender. In that case the chain
+ * received is kept by #store_calendar_chain.
+ */
+static int extend_from_cached_chain(ERR_TRCKR *err, KSI_CTX *ksi, int d, CHAIN_CACHE *chains, KSI_Signature *sig, KSI_Integer *pubTime, int withPublication, KSI_Signature **ext) {
+	int res;
+	KSI_Integer *sigTime = NULL;
+	unsigned char *data = NULL;
+	size_t data_len = 0;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	KSI_Signature *tmp = NULL;
+
+	if (err == NULL || ksi == NULL || chains == NULL || sig == NULL || pubTime == NULL || ext == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	*ext = NULL;
+	chains->pending = 0;
+
+	res = KSI_Signature_getSigningTime(sig, &sigTime);
+	ERR_CATCH_MSG(err, res, "Error: Unable to get signing time.");
+
+	chains->aggr_time = KSI_Integer_getUInt64(sigTime);
+	chains->pub_time = KSI_Integer_getUInt64(pubTime);
+
+	if (chains->last != NULL && chains->last_aggr_time == chains->aggr_time && chains->last_pub_time == chains->pub_time) {
+		print_progressDesc(d, "Extending the signature with the calendar hash chain of the group... ");
+
+		res = KSI_Signature_serialize(sig, &raw, &raw_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to serialize signature.");
+
+		res = apply_cached_chain(ksi, raw, raw_len, chains->last, chains->last_len, withPublication, &tmp);
+		ERR_CATCH_MSG(err, res, "Error: Unable to apply the calendar hash chain.");
+
+		print_progressResult(tmp != NULL ? KT_OK : KT_INVALID_INPUT_FORMAT);
+		if (tmp != NULL) chains->group_hits++;
+	}
+
+	if (tmp == NULL && chains->cache != NULL) {
+		res = CALENDAR_CACHE_get(chains->cache, chains->aggr_time, chains->pub_time, &data, &data_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to read the calendar cache.");
+
+		if (data != NULL) {
+			print_progressDesc(d, "Extending the signature with the cached calendar hash chain... ");
+
+			if (raw == NULL) {
+				res = KSI_Signature_serialize(sig, &raw, &raw_len);
+				ERR_CATCH_MSG(err, res, "Error: Unable to serialize signature.");
+			}
+
+			/* A corrupted or incomplete entry is handled as it was not found. */
+			res = apply_cached_chain(ksi, raw, raw_len, data, data_len, withPublication, &tmp);
+			ERR_CATCH_MSG(err, res, "Error: Unable to apply the calendar hash chain.");
+
+			print_progressResult(tmp != NULL ? KT_OK : KT_INVALID_INPUT_FORMAT);
+			if (tmp != NULL) chains->hits++;
+		}
+	}
+
+	if (tmp == NULL) {
+		if (raw != NULL) print_debug("Cached calendar hash chain is not usable, asking the extender.\n");
+		chains->pending = 1;
+	}
+
+	*ext = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+	print_progressResult(res);
+
+	KSI_free(data);
+	KSI_free(raw);
+	KSI_Signature_free(tmp);
+
+	return res;
+}
+
+/**
+ * Keeps the calendar hash chain of the verified extended signature for the rest
+ * of its group and stores it to the calendar cache if it was received from the
+ * extender.
+ */
+static int store_calendar_chain(ERR_TRCKR *err, CHAIN_CACHE *chains, KSI_Signature *ext) {
+	int res;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	unsigned char *data = NULL;
+	size_t data_len = 0;
+
+	if (err == NULL || chains == NULL || ext == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (!chains->pending) {
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	res = KSI_Signature_serialize(ext, &raw, &raw_len);
+	ERR_CATCH_MSG(err, res, "Error: Unable to serialize extended signature.");
+
+	res = CALENDAR_CACHE_extract(raw, raw_len, &data, &data_len);
+	ERR_CATCH_MSG(err, res, "Error: Unable to extract the calendar hash chain from the extended signature.");
+
+	if (chains->cache != NULL) {
+		res = CALENDAR_CACHE_put(chains->cache, chains->aggr_time, chains->pub_time, data, data_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to write the calendar cache.");
+	}
+
+	KSI_free(chains->last);
+	chains->last = data;
+	chains->last_len = data_len;
+	chains->last_aggr_time = chains->aggr_time;
+	chains->last_pub_time = chains->pub_time;
+	data = NULL;
+
+	chains->pending = 0;
+	res = KT_OK;
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_free(data);
+
+	return res;
+}
+
+typedef struct EXTEND_PLAN_ITEM_st {
+	KSI_uint64_t sigTime;
+
+	/* Index of the input. */
+	size_t i;
+
+	/* Number of the group of the signatures with the same signing time. */
+	size_t group;
+} EXTEND_PLAN_ITEM;
+
+static int compare_plan_items(const void *a, const void *b) {
+	const EXTEND_PLAN_ITEM *x = (const EXTEND_PLAN_ITEM*)a;
+	const EXTEND_PLAN_ITEM *y = (const EXTEND_PLAN_ITEM*)b;
+
+	if (x->sigTime != y->sigTime) return x->sigTime < y->sigTime ? -1 : 1;
+	if (x->i != y->i) return x->i < y->i ? -1 : 1;
+	return 0;
+}
+
+/**
+ * Reads all the input signatures and orders the inputs by signing time. The
+ * publication a signature is extended to depends only on its signing time, so
+ * the signatures of a group with the same signing time are extended one after
+ * another, only the first one of the group is sent to the extender and the rest
+ * get the calendar hash chain received for it. The signatures are read again when
+ * extended, as keeping all of them in memory does not scale.
+ * If the signature is read from stdin, it can not be read twice and the inputs
+ * are extended in the given order.
+ * \param set			Parameter set.
+ * \param err			Error tracker.
+ * \param inputs		Resolved inputs.
+ * \param extra		Extra context for reading the signatures.
+ * \param plan		Output parameter for the inputs in the order of extending. Free with #KSI_free.
+ * \param groups		Output parameter for the count of groups, 0 if the inputs are not grouped.
+ */
+static int plan_extending(PARAM_SET *set, ERR_TRCKR *err, const INPUT_INDEX *inputs, COMPOSITE *extra, EXTEND_PLAN_ITEM **plan, size_t *groups) {
+	int res;
+	int d = 0;
+	size_t i = 0;
+	size_t in_count = 0;
+	size_t group_count = 0;
+	int isGrouped = 1;
+	EXTEND_PLAN_ITEM *items = NULL;
+	KSI_Signature *sig = NULL;
+	KSI_Integer *sigTime = NULL;
+
+	if (set == NULL || err == NULL || inputs == NULL || extra == NULL || plan == NULL || groups == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	d = PARAM_SET_isSetByName(set, "d");
+	in_count = INPUT_INDEX_getCount(inputs);
+
+	items = (EXTEND_PLAN_ITEM*)KSI_malloc((in_count > 0 ? in_count : 1) * sizeof(EXTEND_PLAN_ITEM));
+	if (items == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	for (i = 0; i < in_count; i++) {
+		items[i].sigTime = 0;
+		items[i].i = i;
+		items[i].group = i;
+
+		/* Parameter -i is the first one in the index. */
+		if (INPUT_INDEX_getParam(inputs, i) == 0 && strcmp(INPUT_INDEX_getName(inputs, i), "-") == 0) isGrouped = 0;
+	}
+
+	if (in_count < 2 || !isGrouped) {
+		*plan = items;
+		*groups = 0;
+		items = NULL;
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	print_progressDesc(d, "Grouping the signatures by signing time... ");
+	for (i = 0; i < in_count; i++) {
+		res = INPUT_INDEX_getObj(inputs, set, i, extra, (void**)&sig);
+		if (res != PST_OK) goto cleanup;
 
+		res = KSI_Signature_getSigningTime(sig, &sigTime);
+		ERR_CATCH_MSG(err, res, "Error: Unable to get signing time of '%s'.", INPUT_INDEX_getName(inputs, i));
+
+		items[i].sigTime = KSI_Integer_getUInt64(sigTime);
+
+		KSI_Signature_free(sig);
+		sig = NULL;
+	}
+
+	qsort(items, in_count, sizeof(EXTEND_PLAN_ITEM), compare_plan_items);
+
+	for (i = 0; i < in_count; i++) {
+		if (i > 0 && items[i].sigTime != items[i - 1].sigTime) group_count++;
+		items[i].group = group_count;
+	}
+	print_progressResult(KT_OK);
+
+	*plan = items;
+	*groups = group_count + 1;
+	items = NULL;
+	res = KT_OK;
+
+cleanup:
+	print_progressResult(res);
+
+	KSI_Signature_free(sig);
+	KSI_free(items);
+
+	return res;
+}
+
+/**
+ * Finds the publication the signature is extended to: the publication given with
+ * --pub-str or the nearest publication after the signing time. The returned
+ * publication record is owned by the caller. If there is no such publication in
+ * the publications file, pubRec and pubTime are set to NULL.
+ */
+static int find_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, PUBFILE_CACHE *pubfiles, int task_id, KSI_Signature *sig, KSI_PublicationsFile **pubFile, KSI_PublicationRecord **pubRec, KSI_Integer **pubTime) {
+	int res;
+	KSI_PublicationsFile *tmp_pubFile = NULL;
+	KSI_PublicationRecord *tmp = NULL;
+	KSI_PublicationData *pubData = NULL;
+	KSI_Integer *sigTime = NULL;
+	KSI_Integer *tmp_time = NULL;
+	char *pubs_str = NULL;
+
+	if (set == NULL || err == NULL || ksi == NULL || pubfiles == NULL || sig == NULL || pubFile == NULL || pubRec == NULL || pubTime == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = get_publications_file(set, err, ksi, pubfiles, &tmp_pubFile);
+	if (res != KT_OK) goto cleanup;
+
+	if (task_id == EXTEND_TO_PUB_STR) {
+		KSI_PublicationRecord *found = NULL;
+
+		res = PARAM_SET_getStr(set, "pub-str", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &pubs_str);
+		ERR_CATCH_MSG(err, res, "Error: Unable get publication string.");
+
+		res = KSI_PublicationsFile_getPublicationDataByPublicationString(tmp_pubFile, pubs_str, &found);
+		ERR_CATCH_MSG(err, res, "Error: Unable get publication record from publications file.");
+
+		/* The record found is owned by the publications file. */
+		if (found != NULL) {
+			res = KSI_PublicationRecord_clone(found, &tmp);
+			ERR_CATCH_MSG(err, res, "Error: Unable to clone publication record.");
+		}
+	} else {
 		res = KSI_Signature_getSigningTime(sig, &sigTime);
 		ERR_CATCH_MSG(err, res, "Error: Unable to get signing time.");
 
-		res = KSI_PublicationsFile_getNearestPublication(pubFile, sigTime, &pubRec);
+		res = KSI_PublicationsFile_getNearestPublication(tmp_pubFile, sigTime, &tmp);
 		ERR_CATCH_MSG(err, res, "Error: Unable to find nearest publication.");
+	}
 
-		res = KSI_PublicationRecord_getPublishedData(pubRec, &pubData);
+	/* The time of the publication is needed for the server configuration and to find the cached calendar hash chain. */
+	if (tmp != NULL) {
+		res = KSI_PublicationRecord_getPublishedData(tmp, &pubData);
 		ERR_CATCH_MSG(err, res, "Error: Unable to get publication data.");
 
-		res = KSI_PublicationData_getTime(pubData, &pubTime);
+		res = KSI_PublicationData_getTime(pubData, &tmp_time);
 		ERR_CATCH_MSG(err, res, "Error: Unable to get publication time.");
+	}
+
+	*pubFile = tmp_pubFile;
+	*pubRec = tmp;
+	*pubTime = tmp_time;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	KSI_PublicationRecord_free(tmp);
+
+	return res;
+}
+
+static int extend_to_nearest_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, PUBFILE_CACHE *pubfiles, CHAIN_CACHE *chains, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext) {
+	int res;
+	int d = 0;
+	KSI_Signature *tmp = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationRecord *pubRec = NULL;
+	KSI_Integer *pubTime = NULL;
+
+	if (set == NULL || ksi == NULL || err == NULL || sig == NULL || pubfiles == NULL || chains == NULL || ext == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	d = PARAM_SET_isSetByName(set, "d");
+
+	res = find_publication(set, err, ksi, pubfiles, EXTEND_TO_HEAD, sig, &pubFile, &pubRec, &pubTime);
+	if (res != KT_OK) goto cleanup;
+
+	/* If there is no publication to extend to, the signature is not looked up from the cached calendar hash chains. */
+	if (pubRec == NULL && PARAM_SET_isSetByName(set, "apply-remote-conf")) {
+		ERR_TRCKR_ADD(err, res = KT_PUBFILE_HAS_NO_PUBREC_TO_EXTEND_TO, "Error: Unable to extend signature as publication record not found from publications file.");
+		goto cleanup;
+	}
+
+	/* Obtain configuration from server. */
+	if (PARAM_SET_isSetByName(set, "apply-remote-conf")) {
+		size_t calFirst = 0;
+		size_t calLast = 0;
 
 		res = obtain_remote_conf(set, err, ksi, &calFirst, &calLast);
+		chains->conf_requests++;
 		if (res != KT_OK) goto cleanup;
 
 		if ((calFirst != 0 && KSI_Integer_getUInt64(pubTime) < calFirst) ||
@@ -370,10 +907,18 @@ static int extend_to_nearest_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX
 		}
 	}
 
-	print_progressDesc(d, "Extend the signature to the earliest available publication... ");
-	res = KSITOOL_extendSignature(err, ksi, sig, pubFile, &tmp);
-	ERR_CATCH_MSG(err, res, "Error: Unable to extend signature.");
-	print_progressResult(res);
+	if (pubTime != NULL) {
+		res = extend_from_cached_chain(err, ksi, d, chains, sig, pubTime, 1, &tmp);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	if (tmp == NULL) {
+		print_progressDesc(d, "Extend the signature to the earliest available publication... ");
+		chains->ext_requests++;
+		res = KSITOOL_extendSignature(err, ksi, sig, pubFile, &tmp);
+		ERR_CATCH_MSG(err, res, "Error: Unable to extend signature.");
+		print_progressResult(res);
+	}
 
 	if (pubFileOut != NULL) {
 		*pubFileOut = pubFile;
@@ -386,14 +931,13 @@ static int extend_to_nearest_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX
 cleanup:
 	print_progressResult(res);
 
-	KSI_PublicationsFile_free(pubFile);
 	KSI_PublicationRecord_free(pubRec);
 	KSI_Signature_free(tmp);
 
 	return res;
 }
 
-static int extend_to_specified_time(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, COMPOSITE *extra, KSI_Signature *sig, KSI_Signature **ext) {
+static int extend_to_specified_time(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, COMPOSITE *extra, KSI_Signature *sig, CHAIN_CACHE *chains, KSI_Signature **ext) {
 	int res;
 	int d = 0;
 	KSI_Signature *tmp = NULL;
@@ -402,7 +946,7 @@ static int extend_to_specified_time(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi
 	size_t calFirst = 0;
 	size_t calLast = 0;
 
-	if (set == NULL || ksi == NULL || err == NULL || sig == NULL || extra == NULL || ext == NULL) {
+	if (set == NULL || ksi == NULL || err == NULL || sig == NULL || extra == NULL || chains == NULL || ext == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
@@ -419,9 +963,17 @@ static int extend_to_specified_time(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi
 	/* Obtain configuration from server. */
 	if (PARAM_SET_isSetByName(set, "apply-remote-conf")) {
 		res = obtain_remote_conf(set, err, ksi, &calFirst, &calLast);
+		chains->conf_requests++;
 		if (res != KT_OK) goto cleanup;
 	}
 
+	/**
+	 * The signature extended to a time has no publication record, so it can only
+	 * be trusted without asking the extender again if its calendar hash chain is
+	 * just received. The chains are not reused (see verify_and_save).
+	 */
+	chains->pending = 0;
+
 	/* Extend the signature. */
 	print_progressDesc(d, "Extending the signature to %s (%llu)... ",
 			KSI_Integer_toDateString(pubTime, buf, sizeof(buf)),
@@ -436,6 +988,7 @@ static int extend_to_specified_time(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi
 		goto cleanup;
 	}
 
+	chains->ext_requests++;
 	res = KSITOOL_Signature_extendTo(err, sig, ksi, pubTime, &tmp);
 	ERR_CATCH_MSG(err, res, "Error: Unable to extend signature.");
 	print_progressResult(res);
@@ -454,59 +1007,37 @@ cleanup:
 	return res;
 }
 
-static int extend_to_specified_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext) {
+static int extend_to_specified_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, KSI_Signature *sig, PUBFILE_CACHE *pubfiles, CHAIN_CACHE *chains, KSI_PublicationsFile **pubFileOut, KSI_Signature **ext) {
 	int res;
 	int d = 0;
 	KSI_Signature *tmp = NULL;
 	KSI_PublicationRecord *pub_rec = NULL;
 	KSI_PublicationsFile *pubFile = NULL;
-	char *pubs_str = NULL;
+	KSI_Integer *pubTime = NULL;
 
-	if (set == NULL || ksi == NULL || err == NULL || sig == NULL || ext == NULL) {
+	if (set == NULL || ksi == NULL || err == NULL || sig == NULL || pubfiles == NULL || chains == NULL || ext == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
 	d = PARAM_SET_isSetByName(set, "d");
-	res = PARAM_SET_getStr(set, "pub-str", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &pubs_str);
-	ERR_CATCH_MSG(err, res, "Error: Unable get publication string.");
-
-
-	print_progressDesc(d, "%s", getPublicationsFileRetrieveDescriptionString(set));
-	res = KSITOOL_receivePublicationsFile(err, ksi, &pubFile);
-	ERR_CATCH_MSG(err, res, "Error: Unable receive publications file.");
-	print_progressResult(res);
 
 	print_progressDesc(d, "Searching for a publication record from publications file... ");
-	res = KSI_PublicationsFile_getPublicationDataByPublicationString(pubFile, pubs_str, &pub_rec);
-	ERR_CATCH_MSG(err, res, "Error: Unable get publication record from publications file.");
+	res = find_publication(set, err, ksi, pubfiles, EXTEND_TO_PUB_STR, sig, &pubFile, &pub_rec, &pubTime);
+	if (res != KT_OK) goto cleanup;
 	if (pub_rec == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_PUBFILE_HAS_NO_PUBREC_TO_EXTEND_TO, "Error: Unable to extend signature as publication record not found from publications file.");
 		goto cleanup;
 	}
 	print_progressResult(res);
 
-	if (!PARAM_SET_isSetByName(set, "publications-file-no-verify")) {
-		print_progressDesc(d, "Verifying publications file... ");
-		res = KSITOOL_verifyPublicationsFile(err, ksi, pubFile);
-		ERR_CATCH_MSG(err, res, "Error: Unable to verify publications file.");
-		print_progressResult(res);
-	}
-
 	/* Obtain configuration from server. */
 	if (PARAM_SET_isSetByName(set, "apply-remote-conf")) {
-		KSI_PublicationData *pubData = NULL;
-		KSI_Integer *pubTime = NULL;
 		size_t calFirst = 0;
 		size_t calLast = 0;
 
-		res = KSI_PublicationRecord_getPublishedData(pub_rec, &pubData);
-		ERR_CATCH_MSG(err, res, "Error: Unable to get publication data.");
-
-		res = KSI_PublicationData_getTime(pubData, &pubTime);
-		ERR_CATCH_MSG(err, res, "Error: Unable to get publication time.");
-
 		res = obtain_remote_conf(set, err, ksi, &calFirst, &calLast);
+		chains->conf_requests++;
 		if (res != KT_OK) goto cleanup;
 
 		if ((calFirst != 0 && KSI_Integer_getUInt64(pubTime) < calFirst) ||
@@ -519,10 +1050,16 @@ static int extend_to_specified_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_C
 		}
 	}
 
-	print_progressDesc(d, "Extend the signature to the specified publication... ");
-	res = KSITOOL_Signature_extend(err, sig, ksi, pub_rec, &tmp);
-	ERR_CATCH_MSG(err, res, "Error: Unable to extend signature.");
-	print_progressResult(res);
+	res = extend_from_cached_chain(err, ksi, d, chains, sig, pubTime, 1, &tmp);
+	if (res != KT_OK) goto cleanup;
+
+	if (tmp == NULL) {
+		print_progressDesc(d, "Extend the signature to the specified publication... ");
+		chains->ext_requests++;
+		res = KSITOOL_Signature_extend(err, sig, ksi, pub_rec, &tmp);
+		ERR_CATCH_MSG(err, res, "Error: Unable to extend signature.");
+		print_progressResult(res);
+	}
 
 	if (pubFileOut != NULL) {
 		*pubFileOut = pubFile;
@@ -535,7 +1072,7 @@ static int extend_to_specified_publication(PARAM_SET *set, ERR_TRCKR *err, KSI_C
 cleanup:
 	print_progressResult(res);
 
-	KSI_PublicationsFile_free(pubFile);
+	KSI_PublicationRecord_free(pub_rec);
 	KSI_Signature_free(tmp);
 
 	return res;
@@ -560,13 +1097,15 @@ static int generate_tasks_set(PARAM_SET *set, TASK_SET *task_set) {
 	 * Configure parameter set, check, repair and object extractor function.
 	 */
 	PARAM_SET_addControl(set, "{conf}", isFormatOk_inputFile, isContentOk_inputFileRestrictPipe, convertRepair_path, NULL);
-	PARAM_SET_addControl(set, "{log}{o}", isFormatOk_path, NULL, convertRepair_path, NULL);
+	PARAM_SET_addControl(set, "{log}{o}{calendar-cache}", isFormatOk_path, NULL, convertRepair_path, NULL);
 	PARAM_SET_addControl(set, "{i}", isFormatOk_inputFile, isContentOk_inputFileWithPipe, convertRepair_path, extract_inputSignature);
 	PARAM_SET_addControl(set, "{input}", isFormatOk_inputFile, isContentOk_inputFile, convertRepair_path, extract_inputSignatureFromFile);
+	PARAM_SET_addControl(set, "{bundle}", isFormatOk_inputFile, isContentOk_inputFileRestrictPipe, convertRepair_path, NULL);
 	PARAM_SET_addControl(set, "{T}", isFormatOk_utcTime, isContentOk_utcTime, NULL, extract_utcTime);
-	PARAM_SET_addControl(set, "{d}{dump-conf}", isFormatOk_flag, NULL, NULL, NULL);
+	PARAM_SET_addControl(set, "{d}{dump-conf}{durable}{async}", isFormatOk_flag, NULL, NULL, NULL);
 	PARAM_SET_addControl(set, "{pub-str}", isFormatOk_pubString, NULL, NULL, extract_pubString);
-	PARAM_SET_setParseOptions(set, "{d}{dump-conf}{replace-existing}", PST_PRSCMD_HAS_NO_VALUE);
+	PARAM_SET_addControl(set, "{pubfile-max-age}{async-window}", isFormatOk_int, isContentOk_uint_not_zero, NULL, extract_int);
+	PARAM_SET_setParseOptions(set, "{d}{dump-conf}{replace-existing}{durable}{async}", PST_PRSCMD_HAS_NO_VALUE);
 
 	PARAM_SET_addControl(set, "{dump}", NULL, isContentOk_dump_flag, NULL, extract_dump_flag);
 
@@ -595,30 +1134,27 @@ static int generate_tasks_set(PARAM_SET *set, TASK_SET *task_set) {
 	 */
 	/*						ID					DESC												MAN				ATL			FORBIDDEN		IGN	*/
 	TASK_SET_add(task_set,	EXTEND_TO_HEAD,		"Extend to the earliest available publication.",	"X,P",			"i,input",	"T,pub-str",	NULL);
-	TASK_SET_add(task_set,	EXTEND_TO_TIME,		"Extend to the specified time.",					"X,T",			"i,input",	"pub-str",		NULL);
+	TASK_SET_add(task_set,	EXTEND_TO_TIME,		"Extend to the specified time.",					"X,T",			"i,input",	"pub-str,pubfile-max-age,calendar-cache,async,async-window",		NULL);
 	TASK_SET_add(task_set,	EXTEND_TO_PUB_STR,	"Extend to time specified in publications string.",	"X,P,pub-str",	"i,input",	"T",			NULL);
-	TASK_SET_add(task_set,	EXTENDER_DUMP_CONF,	"Dump extender configuration.",						"X,dump-conf",	NULL,		"i,input,o,pub-str,T,apply-remote-conf,replace-existing",	NULL);
+	TASK_SET_add(task_set,	EXTENDER_DUMP_CONF,	"Dump extender configuration.",						"X,dump-conf",	NULL,		"i,input,o,pub-str,T,apply-remote-conf,replace-existing,durable,pubfile-max-age,calendar-cache,async,async-window",	NULL);
 
 cleanup:
 
 	return res;
 }
 
-static int generate_file_name(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags, const char *out_flags, int i, char *buf, size_t buf_len) {
+static int generate_file_name(const INPUT_INDEX *inputs, size_t i, char *buf, size_t buf_len) {
 	int res = KT_UNKNOWN_ERROR;
-	char *in_file_name = NULL;
-	int in_count = 0;
+	const char *in_file_name = NULL;
 	size_t count = 0;
-	VARIABLE_IS_NOT_USED(out_flags);
-	VARIABLE_IS_NOT_USED(err);
-
-	res = PARAM_SET_getValueCount(set, in_flags, NULL, PST_PRIORITY_NONE, &in_count);
-	if (res != PST_OK) goto cleanup;
 
-	res = PARAM_SET_getStr(set, in_flags, NULL, PST_PRIORITY_NONE, i, &in_file_name);
-	if (res != PST_OK) goto cleanup;
+	in_file_name = INPUT_INDEX_getName(inputs, i);
+	if (in_file_name == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
 
-	if (strcmp(in_file_name, "-") == 0 && in_count == 1) {
+	if (strcmp(in_file_name, "-") == 0 && INPUT_INDEX_getCount(inputs) == 1) {
 		KSI_snprintf(buf, buf_len, "stdin.ext.ksig");
 	} else if (SMART_FILE_hasFileExtension(in_file_name, "ksig")) {
 		count += KSI_snprintf(buf + count, buf_len - count , "%s", in_file_name);
@@ -663,6 +1199,11 @@ static int check_other_input_param_errors(PARAM_SET *set, ERR_TRCKR *err) {
 			goto cleanup;
 		}
 
+		if (PARAM_SET_isSetByName(set, "bundle")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: --replace-existing can not be used with --bundle, as the bundle is append-only.");
+			goto cleanup;
+		}
+
 		res = PARAM_SET_getValueCount(set, "i", NULL, PST_PRIORITY_NONE, &i_count);
 		if (res != PST_OK) goto cleanup;
 
@@ -681,6 +1222,22 @@ static int check_other_input_param_errors(PARAM_SET *set, ERR_TRCKR *err) {
 	}
 
 
+	/* The server configuration is applied to every extending request separately. */
+	if (PARAM_SET_isSetByName(set, "async") && PARAM_SET_isSetByName(set, "apply-remote-conf")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: --async can not be used with --apply-remote-conf.");
+		goto cleanup;
+	}
+
+	if (PARAM_SET_isSetByName(set, "async-window") && !PARAM_SET_isSetByName(set, "async")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: --async-window can only be used with --async.");
+		goto cleanup;
+	}
+
+	if (PARAM_SET_isSetByName(set, "durable") && how_is_output_saved_to(set, "i,input", "o") == OUTPUT_TO_STDOUT) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: --durable can not be used when the signature is written to stdout (-o -).");
+		goto cleanup;
+	}
+
 	res = KT_OK;
 
 cleanup:
@@ -708,29 +1265,439 @@ cleanup:
 	return res;
 }
 
+/**
+ * State shared by all the signatures extended in a run.
+ */
+typedef struct EXTEND_RUN_st {
+	int task_id;
+	int d;
+	int dump;
+	int dump_flags;
+	int how_to_save;
+	const char *mode;
+	const INPUT_INDEX *inputs;
+	COMPOSITE *extra;
+	DURABLE_BATCH *durable;
+	PUBFILE_CACHE *pubfiles;
+	CHAIN_CACHE *chains;
+
+	/* Count of signatures read. */
+	size_t count;
+} EXTEND_RUN;
+
+/**
+ * The signature being extended. If extending fails, the signatures and the
+ * verification results are printed with -d.
+ */
+typedef struct EXTEND_ITEM_st {
+	KSI_Signature *sig;
+	KSI_Signature *ext;
+	KSI_PolicyVerificationResult *result_sig;
+	KSI_PolicyVerificationResult *result_ext;
+
+	/* Publications file to verify the extended signature with. This must not be freed! */
+	KSI_PublicationsFile *pubFile;
+
+	/* Set if the calendar hash chain of the extended signature is just received from the extender. */
+	int fromExtender;
+} EXTEND_ITEM;
+
+static void extend_item_clear(EXTEND_ITEM *item) {
+	if (item == NULL) return;
+
+	KSI_Signature_free(item->sig);
+	KSI_Signature_free(item->ext);
+	KSI_PolicyVerificationResult_free(item->result_sig);
+	KSI_PolicyVerificationResult_free(item->result_ext);
+	memset(item, 0, sizeof(EXTEND_ITEM));
+}
+
+/**
+ * Reads the signature of the input and verifies it internally.
+ */
+static int read_signature(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, EXTEND_RUN *run, size_t i, EXTEND_ITEM *item) {
+	int res;
+
+	if (set == NULL || err == NULL || ksi == NULL || run == NULL || item == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (run->count > 0 && (run->d || run->dump)) print_debug(" ----------------------------\n");
+	run->count++;
+
+	print_debug("Extending signature '%s'.\n", INPUT_INDEX_getName(run->inputs, i));
+	print_progressDesc(run->d, "Reading signature... ");
+
+	res = INPUT_INDEX_getObj(run->inputs, set, i, run->extra, (void**)&item->sig);
+	if (res != PST_OK) goto cleanup;
+	print_progressResult(res);
+
+	/* Make sure the signature is ok. */
+	print_progressDesc(run->d, "Verifying old signature... ");
+	res = KSITOOL_SignatureVerify_internally(err, item->sig, ksi, NULL, &item->result_sig);
+	if (res != KSI_OK) {
+		if (item->result_sig != NULL) {
+			ERR_TRCKR_ADD(err, res, "Error: [%s] %s", OBJPRINT_getVerificationErrorCode(item->result_sig->finalResult.errorCode),
+				OBJPRINT_getVerificationErrorDescription(item->result_sig->finalResult.errorCode));
+		}
+		ERR_TRCKR_ADD(err, res, "Error: Unable to verify signature.");
+		goto cleanup;
+	}
+	print_progressResult(res);
+
+	res = KT_OK;
+
+cleanup:
+	print_progressResult(res);
+
+	return res;
+}
+
+/**
+ * Verifies and saves the extended signature of the input.
+ */
+static int save_signature(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, EXTEND_RUN *run, size_t i, EXTEND_ITEM *item) {
+	int res;
+	const char *save_to = NULL;
+	char buf[1024] = "";
+
+	if (set == NULL || err == NULL || ksi == NULL || run == NULL || item == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	save_to = get_output_file_name(err, run->inputs, run->how_to_save, i, buf, sizeof(buf), generate_file_name);
+
+	res = verify_and_save(set, err, ksi, item->ext, item->pubFile, item->fromExtender, save_to, run->mode, run->durable, &item->result_ext);
+	if (res != KT_OK) goto cleanup;
+
+	res = store_calendar_chain(err, run->chains, item->ext);
+	if (res != KT_OK) goto cleanup;
+
+	if (DURABLE_BATCH_getCount(run->durable) >= DURABLE_BATCH_SIZE) {
+		res = commit_durable(err, run->durable, run->d);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	if (run->dump) {
+		print_result("\n");
+		print_result("=== Old signature ===\n");
+		OBJPRINT_signatureDump(ksi, item->sig, run->dump_flags, print_result);
+		print_result("\n");
+		print_result("=== Extended signature ===\n");
+		OBJPRINT_signatureDump(ksi, item->ext, run->dump_flags, print_result);
+		print_result("\n");
+		print_result("=== Extended signature verification ===\n");
+		OBJPRINT_signatureVerificationResultDump(item->result_ext , print_result);
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Reads, extends, verifies and saves the signature of the input.
+ */
+static int extend_input(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, EXTEND_RUN *run, size_t i, EXTEND_ITEM *item) {
+	int res;
+
+	if (set == NULL || err == NULL || ksi == NULL || run == NULL || item == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = read_signature(set, err, ksi, run, i, item);
+	if (res != KT_OK) goto cleanup;
+
+	switch(run->task_id) {
+		case EXTEND_TO_HEAD:
+			res = extend_to_nearest_publication(set, err, ksi, item->sig, run->pubfiles, run->chains, &item->pubFile, &item->ext);
+			break;
+		case EXTEND_TO_TIME:
+			res = extend_to_specified_time(set, err, ksi, run->extra, item->sig, run->chains, &item->ext);
+			break;
+		case EXTEND_TO_PUB_STR:
+			res = extend_to_specified_publication(set, err, ksi, item->sig, run->pubfiles, run->chains, &item->pubFile, &item->ext);
+			break;
+	}
+	if (res != KT_OK) goto cleanup;
+
+	/* With -T every signature is sent to the extender. */
+	item->fromExtender = run->task_id == EXTEND_TO_TIME || run->chains->pending;
+
+	res = save_signature(set, err, ksi, run, i, item);
+	if (res != KT_OK) goto cleanup;
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * An extending request in flight (see --async). The request is sent for the
+ * first signature of a group and the rest of the group is extended with the
+ * calendar hash chain of the response.
+ */
+typedef struct EXTEND_ASYNC_REQ_st {
+	/* Position of the first signature of the group in the plan and the position after the last one. */
+	size_t first;
+	size_t last;
+
+	/* The signature sent to the extender. */
+	KSI_Signature *sig;
+
+	/* The publications file and the publication record the signature is extended to. */
+	KSI_PublicationsFile *pubFile;
+	KSI_PublicationRecord *pubRec;
+
+	/* Aggregation time and publication time of the calendar hash chain requested. */
+	KSI_uint64_t aggr_time;
+	KSI_uint64_t pub_time;
+} EXTEND_ASYNC_REQ;
+
+static void extend_async_req_free(void *obj) {
+	EXTEND_ASYNC_REQ *req = (EXTEND_ASYNC_REQ*)obj;
+
+	if (req == NULL) return;
+
+	KSI_Signature_free(req->sig);
+	KSI_PublicationRecord_free(req->pubRec);
+	KSI_PublicationsFile_free(req->pubFile);
+	KSI_free(req);
+}
+
+/**
+ * Extends the signatures with asynchronous extending service. Up to --async-window
+ * requests are kept in flight, one for every group of the plan. The extended
+ * signatures are verified and saved as the responses arrive, and the rest of the
+ * group is extended with the calendar hash chain of the response.
+ */
+static int perform_async_extending(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, EXTEND_RUN *run, const EXTEND_PLAN_ITEM *plan, size_t in_count, EXTEND_ITEM *item) {
+	int res;
+	int window = 0;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *handle = NULL;
+	EXTEND_ASYNC_REQ *req = NULL;
+	KSI_PublicationsFile *pubFile = NULL;
+	KSI_PublicationRecord *pubRec = NULL;
+	KSI_Integer *pubTime = NULL;
+	size_t next = 0;
+	size_t pending = 0;
+	size_t waiting = 0;
+	size_t k = 0;
+	unsigned poll_delay = 0;
+
+	if (set == NULL || err == NULL || ksi == NULL || run == NULL || plan == NULL || item == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	window = EXTEND_ASYNC_WINDOW_DEFAULT;
+	res = PARAM_SET_getObj(set, "async-window", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&window);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	/**
+	 * Configure the asynchronous extending service. The service keeps up to window
+	 * requests in its cache.
+	 */
+	res = TOOL_init_ksi_async_service(set, err, ksi, TOOL_ASYNC_EXTENDING, window, &as);
+	if (res != KT_OK) goto cleanup;
+
+	print_debug("Extending asynchronously with up to %i requests in flight.\n", window);
+
+	while (next < in_count || pending > 0) {
+		/**
+		 * Keep the window full.
+		 */
+		while (next < in_count && pending < (size_t)window) {
+			size_t last = next + 1;
+
+			while (last < in_count && plan[last].group == plan[next].group) last++;
+
+			res = read_signature(set, err, ksi, run, plan[next].i, item);
+			if (res != KT_OK) goto cleanup;
+
+			res = find_publication(set, err, ksi, run->pubfiles, run->task_id, item->sig, &pubFile, &pubRec, &pubTime);
+			if (res != KT_OK) goto cleanup;
+			if (pubRec == NULL) {
+				ERR_TRCKR_ADD(err, res = KT_PUBFILE_HAS_NO_PUBREC_TO_EXTEND_TO, "Error: Unable to extend signature as publication record not found from publications file.");
+				goto cleanup;
+			}
+
+			res = extend_from_cached_chain(err, ksi, run->d, run->chains, item->sig, pubTime, 1, &item->ext);
+			if (res != KT_OK) goto cleanup;
+
+			/* The whole group is extended with the cached calendar hash chain. */
+			if (item->ext != NULL) {
+				item->pubFile = pubFile;
+
+				res = save_signature(set, err, ksi, run, plan[next].i, item);
+				if (res != KT_OK) goto cleanup;
+				extend_item_clear(item);
+
+				for (k = next + 1; k < last; k++) {
+					res = extend_input(set, err, ksi, run, plan[k].i, item);
+					if (res != KT_OK) goto cleanup;
+					extend_item_clear(item);
+				}
+
+				KSI_PublicationRecord_free(pubRec);
+				pubRec = NULL;
+				next = last;
+				continue;
+			}
+
+			print_progressDesc(run->d, "Sending extending request... ");
+
+			req = (EXTEND_ASYNC_REQ*)KSI_malloc(sizeof(EXTEND_ASYNC_REQ));
+			if (req == NULL) {
+				ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+				goto cleanup;
+			}
+
+			req->first = next;
+			req->last = last;
+			req->sig = item->sig;
+			req->pubFile = KSI_PublicationsFile_ref(pubFile);
+			req->pubRec = pubRec;
+			req->aggr_time = run->chains->aggr_time;
+			req->pub_time = run->chains->pub_time;
+			item->sig = NULL;
+			pubRec = NULL;
+
+			res = KSI_AsyncExtendingHandle_new(ksi, req->sig, req->pubRec, &handle);
+			ERR_CATCH_MSG(err, res, "Error: Unable to create asynchronous request handle.");
+
+			/* The signature, publication record and the position in the plan are needed when the response arrives. */
+			res = KSI_AsyncHandle_setRequestCtx(handle, (void*)req, extend_async_req_free);
+			ERR_CATCH_MSG(err, res, "Error: Unable to set asynchronous request context.");
+			req = NULL;
+
+			res = KSITOOL_AsyncService_addRequest(err, ksi, as, handle);
+			ERR_CATCH_MSG(err, res, "Error: Unable to add asynchronous extending request.");
+			handle = NULL;
+			run->chains->ext_requests++;
+
+			print_progressResult(res);
+			extend_item_clear(item);
+
+			next = last;
+			pending++;
+		}
+
+		/**
+		 * Send the requests and receive a response if one is available.
+		 */
+		res = KSITOOL_ExtendingAsyncService_run(err, ksi, as, &handle, &waiting);
+		ERR_CATCH_MSG(err, res, "Error: Unable to run asynchronous extending service.");
+
+		if (handle != NULL) {
+			const void *tmp_req = NULL;
+			const EXTEND_ASYNC_REQ *done = NULL;
+
+			res = KSI_AsyncHandle_getRequestCtx(handle, &tmp_req);
+			if (res != KSI_OK || tmp_req == NULL) {
+				ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unexpected error. Unable to get asynchronous request context.");
+				goto cleanup;
+			}
+			done = (const EXTEND_ASYNC_REQ*)tmp_req;
+
+			if (run->d || run->dump) print_debug(" ----------------------------\n");
+			print_debug("Received extended signature '%s'.\n", INPUT_INDEX_getName(run->inputs, plan[done->first].i));
+
+			res = KSI_Signature_clone(done->sig, &item->sig);
+			ERR_CATCH_MSG(err, res, "Error: Unable to clone signature.");
+
+			print_progressDesc(run->d, "Receiving extended signature... ");
+			res = KSITOOL_AsyncHandle_getExtendedSignature(err, ksi, handle, &item->ext);
+			ERR_CATCH_MSG(err, res, "Error: Unable to extend signature.");
+			print_progressResult(res);
+
+			/* The chain received is kept for the rest of the group. */
+			item->pubFile = done->pubFile;
+			item->fromExtender = 1;
+			run->chains->aggr_time = done->aggr_time;
+			run->chains->pub_time = done->pub_time;
+			run->chains->pending = 1;
+
+			res = save_signature(set, err, ksi, run, plan[done->first].i, item);
+			if (res != KT_OK) goto cleanup;
+			extend_item_clear(item);
+
+			for (k = done->first + 1; k < done->last; k++) {
+				res = extend_input(set, err, ksi, run, plan[k].i, item);
+				if (res != KT_OK) goto cleanup;
+				extend_item_clear(item);
+			}
+
+			KSI_AsyncHandle_free(handle);
+			handle = NULL;
+			pending--;
+			poll_delay = 0;
+		} else if (pending > 0) {
+			/* The service can only be polled, so back off until a response arrives. */
+			sleepWithBackoff(&poll_delay, EXTEND_ASYNC_POLL_MAX_MS);
+		}
+	}
+
+	res = KT_OK;
+
+cleanup:
+	print_progressResult(res);
+
+	extend_async_req_free(req);
+	KSI_PublicationRecord_free(pubRec);
+	KSI_AsyncHandle_free(handle);
+	KSI_AsyncService_free(as);
+
+	return res;
+}
+
 static int perform_extending(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, int task_id) {
 	int res;
-	int i = 0;
-	int in_count = 0;
+	size_t n = 0;
+	size_t in_count = 0;
+	EXTEND_PLAN_ITEM *plan = NULL;
+	size_t groups = 0;
 	COMPOSITE extra;
-	KSI_Signature *sig = NULL;
-	KSI_Signature *ext = NULL;
+	INPUT_INDEX *inputs = NULL;
+	const INPUT_INDEX_EXTRACTOR extractors[] = {extract_inputSignature, extract_inputSignatureFromFile};
 	int d = 0;
 	int dump = 0;
 	int how_to_save = 0;
 	const char *mode = NULL;
-	KSI_PolicyVerificationResult *result_ext = NULL;
-	KSI_PolicyVerificationResult *result_sig = NULL;
+	BUNDLE *bundle = NULL;
+	DURABLE_BATCH *durable = NULL;
+	PUBFILE_CACHE pubfiles;
+	CHAIN_CACHE chains;
+	EXTEND_RUN run;
+	EXTEND_ITEM item;
 
 	int dump_flags = OBJPRINT_NONE;
 
+	memset(&pubfiles, 0, sizeof(pubfiles));
+	memset(&chains, 0, sizeof(chains));
+	memset(&item, 0, sizeof(item));
+
 	if (set == NULL || err == NULL || ksi == NULL || task_id > 2) {
 		res = KT_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
-	res = PARAM_SET_getValueCount(set, "i,input", NULL, PST_PRIORITY_NONE, &in_count);
-	if (res != PST_OK) goto cleanup;
+	/* The inputs are resolved once, as looking up the values by index is slow with many inputs. */
+	res = INPUT_INDEX_new("i,input", extractors, "o", &inputs);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create input index.");
+
+	res = INPUT_INDEX_update(inputs, set);
+	ERR_CATCH_MSG(err, res, "Error: Unable to resolve the inputs.");
+
+	in_count = INPUT_INDEX_getCount(inputs);
 
 	d = PARAM_SET_isSetByName(set, "d");
 	dump = PARAM_SET_isSetByName(set, "dump");
@@ -738,84 +1705,116 @@ static int perform_extending(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, int t
 
 	extra.ctx = ksi;
 	extra.err = err;
+	extra.bundle = NULL;
+
+	if (PARAM_SET_isSetByName(set, "bundle")) {
+		char *bundle_name = NULL;
+
+		res = PARAM_SET_getStr(set, "bundle", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &bundle_name);
+		if (res != PST_OK) goto cleanup;
+
+		print_progressDesc(d, "Reading bundle index... ");
+		res = BUNDLE_open(bundle_name, 0, &bundle);
+		if (res == KT_INVALID_INPUT_FORMAT) {
+			ERR_TRCKR_ADD(err, res, "Error: '%s' is not a valid signature bundle.", bundle_name);
+			goto cleanup;
+		}
+		ERR_CATCH_MSG(err, res, "Error: Unable to open signature bundle '%s'.", bundle_name);
+		print_progressResult(res);
+
+		extra.bundle = bundle;
+	}
 
 	how_to_save = how_is_output_saved_to(set, "i,input", "o");
 
 	res = get_smart_file_mode(err, how_to_save, &mode);
 	if (res != KT_OK) goto cleanup;
 
-	print_debug("Extending %d signature%s.\n", in_count, in_count > 1 ? "s" : "");
-	for (i = 0; i < in_count; i++) {
-		char *in_fname = NULL;
-		const char *save_to = NULL;
-		char buf[1024] = "";
-
-		/* This must not be freed! */
-		KSI_PublicationsFile *pubFile = NULL;
+	if (PARAM_SET_isSetByName(set, "durable")) {
+		res = DURABLE_BATCH_new(DURABLE_SYNC_THREADS, &durable);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create durable output batch.");
+	}
 
-		if (i > 0 && (d || dump)) print_debug(" ----------------------------\n");
+	res = PARAM_SET_getObj(set, "pubfile-max-age", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void**)&pubfiles.max_age);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
 
-		PARAM_SET_getStr(set, "i,input", NULL, PST_PRIORITY_NONE, i, &in_fname);
-		print_debug("Extending signature '%s'.\n", in_fname);
-		print_progressDesc(d, "Reading signature... ");
+	if (PARAM_SET_isSetByName(set, "calendar-cache")) {
+		char *cache_name = NULL;
 
-		res = PARAM_SET_getObjExtended(set, "i,input", NULL, PST_PRIORITY_NONE, (int)i, &extra, (void**)&sig);
+		res = PARAM_SET_getStr(set, "calendar-cache", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &cache_name);
 		if (res != PST_OK) goto cleanup;
-		print_progressResult(res);
 
-		/* Make sure the signature is ok. */
-		print_progressDesc(d, "Verifying old signature... ");
-		res = KSITOOL_SignatureVerify_internally(err, sig, ksi, NULL, &result_sig);
-		if (res != KSI_OK) {
-			if (result_sig != NULL) {
-				ERR_TRCKR_ADD(err, res, "Error: [%s] %s", OBJPRINT_getVerificationErrorCode(result_sig->finalResult.errorCode),
-					OBJPRINT_getVerificationErrorDescription(result_sig->finalResult.errorCode));
-			}
-			ERR_TRCKR_ADD(err, res, "Error: Unable to verify signature.");
+		print_progressDesc(d, "Reading calendar cache... ");
+		res = CALENDAR_CACHE_open(cache_name, &chains.cache);
+		if (res == KT_INVALID_INPUT_FORMAT) {
+			ERR_TRCKR_ADD(err, res, "Error: '%s' is not a valid calendar cache.", cache_name);
 			goto cleanup;
 		}
+		ERR_CATCH_MSG(err, res, "Error: Unable to open calendar cache '%s'.", cache_name);
 		print_progressResult(res);
 
-		switch(task_id) {
-			case EXTEND_TO_HEAD:
-				res = extend_to_nearest_publication(set, err, ksi, sig, &pubFile, &ext);
-				break;
-			case EXTEND_TO_TIME:
-				res = extend_to_specified_time(set, err, ksi, &extra, sig, &ext);
-				break;
-			case EXTEND_TO_PUB_STR:
-				res = extend_to_specified_publication(set, err, ksi, sig, &pubFile, &ext);
-				break;
+		print_debug("Calendar cache contains %zu calendar hash chain%s.\n", CALENDAR_CACHE_getCount(chains.cache), CALENDAR_CACHE_getCount(chains.cache) == 1 ? "" : "s");
+		if (CALENDAR_CACHE_isDamaged(chains.cache)) {
+			print_warnings("Warning: Calendar cache '%s' is damaged. Only the calendar hash chains before the damaged entry are used and no new chains are stored.\n", cache_name);
 		}
-		if (res != KT_OK) goto cleanup;
+	}
 
-		save_to = get_output_file_name(set, err, "i,input", "o", how_to_save, i, buf, sizeof(buf), generate_file_name);
+	res = plan_extending(set, err, inputs, &extra, &plan, &groups);
+	if (res != KT_OK) goto cleanup;
 
-		res = verify_and_save(set, err, ksi, ext, pubFile, save_to, mode, &result_ext);
+	run.task_id = task_id;
+	run.d = d;
+	run.dump = dump;
+	run.dump_flags = dump_flags;
+	run.how_to_save = how_to_save;
+	run.mode = mode;
+	run.inputs = inputs;
+	run.extra = &extra;
+	run.durable = durable;
+	run.pubfiles = &pubfiles;
+	run.chains = &chains;
+	run.count = 0;
+
+	print_debug("Extending %zu signature%s.\n", in_count, in_count > 1 ? "s" : "");
+	if (groups > 0) print_debug("Signatures grouped by signing time into %zu group%s.\n", groups, groups > 1 ? "s" : "");
+
+	if (PARAM_SET_isSetByName(set, "async")) {
+		res = perform_async_extending(set, err, ksi, &run, plan, in_count, &item);
 		if (res != KT_OK) goto cleanup;
+	} else {
+		for (n = 0; n < in_count; n++) {
+			res = extend_input(set, err, ksi, &run, plan[n].i, &item);
+			if (res != KT_OK) goto cleanup;
 
-		if (PARAM_SET_isSetByName(set, "dump")) {
-			print_result("\n");
-			print_result("=== Old signature ===\n");
-			OBJPRINT_signatureDump(ksi, sig, dump_flags, print_result);
-			print_result("\n");
-			print_result("=== Extended signature ===\n");
-			OBJPRINT_signatureDump(ksi, ext, dump_flags, print_result);
-			print_result("\n");
-			print_result("=== Extended signature verification ===\n");
-			OBJPRINT_signatureVerificationResultDump(result_ext , print_result);
+			extend_item_clear(&item);
 		}
+	}
 
-		KSI_Signature_free(sig);
-		KSI_Signature_free(ext);
-		KSI_PolicyVerificationResult_free(result_ext);
-		KSI_PolicyVerificationResult_free(result_sig);
-		result_sig = NULL;
-		result_ext = NULL;
-		ext = NULL;
-		sig = NULL;
+	res = commit_durable(err, durable, d);
+	if (res != KT_OK) goto cleanup;
+
+	/**
+	 * The KSI context keeps the received publications file, so without the cache
+	 * only the verification would be repeated for every signature.
+	 */
+	if (pubfiles.receive_count > 0) {
+		KSI_uint64_t per_verify = pubfiles.verify_time / pubfiles.receive_count;
+
+		print_debug("Publications file received and verified %zu time%s for %zu signature%s in %.3f s, about %.3f s of verification saved.\n",
+				pubfiles.receive_count, pubfiles.receive_count > 1 ? "s" : "",
+				pubfiles.use_count, pubfiles.use_count > 1 ? "s" : "",
+				(double)pubfiles.receive_time / 1000000.0,
+				(double)(per_verify * (pubfiles.use_count - pubfiles.receive_count)) / 1000000.0);
 	}
 
+	/* The extended signatures are verified without the extender (see verify_and_save). */
+	print_debug("Network requests: %zu extending, %zu extender configuration, %zu publications file.\n",
+			chains.ext_requests, chains.conf_requests, pubfiles.receive_count);
+	print_debug("Signatures extended with the calendar hash chain of the group: %zu.\n", chains.group_hits);
+	if (chains.cache != NULL) {
+		print_debug("Calendar cache: %zu signature%s extended with a cached calendar hash chain.\n",
+				chains.hits, chains.hits == 1 ? "" : "s");
+	}
 
 	res = KT_OK;
 	goto cleanup;
@@ -824,23 +1823,30 @@ cleanup:
 	print_progressResult(res);
 	KSITOOL_KSI_ERRTrace_save(ksi);
 
+	/* The signatures extended before the failure are saved as without --durable. */
+	if (res != KT_OK && durable != NULL) commit_durable(err, durable, d);
+
 	if (res != KT_OK) {
 		if (ERR_TRCKR_getErrCount(err) == 0) {ERR_TRCKR_ADD(err, res, NULL);}
 		KSITOOL_KSI_ERRTrace_LOG(ksi);
 		print_debug("\n");
-		if (ext == NULL) {
-			DEBUG_verifySignature(ksi, res, sig, result_sig, NULL);
+		if (item.ext == NULL) {
+			DEBUG_verifySignature(ksi, res, item.sig, item.result_sig, NULL);
 		} else {
 			print_debug("=== Old signature ===\n");
-			DEBUG_verifySignature(ksi, res, sig, NULL, NULL);
+			DEBUG_verifySignature(ksi, res, item.sig, NULL, NULL);
 			print_debug("=== Extended signature ===\n");
-			DEBUG_verifySignature(ksi, res, ext, result_ext, NULL);
+			DEBUG_verifySignature(ksi, res, item.ext, item.result_ext, NULL);
 		}
 	}
 
-	KSI_PolicyVerificationResult_free(result_ext);
-	KSI_PolicyVerificationResult_free(result_sig);
-	KSI_Signature_free(sig);
-	KSI_Signature_free(ext);
+	extend_item_clear(&item);
+	BUNDLE_close(bundle);
+	DURABLE_BATCH_free(durable);
+	KSI_PublicationsFile_free(pubfiles.pubFile);
+	CALENDAR_CACHE_close(chains.cache);
+	KSI_free(chains.last);
+	KSI_free(plan);
+	INPUT_INDEX_free(inputs);
 	return res;
 }
@@ -105,6 +105,27 @@ cleanup:
 	return res;
 }
 
+/**
+ * Logs the messages of the context to the log file. Every message is written
+ * with a single write (see KSITOOL_LOG_SmartFile), so the contexts of the worker
+ * threads can share the log file with the main context.
+ */
+static int tool_init_ksi_setLogFile(KSI_CTX *ksi, ERR_TRCKR *err, SMART_FILE *log) {
+	int res;
+
+	res = KSI_CTX_setLoggerCallback(ksi, KSITOOL_LOG_SmartFile, log);
+	ERR_CATCH_MSG(err, res, "Error: Unable to set logger callback function.");
+
+	res = KSI_CTX_setLogLevel(ksi, KSI_LOG_DEBUG);
+	ERR_CATCH_MSG(err, res, "Error: Unable to set logger log level.");
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
 static int tool_init_ksi_logger(KSI_CTX *ksi, ERR_TRCKR *err, PARAM_SET *set, SMART_FILE **log) {
 	int res;
 	SMART_FILE *tmp = NULL;
@@ -125,11 +146,8 @@ static int tool_init_ksi_logger(KSI_CTX *ksi, ERR_TRCKR *err, PARAM_SET *set, SM
 			goto cleanup;
 		}
 
-		res = KSI_CTX_setLoggerCallback(ksi, KSITOOL_LOG_SmartFile, tmp);
-		ERR_CATCH_MSG(err, res, "Error: Unable to set logger callback function.");
-
-		res = KSI_CTX_setLogLevel(ksi, KSI_LOG_DEBUG);
-		ERR_CATCH_MSG(err, res, "Error: Unable to set logger log level.");
+		res = tool_init_ksi_setLogFile(ksi, err, tmp);
+		if (res != KT_OK) goto cleanup;
 	}
 
 	res = KT_OK;
@@ -576,3 +594,128 @@ cleanup:
 
 	return res;
 }
+
+int TOOL_init_ksi_service(PARAM_SET *set, ERR_TRCKR *err, SMART_FILE *ksi_log, KSI_CTX **ksi) {
+	int res;
+	KSI_CTX *tmp = NULL;
+
+	if (set == NULL || err == NULL || ksi == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = KSI_CTX_new(&tmp);
+	if (res != KSI_OK) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to initialize KSI context.");
+		goto cleanup;
+	}
+
+	res = tool_init_hmac_alg(tmp, err, set);
+	if (res != KT_OK) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to configure HMAC algorithm.");
+		goto cleanup;
+	}
+
+	res = tool_init_ksi_network_provider(tmp, err, set);
+	if (res != KT_OK) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to configure network provider.");
+		goto cleanup;
+	}
+
+	if (ksi_log != NULL) {
+		res = tool_init_ksi_setLogFile(tmp, err, ksi_log);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	*ksi = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	KSI_CTX_free(tmp);
+
+	return res;
+}
+
+int TOOL_init_ksi_async_service(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, int service, int window, KSI_AsyncService **as) {
+	int res;
+	KSI_AsyncService *tmp = NULL;
+	char *url = NULL;
+	char *user = NULL;
+	char *pass = NULL;
+	const char *name = NULL;
+	int networkConnectionTimeout = -1;
+	int networkTransferTimeout = -1;
+
+	if (set == NULL || err == NULL || ksi == NULL || window <= 0 || as == NULL
+			|| (service != TOOL_ASYNC_SIGNING && service != TOOL_ASYNC_EXTENDING)) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/**
+	 * Extract values from the set.
+	 */
+	if (service == TOOL_ASYNC_SIGNING) {
+		PARAM_SET_getStr(set, "S", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &url);
+		PARAM_SET_getStr(set, "aggr-user", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &user);
+		PARAM_SET_getStr(set, "aggr-key", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &pass);
+		name = "signing";
+	} else {
+		PARAM_SET_getStr(set, "X", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &url);
+		PARAM_SET_getStr(set, "ext-user", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &user);
+		PARAM_SET_getStr(set, "ext-key", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &pass);
+		name = "extending";
+	}
+
+	PARAM_SET_getObj(set, "C", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void**)&networkConnectionTimeout);
+	PARAM_SET_getObj(set, "c", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void**)&networkTransferTimeout);
+
+	if (url == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: %s URL is not configured.", service == TOOL_ASYNC_SIGNING ? "Aggregator" : "Extender");
+		goto cleanup;
+	}
+
+	/**
+	 * Configure the service. The service keeps up to window requests in its cache.
+	 */
+	if (service == TOOL_ASYNC_SIGNING) {
+		res = KSI_SigningAsyncService_new(ksi, &tmp);
+	} else {
+		res = KSI_ExtendingAsyncService_new(ksi, &tmp);
+	}
+	ERR_CATCH_MSG(err, res, "Error: Unable to create asynchronous %s service.", name);
+
+	res = KSI_AsyncService_setEndpoint(tmp, url, user, pass);
+	ERR_CATCH_MSG(err, res, "Error: Unable to set asynchronous %s service endpoint.", name);
+
+	res = KSI_AsyncService_setOption(tmp, KSI_ASYNC_OPT_REQUEST_CACHE_SIZE, (void*)(size_t)window);
+	ERR_CATCH_MSG(err, res, "Error: Unable to set asynchronous %s service request cache size.", name);
+
+	/**
+	 * Set service timeouts.
+	 */
+	if (networkConnectionTimeout > 0) {
+		res = KSI_AsyncService_setOption(tmp, KSI_ASYNC_OPT_CON_TIMEOUT, (void*)(size_t)networkConnectionTimeout);
+		ERR_CATCH_MSG(err, res, "Error: Unable set connection timeout.");
+	}
+
+	if (networkTransferTimeout > 0) {
+		res = KSI_AsyncService_setOption(tmp, KSI_ASYNC_OPT_RCV_TIMEOUT, (void*)(size_t)networkTransferTimeout);
+		ERR_CATCH_MSG(err, res, "Error: Unable set transfer timeout.");
+
+		res = KSI_AsyncService_setOption(tmp, KSI_ASYNC_OPT_SND_TIMEOUT, (void*)(size_t)networkTransferTimeout);
+		ERR_CATCH_MSG(err, res, "Error: Unable set transfer timeout.");
+	}
+
+	*as = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	KSI_AsyncService_free(tmp);
+
+	return res;
+}
@@ -44,6 +44,44 @@ extern "C" {
  * \return KT_OK if successful, error code otherwise.
  */
 int TOOL_init_ksi(PARAM_SET *set, KSI_CTX **ksi, ERR_TRCKR **error, SMART_FILE **ksi_log);
+
+/**
+ * Creates an additional KSI_CTX with the same service configuration (service
+ * URLs, credentials, timeouts and HMAC algorithms) as \c TOOL_init_ksi. As KSI_CTX
+ * is not thread safe, this can be used to communicate with the services from
+ * worker threads. Publications file and trust store are not configured.
+ *
+ * \param set		PARAM_SET given.
+ * \param err		Error tracker.
+ * \param ksi_log	Log file returned by \c TOOL_init_ksi (see --log), shared with
+ *					the new context. Can be NULL.
+ * \param ksi		Output parameter for KSI_CTX.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int TOOL_init_ksi_service(PARAM_SET *set, ERR_TRCKR *err, SMART_FILE *ksi_log, KSI_CTX **ksi);
+
+/**
+ * Services that can be created with \c TOOL_init_ksi_async_service.
+ */
+enum TOOL_ASYNC_SERVICE_enum {
+	TOOL_ASYNC_SIGNING,
+	TOOL_ASYNC_EXTENDING
+};
+
+/**
+ * Creates an asynchronous signing or extending service with the endpoint
+ * (aggregator or extender URL and credentials) and timeouts configured as for
+ * \c TOOL_init_ksi.
+ *
+ * \param set		PARAM_SET given.
+ * \param err		Error tracker.
+ * \param ksi		KSI context.
+ * \param service	\c TOOL_ASYNC_SIGNING or \c TOOL_ASYNC_EXTENDING.
+ * \param window	Count of requests kept in the request cache of the service.
+ * \param as		Output parameter for the service.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int TOOL_init_ksi_async_service(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, int service, int window, KSI_AsyncService **as);
 	
 #ifdef	__cplusplus
 }
@@ -33,6 +33,8 @@
 #include "param_set/param_set.h"
 #include "param_set/task_def.h"
 #include "smart_file.h"
+#include "digest_cache.h"
+#include "data_tee.h"
 #include "obj_printer.h"
 #include "api_wrapper.h"
 #include "common.h"
@@ -272,7 +274,7 @@ cleanup:
 	return res;
 }
 
-static int imprint_get_hash_obj(const char *imprint, KSI_CTX *ksi, ERR_TRCKR *err, KSI_DataHash **hash){
+int get_hash_from_imprint(KSI_CTX *ksi, const char *imprint, KSI_DataHash **hash) {
 	int res;
 	char hash_hex[1024];
 	unsigned char bin[1024];
@@ -280,8 +282,8 @@ static int imprint_get_hash_obj(const char *imprint, KSI_CTX *ksi, ERR_TRCKR *er
 	KSI_HashAlgorithm alg_id = KSI_HASHALG_INVALID_VALUE;
 	KSI_DataHash *tmp = NULL;
 
-	if (imprint == NULL || ksi == NULL || err == NULL || hash == NULL) {
-		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+	if (imprint == NULL || ksi == NULL || hash == NULL) {
+		res = KT_INVALID_ARGUMENT;
 		goto cleanup;
 	}
 
@@ -307,29 +309,51 @@ cleanup:
 
 	KSI_DataHash_free(tmp);
 
+	return res;
+}
+
+static int imprint_get_hash_obj(const char *imprint, KSI_CTX *ksi, ERR_TRCKR *err, KSI_DataHash **hash){
+	int res;
+
+	if (imprint == NULL || ksi == NULL || err == NULL || hash == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = get_hash_from_imprint(ksi, imprint, hash);
 	if (res != KT_OK) {
 		ERR_TRCKR_ADD(err, res, "Error: Unable to get hash from command-line");
 		ERR_TRCKR_ADD(err, res, "Error: %s", KSITOOL_errToString(res));
 	}
 
+cleanup:
+
 	return res;
 }
 
-static int file_get_hash(ERR_TRCKR *err, KSI_CTX *ctx, const char *open_mode, const char *fname_in, const char *fname_out, KSI_HashAlgorithm *algo, KSI_DataHash **hash){
+static int file_hash_sink(void *sink_ctx, const char *data, size_t data_len) {
+	return KSI_DataHasher_add((KSI_DataHasher*)sink_ctx, data, data_len);
+}
+
+static int file_get_hash(ERR_TRCKR *err, KSI_CTX *ctx, const char *open_mode, const char *fname_in, const char *fname_out, KSI_HashAlgorithm *algo, int cache_mode, int *isCached, KSI_DataHash **hash){
 	int res;
 	KSI_DataHasher *hasher = NULL;
 	SMART_FILE *in = NULL;
 	SMART_FILE *out = NULL;
 	char buf[0xffff];
 	size_t read_count = 0;
-	size_t write_count = 0;
 	KSI_DataHash *tmp = NULL;
+	DIGEST_CACHE_STAMP stamp;
+	unsigned char cached[KSI_MAX_IMPRINT_LEN];
+	size_t cached_len = 0;
 
-	if (err == NULL || ctx == NULL || open_mode == NULL || fname_in == NULL || hash == NULL) {
+	if (err == NULL || ctx == NULL || open_mode == NULL || fname_in == NULL || isCached == NULL || hash == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
+	*isCached = 0;
+
 	if (algo == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unable to hash data file as hash algorithm is not specified (null).");
 		goto cleanup;
@@ -338,6 +362,24 @@ static int file_get_hash(ERR_TRCKR *err, KSI_CTX *ctx, const char *open_mode, co
 		goto cleanup;
 	}
 
+	/**
+	 * The digest cache is only used for regular files that are not copied.
+	 */
+	if (fname_out != NULL || strcmp(fname_in, "-") == 0) cache_mode = DIGEST_CACHE_OFF;
+
+	if (cache_mode & DIGEST_CACHE_READ) {
+		DIGEST_CACHE_get(fname_in, *algo, cached, &cached_len);
+		if (cached_len > 0) {
+			res = KSI_DataHash_fromImprint(ctx, cached, cached_len, &tmp);
+			ERR_CATCH_MSG(err, res, "Error: Unable to create hash from the cached digest.");
+			*isCached = 1;
+			goto done;
+		}
+	}
+
+	if (cache_mode & DIGEST_CACHE_WRITE) {
+		DIGEST_CACHE_getStamp(fname_in, &stamp);
+	}
 
 	res = KSI_DataHasher_open(ctx, *algo, &hasher);
 	if (res != KSI_OK) goto cleanup;
@@ -360,9 +402,23 @@ static int file_get_hash(ERR_TRCKR *err, KSI_CTX *ctx, const char *open_mode, co
 	}
 
 
-	while (!SMART_FILE_isEof(in)) {
+	/**
+	 * When the data is copied, forwarding and hashing are overlapped (or done
+	 * without copying the data through the user space if possible).
+	 */
+	if (out != NULL) {
+		res = DATA_TEE_copy(in, out, file_hash_sink, hasher);
+		if (res == KT_INVALID_IO_WRITE) {
+			ERR_TRCKR_ADD(err, res, "Error: Unable to write to file.");
+			goto cleanup;
+		} else if (res != KT_OK) {
+			ERR_TRCKR_ADD(err, res, "Error: Unable to read data from file '%s'.", fname_in);
+			goto cleanup;
+		}
+	}
+
+	while (out == NULL && !SMART_FILE_isEof(in)) {
 		read_count = 0;
-		write_count = 0;
 
 		res = SMART_FILE_read(in, buf, sizeof(buf), &read_count);
 		if (res != SMART_FILE_OK) {
@@ -372,21 +428,22 @@ static int file_get_hash(ERR_TRCKR *err, KSI_CTX *ctx, const char *open_mode, co
 
 		res = KSI_DataHasher_add(hasher, buf, read_count);
 		ERR_CATCH_MSG(err, res, "Error: Unable to add data to hasher.");
-
-		if (!SMART_FILE_isEof(in)) {
-			if (out != NULL) {
-				res = SMART_FILE_write(out, buf, read_count, &write_count);
-				if (res != SMART_FILE_OK || write_count != read_count) {
-					ERR_TRCKR_ADD(err, res, "Error: Unable to write to file.");
-					goto cleanup;
-				}
-			}
-		}
 	}
 
 	res = KSI_DataHasher_close(hasher, &tmp);
 	ERR_CATCH_MSG(err, res, "Error: Unable close hasher.");
 
+	if (cache_mode & DIGEST_CACHE_WRITE) {
+		const unsigned char *imprint = NULL;
+		size_t imprint_len = 0;
+
+		if (KSI_DataHash_getImprint(tmp, &imprint, &imprint_len) == KSI_OK) {
+			DIGEST_CACHE_put(fname_in, &stamp, imprint, imprint_len);
+		}
+	}
+
+done:
+
 	*hash = tmp;
 	tmp = NULL;
 
@@ -644,6 +701,67 @@ int extract_int(void **extra, const char* str,  void** obj){
 	return PST_OK;
 }
 
+#define SIZE_PARSE_MAX ((KSI_uint64_t)-1)
+
+/**
+ * Parses the size in bytes with an optional unit suffix k, M or G (powers of
+ * 1024). Returns 0 if the format is invalid or the value is too large.
+ */
+static int size_parse(const char *str, KSI_uint64_t *size) {
+	KSI_uint64_t tmp = 0;
+	KSI_uint64_t unit = 1;
+	int i = 0;
+
+	if (str == NULL || !isdigit((unsigned char)str[0])) return 0;
+
+	while (isdigit((unsigned char)str[i])) {
+		if (tmp > (SIZE_PARSE_MAX - 9) / 10) return 0;
+		tmp = tmp * 10 + (KSI_uint64_t)(str[i++] - '0');
+	}
+
+	switch (str[i]) {
+		case '\0': break;
+		case 'k': case 'K': unit = 1024; i++; break;
+		case 'm': case 'M': unit = 1024 * 1024; i++; break;
+		case 'g': case 'G': unit = 1024 * 1024 * 1024; i++; break;
+		default: return 0;
+	}
+
+	if (str[i] != '\0' || tmp > SIZE_PARSE_MAX / unit) return 0;
+
+	*size = tmp * unit;
+	return 1;
+}
+
+int isFormatOk_size(const char *size) {
+	int i = 0;
+
+	if (size == NULL) return FORMAT_NULLPTR;
+	if (size[0] == '\0') return FORMAT_NOCONTENT;
+
+	while (isdigit((unsigned char)size[i])) i++;
+	if (i == 0) return FORMAT_NOT_INTEGER;
+	if (size[i] != '\0' && (strchr("kKmMgG", size[i]) == NULL || size[i + 1] != '\0')) return FORMAT_INVALID;
+
+	return FORMAT_OK;
+}
+
+int isContentOk_size(const char *size) {
+	KSI_uint64_t tmp = 0;
+
+	if (size == NULL) return FORMAT_NULLPTR;
+	if (!size_parse(size, &tmp)) return INTEGER_TOO_LARGE;
+
+	return PARAM_OK;
+}
+
+int extract_size(void **extra, const char* str, void** obj) {
+	KSI_uint64_t *pSize = (KSI_uint64_t*)obj;
+	VARIABLE_IS_NOT_USED(extra);
+
+	if (!size_parse(str, pSize)) return KT_INVALID_CMD_PARAM;
+	return PST_OK;
+}
 
 int isContentOk_tree_level(const char* integer) {
 	long lvl = 0;
@@ -679,6 +797,26 @@ int isContentOk_inputFile(const char* path){
 	return PARAM_OK;
 }
 
+int isContentOk_inputDir(const char* path){
+	if (isFormatOk_inputFile(path) != FORMAT_OK) {
+		return FILE_INVALID_PATH;
+	}
+
+	if (!SMART_FILE_doFileExist(path)) {
+		return FILE_DOES_NOT_EXIST;
+	}
+
+	if (!SMART_FILE_isFileType(path, SMART_FILE_TYPE_DIR)) {
+		return FILE_NOT_A_DIRECTORY;
+	}
+
+	if (!SMART_FILE_isReadAccess(path)) {
+		return FILE_ACCESS_DENIED;
+	}
+
+	return PARAM_OK;
+}
+
 int isContentOk_inputFileWithPipe(const char* path){
 	if (path == NULL) return FORMAT_NULLPTR;
 	if (strcmp(path, "-") == 0)	return PARAM_OK;
@@ -753,6 +891,61 @@ int extract_hashAlg(void **extra, const char* str, void** obj) {
 	return PST_OK;
 }
 
+int get_hashAlgList(const char *str, KSI_HashAlgorithm *algos, size_t *count) {
+	int ret;
+	const char *next = str;
+	size_t n = 0;
+	size_t i = 0;
+
+	if (str == NULL || algos == NULL || count == NULL) return PARAM_UNKNOWN_ERROR;
+
+	while (next != NULL) {
+		char name[64];
+		const char *comma = strchr(next, ',');
+		size_t len = comma != NULL ? (size_t)(comma - next) : strlen(next);
+
+		if (len == 0 || len >= sizeof(name)) return HASH_ALG_INVALID_NAME;
+		if (n >= HASH_ALG_LIST_MAX) return HASH_ALG_TOO_MANY;
+
+		memcpy(name, next, len);
+		name[len] = '\0';
+
+		ret = isContentOk_hashAlgRejectDeprecated(name);
+		if (ret != PARAM_OK) return ret;
+
+		algos[n] = KSI_getHashAlgorithmByName(name);
+		for (i = 0; i < n; i++) {
+			if (algos[i] == algos[n]) return HASH_ALG_DUPLICATE;
+		}
+
+		n++;
+		next = comma != NULL ? comma + 1 : NULL;
+	}
+
+	*count = n;
+	return PARAM_OK;
+}
+
+int isContentOk_hashAlgListRejectDeprecated(const char *list) {
+	KSI_HashAlgorithm algos[HASH_ALG_LIST_MAX];
+	size_t count = 0;
+
+	return get_hashAlgList(list, algos, &count);
+}
+
+int extract_hashAlgList(void **extra, const char* str, void** obj) {
+	int res;
+	KSI_HashAlgorithm algos[HASH_ALG_LIST_MAX];
+	size_t count = 0;
+
+	if (str == NULL) return extract_hashAlg(extra, str, obj);
+
+	res = get_hashAlgList(str, algos, &count);
+	if (res != PARAM_OK) return KT_UNKNOWN_HASH_ALG;
+
+	*(KSI_HashAlgorithm*)obj = algos[0];
+	return PST_OK;
+}
 
 int isFormatOk_imprint(const char *imprint){
 	char *colon;
@@ -864,6 +1057,7 @@ static int extract_input_hash(void **extra, const char* str, void** obj, int no_
 	char *fname_out = comp->fname_out;
 	KSI_DataHash *tmp = NULL;
 	int in_count = 0;
+	int cache_mode = DIGEST_CACHE_OFF;
 
 	if (obj == NULL) {
 		res = KT_INVALID_ARGUMENT;
@@ -878,7 +1072,13 @@ static int extract_input_hash(void **extra, const char* str, void** obj, int no_
 		res = PARAM_SET_getValueCount(set, "i", NULL, PST_PRIORITY_NONE, &in_count);
 		if (res != KT_OK) goto cleanup;
 
-		res = file_get_hash(err, ctx, no_stream ? "rb" : "rbs", str, fname_out, algo, &tmp);
+		if (PARAM_SET_isSetByName(set, "digest-cache-strict")) {
+			cache_mode = DIGEST_CACHE_WRITE;
+		} else if (PARAM_SET_isSetByName(set, "digest-cache")) {
+			cache_mode = DIGEST_CACHE_READ | DIGEST_CACHE_WRITE;
+		}
+
+		res = file_get_hash(err, ctx, no_stream ? "rb" : "rbs", str, fname_out, algo, cache_mode, &comp->isDigestCached, &tmp);
 		if (res != KT_OK) goto cleanup;
 	}
 
@@ -914,6 +1114,19 @@ static int extract_input_signature(void **extra, const char* str, void** obj, in
 		goto cleanup;
 	}
 
+	if (comp->bundle != NULL) {
+		KSI_DataHash *hsh = NULL;
+
+		if (is_imprint(str)) {
+			res = get_hash_from_imprint(ctx, str, &hsh);
+			ERR_CATCH_MSG(err, res, "Error: Unable to parse hash imprint '%s'.", str);
+		}
+
+		res = KSI_OBJ_loadSignatureFromBundle(err, ctx, (BUNDLE*)comp->bundle, str, hsh, (KSI_Signature**)obj);
+		KSI_DataHash_free(hsh);
+		goto cleanup;
+	}
+
 	res = KSI_OBJ_loadSignature(err, ctx, str, isStream ? "rbs" : "rb", (KSI_Signature**)obj);
 	if (res != KT_OK) goto cleanup;
 
@@ -1147,6 +1360,9 @@ const char *getParameterErrorString(int res) {
 		case FUNCTION_INVALID_ARG_2: return "Argument 2 is invalid";
 		case INVALID_VERSION: return "Invalid version";
 		case INVALID_FLAG_PARAM: return "Invalid flag argument";
+		case FILE_NOT_A_DIRECTORY: return "Path is not a directory";
+		case HASH_ALG_DUPLICATE: return "Hash algorithm is listed more than once";
+		case HASH_ALG_TOO_MANY: return "Too many hash algorithms";
 		default: return "Unknown error";
 	}
 }
@@ -45,6 +45,12 @@ struct COMPOSITE_st {
 
 	/** An optional pointer to file name to save input data to file when hashing. */
 	void *fname_out;
+
+	/** An optional pointer to the signature bundle. If set, input signatures are read from the bundle by name or hash imprint. */
+	void *bundle;
+
+	/** Output parameter set to 1 if the hash of the input file was taken from the digest cache, 0 otherwise. */
+	int isDigestCached;
 };
 
 
@@ -68,6 +74,9 @@ enum contentStatus {
 	FUNCTION_INVALID_ARG_2,
 	INVALID_VERSION,
 	INVALID_FLAG_PARAM,
+	FILE_NOT_A_DIRECTORY,
+	HASH_ALG_DUPLICATE,
+	HASH_ALG_TOO_MANY,
 	PARAM_UNKNOWN_ERROR
 };
 
@@ -104,10 +113,27 @@ int isContentOk_hashAlgRejectDeprecated(const char *alg);
 /** extra is not used.*/
 int extract_hashAlg(void **extra, const char* str, void** obj);
 
+/** Maximum count of hash algorithms in a comma separated list (e.g. SHA-256,SHA-512). */
+#define HASH_ALG_LIST_MAX 8
+
+int isContentOk_hashAlgListRejectDeprecated(const char *list);
+/** Extracts the first algorithm of the list. extra is not used.*/
+int extract_hashAlgList(void **extra, const char* str, void** obj);
+
+/**
+ * Parses a comma separated list of hash algorithms.
+ * \param str		List of algorithm names.
+ * \param algos		Array for the algorithms, at least #HASH_ALG_LIST_MAX elements.
+ * \param count		Output parameter for the count of algorithms.
+ * \return PARAM_OK if successful, content status (see #contentStatus) otherwise.
+ */
+int get_hashAlgList(const char *str, KSI_HashAlgorithm *algos, size_t *count);
+
 int isFormatOk_inputFile(const char *path);
 int isContentOk_inputFile(const char* path);
 int isContentOk_inputFileWithPipe(const char* path);
 int isContentOk_inputFileRestrictPipe(const char* path);
+int isContentOk_inputDir(const char* path);
 
 int isFormatOk_path(const char *path);
 int convertRepair_path(const char* arg, char* buf, unsigned len);
@@ -154,6 +180,15 @@ int isContentOk_int(const char* integer);
  */
 int extract_int(void **extra, const char* str,  void** obj);
 
+/**
+ * Size in bytes with an optional unit suffix k, M or G (powers of 1024), e.g.
+ * 512, 4k or 1G. Parameter obj MUST be a casted pointer that POINTS TO
+ * KSI_uint64_t value.
+ */
+int isFormatOk_size(const char *size);
+int isContentOk_size(const char *size);
+int extract_size(void **extra, const char* str, void** obj);
+
 int isContentOk_tree_level(const char *integer);
 
 int isFormatOk_url(const char *url);
@@ -191,6 +226,13 @@ int get_pipe_in_error(PARAM_SET *set, ERR_TRCKR *err, const char *check_all_file
 
 int is_imprint(const char *str);
 
+/**
+ * Converts the hash imprint (<alg>:<hash in hex>) to the hash object. Use
+ * #is_imprint to validate the string first.
+ * \return KT_OK if successful, error code otherwise.
+ */
+int get_hash_from_imprint(KSI_CTX *ksi, const char *imprint, KSI_DataHash **hash);
+
 #ifdef _WIN32
 int Win32FileWildcard(PARAM_VAL *param_value, void *ctx, int *value_shift);
 #endif
@@ -17,6 +17,7 @@
  * reserves and retains all trademark rights.
  */
 
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -43,31 +44,237 @@
 #include "tool_box.h"
 #include "param_set/strn.h"
 #include "common.h"
+#include "thread_pool.h"
+#include "input_list.h"
+#include "input_index.h"
+#include "hash_stream.h"
+#include "sign_state.h"
+#include "digest_cache.h"
+#include "round_sizer.h"
+#include "bundle.h"
+#include "round_store.h"
+#include "durable.h"
+#include "sign_journal.h"
 
 #ifdef _WIN32
 #	include <windows.h>
 #else
 #	include <sys/time.h>
+#	include <sys/resource.h>
 #endif
 
 typedef struct SIGNING_AGGR_ROUND_st {
 	/* Aggregation round block-signer. */
 	KSI_BlockSigner *block_signer;
-	 /* Block signer handles for aggregation round. */
-	KSI_BlockSignerHandleList *bs_handleList;
+	 /* Block signer handles for aggregation round, one per leaf. NULL if the signature is not held by block-signer. */
+	KSI_BlockSignerHandle **handles;
 
-	 /* A list of hash values. */
-	KSI_DataHash **hash_values;
+	 /* Imprints of the hash values, one slot of KSI_MAX_IMPRINT_LEN bytes per leaf. */
+	unsigned char *imprints;
+
+	/* A list of signatures received without block-signer (see --async). NULL if signature is held by block-signer handle. */
+	KSI_Signature **signatures;
 
 	 /* A list of file names to be used to save the signature file. */
-	char **fname;
+	const char **fname;
+
+	/* Names of the saved signature files, pointing to the name arena. */
 	char **fname_out;
 
+	/* Set if fname_out holds the names reserved before saving, which are then overwritten (see --journal). */
+	int hasReservedNames;
+
+	/**
+	 * Arena of the output names. The blocks are kept when the round is reset and
+	 * reused by the following rounds, so the names are not allocated one by one.
+	 */
+	char **name_blocks;
+	size_t name_block_count;
+	size_t name_block_max;
+	size_t name_block_current;
+	size_t name_block_used;
+
+	/* Count of heap allocations made by the tool for the round state (see -d). The block-signer of libksi is not included. */
+	size_t alloc_count;
+
 	 /* Count of hash values used in aggregation round. */
 	size_t hash_count_max;
 	size_t hash_count;
 } SIGNING_AGGR_ROUND;
 
+#define SIGNING_AGGR_ROUND_NAME_BLOCK 0x10000
+
+typedef struct INPUT_HASH_JOB_st {
+	/* Input file to be hashed by a worker. If NULL, the input is extracted by the main thread. */
+	const char *fname;
+
+	/* Result of hashing and the imprint of the hash value. */
+	int res;
+	unsigned char imprint[KSI_MAX_IMPRINT_LEN];
+	size_t imprint_len;
+} INPUT_HASH_JOB;
+
+typedef struct PARALLEL_HASHER_st {
+	THREAD_POOL *pool;
+
+	/* As KSI context is not thread safe, every worker has its own context, hasher and buffer. */
+	KSI_CTX **ctx;
+	KSI_DataHasher **hasher;
+	char **buf;
+	size_t worker_count;
+	KSI_HashAlgorithm algo;
+
+	/* Usage of the digest cache (see #DIGEST_CACHE_MODE_en). */
+	int cache_mode;
+
+	/* Inputs of the current aggregation round and the count of the inputs actually hashed by the workers. */
+	INPUT_HASH_JOB *jobs;
+	size_t job_count;
+	size_t job_count_max;
+	size_t file_count;
+} PARALLEL_HASHER;
+
+#define PARALLEL_HASHER_BUF_SIZE 0xffff
+
+typedef struct MULTI_HASH_st {
+	/* Hash algorithms given with -H (e.g. -H SHA-256,SHA-512) and the index of the algorithm being signed. */
+	KSI_HashAlgorithm algo[HASH_ALG_LIST_MAX];
+	size_t algo_count;
+	size_t current;
+
+	/* Imprints of the inputs, one slot of KSI_MAX_IMPRINT_LEN bytes per input and algorithm. */
+	unsigned char *imprints;
+	size_t input_count;
+} MULTI_HASH;
+
+typedef struct INPUT_DEDUPE_st {
+	/* Imprints of the inputs, one slot of KSI_MAX_IMPRINT_LEN bytes per input. */
+	unsigned char *imprints;
+	size_t input_count;
+
+	/* Inputs with a unique hash value in the order of the first occurrence. Only these are added to the aggregation trees. */
+	size_t *unique;
+	size_t unique_count;
+
+	/* For every input, the index of the next input with the same hash value or DEDUPE_NONE. */
+	size_t *next;
+} INPUT_DEDUPE;
+
+#define DEDUPE_NONE ((size_t)-1)
+
+typedef struct SIGNATURE_WRITE_JOB_st {
+	/**
+	 * Serialized signature and the file it is written to. Inputs with the same
+	 * hash value (see --dedupe) share the data, which is owned and freed by the
+	 * last job of the leaf. A new file name (see SMART_FILE mode 'i') is chosen
+	 * before the job is queued (see KT_SIGN_reserveOutputName).
+	 */
+	unsigned char *raw;
+	size_t raw_len;
+	int isOwner;
+	char save_to[1024];
+
+	/* Index of the leaf in the aggregation round and the input file name. */
+	size_t leaf;
+	const char *fname;
+	int isDuplicate;
+
+	/**
+	 * Result of writing and the name of the file actually written (see SMART_FILE
+	 * mode 'i'). With --durable it is the temporary file until it is committed.
+	 */
+	int res;
+	char real_output_name[1024];
+} SIGNATURE_WRITE_JOB;
+
+typedef struct SIGNATURE_WRITER_st {
+	THREAD_POOL *pool;
+	size_t worker_count;
+	const char *mode;
+
+	/* Set if the file names are made unique (see mode). The workers then open the reserved names with mode "wb". */
+	int isUnique;
+
+	/**
+	 * Two batches of jobs: the signatures of the next batch are built and
+	 * serialized by the thread that owns the KSI context while the workers are
+	 * writing the previous batch.
+	 */
+	SIGNATURE_WRITE_JOB *jobs[2];
+	size_t job_count[2];
+	size_t job_count_max;
+
+	/* Index of the batch being filled. If isPending is set, the other batch is being written. */
+	size_t current;
+	int isPending;
+
+	/* Aggregation round being saved and the progress of saving. */
+	SIGNING_AGGR_ROUND *aggr_round;
+	SIGN_STATE *state;
+	int prgrs;
+	int divider;
+	int in_count;
+	int count;
+
+	/* Batch that commits the written files (see --durable) or NULL. */
+	DURABLE_BATCH *durable;
+} SIGNATURE_WRITER;
+
+#define SIGNATURE_WRITER_JOBS_PER_WORKER 16
+
+typedef struct SIGNING_SLOT_st {
+	/* Aggregation round record that also holds the block-signer and its handles. */
+	SIGNING_AGGR_ROUND *aggr_round;
+
+	/**
+	 * KSI context and error tracker used to sign the round. If the round is
+	 * signed in the background, these are owned by the slot as neither of them
+	 * is thread safe.
+	 */
+	KSI_CTX *ctx;
+	ERR_TRCKR *err;
+	int isOwner;
+
+	/* Metadata embedded into the signatures of the round. */
+	KSI_MetaData *mdata;
+
+	/* A single worker for signing the round in the background. NULL if the round is signed synchronously. */
+	THREAD_POOL *pool;
+
+	/* Index of the aggregation round and indicator that the round is in flight. */
+	size_t round;
+	int isBusy;
+
+	/* Index of the first input of the round in the inputs (see inputs). */
+	size_t input_offset;
+
+	/* State of incremental signing (see --state) or NULL. */
+	SIGN_STATE *state;
+
+	/* Tag inserted into the output file names when signing with multiple hash algorithms or NULL. */
+	const char *name_tag;
+
+	/* Inputs that share the signature of a leaf (see --dedupe) or NULL. */
+	const INPUT_DEDUPE *dedupe;
+
+	/* Bundle the signatures are written to (see --bundle) or NULL. */
+	BUNDLE *bundle;
+
+	/* Workers that write the signature files of the round (see --save-threads) or NULL. */
+	SIGNATURE_WRITER *writer;
+
+	/* Journal the saved rounds are recorded to (see --journal) or NULL. */
+	SIGN_JOURNAL *journal;
+
+	/**
+	 * Inputs resolved from the parameter set. When the inputs are read from the
+	 * input list, the set is refilled while rounds are in flight, so it points to
+	 * round_inputs that holds copies of the inputs of the round.
+	 */
+	const INPUT_INDEX *inputs;
+	INPUT_INDEX *round_inputs;
+} SIGNING_SLOT;
+
 enum SIGNER_TASKS_en {
 	SIGN_DATA = 0,
 	SIGN_DATA_AND_SAVE,
@@ -75,22 +282,53 @@ enum SIGNER_TASKS_en {
 };
 
 #define TREE_DEPTH_INVALID (-1)
+#define ASYNC_WINDOW_DEFAULT 64
+
+/* Maximum time in milliseconds to sleep between polls of the asynchronous service while responses are awaited. */
+#define ASYNC_POLL_MAX_MS 50
+
+/* Source of the input values read from the input list and the minimum count of rounds read at once. */
+#define INPUT_LIST_SOURCE "input-list"
+#define INPUT_LIST_BATCH_ROUNDS 4
+
+/* Default time window of a hash stream round (see --stream-window) and maximum length of the name of a hash value. */
+#define STREAM_WINDOW_DEFAULT 1000
+#define STREAM_NAME_LEN (KSI_MAX_IMPRINT_LEN * 2 + 32)
+
+/* Default count of threads reading the directories with recursive signing (see -r). */
+#define WALK_THREADS_DEFAULT 4
 
 static int generate_tasks_set(PARAM_SET *set, TASK_SET *task_set);
 static int check_pipe_errors(PARAM_SET *set, ERR_TRCKR *err);
 static int check_io_naming_and_type_errors(PARAM_SET *set, ERR_TRCKR *err);
-static int handleTask(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, int task);
+static int handleTask(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, SMART_FILE *logfile, int task);
 static void SIGNING_AGGR_ROUND_free(SIGNING_AGGR_ROUND *obj);
 static int SIGNING_AGGR_ROUND_resetAndClean(SIGNING_AGGR_ROUND *round);
 static int KT_SIGN_getRemoteConf(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, int *remote_max_lvl, KSI_HashAlgorithm *remote_algo);
 static int KT_SIGN_getMaximumInputsPerRound(PARAM_SET *set, ERR_TRCKR *err, int remote_max_lvl, size_t *inputs);
-static int KT_SIGN_getAggregationRoundsNeeded(PARAM_SET *set, ERR_TRCKR *err, size_t max_tree_inputs, size_t *rounds);
-static int KT_SIGN_performSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, size_t max_tree_inputs, size_t rounds);
-static int KT_SIGN_saveToOutput(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, SIGNING_AGGR_ROUND *aggr_round, int offset);
+static int KT_SIGN_getAggregationRoundsNeeded(PARAM_SET *set, ERR_TRCKR *err, const INPUT_INDEX *inputs, size_t max_tree_inputs, const INPUT_DEDUPE *dedupe, size_t *rounds);
+static int KT_SIGN_performSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, SMART_FILE *logfile, KSI_HashAlgorithm remote_algo, size_t max_tree_inputs, size_t rounds, INPUT_INDEX *inputs, INPUT_LIST *list, SIGN_STATE *state, MULTI_HASH *multi, const INPUT_DEDUPE *dedupe, BUNDLE *bundle, SIGN_JOURNAL *journal);
+static int KT_SIGN_openJournal(PARAM_SET *set, ERR_TRCKR *err, KSI_HashAlgorithm remote_algo, const INPUT_INDEX *inputs, SIGN_JOURNAL **journal);
+static int KT_SIGN_performAsyncSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, const INPUT_INDEX *inputs);
+static int KT_SIGN_performStreamSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, size_t max_tree_inputs);
+static int KT_SIGN_openDirWalker(PARAM_SET *set, ERR_TRCKR *err, INPUT_LIST **list);
+static int KT_SIGN_checkInputListSize(PARAM_SET *set, ERR_TRCKR *err, const char *list_name, SIGN_STATE *state, KSI_HashAlgorithm algo, size_t max_tree_inputs);
+static int KT_SIGN_getHashAlgorithm(PARAM_SET *set, KSI_HashAlgorithm remote_algo, KSI_HashAlgorithm *algo);
+static int KT_SIGN_skipUnchangedInputs(ERR_TRCKR *err, INPUT_INDEX *inputs, SIGN_STATE *state, KSI_HashAlgorithm algo, size_t *skipped);
+static int KT_SIGN_saveToOutput(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, const INPUT_INDEX *inputs, SIGNING_AGGR_ROUND *aggr_round, int offset, SIGN_STATE *state, const char *name_tag, const INPUT_DEDUPE *dedupe, BUNDLE *bundle, SIGNATURE_WRITER *writer);
+static int KT_SIGN_getSignatureFileName(ERR_TRCKR *err, const INPUT_INDEX *inputs, int how_to_save, int input, const char *name_tag, char *buf, size_t buf_len);
 static int KT_SIGN_getMetadata(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, size_t seq_offset, KSI_MetaData **mdata);
 static int KT_SIGN_dump(KSI_CTX *ksi, PARAM_SET *set, ERR_TRCKR *err, SIGNING_AGGR_ROUND *aggr_round);
+static int KT_SIGN_startParallelHashing(PARAM_SET *set, ERR_TRCKR *err, const INPUT_INDEX *inputs, PARALLEL_HASHER *hasher, SIGN_STATE *state, KSI_HashAlgorithm algo, size_t first, size_t count);
+static int KT_SIGN_waitParallelHashing(ERR_TRCKR *err, PARALLEL_HASHER *hasher);
+static int KT_SIGN_getInputHash(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_CTX *hash_ctx, const INPUT_INDEX *inputs, PARALLEL_HASHER *hasher, SIGN_STATE *state, MULTI_HASH *multi, COMPOSITE *extra, size_t i, size_t tree_input, KSI_DataHash **hash);
+static int KT_SIGN_hashWithAllAlgorithms(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, const INPUT_INDEX *inputs, MULTI_HASH *multi);
+static int KT_SIGN_dedupeInputs(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, const INPUT_INDEX *inputs, SIGN_STATE *state, INPUT_DEDUPE *dedupe);
+static void INPUT_DEDUPE_clean(INPUT_DEDUPE *dedupe);
+static size_t getPeakMemoryInKiB(void);
+static void KT_SIGN_printRoundMemory(SIGNING_SLOT **slots, size_t count);
 
-#define PARAMS "{sign}{i}{input}{o}{data-out}{d}{dump}{dump-conf}{log}{conf}{h|help}{dump-last-leaf}{prev-leaf}{mdata}{mask}{show-progress}"
+#define PARAMS "{sign}{i}{input}{o}{data-out}{d}{dump}{dump-conf}{log}{conf}{h|help}{dump-last-leaf}{prev-leaf}{mdata}{mask}{show-progress}{threads}{pipeline}{max-inflight-rounds}{async}{async-window}{input-list}{hash-stream}{stream-window}{stream-raw}{r}{glob}{min-size}{max-size}{walk-threads}{state}{digest-cache}{digest-cache-strict}{dedupe}{target-round-ms}{bundle}{round-store}{save-threads}{durable}{journal}{resume}"
 
 int sign_run(int argc, char** argv, char **envp) {
 	int res;
@@ -135,7 +373,7 @@ int sign_run(int argc, char** argv, char **envp) {
 	/**
 	 * If everything OK, run the task.
 	 */
-	res = handleTask(set, err, ksi, TASK_getID(task));
+	res = handleTask(set, err, ksi, logfile, TASK_getID(task));
 	if (res != KT_OK) goto cleanup;
 
 cleanup:
@@ -171,9 +409,12 @@ char *sign_help_toString(char *buf, size_t len) {
 	if (res != PST_OK) goto cleanup;
 
 	PARAM_SET_setPrintName(set, "input", "--", NULL); /* Temporary name change for formatting help text. */
+	PARAM_SET_setHelpText(set, "H", "<alg>[,<alg>]...", "Use the given hash algorithm to hash the file to be signed. If not set, the default algorithm is used. Use ksi -h to get the list of supported hash algorithms. If a comma separated list of algorithms is given (e.g. SHA-256,SHA-512), every input is read once, hashed with all the algorithms and signed separately for every algorithm. The name of the algorithm is inserted into the output file names (e.g. file.SHA-256.ksig). A list can not be combined with hash imprints as input, --input-list, -r, --hash-stream, --state, --async, --data-out and --prev-leaf.\nIf used in combination with --apply-remote-conf, the algorithm parameter provided by the server will be ignored.");
 	PARAM_SET_setHelpText(set, "input", NULL, "If used everything specified after the token is interpreted as input file (command-line parameters (e.g. --conf, -d), stdin (-) and pre-calculated hash imprints (SHA-256:7647c6...) are all interpreted as regular files).");
 	PARAM_SET_setHelpText(set, "i", "<input>", "The input is either the path to the file to be hashed and signed or a hash imprint in the case the data to be signed has been hashed already. Use '-' as file name to read data to be hashed from stdin. Hash imprint format: <alg>:<hash in hex>.\n\nFlag -i can be omitted when specifying the input. To interpret all inputs as regular files no matter what the file's name is see parameter --.");
 	PARAM_SET_setHelpText(set, "o", "<out.ksig>", "Output file path for the signature. Use '-' as file name to redirect signature binary stream to stdout. If not specified the output is saved to the same directory where the input file is located. When specified as directory all the signatures are saved there. When signature's output file name is not explicitly specified the signature is saved to <input file>.ksig (or <input file>_<nr>.ksig, where <nr> is auto-incremented counter if the output file already exists). When there are N x input and explicitly specified N x output every signature is saved to the corresponding path. If output file name is explicitly specified, will always overwrite the existing file.");
+	PARAM_SET_setHelpText(set, "bundle", "<file>", "Write all the signatures of the run to a single signature bundle instead of separate signature files. Every signature is stored once and indexed by the name of the input ('stdin' for -) and by the document hash, so that ksi verify and ksi extend can read a single signature with --bundle. If the bundle exists, the new signatures are appended to it. Can not be combined with -o, --hash-stream and --async.");
+	PARAM_SET_setHelpText(set, "round-store", NULL, "Write the signatures to the bundle in the round store format. The aggregation and calendar chains that the signatures of an aggregation round have in common are written once per round and every signature only keeps its own local aggregation chains, which makes the bundle considerably smaller. The signatures are rebuilt when read with --bundle and can be exported as standard signature files with ksi verify --export. Only valid with --bundle.");
 	PARAM_SET_setHelpText(set, "data-out", "<file>", "Save signed data to file. Use when signing an incoming stream. Use '-' as file name to redirect data being hashed to stdout.");
 	PARAM_SET_setHelpText(set, "mask", "[<hex | alg:[arg...]>]",  "Specify a hex string to initialize and apply the masking process, or algorithm to generate the initial value instead.\nSupported algorithms:\n"
 																		"\\>2\n*\\>4 crand:seed,len - Use standard C rand() function to generate array of random numbers with the given seed and length. The seed value is unsigned 32bit integer or 'time' to use the system time value instead. If function is specified without the arguments (crand:) 'time' is used to generate random array with size of 32 bytes.\\>\n\n"
@@ -183,6 +424,29 @@ char *sign_help_toString(char *buf, size_t len) {
 	PARAM_SET_setHelpText(set, "dump", "[G]", "Dump signature(s) created in human-readable format to stdout. To make.signature dump suitable for processing with grep, use 'G' as argument.");
 	PARAM_SET_setHelpText(set, "dump-conf", NULL, "Dump aggregator configuration to stdout.");
 	PARAM_SET_setHelpText(set, "show-progress", NULL, "Show progress bar. Is only valid with -d.");
+	PARAM_SET_setHelpText(set, "threads", "<int>", "Count of worker threads used to hash the input files of an aggregation round in parallel. Hash values are added to the local aggregation tree in the same order as the inputs are specified. Default is 1.");
+	PARAM_SET_setHelpText(set, "save-threads", "<int>", "Count of worker threads used to write the signature files of an aggregation round in parallel. The signatures are built and serialized in the order of the inputs while the workers write the previous ones, and the output files and messages are the same as with a single thread. Not used with --bundle and when the signature is written to stdout. Default is 1.");
+	PARAM_SET_setHelpText(set, "durable", NULL, "Make sure that the signature files survive a crash or a power loss before they are reported as saved. Every signature is written to a temporary file, the files are flushed to the storage device in batches by background threads, renamed to their final names and the directory is flushed. Only then the signatures are reported and recorded to the state file. Can not be combined with --bundle, --hash-stream, --async and when the signature is written to stdout.");
+	PARAM_SET_setHelpText(set, "max-inflight-rounds", "<int>", "Maximum count of local aggregation rounds that are being signed at the same time. Every round in flight has its own block-signer and the next round is built while the previous ones are waiting for the aggregator. Signatures are saved in the order of the rounds. Can not be combined with --mask. Default is 1.");
+	PARAM_SET_setHelpText(set, "target-round-ms", "<ms>", "When signing in multiple local aggregation rounds (see --max-aggr-rounds), choose the count of inputs of every round so that hashing, signing and saving a round takes about the given time. The first round is small and the following rounds are sized from the measured signing latency and time per input, up to the maximum size of the tree (see --max-lvl). If signing alone takes longer, full rounds are used. Can not be combined with --input-list, -r, --hash-stream, --async and --max-inflight-rounds.");
+	PARAM_SET_setHelpText(set, "input-list", "<file | ->", "Read the inputs (file paths or hash imprints) from a file or stdin instead of the command-line. Entries are separated by newline, or only by NUL character if the list contains any (e.g. find -print0). The list is read round by round. Output (-o) must be a directory if specified.");
+	PARAM_SET_setHelpText(set, "journal", "<file>", "Record every local aggregation round and the names of its signature files in the journal, so that an interrupted job can be continued with --resume. The journal must not exist. Can not be combined with --input-list, -r, --hash-stream, --async, --data-out, --state, --dedupe, masking and multiple hash algorithms (-H).");
+	PARAM_SET_setHelpText(set, "resume", "<file>", "Continue the job recorded in the journal created with --journal. The rounds that are saved are skipped and signing restarts at the first round that is not, with the same round numbers and metadata sequence numbers (see --mdata-sqn-nr). The inputs and the hash algorithm must be the same as in the job that created the journal.");
+	PARAM_SET_setHelpText(set, "digest-cache", NULL, "Cache the hashes of the input files in their extended attributes (user.ksi.<alg>) and reuse them while the size, modification and change time of the file stay the same. The cache trusts everyone who can write the file, as they can also forge the cached hash. Files that can not be written or are on a file system without extended attributes are hashed as usual.");
+	PARAM_SET_setHelpText(set, "digest-cache-strict", NULL, "Always hash the input files and ignore the cached hashes, but update the cache.");
+	PARAM_SET_setHelpText(set, "dedupe", NULL, "Hash all the inputs in advance and add every hash value to the local aggregation tree only once. The signature of the hash value is saved for every input with the same hash value, so identical files take a single leaf and fewer aggregation rounds are needed. Can not be combined with --mask, --prev-leaf, --mdata, --input-list, -r, --hash-stream, --async, --data-out, --pipeline and multiple hash algorithms (-H).");
+	PARAM_SET_setHelpText(set, "r", "<dir>", "Sign all regular files in the directory tree. Directories are read in parallel (see --walk-threads) while the files already found are hashed and signed, so the order of the inputs is not defined. Symbolic links to files are followed, symbolic links to directories are not. Output (-o) must be a directory if specified. Can be used multiple times.");
+	PARAM_SET_setHelpText(set, "glob", "<pattern>", "Sign only the files with the name matching the pattern (wildcards * and ?) when -r is used. Can be used multiple times.");
+	PARAM_SET_setHelpText(set, "min-size", "<size>", "Sign only the files with at least the given size when -r is used. Size is in bytes or with suffix k, M or G.");
+	PARAM_SET_setHelpText(set, "max-size", "<size>", "Sign only the files with at most the given size when -r is used. Size is in bytes or with suffix k, M or G.");
+	PARAM_SET_setHelpText(set, "walk-threads", "<int>", "Count of threads reading the directories when -r is used. Default is 4.");
+	PARAM_SET_setHelpText(set, "state", "<file>", "Sign incrementally. Every signed file is recorded in the state file with its size, modification time and hash. Files that have not changed since they were recorded and whose signature exists are skipped, and the recorded hash is reused if the signature is missing. The file is created if it does not exist. Output (-o) must be a directory if specified.");
+	PARAM_SET_setHelpText(set, "hash-stream", "<file | ->", "Sign a continuous stream of hash imprints (<alg>:<hash in hex>), one per line, read from a file or stdin. A local aggregation round is signed as soon as the tree is full or the time window (--stream-window) expires and the signatures are written immediately to stdout (-o -) or to a directory (-o <dir>) as <nr>.ksig, where <nr> is the index of the hash in the stream.");
+	PARAM_SET_setHelpText(set, "stream-window", "<ms>", "Maximum time in milliseconds a hash from the hash stream waits for the local aggregation round to be signed. The time is counted from the first hash of the round. Default is 1000.");
+	PARAM_SET_setHelpText(set, "stream-raw", NULL, "Read the hash stream as raw binary digests of the hash algorithm specified with -H instead of hash imprints.");
+	PARAM_SET_setHelpText(set, "async", NULL, "Sign every input separately with asynchronous signing service instead of the local aggregation tree. Up to --async-window requests are sent to the aggregator without waiting for the responses. Can not be combined with --mask or --mdata.");
+	PARAM_SET_setHelpText(set, "async-window", "<int>", "Maximum count of signing requests in flight when --async is used. Default is 64.");
+	PARAM_SET_setHelpText(set, "pipeline", NULL, "When signing in multiple local aggregation rounds (see --max-aggr-rounds), hash the input files of the next round in the background while the current round is being signed. Use --threads to set the count of hashing threads.");
 	PARAM_SET_setHelpText(set,    "apply-remote-conf", NULL, "Obtain and apply configuration data from aggregation service server. Following configuration parameters can be received from server:"
 										"\\>2\n*\\>4  maximum level - the maximum allowed depth of the local aggregation tree. This can be set to a lower value with --max-lvl."
 										"\\>2\n*\\>4  aggregation hash algorithm - recommended hash function identifier to be used for hashing the file to be signed. This parameter can be overridden with -H.\\>\n"
@@ -192,12 +456,16 @@ char *sign_help_toString(char *buf, size_t len) {
 	PARAM_SET_setHelpText(set, "log", "<file>", "Write libksi log to given file. Use '-' as file name to redirect log to stdout.");
 
 	count += PST_snhiprintf(buf + count, len - count, 80, 0, 0, NULL, ' ', "Usage:\\>1\n\\>10"
-			"ksi sign -S <URL> [--aggr-user <user> --aggr-key <key>] [-H <alg>]\n"
+			"ksi sign -S <URL> [--aggr-user <user> --aggr-key <key>] [-H <alg>[,<alg>]...]\n"
 			"[--data-out <file>] [more_options] [-i <input>]... [<input>]...\n"
 			"[-- [<only file input>]...] [-o <out.ksig>]...\\>1\n\\>4"
+			"ksi sign -S <URL> [--aggr-user <user> --aggr-key <key>] [more_options]\n"
+			"-r <dir>... [--glob <pattern>]... [-o <dir>]\\>1\n\\>4"
+			"ksi sign -S <URL> [--aggr-user <user> --aggr-key <key>] [more_options]\n"
+			"--hash-stream <file | -> [--stream-window <ms>] -o <dir | ->\\>1\n\\>4"
 			"ksi sign -S <URL> [--aggr-user <user> --aggr-key <key>] --dump-conf\\>\n\n\n");
 
-	ret = PARAM_SET_helpToString(set, "i,o,H,S,aggr-user,aggr-key,aggr-hmac-alg,data-out,max-lvl,max-aggr-rounds,mask,prev-leaf,mdata,mdata-cli-id,mdata-mac-id,mdata-sqn-nr,mdata-req-tm,input,d,dump,dump-conf,show-progress,conf,apply-remote-conf,log", 1, 13, 80, buf + count, len - count);
+	ret = PARAM_SET_helpToString(set, "i,input-list,r,glob,min-size,max-size,walk-threads,state,journal,resume,digest-cache,digest-cache-strict,hash-stream,o,bundle,round-store,H,S,aggr-user,aggr-key,aggr-hmac-alg,data-out,max-lvl,max-aggr-rounds,threads,save-threads,durable,pipeline,max-inflight-rounds,target-round-ms,dedupe,async,async-window,stream-window,stream-raw,mask,prev-leaf,mdata,mdata-cli-id,mdata-mac-id,mdata-sqn-nr,mdata-req-tm,input,d,dump,dump-conf,show-progress,conf,apply-remote-conf,log", 1, 13, 80, buf + count, len - count);
 
 cleanup:
 	if (res != PST_OK || ret == NULL) {
@@ -226,14 +494,20 @@ static int generate_tasks_set(PARAM_SET *set, TASK_SET *task_set) {
 	res = CONF_initialize_set_functions(set, "S");
 	if (res != KT_OK) goto cleanup;
 
+	/* Sign accepts a list of hash algorithms to sign every input with each of them. */
+	PARAM_SET_addControl(set, "{H}", isFormatOk_hashAlg, isContentOk_hashAlgListRejectDeprecated, NULL, extract_hashAlgList);
 	PARAM_SET_addControl(set, "{conf}", isFormatOk_inputFile, isContentOk_inputFileRestrictPipe, convertRepair_path, NULL);
-	PARAM_SET_addControl(set, "{o}{data-out}{log}", isFormatOk_path, NULL, convertRepair_path, NULL);
+	PARAM_SET_addControl(set, "{o}{data-out}{log}{input-list}{hash-stream}{state}{bundle}{journal}{resume}", isFormatOk_path, NULL, convertRepair_path, NULL);
+	PARAM_SET_addControl(set, "{r}", isFormatOk_path, isContentOk_inputDir, convertRepair_path, NULL);
+	PARAM_SET_addControl(set, "{glob}", isFormatOk_string, NULL, NULL, NULL);
+	PARAM_SET_addControl(set, "{min-size}{max-size}", isFormatOk_size, isContentOk_size, NULL, extract_size);
 	PARAM_SET_addControl(set, "{i}", isFormatOk_inputHash, isContentOk_inputHash, convertRepair_path, extract_inputHash);
 	PARAM_SET_addControl(set, "{input}", isFormatOk_inputFile, isContentOk_inputFile, convertRepair_path, extract_inputHashFromFile);
 	PARAM_SET_addControl(set, "{prev-leaf}", isFormatOk_imprint, isContentOk_imprint, NULL, extract_imprint);
-	PARAM_SET_addControl(set, "{d}{dump-conf}{dump-last-leaf}{mdata}{show-progress}", isFormatOk_flag, NULL, NULL, NULL);
+	PARAM_SET_addControl(set, "{d}{dump-conf}{dump-last-leaf}{mdata}{show-progress}{pipeline}{async}{stream-raw}{digest-cache}{digest-cache-strict}{dedupe}{round-store}{durable}", isFormatOk_flag, NULL, NULL, NULL);
 	PARAM_SET_addControl(set, "{mask}", isFormatOk_mask, isContentOk_mask, convertRepair_mask, extract_mask);
-	PARAM_SET_setParseOptions(set, "{d}{dump-conf}{dump-last-leaf}{mdata}{show-progress}", PST_PRSCMD_HAS_NO_VALUE);
+	PARAM_SET_addControl(set, "{threads}{save-threads}{max-inflight-rounds}{async-window}{stream-window}{walk-threads}{target-round-ms}", isFormatOk_int, isContentOk_uint_not_zero, NULL, extract_int);
+	PARAM_SET_setParseOptions(set, "{d}{dump-conf}{dump-last-leaf}{mdata}{show-progress}{pipeline}{async}{stream-raw}{digest-cache}{digest-cache-strict}{dedupe}{round-store}{durable}", PST_PRSCMD_HAS_NO_VALUE);
 
 	PARAM_SET_addControl(set, "{dump}", NULL, isContentOk_dump_flag, NULL, extract_dump_flag);
 
@@ -263,9 +537,9 @@ static int generate_tasks_set(PARAM_SET *set, TASK_SET *task_set) {
 	res = PARAM_SET_add(set, "max-aggr-rounds", "1", "default", PRIORITY_KSI_DEFAULT);
 
 	/*						ID							DESC										MAN				ATL				FORBIDDEN		IGN	*/
-	TASK_SET_add(task_set,	SIGN_DATA,					"Sign data.",								"S",			"i,input",		"data-out",	NULL);
-	TASK_SET_add(task_set,	SIGN_DATA_AND_SAVE,			"Sign and save data.",						"S,data-out",	"i,input",		NULL,			NULL);
-	TASK_SET_add(task_set,	AGGREGATOR_DUMP_CONF,		"Dump aggregator configuration.",			"S,dump-conf",	NULL,			"i,input,o,data-out",		NULL);
+	TASK_SET_add(task_set,	SIGN_DATA,					"Sign data.",								"S",			"i,input,input-list,r,hash-stream",		"data-out",	NULL);
+	TASK_SET_add(task_set,	SIGN_DATA_AND_SAVE,			"Sign and save data.",						"S,data-out",	"i,input,input-list,r,hash-stream",		NULL,			NULL);
+	TASK_SET_add(task_set,	AGGREGATOR_DUMP_CONF,		"Dump aggregator configuration.",			"S,dump-conf",	NULL,			"i,input,input-list,r,hash-stream,o,data-out",		NULL);
 
 cleanup:
 
@@ -278,7 +552,7 @@ static int check_pipe_errors(PARAM_SET *set, ERR_TRCKR *err) {
 	res = get_pipe_out_error(set, err, "o", "data-out,log", "dump");
 	if (res != KT_OK) goto cleanup;
 
-	res = get_pipe_in_error(set, err, "i", NULL, NULL);
+	res = get_pipe_in_error(set, err, "i,input-list,hash-stream", NULL, NULL);
 	if (res != KT_OK) goto cleanup;
 
 cleanup:
@@ -289,21 +563,219 @@ static int check_io_naming_and_type_errors(PARAM_SET *set, ERR_TRCKR *err) {
 	int res;
 	int in_count = 0;
 	char *data_out = NULL;
-
+	int max_inflight = 1;
 
 	if (set == NULL || err == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
+	/**
+	 * Inputs from the input list or the directory tree are not known in advance,
+	 * so the signatures can only be saved next to the inputs or to a directory.
+	 */
+	if (PARAM_SET_isOneOfSetByName(set, "input-list,r")) {
+		int out_count = 0;
+		char *out = NULL;
+
+		if (PARAM_SET_isOneOfSetByName(set, "i,input,data-out,async") || (PARAM_SET_isSetByName(set, "input-list") && PARAM_SET_isSetByName(set, "r"))) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Input list (--input-list) or recursive signing (-r) can not be combined with -i, --data-out, --async or with each other.");
+			goto cleanup;
+		}
+
+		res = PARAM_SET_getValueCount(set, "o", NULL, PST_PRIORITY_NONE, &out_count);
+		if (res != PST_OK) goto cleanup;
+
+		res = PARAM_SET_getStr(set, "o", NULL, PST_PRIORITY_NONE, 0, &out);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+		if (out_count > 1 || (out_count == 1 && !SMART_FILE_isFileType(out, SMART_FILE_TYPE_DIR))) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Output (-o) must be a directory when input list (--input-list) or recursive signing (-r) is used.");
+			goto cleanup;
+		}
+	}
+
+	/**
+	 * Incremental signing skips the inputs, so the signatures can not be saved
+	 * to the explicitly specified files. The data must be read from files.
+	 */
+	if (PARAM_SET_isSetByName(set, "state")) {
+		int out_count = 0;
+		char *out = NULL;
+
+		if (PARAM_SET_isOneOfSetByName(set, "data-out,async,hash-stream")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: State file (--state) can not be combined with --data-out, --async or --hash-stream.");
+			goto cleanup;
+		}
+
+		res = PARAM_SET_getValueCount(set, "o", NULL, PST_PRIORITY_NONE, &out_count);
+		if (res != PST_OK) goto cleanup;
+
+		res = PARAM_SET_getStr(set, "o", NULL, PST_PRIORITY_NONE, 0, &out);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+		if (out_count > 1 || (out_count == 1 && !SMART_FILE_isFileType(out, SMART_FILE_TYPE_DIR))) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Output (-o) must be a directory when state file (--state) is used.");
+			goto cleanup;
+		}
+	}
+
+	/**
+	 * Signing with multiple hash algorithms needs all the inputs in advance and
+	 * every input must be hashed with every algorithm.
+	 */
+	if (PARAM_SET_isSetByName(set, "H")) {
+		char *algo_list = NULL;
+
+		res = PARAM_SET_getStr(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &algo_list);
+		if (res != PST_OK) goto cleanup;
+
+		if (strchr(algo_list, ',') != NULL && PARAM_SET_isOneOfSetByName(set, "input-list,r,hash-stream,state,async,data-out,prev-leaf")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Multiple hash algorithms (-H) can not be combined with --input-list, -r, --hash-stream, --state, --async, --data-out or --prev-leaf.");
+			goto cleanup;
+		}
+	}
+
+	/**
+	 * Duplicate hash values share a leaf. Masking and metadata make every leaf
+	 * unique and the inputs must be known in advance.
+	 */
+	if (PARAM_SET_isSetByName(set, "dedupe")) {
+		char *algo_list = NULL;
+
+		if (PARAM_SET_isOneOfSetByName(set, "mask,prev-leaf,mdata,mdata-cli-id")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Deduplication (--dedupe) can not be combined with masking (--mask, --prev-leaf) or metadata (--mdata), as these need a separate leaf for every input.");
+			goto cleanup;
+		}
+
+		res = PARAM_SET_getStr(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &algo_list);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+		if (PARAM_SET_isOneOfSetByName(set, "input-list,r,hash-stream,async,data-out,pipeline") || (algo_list != NULL && strchr(algo_list, ',') != NULL)) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Deduplication (--dedupe) can not be combined with --input-list, -r, --hash-stream, --async, --data-out, --pipeline or multiple hash algorithms (-H).");
+			goto cleanup;
+		}
+	}
+
+	/**
+	 * All the signatures are written to the bundle, so there are no output files.
+	 * Hash stream and asynchronous signing save the signatures on their own.
+	 */
+	if (PARAM_SET_isSetByName(set, "bundle")) {
+		char *bundle_name = NULL;
+
+		if (PARAM_SET_isOneOfSetByName(set, "o,hash-stream,async")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Signature bundle (--bundle) can not be combined with -o, --hash-stream or --async.");
+			goto cleanup;
+		}
+
+		res = PARAM_SET_getStr(set, "bundle", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &bundle_name);
+		if (res != PST_OK) goto cleanup;
+
+		if (strcmp(bundle_name, "-") == 0) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Signature bundle (--bundle) can not be written to stdout.");
+			goto cleanup;
+		}
+	}
+
+	if (PARAM_SET_isSetByName(set, "round-store") && !PARAM_SET_isSetByName(set, "bundle")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Round store (--round-store) is only valid with signature bundle (--bundle).");
+		goto cleanup;
+	}
+
+	/**
+	 * Durable output files are committed by the signature writer, that is only
+	 * used when the signatures of the rounds are saved to separate files.
+	 */
+	if (PARAM_SET_isSetByName(set, "durable")) {
+		if (PARAM_SET_isOneOfSetByName(set, "bundle,hash-stream,async")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Durable output (--durable) can not be combined with --bundle, --hash-stream or --async.");
+			goto cleanup;
+		}
+
+		if (how_is_output_saved_to(set, "i,input", "o") == OUTPUT_TO_STDOUT) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Durable output (--durable) can not be used when the signature is written to stdout (-o -).");
+			goto cleanup;
+		}
+	}
+
+	/**
+	 * The journal records the rounds by the indexes of the inputs, so the inputs
+	 * must be known in advance and be the same when the job is resumed.
+	 */
+	if (PARAM_SET_isOneOfSetByName(set, "journal,resume")) {
+		char *algo_list = NULL;
+
+		if (PARAM_SET_isSetByName(set, "journal") && PARAM_SET_isSetByName(set, "resume")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Journal (--journal) can not be combined with --resume, as the resumed job is recorded to the same journal.");
+			goto cleanup;
+		}
+
+		res = PARAM_SET_getStr(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &algo_list);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+		if (PARAM_SET_isOneOfSetByName(set, "input-list,r,hash-stream,async,data-out,state,dedupe,mask,prev-leaf") || (algo_list != NULL && strchr(algo_list, ',') != NULL)) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Journal (--journal, --resume) can not be combined with --input-list, -r, --hash-stream, --async, --data-out, --state, --dedupe, masking (--mask, --prev-leaf) or multiple hash algorithms (-H).");
+			goto cleanup;
+		}
+	}
+
+	if (!PARAM_SET_isSetByName(set, "r") && PARAM_SET_isOneOfSetByName(set, "glob,min-size,max-size,walk-threads")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Options --glob, --min-size, --max-size and --walk-threads are only valid with recursive signing (-r).");
+		goto cleanup;
+	}
+
+	if (PARAM_SET_isSetByName(set, "min-size") && PARAM_SET_isSetByName(set, "max-size")) {
+		KSI_uint64_t min_size = 0;
+		KSI_uint64_t max_size = 0;
+
+		res = PARAM_SET_getObj(set, "min-size", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&min_size);
+		if (res != PST_OK) goto cleanup;
+
+		res = PARAM_SET_getObj(set, "max-size", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_size);
+		if (res != PST_OK) goto cleanup;
+
+		if (min_size > max_size) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Minimum file size (--min-size) is larger than maximum file size (--max-size).");
+			goto cleanup;
+		}
+	}
+
+	/**
+	 * Hash stream is signed until the stream is closed, so the signatures are
+	 * written out round by round to stdout or to a directory.
+	 */
+	if (PARAM_SET_isSetByName(set, "hash-stream")) {
+		int out_count = 0;
+		char *out = NULL;
+
+		if (PARAM_SET_isOneOfSetByName(set, "i,input,input-list,r,data-out,async,pipeline,max-inflight-rounds,threads")) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Hash stream (--hash-stream) can not be combined with -i, --input-list, -r, --data-out, --async, --pipeline, --max-inflight-rounds or --threads.");
+			goto cleanup;
+		}
+
+		res = PARAM_SET_getValueCount(set, "o", NULL, PST_PRIORITY_NONE, &out_count);
+		if (res != PST_OK) goto cleanup;
+
+		res = PARAM_SET_getStr(set, "o", NULL, PST_PRIORITY_NONE, 0, &out);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+		if (out_count != 1 || (strcmp(out, "-") != 0 && !SMART_FILE_isFileType(out, SMART_FILE_TYPE_DIR))) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Output (-o) must be stdout (-) or a directory when hash stream (--hash-stream) is used.");
+			goto cleanup;
+		}
+	}
+
 	/**
 	 * Get the count of inputs and outputs for error handling.
 	 */
 	res = PARAM_SET_getValueCount(set, "i,input", NULL, PST_PRIORITY_NONE, &in_count);
 	if (res != PST_OK) goto cleanup;
 
-	res = check_general_io_errors(set, err, "i,input", "o");
-	if (res != PST_OK) goto cleanup;
+	if (!PARAM_SET_isOneOfSetByName(set, "input-list,r,hash-stream")) {
+		res = check_general_io_errors(set, err, "i,input", "o");
+		if (res != PST_OK) goto cleanup;
+	}
 
 	res = PARAM_SET_getStr(set, "data-out", NULL, PST_PRIORITY_NONE, 0, &data_out);
 	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
@@ -318,6 +790,42 @@ static int check_io_naming_and_type_errors(PARAM_SET *set, ERR_TRCKR *err) {
 		goto cleanup;
 	}
 
+	res = PARAM_SET_getObj(set, "max-inflight-rounds", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_inflight);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	/**
+	 * Rounds that are in flight at the same time are signed with separate
+	 * block-signers. Masking links the rounds with each other and PDU header
+	 * message id is a shared counter, so these can not be combined.
+	 */
+	if (max_inflight > 1 && PARAM_SET_isSetByName(set, "mask")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Masking (--mask) can not be used with multiple local aggregation rounds in flight (--max-inflight-rounds).");
+		goto cleanup;
+	}
+
+	/**
+	 * Adaptive round size is chosen from the measurements of the previous round,
+	 * so the rounds must be signed one at a time from the inputs known in advance.
+	 */
+	if (PARAM_SET_isSetByName(set, "target-round-ms") && (max_inflight > 1 || PARAM_SET_isOneOfSetByName(set, "input-list,r,hash-stream,async"))) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Adaptive round size (--target-round-ms) can not be combined with --input-list, -r, --hash-stream, --async or multiple local aggregation rounds in flight (--max-inflight-rounds).");
+		goto cleanup;
+	}
+
+	if (max_inflight > 1 && PARAM_SET_isOneOfSetByName(set, "inst-id,msg-id")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: PDU header instance or message id (--inst-id, --msg-id) can not be used with multiple local aggregation rounds in flight (--max-inflight-rounds).");
+		goto cleanup;
+	}
+
+	/**
+	 * Asynchronous signing does not build a local aggregation tree, so the tree
+	 * related options have no meaning.
+	 */
+	if (PARAM_SET_isSetByName(set, "async") && PARAM_SET_isOneOfSetByName(set, "mask,prev-leaf,mdata,dump-last-leaf,pipeline,max-inflight-rounds,threads")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Asynchronous signing (--async) can not be combined with --mask, --prev-leaf, --mdata, --dump-last-leaf, --pipeline, --max-inflight-rounds or --threads.");
+		goto cleanup;
+	}
+
 	res = KT_OK;
 
 cleanup:
@@ -325,8 +833,19 @@ cleanup:
 	return res;
 }
 
-static int handleTask(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, int task) {
+static int handleTask(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, SMART_FILE *logfile, int task) {
 	int res = KT_UNKNOWN_ERROR;
+	INPUT_LIST *list = NULL;
+	SIGN_STATE *state = NULL;
+	BUNDLE *bundle = NULL;
+	SIGN_JOURNAL *journal = NULL;
+	INPUT_INDEX *inputs = NULL;
+	MULTI_HASH multi;
+	INPUT_DEDUPE dedupe;
+	const INPUT_INDEX_EXTRACTOR extractors[] = {extract_inputHash, extract_inputHashFromFile};
+
+	memset(&multi, 0, sizeof(multi));
+	memset(&dedupe, 0, sizeof(dedupe));
 
 	switch (task) {
 		case SIGN_DATA:
@@ -341,13 +860,172 @@ static int handleTask(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, int task) {
 					if (res != KT_OK) goto cleanup;
 				}
 
+				/**
+				 * The inputs are resolved from the parameter set once and then
+				 * accessed by index in every stage of signing.
+				 */
+				res = INPUT_INDEX_new("i,input", extractors, "o", &inputs);
+				ERR_CATCH_MSG(err, res, "Error: Unable to create input index.");
+
+				if (PARAM_SET_isSetByName(set, "async")) {
+					res = INPUT_INDEX_update(inputs, set);
+					ERR_CATCH_MSG(err, res, "Error: Unable to index the inputs.");
+
+					res = KT_SIGN_performAsyncSigning(set, err, ctx, remote_algo, inputs);
+					goto cleanup;
+				}
+
 				res = KT_SIGN_getMaximumInputsPerRound(set, err, remote_max_lvl, &max_tree_input);
 				if (res != KT_OK) goto cleanup;
 
-				res = KT_SIGN_getAggregationRoundsNeeded(set, err, max_tree_input, &rounds);
-				if (res != KT_OK) goto cleanup;
+				if (PARAM_SET_isSetByName(set, "hash-stream")) {
+					res = KT_SIGN_performStreamSigning(set, err, ctx, remote_algo, max_tree_input);
+					goto cleanup;
+				}
 
-				res = KT_SIGN_performSigning(set, err, ctx, remote_algo, max_tree_input, rounds);
+				if (PARAM_SET_isSetByName(set, "state")) {
+					char *state_name = NULL;
+					int d = PARAM_SET_isSetByName(set, "d");
+
+					res = PARAM_SET_getStr(set, "state", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &state_name);
+					if (res != PST_OK) goto cleanup;
+
+					print_progressDesc(d, "Loading state file... ");
+					res = SIGN_STATE_open(state_name, &state);
+					if (res == KT_INVALID_INPUT_FORMAT) {
+						ERR_TRCKR_ADD(err, res, "Error: '%s' is not a valid state file.", state_name);
+						goto cleanup;
+					}
+					ERR_CATCH_MSG(err, res, "Error: Unable to open state file '%s'.", state_name);
+					print_progressResult(res);
+					print_debug("%zu files recorded in the state file.\n", SIGN_STATE_getCount(state));
+				}
+
+				if (PARAM_SET_isSetByName(set, "bundle")) {
+					char *bundle_name = NULL;
+
+					res = PARAM_SET_getStr(set, "bundle", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &bundle_name);
+					if (res != PST_OK) goto cleanup;
+
+					res = BUNDLE_open(bundle_name, 1, &bundle);
+					if (res == KT_INVALID_INPUT_FORMAT) {
+						ERR_TRCKR_ADD(err, res, "Error: '%s' is not a valid signature bundle.", bundle_name);
+						goto cleanup;
+					}
+					ERR_CATCH_MSG(err, res, "Error: Unable to open signature bundle '%s'.", bundle_name);
+				}
+
+				if (PARAM_SET_isSetByName(set, "input-list")) {
+					char *list_name = NULL;
+					int max_inflight = 1;
+
+					res = PARAM_SET_getStr(set, "input-list", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &list_name);
+					if (res != PST_OK) goto cleanup;
+
+					res = PARAM_SET_getObj(set, "max-inflight-rounds", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_inflight);
+					if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+					res = INPUT_LIST_open(list_name, &list);
+					ERR_CATCH_MSG(err, res, "Error: Unable to open the input list '%s'.", list_name);
+
+					if (strcmp(list_name, "-") != 0 && SMART_FILE_isFileType(list_name, SMART_FILE_TYPE_REGULAR)) {
+						KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+
+						res = KT_SIGN_getHashAlgorithm(set, remote_algo, &algo);
+						if (res != KT_OK) goto cleanup;
+
+						res = KT_SIGN_checkInputListSize(set, err, list_name, state, algo, max_tree_input);
+						if (res != KT_OK) goto cleanup;
+					}
+
+					/* Read enough rounds at once to keep all the rounds in flight busy. */
+					rounds = max_inflight > INPUT_LIST_BATCH_ROUNDS ? (size_t)max_inflight : INPUT_LIST_BATCH_ROUNDS;
+				} else if (PARAM_SET_isSetByName(set, "r")) {
+					int max_inflight = 1;
+
+					res = PARAM_SET_getObj(set, "max-inflight-rounds", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_inflight);
+					if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+					res = KT_SIGN_openDirWalker(set, err, &list);
+					if (res != KT_OK) goto cleanup;
+
+					rounds = max_inflight > INPUT_LIST_BATCH_ROUNDS ? (size_t)max_inflight : INPUT_LIST_BATCH_ROUNDS;
+				} else {
+					res = INPUT_INDEX_update(inputs, set);
+					ERR_CATCH_MSG(err, res, "Error: Unable to index the inputs.");
+
+					if (state != NULL) {
+						KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+						size_t skipped = 0;
+
+						res = KT_SIGN_getHashAlgorithm(set, remote_algo, &algo);
+						if (res != KT_OK) goto cleanup;
+
+						res = KT_SIGN_skipUnchangedInputs(err, inputs, state, algo, &skipped);
+						if (res != KT_OK) goto cleanup;
+
+						if (INPUT_INDEX_getCount(inputs) == 0) {
+							print_debug("All the inputs are unchanged since they were signed.\n");
+							res = KT_OK;
+							goto cleanup;
+						}
+					}
+
+					/**
+					 * With deduplication all the inputs are hashed first and the
+					 * rounds are counted from the unique hash values.
+					 */
+					if (PARAM_SET_isSetByName(set, "dedupe")) {
+						res = KT_SIGN_dedupeInputs(set, err, ctx, remote_algo, inputs, state, &dedupe);
+						if (res != KT_OK) goto cleanup;
+
+						res = KT_SIGN_getAggregationRoundsNeeded(set, err, inputs, max_tree_input, &dedupe, &rounds);
+						if (res != KT_OK) goto cleanup;
+
+						res = KT_SIGN_performSigning(set, err, ctx, logfile, remote_algo, max_tree_input, rounds, inputs, NULL, state, NULL, &dedupe, bundle, NULL);
+						goto cleanup;
+					}
+
+					res = KT_SIGN_getAggregationRoundsNeeded(set, err, inputs, max_tree_input, NULL, &rounds);
+					if (res != KT_OK) goto cleanup;
+
+					if (PARAM_SET_isOneOfSetByName(set, "journal,resume")) {
+						res = KT_SIGN_openJournal(set, err, remote_algo, inputs, &journal);
+						if (res != KT_OK) goto cleanup;
+					}
+
+					/**
+					 * When multiple hash algorithms are given, every input is read
+					 * once and hashed with all the algorithms. The inputs are then
+					 * signed separately for every algorithm.
+					 */
+					if (PARAM_SET_isSetByName(set, "H")) {
+						char *algo_list = NULL;
+
+						res = PARAM_SET_getStr(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &algo_list);
+						if (res != PST_OK) goto cleanup;
+
+						if (get_hashAlgList(algo_list, multi.algo, &multi.algo_count) != PARAM_OK) {
+							ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Invalid hash algorithm list '%s'.", algo_list);
+							goto cleanup;
+						}
+					}
+
+					if (multi.algo_count > 1) {
+						res = KT_SIGN_hashWithAllAlgorithms(set, err, ctx, inputs, &multi);
+						if (res != KT_OK) goto cleanup;
+
+						for (multi.current = 0; multi.current < multi.algo_count; multi.current++) {
+							print_debug("Signing with %s.\n", KSI_getHashAlgorithmName(multi.algo[multi.current]));
+
+							res = KT_SIGN_performSigning(set, err, ctx, logfile, remote_algo, max_tree_input, rounds, inputs, NULL, NULL, &multi, NULL, bundle, NULL);
+							if (res != KT_OK) goto cleanup;
+						}
+						goto cleanup;
+					}
+				}
+
+				res = KT_SIGN_performSigning(set, err, ctx, logfile, remote_algo, max_tree_input, rounds, inputs, list, state, NULL, NULL, bundle, journal);
 				if (res != KT_OK) goto cleanup;
 			}
 			goto cleanup;
@@ -362,6 +1040,22 @@ static int handleTask(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, int task) {
 	}
 
 cleanup:
+
+	INPUT_LIST_close(list);
+	SIGN_STATE_close(state);
+	SIGN_JOURNAL_close(journal);
+	INPUT_INDEX_free(inputs);
+	KSI_free(multi.imprints);
+	INPUT_DEDUPE_clean(&dedupe);
+
+	/* The index is written even if signing failed, so the signatures already saved can be read. */
+	if (bundle != NULL) {
+		int close_res = BUNDLE_close(bundle);
+		if (close_res != KT_OK && res == KT_OK) {
+			ERR_TRCKR_ADD(err, res = close_res, "Error: Unable to write the index of the signature bundle.");
+		}
+	}
+
 	return res;
 }
 
@@ -541,7 +1235,7 @@ cleanup:
 	return res;
 }
 
-static int KT_SIGN_getAggregationRoundsNeeded(PARAM_SET *set, ERR_TRCKR *err, size_t max_tree_inputs, size_t *rounds) {
+static int KT_SIGN_getAggregationRoundsNeeded(PARAM_SET *set, ERR_TRCKR *err, const INPUT_INDEX *inputs, size_t max_tree_inputs, const INPUT_DEDUPE *dedupe, size_t *rounds) {
 	int res = KT_UNKNOWN_ERROR;
 	int input_file_count = 0;
 	int max_local_aggr_rounds = 0;
@@ -549,13 +1243,16 @@ static int KT_SIGN_getAggregationRoundsNeeded(PARAM_SET *set, ERR_TRCKR *err, si
 	size_t round_count = 0;
 
 
-	if (set == NULL || err == NULL || rounds == NULL || max_tree_inputs == 0) {
+	if (set == NULL || err == NULL || inputs == NULL || rounds == NULL || max_tree_inputs == 0) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
 		goto cleanup;
 	}
 
-	res = PARAM_SET_getValueCount(set, "i,input", NULL, PST_PRIORITY_NONE, &input_file_count);
-	if (res != PST_OK) goto cleanup;
+	/* Count the indexed inputs, as the unchanged files are only removed from the index (see --state). */
+	input_file_count = (int)INPUT_INDEX_getCount(inputs);
+
+	/* Inputs with duplicate hash values do not take a leaf. */
+	if (dedupe != NULL) input_file_count = (int)dedupe->unique_count;
 
 	res = PARAM_SET_getObj(set, "max-aggr-rounds", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_local_aggr_rounds);
 	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
@@ -584,14 +1281,23 @@ cleanup:
 }
 
 static void SIGNING_AGGR_ROUND_free(SIGNING_AGGR_ROUND *obj) {
+	size_t i = 0;
+
 	if (obj == NULL) return;
 
-	KSI_free(obj->fname);
+	KSI_free((void*)obj->fname);
 
 	SIGNING_AGGR_ROUND_resetAndClean(obj);
 
+	if (obj->name_blocks != NULL) {
+		for (i = 0; i < obj->name_block_count; i++) KSI_free(obj->name_blocks[i]);
+		free(obj->name_blocks);
+	}
+
 	KSI_free(obj->fname_out);
-	KSI_free(obj->hash_values);
+	KSI_free(obj->handles);
+	KSI_free(obj->imprints);
+	KSI_free(obj->signatures);
 
 	KSI_free(obj);
 }
@@ -599,9 +1305,11 @@ static void SIGNING_AGGR_ROUND_free(SIGNING_AGGR_ROUND *obj) {
 static int SIGNING_AGGR_ROUND_new(size_t max_leaves, SIGNING_AGGR_ROUND **round) {
 	int res;
 	SIGNING_AGGR_ROUND *tmp = NULL;
-	KSI_DataHash **tmp_hash = NULL;
-	char **tmp_fname = NULL;
+	unsigned char *tmp_imprints = NULL;
+	KSI_BlockSignerHandle **tmp_handles = NULL;
+	const char **tmp_fname = NULL;
 	char **tmp_fname_out = NULL;
+	KSI_Signature **tmp_sig = NULL;
 
 	if (round == NULL || max_leaves < 1) {
 		res = KT_INVALID_ARGUMENT;
@@ -616,53 +1324,87 @@ static int SIGNING_AGGR_ROUND_new(size_t max_leaves, SIGNING_AGGR_ROUND **round)
 
 	tmp->hash_count_max = max_leaves;
 	tmp->hash_count = 0;
-	tmp->hash_values = NULL;
+	tmp->imprints = NULL;
 	tmp->fname = NULL;
 	tmp->block_signer = NULL;
-	tmp->bs_handleList = NULL;
+	tmp->handles = NULL;
 	tmp->fname_out = NULL;
+	tmp->hasReservedNames = 0;
+	tmp->signatures = NULL;
+	tmp->name_blocks = NULL;
+	tmp->name_block_count = 0;
+	tmp->name_block_max = 0;
+	tmp->name_block_current = 0;
+	tmp->name_block_used = 0;
+	tmp->alloc_count = 1;
+
+	tmp_imprints = (unsigned char*)KSI_malloc(max_leaves * KSI_MAX_IMPRINT_LEN);
+	if (tmp_imprints == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
 
-	tmp_hash = (KSI_DataHash**)KSI_calloc(max_leaves, sizeof(KSI_DataHash*));
-	if (tmp_hash == NULL) {
+	tmp_handles = (KSI_BlockSignerHandle**)KSI_calloc(max_leaves, sizeof(KSI_BlockSignerHandle*));
+	if (tmp_handles == NULL) {
 		res = KT_OUT_OF_MEMORY;
 		goto cleanup;
 	}
 
-	tmp_fname = (char**)KSI_calloc(max_leaves, sizeof(char*));
+	tmp_fname = (const char**)KSI_calloc(max_leaves, sizeof(const char*));
 	if (tmp_fname == NULL) {
 		res = KT_OUT_OF_MEMORY;
 		goto cleanup;
 	}
 
 	tmp_fname_out = (char**)KSI_calloc(max_leaves, sizeof(char*));
-	if (tmp_fname == NULL) {
+	if (tmp_fname_out == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp_sig = (KSI_Signature**)KSI_calloc(max_leaves, sizeof(KSI_Signature*));
+	if (tmp_sig == NULL) {
 		res = KT_OUT_OF_MEMORY;
 		goto cleanup;
 	}
 
-	tmp->hash_values = tmp_hash;
+	tmp->imprints = tmp_imprints;
+	tmp->handles = tmp_handles;
+	tmp->signatures = tmp_sig;
 	tmp->fname = tmp_fname;
 	tmp->fname_out = tmp_fname_out;
+	tmp->alloc_count += 5;
 	*round = tmp;
 
 	tmp = NULL;
+	tmp_sig = NULL;
 	tmp_fname_out = NULL;
 	tmp_fname = NULL;
-	tmp_hash = NULL;
+	tmp_handles = NULL;
+	tmp_imprints = NULL;
 	res = KT_OK;
 
 cleanup:
 
 	SIGNING_AGGR_ROUND_free(tmp);
+	KSI_free(tmp_sig);
 	KSI_free(tmp_fname_out);
-	KSI_free(tmp_fname);
-	KSI_free(tmp_hash);
+	KSI_free((void*)tmp_fname);
+	KSI_free(tmp_handles);
+	KSI_free(tmp_imprints);
 
 	return res;
 }
 
-static int SIGNING_AGGR_ROUND_append(SIGNING_AGGR_ROUND *round, KSI_DataHash *hsh, char *fname) {
+/**
+ * Appends a leaf to the round. The imprint of the hash value is copied, the
+ * caller keeps the ownership of \c hsh. The round takes the ownership of the
+ * block-signer handle \c hndl (may be NULL) if the function succeeds.
+ */
+static int SIGNING_AGGR_ROUND_append(SIGNING_AGGR_ROUND *round, KSI_BlockSignerHandle *hndl, KSI_DataHash *hsh, const char *fname) {
 	int res;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
 
 	if (round == NULL || hsh == NULL || fname == NULL) {
 		res = KT_INVALID_ARGUMENT;
@@ -674,8 +1416,18 @@ static int SIGNING_AGGR_ROUND_append(SIGNING_AGGR_ROUND *round, KSI_DataHash *hs
 		goto cleanup;
 	}
 
-	round->hash_values[round->hash_count] = hsh;
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (imprint_len > KSI_MAX_IMPRINT_LEN) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	memcpy(round->imprints + round->hash_count * KSI_MAX_IMPRINT_LEN, imprint, imprint_len);
+	round->handles[round->hash_count] = hndl;
 	round->fname[round->hash_count] = fname;
+	round->fname_out[round->hash_count] = NULL;
 	round->hash_count++;
 	res = KT_OK;
 
@@ -684,29 +1436,136 @@ cleanup:
 	return res;
 }
 
-static int SIGNING_AGGR_ROUND_resetAndClean(SIGNING_AGGR_ROUND *round) {
-	int res;
-	int i = 0;
+/**
+ * Returns 1 if the n-th leaf of the round has the same hash value as \c hsh, 0 otherwise.
+ */
+static int SIGNING_AGGR_ROUND_isSameHash(SIGNING_AGGR_ROUND *round, size_t n, KSI_DataHash *hsh) {
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
 
-	if (round == NULL) {
-		res = KT_INVALID_ARGUMENT;
-		goto cleanup;
-	}
+	if (round == NULL || n >= round->hash_count || hsh == NULL) return 0;
+	if (KSI_DataHash_getImprint(hsh, &imprint, &imprint_len) != KSI_OK || imprint_len > KSI_MAX_IMPRINT_LEN) return 0;
 
-	if (round->fname_out != NULL) {
-		i = 0;
-		while (i < round->hash_count && round->fname_out[i] != NULL) {
-			KSI_free(round->fname_out[i++]);
-		}
+	return memcmp(round->imprints + n * KSI_MAX_IMPRINT_LEN, imprint, imprint_len) == 0;
+}
+
+/**
+ * Returns the imprint of the n-th leaf of the round.
+ */
+static const unsigned char *SIGNING_AGGR_ROUND_getImprint(SIGNING_AGGR_ROUND *round, size_t n, size_t *imprint_len) {
+	const unsigned char *imprint = round->imprints + n * KSI_MAX_IMPRINT_LEN;
+
+	*imprint_len = KSI_getHashLength((KSI_HashAlgorithm)imprint[0]) + 1;
+	return imprint;
+}
+
+/**
+ * Copies the name of the saved signature file of the n-th leaf to the name
+ * arena. A new block is allocated only if all the blocks kept from the previous
+ * rounds are full.
+ */
+static int SIGNING_AGGR_ROUND_setOutputName(SIGNING_AGGR_ROUND *round, size_t n, const char *name) {
+	int res;
+	size_t len = 0;
+	char *block = NULL;
+
+	if (round == NULL || n >= round->hash_count || name == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
 	}
 
-	if (round->hash_values != NULL) {
-		i = 0;
-		while (i < round->hash_count && round->hash_values[i] != NULL) {
-			KSI_DataHash_free(round->hash_values[i++]);
+	len = strlen(name) + 1;
+	if (len > SIGNING_AGGR_ROUND_NAME_BLOCK) {
+		res = KT_INDEX_OVF;
+		goto cleanup;
+	}
+
+	if (round->name_block_current < round->name_block_count && round->name_block_used + len > SIGNING_AGGR_ROUND_NAME_BLOCK) {
+		round->name_block_current++;
+		round->name_block_used = 0;
+	}
+
+	if (round->name_block_current == round->name_block_count) {
+		if (round->name_block_count == round->name_block_max) {
+			size_t new_max = (round->name_block_max == 0) ? 16 : round->name_block_max * 2;
+			char **tmp = (char**)realloc(round->name_blocks, new_max * sizeof(char*));
+
+			if (tmp == NULL) {
+				res = KT_OUT_OF_MEMORY;
+				goto cleanup;
+			}
+
+			round->name_blocks = tmp;
+			round->name_block_max = new_max;
+			round->alloc_count++;
+		}
+
+		block = (char*)KSI_malloc(SIGNING_AGGR_ROUND_NAME_BLOCK);
+		if (block == NULL) {
+			res = KT_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+
+		round->name_blocks[round->name_block_count++] = block;
+		round->name_block_used = 0;
+		round->alloc_count++;
+	}
+
+	block = round->name_blocks[round->name_block_current] + round->name_block_used;
+	memcpy(block, name, len);
+	round->name_block_used += len;
+	round->fname_out[n] = block;
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Frees the block-signer handles of the round. Must be called before the
+ * block-signer is reset.
+ */
+static void SIGNING_AGGR_ROUND_releaseHandles(SIGNING_AGGR_ROUND *round) {
+	size_t i = 0;
+
+	if (round == NULL || round->handles == NULL) return;
+
+	for (i = 0; i < round->hash_count; i++) {
+		KSI_BlockSignerHandle_free(round->handles[i]);
+		round->handles[i] = NULL;
+	}
+}
+
+/**
+ * Resets the round for the next aggregation round. The buffers of the round and
+ * the blocks of the name arena are kept.
+ */
+static int SIGNING_AGGR_ROUND_resetAndClean(SIGNING_AGGR_ROUND *round) {
+	int res;
+	size_t i = 0;
+
+	if (round == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	SIGNING_AGGR_ROUND_releaseHandles(round);
+
+	if (round->fname_out != NULL) {
+		for (i = 0; i < round->hash_count; i++) round->fname_out[i] = NULL;
+	}
+	round->hasReservedNames = 0;
+
+	if (round->signatures != NULL) {
+		for (i = 0; i < round->hash_count; i++) {
+			KSI_Signature_free(round->signatures[i]);
+			round->signatures[i] = NULL;
 		}
 	}
 
+	round->name_block_current = 0;
+	round->name_block_used = 0;
 	round->hash_count = 0;
 	res = KT_OK;
 
@@ -715,267 +1574,3045 @@ cleanup:
 	return res;
 }
 
-static int KT_SIGN_performSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, size_t max_tree_inputs, size_t rounds) {
+static int SIGNING_AGGR_ROUND_getSignature(SIGNING_AGGR_ROUND *round, size_t n, KSI_Signature **sig) {
+	int res;
+
+	if (round == NULL || n >= round->hash_count || sig == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* Signature received without block-signer. */
+	if (round->signatures[n] != NULL) {
+		res = KSI_Signature_clone(round->signatures[n], sig);
+		goto cleanup;
+	}
+
+	if (round->handles[n] == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	/* Get KSI signature from block-signer handle. */
+	res = KSI_BlockSignerHandle_getSignature(round->handles[n], sig);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+static void PARALLEL_HASHER_free(PARALLEL_HASHER *obj) {
+	size_t i = 0;
+
+	if (obj == NULL) return;
+
+	/* Make sure that none of the workers is using the resources. */
+	THREAD_POOL_free(obj->pool);
+
+	for (i = 0; i < obj->worker_count; i++) {
+		if (obj->hasher != NULL) KSI_DataHasher_free(obj->hasher[i]);
+		if (obj->buf != NULL) KSI_free(obj->buf[i]);
+		if (obj->ctx != NULL) KSI_CTX_free(obj->ctx[i]);
+	}
+
+	KSI_free(obj->hasher);
+	KSI_free(obj->buf);
+	KSI_free(obj->ctx);
+	KSI_free(obj->jobs);
+	KSI_free(obj);
+}
+
+static int PARALLEL_HASHER_new(size_t worker_count, KSI_HashAlgorithm algo, size_t max_jobs, PARALLEL_HASHER **hasher) {
+	int res;
+	PARALLEL_HASHER *tmp = NULL;
+	size_t i = 0;
+
+	if (worker_count < 1 || max_jobs < 1 || hasher == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (PARALLEL_HASHER*)KSI_calloc(1, sizeof(PARALLEL_HASHER));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->pool = NULL;
+	tmp->ctx = NULL;
+	tmp->hasher = NULL;
+	tmp->buf = NULL;
+	tmp->jobs = NULL;
+	tmp->job_count = 0;
+	tmp->file_count = 0;
+	tmp->algo = algo;
+	tmp->cache_mode = DIGEST_CACHE_OFF;
+	tmp->job_count_max = max_jobs;
+	tmp->worker_count = worker_count;
+
+	tmp->ctx = (KSI_CTX**)KSI_calloc(worker_count, sizeof(KSI_CTX*));
+	tmp->hasher = (KSI_DataHasher**)KSI_calloc(worker_count, sizeof(KSI_DataHasher*));
+	tmp->buf = (char**)KSI_calloc(worker_count, sizeof(char*));
+	tmp->jobs = (INPUT_HASH_JOB*)KSI_calloc(max_jobs, sizeof(INPUT_HASH_JOB));
+	if (tmp->ctx == NULL || tmp->hasher == NULL || tmp->buf == NULL || tmp->jobs == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	for (i = 0; i < worker_count; i++) {
+		res = KSI_CTX_new(&tmp->ctx[i]);
+		if (res != KSI_OK) goto cleanup;
+
+		res = KSI_DataHasher_open(tmp->ctx[i], algo, &tmp->hasher[i]);
+		if (res != KSI_OK) goto cleanup;
+
+		tmp->buf[i] = (char*)KSI_malloc(PARALLEL_HASHER_BUF_SIZE);
+		if (tmp->buf[i] == NULL) {
+			res = KT_OUT_OF_MEMORY;
+			goto cleanup;
+		}
+	}
+
+	res = THREAD_POOL_new(worker_count, &tmp->pool);
+	if (res != KT_OK) goto cleanup;
+
+	*hasher = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	PARALLEL_HASHER_free(tmp);
+
+	return res;
+}
+
+/**
+ * A worker job that hashes a single input file. Note that the error tracker and
+ * the main KSI context must not be used here. The result is stored as an imprint
+ * and is converted to the KSI_DataHash object by the main thread.
+ */
+static int parallel_hasher_job(void *job_ctx, size_t worker, size_t job) {
+	int res;
+	PARALLEL_HASHER *ph = (PARALLEL_HASHER*)job_ctx;
+	INPUT_HASH_JOB *in = &ph->jobs[job];
+	KSI_DataHasher *hasher = ph->hasher[worker];
+	char *buf = ph->buf[worker];
+	SMART_FILE *file = NULL;
+	KSI_DataHash *hsh = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	size_t read_count = 0;
+	DIGEST_CACHE_STAMP stamp;
+
+	if (in->fname == NULL) {
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	if (ph->cache_mode & DIGEST_CACHE_READ) {
+		DIGEST_CACHE_get(in->fname, ph->algo, in->imprint, &in->imprint_len);
+		if (in->imprint_len > 0) {
+			res = KT_OK;
+			goto cleanup;
+		}
+	}
+
+	if (ph->cache_mode & DIGEST_CACHE_WRITE) {
+		DIGEST_CACHE_getStamp(in->fname, &stamp);
+	}
+
+	res = KSI_DataHasher_reset(hasher);
+	if (res != KSI_OK) goto cleanup;
+
+	res = SMART_FILE_open(in->fname, "rb", &file);
+	if (res != SMART_FILE_OK) goto cleanup;
+
+	while (!SMART_FILE_isEof(file)) {
+		res = SMART_FILE_read(file, buf, PARALLEL_HASHER_BUF_SIZE, &read_count);
+		if (res != SMART_FILE_OK) goto cleanup;
+
+		res = KSI_DataHasher_add(hasher, buf, read_count);
+		if (res != KSI_OK) goto cleanup;
+	}
+
+	res = KSI_DataHasher_close(hasher, &hsh);
+	if (res != KSI_OK) goto cleanup;
+
+	res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+	if (res != KSI_OK) goto cleanup;
+
+	if (imprint_len > sizeof(in->imprint)) {
+		res = KT_INDEX_OVF;
+		goto cleanup;
+	}
+
+	memcpy(in->imprint, imprint, imprint_len);
+	in->imprint_len = imprint_len;
+
+	if (ph->cache_mode & DIGEST_CACHE_WRITE) {
+		DIGEST_CACHE_put(in->fname, &stamp, imprint, imprint_len);
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	in->res = res;
+	SMART_FILE_close(file);
+	KSI_DataHash_free(hsh);
+
+	return res;
+}
+
+static int KT_SIGN_startParallelHashing(PARAM_SET *set, ERR_TRCKR *err, const INPUT_INDEX *inputs, PARALLEL_HASHER *hasher, SIGN_STATE *state, KSI_HashAlgorithm algo, size_t first, size_t count) {
+	int res = KT_UNKNOWN_ERROR;
+	size_t n = 0;
+
+	if (set == NULL || err == NULL || inputs == NULL || hasher == NULL || count > hasher->job_count_max) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (PARAM_SET_isSetByName(set, "digest-cache-strict")) {
+		hasher->cache_mode = DIGEST_CACHE_WRITE;
+	} else if (PARAM_SET_isSetByName(set, "digest-cache")) {
+		hasher->cache_mode = DIGEST_CACHE_READ | DIGEST_CACHE_WRITE;
+	}
+
+	hasher->file_count = 0;
+
+	for (n = 0; n < count; n++) {
+		INPUT_HASH_JOB *job = &hasher->jobs[n];
+		const char *fname = INPUT_INDEX_getName(inputs, first + n);
+		size_t i = first + n;
+
+		if (fname == NULL) {
+			ERR_TRCKR_ADD(err, res = KT_INDEX_OVF, "Error: Unable to get files name.");
+			goto cleanup;
+		}
+
+		job->fname = NULL;
+		job->res = KT_UNKNOWN_ERROR;
+		job->imprint_len = 0;
+
+		/**
+		 * Values of -i are located before the values of --. Imprints and stdin are
+		 * not hashed by the workers and are extracted as usual.
+		 */
+		if (INPUT_INDEX_getParam(inputs, i) == 0 && (strcmp(fname, "-") == 0 || is_imprint(fname))) continue;
+
+		/* The digest of an unchanged file is taken from the state file instead. */
+		if (state != NULL) {
+			const unsigned char *imprint = NULL;
+			size_t imprint_len = 0;
+
+			res = SIGN_STATE_getImprint(state, fname, (int)algo, &imprint, &imprint_len);
+			ERR_CATCH_MSG(err, res, "Error: Unable to look up '%s' from the state file.", fname);
+			if (imprint != NULL) continue;
+		}
+
+		job->fname = fname;
+		hasher->file_count++;
+	}
+
+	hasher->job_count = count;
+
+	/**
+	 * The workers run in the background until KT_SIGN_waitParallelHashing is
+	 * called, so the caller can meanwhile communicate with the aggregator.
+	 */
+	res = THREAD_POOL_start(hasher->pool, count, parallel_hasher_job, hasher);
+	if (res != KT_OK) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to start hashing the inputs in parallel.");
+		goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int KT_SIGN_waitParallelHashing(ERR_TRCKR *err, PARALLEL_HASHER *hasher) {
+	int res = KT_UNKNOWN_ERROR;
+
+	if (err == NULL || hasher == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/**
+	 * Errors of a single input are not handled here. Failed inputs are extracted
+	 * again by the main thread to report the error in the same way as without
+	 * the workers.
+	 */
+	res = THREAD_POOL_wait(hasher->pool);
+	if (res == KT_THREAD_ERROR || res == KT_OUT_OF_MEMORY) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to hash the inputs in parallel.");
+		goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+static void SIGNATURE_WRITER_free(SIGNATURE_WRITER *obj) {
+	size_t b = 0;
+	size_t n = 0;
+
+	if (obj == NULL) return;
+
+	/* Make sure that none of the workers is using the jobs. */
+	THREAD_POOL_free(obj->pool);
+
+	for (b = 0; b < 2; b++) {
+		if (obj->jobs[b] == NULL) continue;
+		for (n = 0; n < obj->job_count[b]; n++) {
+			if (obj->jobs[b][n].isOwner) KSI_free(obj->jobs[b][n].raw);
+		}
+		KSI_free(obj->jobs[b]);
+	}
+
+	DURABLE_BATCH_free(obj->durable);
+	KSI_free(obj);
+}
+
+static int SIGNATURE_WRITER_new(size_t worker_count, int isDurable, SIGNATURE_WRITER **writer) {
+	int res;
+	SIGNATURE_WRITER *tmp = NULL;
+
+	if (worker_count < 1 || writer == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	tmp = (SIGNATURE_WRITER*)KSI_calloc(1, sizeof(SIGNATURE_WRITER));
+	if (tmp == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	tmp->pool = NULL;
+	tmp->worker_count = worker_count;
+	tmp->mode = NULL;
+	tmp->isUnique = 0;
+	tmp->jobs[0] = NULL;
+	tmp->jobs[1] = NULL;
+	tmp->job_count[0] = 0;
+	tmp->job_count[1] = 0;
+	tmp->job_count_max = worker_count * SIGNATURE_WRITER_JOBS_PER_WORKER;
+	tmp->current = 0;
+	tmp->isPending = 0;
+	tmp->aggr_round = NULL;
+	tmp->state = NULL;
+	tmp->prgrs = 0;
+	tmp->divider = 1;
+	tmp->in_count = 0;
+	tmp->count = 0;
+	tmp->durable = NULL;
+
+	/* Every batch of jobs is committed at once, so larger batches need fewer flushes. */
+	if (isDurable && tmp->job_count_max < DURABLE_BATCH_SIZE) tmp->job_count_max = DURABLE_BATCH_SIZE;
+
+	tmp->jobs[0] = (SIGNATURE_WRITE_JOB*)KSI_calloc(tmp->job_count_max, sizeof(SIGNATURE_WRITE_JOB));
+	tmp->jobs[1] = (SIGNATURE_WRITE_JOB*)KSI_calloc(tmp->job_count_max, sizeof(SIGNATURE_WRITE_JOB));
+	if (tmp->jobs[0] == NULL || tmp->jobs[1] == NULL) {
+		res = KT_OUT_OF_MEMORY;
+		goto cleanup;
+	}
+
+	res = THREAD_POOL_new(worker_count, &tmp->pool);
+	if (res != KT_OK) goto cleanup;
+
+	if (isDurable) {
+		res = DURABLE_BATCH_new(DURABLE_SYNC_THREADS, &tmp->durable);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	*writer = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	SIGNATURE_WRITER_free(tmp);
+
+	return res;
+}
+
+/**
+ * A worker job that writes a single serialized signature to its file. Note that
+ * the error tracker and the KSI context must not be used here. The result is
+ * reported by the main thread in the order of the jobs.
+ */
+static int signature_writer_job(void *job_ctx, size_t worker, size_t job) {
+	int res;
+	SIGNATURE_WRITER *sw = (SIGNATURE_WRITER*)job_ctx;
+	SIGNATURE_WRITE_JOB *out = &sw->jobs[1 - sw->current][job];
+	SMART_FILE *file = NULL;
+	size_t count = 0;
+	char temp_name[1024];
+	VARIABLE_IS_NOT_USED(worker);
+
+	if (sw->durable != NULL) {
+		res = SMART_FILE_open(DURABLE_getTempName(out->save_to, temp_name, sizeof(temp_name)), "wbi", &file);
+	} else {
+		res = SMART_FILE_open(out->save_to, sw->isUnique ? "wb" : sw->mode, &file);
+	}
+	if (res != SMART_FILE_OK) goto cleanup;
+
+	KSI_strncpy(out->real_output_name, SMART_FILE_getFname(file), sizeof(out->real_output_name));
+
+	res = SMART_FILE_write(file, (char*)out->raw, out->raw_len, &count);
+	if (res != SMART_FILE_OK) goto cleanup;
+	if (count != out->raw_len) {
+		res = KT_IO_ERROR;
+		goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	out->res = res;
+	SMART_FILE_close(file);
+
+	/* A partially written temporary file is never committed. */
+	if (res != KT_OK && file != NULL && sw->durable != NULL) SMART_FILE_remove(out->real_output_name);
+
+	return res;
+}
+
+static int KT_SIGN_getInputHash(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_CTX *hash_ctx, const INPUT_INDEX *inputs, PARALLEL_HASHER *hasher, SIGN_STATE *state, MULTI_HASH *multi, COMPOSITE *extra, size_t i, size_t tree_input, KSI_DataHash **hash) {
+	int res = KT_UNKNOWN_ERROR;
+	INPUT_HASH_JOB *job = NULL;
+	KSI_DataHash *tmp = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	if (set == NULL || err == NULL || ctx == NULL || hash_ctx == NULL || inputs == NULL || extra == NULL || hash == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/* When signing with multiple hash algorithms, all the inputs are hashed in advance. */
+	if (multi != NULL) {
+		KSI_HashAlgorithm algo = multi->algo[multi->current];
+
+		if (i >= multi->input_count) {
+			ERR_TRCKR_ADD(err, res = KT_INDEX_OVF, NULL);
+			goto cleanup;
+		}
+
+		imprint = multi->imprints + (i * multi->algo_count + multi->current) * KSI_MAX_IMPRINT_LEN;
+		res = KSI_DataHash_fromImprint(hash_ctx, imprint, KSI_getHashLength(algo) + 1, hash);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create hash from imprint.");
+		goto cleanup;
+	}
+
+	/**
+	 * If the file has not changed since it was recorded in the state file, the
+	 * recorded digest is used without reading the file.
+	 */
+	if (state != NULL) {
+		const char *fname = INPUT_INDEX_getName(inputs, i);
+
+		if (fname == NULL) {
+			ERR_TRCKR_ADD(err, res = KT_INDEX_OVF, "Error: Unable to get files name.");
+			goto cleanup;
+		}
+
+		if (strcmp(fname, "-") != 0 && !is_imprint(fname)) {
+			res = SIGN_STATE_getImprint(state, fname, (int)*(KSI_HashAlgorithm*)extra->h_alg, &imprint, &imprint_len);
+			ERR_CATCH_MSG(err, res, "Error: Unable to look up '%s' from the state file.", fname);
+
+			if (imprint != NULL) {
+				res = KSI_DataHash_fromImprint(hash_ctx, imprint, imprint_len, hash);
+				ERR_CATCH_MSG(err, res, "Error: Unable to create hash from imprint.");
+				goto cleanup;
+			}
+		}
+	}
+
+	if (hasher != NULL && tree_input < hasher->job_count) job = &hasher->jobs[tree_input];
+
+	if (job != NULL && job->fname != NULL && job->res == KT_OK) {
+		res = KSI_DataHash_fromImprint(hash_ctx, job->imprint, job->imprint_len, hash);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create hash from imprint.");
+	} else if (hash_ctx == ctx) {
+		res = INPUT_INDEX_getObj(inputs, set, i, extra, (void**)hash);
+		if (res != KT_OK) goto cleanup;
+	} else {
+		/* The hash must be bound to the context of the aggregation round. */
+		res = INPUT_INDEX_getObj(inputs, set, i, extra, (void**)&tmp);
+		if (res != KT_OK) goto cleanup;
+
+		res = KSI_DataHash_getImprint(tmp, &imprint, &imprint_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to get hash imprint.");
+
+		res = KSI_DataHash_fromImprint(hash_ctx, imprint, imprint_len, hash);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create hash from imprint.");
+	}
+
+cleanup:
+
+	KSI_DataHash_free(tmp);
+
+	return res;
+}
+
+/**
+ * Reads every input once and feeds the data to a hasher of every algorithm, so
+ * that signing with multiple hash algorithms does not read the inputs multiple
+ * times. The imprints are stored in \c multi.
+ */
+static int KT_SIGN_hashWithAllAlgorithms(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, const INPUT_INDEX *inputs, MULTI_HASH *multi) {
+	int res = KT_UNKNOWN_ERROR;
+	int d = 0;
+	int in_count = 0;
+	int cache_mode = DIGEST_CACHE_OFF;
+	KSI_DataHasher *hasher[HASH_ALG_LIST_MAX];
+	KSI_DataHash *hsh = NULL;
+	SMART_FILE *in = NULL;
+	char *buf = NULL;
+	size_t i = 0;
+	size_t a = 0;
+
+	memset(hasher, 0, sizeof(hasher));
+
+	if (set == NULL || err == NULL || ctx == NULL || inputs == NULL || multi == NULL || multi->algo_count == 0) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	d = PARAM_SET_isSetByName(set, "d");
+
+	in_count = (int)INPUT_INDEX_getCount(inputs);
+
+	if (PARAM_SET_isSetByName(set, "digest-cache-strict")) {
+		cache_mode = DIGEST_CACHE_WRITE;
+	} else if (PARAM_SET_isSetByName(set, "digest-cache")) {
+		cache_mode = DIGEST_CACHE_READ | DIGEST_CACHE_WRITE;
+	}
+
+	multi->imprints = (unsigned char*)KSI_calloc((size_t)in_count * multi->algo_count, KSI_MAX_IMPRINT_LEN);
+	buf = (char*)KSI_malloc(PARALLEL_HASHER_BUF_SIZE);
+	if (multi->imprints == NULL || buf == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	multi->input_count = (size_t)in_count;
+
+	for (a = 0; a < multi->algo_count; a++) {
+		res = KSI_DataHasher_open(ctx, multi->algo[a], &hasher[a]);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create %s hasher.", KSI_getHashAlgorithmName(multi->algo[a]));
+	}
+
+	print_progressDesc(d, "Hashing %i inputs with %zu hash algorithms... ", in_count, multi->algo_count);
+
+	for (i = 0; i < (size_t)in_count; i++) {
+		const char *fname = INPUT_INDEX_getName(inputs, i);
+		unsigned char *imprints = multi->imprints + i * multi->algo_count * KSI_MAX_IMPRINT_LEN;
+		int isFromCmd = INPUT_INDEX_getParam(inputs, i) == 0;
+		int isStdin = 0;
+		int mode = cache_mode;
+		size_t cached = 0;
+		DIGEST_CACHE_STAMP stamp;
+
+		if (isFromCmd && is_imprint(fname)) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Hash imprint '%s' can not be signed with multiple hash algorithms.", fname);
+			goto cleanup;
+		}
+
+		isStdin = isFromCmd && strcmp(fname, "-") == 0;
+		if (isStdin) mode = DIGEST_CACHE_OFF;
+
+		/* If all the digests are cached, the file is not read at all. */
+		if (mode & DIGEST_CACHE_READ) {
+			for (a = 0; a < multi->algo_count; a++) {
+				size_t len = 0;
+
+				DIGEST_CACHE_get(fname, multi->algo[a], imprints + a * KSI_MAX_IMPRINT_LEN, &len);
+				if (len == 0) break;
+				cached++;
+			}
+			if (cached == multi->algo_count) continue;
+		}
+
+		if (mode & DIGEST_CACHE_WRITE) {
+			DIGEST_CACHE_getStamp(fname, &stamp);
+		}
+
+		for (a = 0; a < multi->algo_count; a++) {
+			res = KSI_DataHasher_reset(hasher[a]);
+			ERR_CATCH_MSG(err, res, "Error: Unable to reset hasher.");
+		}
+
+		res = SMART_FILE_open(fname, isFromCmd ? "rbs" : "rb", &in);
+		if (res != KT_OK) {
+			ERR_TRCKR_ADD(err, res, "Error: Unable to open file '%s' for reading. %s", fname, KSITOOL_errToString(res));
+			goto cleanup;
+		}
+
+		while (!SMART_FILE_isEof(in)) {
+			size_t read_count = 0;
+
+			res = SMART_FILE_read(in, buf, PARALLEL_HASHER_BUF_SIZE, &read_count);
+			if (res != SMART_FILE_OK) {
+				ERR_TRCKR_ADD(err, res, "Error: Unable to read data from file '%s'.", fname);
+				goto cleanup;
+			}
+
+			for (a = 0; a < multi->algo_count; a++) {
+				res = KSI_DataHasher_add(hasher[a], buf, read_count);
+				ERR_CATCH_MSG(err, res, "Error: Unable to add data to hasher.");
+			}
+		}
+
+		SMART_FILE_close(in);
+		in = NULL;
+
+		for (a = 0; a < multi->algo_count; a++) {
+			const unsigned char *imprint = NULL;
+			size_t imprint_len = 0;
+
+			res = KSI_DataHasher_close(hasher[a], &hsh);
+			ERR_CATCH_MSG(err, res, "Error: Unable to close hasher.");
+
+			res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+			ERR_CATCH_MSG(err, res, "Error: Unable to get hash imprint.");
+
+			if (imprint_len > KSI_MAX_IMPRINT_LEN) {
+				ERR_TRCKR_ADD(err, res = KT_INDEX_OVF, NULL);
+				goto cleanup;
+			}
+
+			memcpy(imprints + a * KSI_MAX_IMPRINT_LEN, imprint, imprint_len);
+			if (mode & DIGEST_CACHE_WRITE) DIGEST_CACHE_put(fname, &stamp, imprint, imprint_len);
+
+			KSI_DataHash_free(hsh);
+			hsh = NULL;
+		}
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	print_progressResult(res);
+
+	for (a = 0; a < HASH_ALG_LIST_MAX; a++) {
+		KSI_DataHasher_free(hasher[a]);
+	}
+	KSI_DataHash_free(hsh);
+	SMART_FILE_close(in);
+	KSI_free(buf);
+
+	return res;
+}
+
+static void INPUT_DEDUPE_clean(INPUT_DEDUPE *dedupe) {
+	if (dedupe == NULL) return;
+
+	KSI_free(dedupe->imprints);
+	KSI_free(dedupe->unique);
+	KSI_free(dedupe->next);
+	memset(dedupe, 0, sizeof(INPUT_DEDUPE));
+}
+
+static size_t input_dedupe_hash(const unsigned char *imprint, size_t imprint_len) {
+	/* FNV-1a. */
+	size_t h = (size_t)2166136261u;
+	size_t i = 0;
+
+	for (i = 0; i < imprint_len; i++) {
+		h ^= imprint[i];
+		h *= (size_t)16777619u;
+	}
+
+	return h;
+}
+
+/**
+ * Hashes all the inputs and links the inputs with the same hash value, so that
+ * every hash value is signed once and its signature is saved for all of them.
+ * The index is an open addressing hash table of input numbers + 1 (0 marks an
+ * empty slot).
+ */
+static int KT_SIGN_dedupeInputs(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, const INPUT_INDEX *inputs, SIGN_STATE *state, INPUT_DEDUPE *dedupe) {
+	int res = KT_UNKNOWN_ERROR;
+	int d = 0;
+	int in_count = 0;
+	int threads = 1;
+	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+	COMPOSITE extra;
+	PARALLEL_HASHER *hasher = NULL;
+	KSI_DataHash *hash = NULL;
+	size_t *index = NULL;
+	size_t *last = NULL;
+	size_t index_size = 1;
+	size_t i = 0;
+
+	if (set == NULL || err == NULL || ctx == NULL || inputs == NULL || dedupe == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	d = PARAM_SET_isSetByName(set, "d");
+
+	in_count = (int)INPUT_INDEX_getCount(inputs);
+
+	res = PARAM_SET_getObj(set, "threads", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&threads);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = KT_SIGN_getHashAlgorithm(set, remote_algo, &algo);
+	if (res != KT_OK) goto cleanup;
+
+	extra.ctx = ctx;
+	extra.err = err;
+	extra.h_alg = &algo;
+	extra.fname_out = NULL;
+
+	/* Keep the load factor of the index below 1/2. */
+	while (index_size < (size_t)in_count * 2) index_size *= 2;
+
+	dedupe->imprints = (unsigned char*)KSI_calloc((size_t)in_count, KSI_MAX_IMPRINT_LEN);
+	dedupe->unique = (size_t*)KSI_calloc((size_t)in_count, sizeof(size_t));
+	dedupe->next = (size_t*)KSI_calloc((size_t)in_count, sizeof(size_t));
+	last = (size_t*)KSI_calloc((size_t)in_count, sizeof(size_t));
+	index = (size_t*)KSI_calloc(index_size, sizeof(size_t));
+	if (dedupe->imprints == NULL || dedupe->unique == NULL || dedupe->next == NULL || last == NULL || index == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+	dedupe->input_count = (size_t)in_count;
+	dedupe->unique_count = 0;
+
+	if (threads > 1 && in_count > 1) {
+		size_t workers = (size_t)threads < (size_t)in_count ? (size_t)threads : (size_t)in_count;
+
+		res = PARALLEL_HASHER_new(workers, algo, (size_t)in_count, &hasher);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create worker threads for hashing.");
+
+		res = KT_SIGN_startParallelHashing(set, err, inputs, hasher, state, algo, 0, (size_t)in_count);
+		if (res != KT_OK) goto cleanup;
+
+		/* Imprints and the inputs taken from the state file are not hashed. */
+		if (hasher->file_count > 0) print_progressDesc(d, "Hashing %zu inputs with %zu threads... ", hasher->file_count, workers);
+
+		res = KT_SIGN_waitParallelHashing(err, hasher);
+		if (res != KT_OK) goto cleanup;
+
+		if (hasher->file_count > 0) print_progressResult(res);
+	}
+
+	print_progressDesc(d, "Removing duplicate hash values of %i inputs... ", in_count);
+
+	for (i = 0; i < (size_t)in_count; i++) {
+		unsigned char *imprint = dedupe->imprints + i * KSI_MAX_IMPRINT_LEN;
+		const unsigned char *tmp = NULL;
+		size_t imprint_len = 0;
+		size_t slot = 0;
+
+		res = KT_SIGN_getInputHash(set, err, ctx, ctx, inputs, hasher, state, NULL, &extra, i, i, &hash);
+		if (res != KT_OK) goto cleanup;
+
+		res = KSI_DataHash_getImprint(hash, &tmp, &imprint_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to get hash imprint.");
+
+		if (imprint_len > KSI_MAX_IMPRINT_LEN) {
+			ERR_TRCKR_ADD(err, res = KT_INDEX_OVF, NULL);
+			goto cleanup;
+		}
+
+		memcpy(imprint, tmp, imprint_len);
+		KSI_DataHash_free(hash);
+		hash = NULL;
+
+		dedupe->next[i] = DEDUPE_NONE;
+
+		/* Hash imprints given on the command-line may have different algorithms, so the algorithm is compared too. */
+		slot = input_dedupe_hash(imprint, imprint_len) & (index_size - 1);
+		while (index[slot] != 0) {
+			size_t first = index[slot] - 1;
+			unsigned char *other = dedupe->imprints + first * KSI_MAX_IMPRINT_LEN;
+
+			if (other[0] == imprint[0] && memcmp(other, imprint, imprint_len) == 0) {
+				dedupe->next[last[first]] = i;
+				last[first] = i;
+				break;
+			}
+			slot = (slot + 1) & (index_size - 1);
+		}
+
+		if (index[slot] == 0) {
+			index[slot] = i + 1;
+			last[i] = i;
+			dedupe->unique[dedupe->unique_count++] = i;
+		}
+	}
+
+	print_progressResult(res);
+	print_debug("%zu of %i inputs have a unique hash value.\n", dedupe->unique_count, in_count);
+
+	res = KT_OK;
+
+cleanup:
+
+	PARALLEL_HASHER_free(hasher);
+	KSI_DataHash_free(hash);
+	KSI_free(index);
+	KSI_free(last);
+
+	return res;
+}
+
+static void SIGNING_SLOT_free(SIGNING_SLOT *obj) {
+	if (obj == NULL) return;
+
+	/* Make sure that the round is not signed in the background. */
+	THREAD_POOL_free(obj->pool);
+
+	if (obj->aggr_round != NULL) {
+		SIGNING_AGGR_ROUND_releaseHandles(obj->aggr_round);
+		KSI_BlockSigner_free(obj->aggr_round->block_signer);
+		SIGNING_AGGR_ROUND_free(obj->aggr_round);
+	}
+
+	KSI_MetaData_free(obj->mdata);
+	INPUT_INDEX_free(obj->round_inputs);
+
+	if (obj->isOwner) {
+		ERR_TRCKR_free(obj->err);
+		KSI_CTX_free(obj->ctx);
+	}
+
+	KSI_free(obj);
+}
+
+static int SIGNING_SLOT_new(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, SMART_FILE *logfile, int inBackground, size_t max_leaves, KSI_HashAlgorithm algo, KSI_DataHash *prev_leaf, KSI_OctetString *mask_iv, SIGNING_SLOT **slot) {
+	int res;
+	SIGNING_SLOT *tmp = NULL;
+
+	if (set == NULL || err == NULL || ctx == NULL || slot == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	tmp = (SIGNING_SLOT*)KSI_calloc(1, sizeof(SIGNING_SLOT));
+	if (tmp == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	tmp->aggr_round = NULL;
+	tmp->ctx = ctx;
+	tmp->err = err;
+	tmp->isOwner = 0;
+	tmp->mdata = NULL;
+	tmp->pool = NULL;
+	tmp->state = NULL;
+	tmp->name_tag = NULL;
+	tmp->dedupe = NULL;
+	tmp->bundle = NULL;
+	tmp->writer = NULL;
+	tmp->journal = NULL;
+	tmp->round = 0;
+	tmp->isBusy = 0;
+	tmp->input_offset = 0;
+	tmp->round_inputs = NULL;
+
+	/**
+	 * When signing in the background, the slot needs its own context and error
+	 * tracker as these are used by the worker thread. The context logs to the
+	 * same --log file as the main context.
+	 */
+	if (inBackground) {
+		tmp->isOwner = 1;
+		tmp->ctx = NULL;
+		tmp->err = ERR_TRCKR_new(print_errors, KSITOOL_errToString);
+		if (tmp->err == NULL) {
+			ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+			goto cleanup;
+		}
+
+		res = TOOL_init_ksi_service(set, err, logfile, &tmp->ctx);
+		if (res != KT_OK) goto cleanup;
+
+		res = THREAD_POOL_new(1, &tmp->pool);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create a worker thread for signing.");
+	}
+
+	res = SIGNING_AGGR_ROUND_new(max_leaves, &tmp->aggr_round);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create a record for aggregation round.");
+
+	res = KSITOOL_KSI_BlockSigner_new(err, tmp->ctx, algo, prev_leaf, mask_iv, &tmp->aggr_round->block_signer);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create KSI Block Signer.");
+
+	*slot = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	SIGNING_SLOT_free(tmp);
+
+	return res;
+}
+
+/**
+ * A worker job that signs the aggregation round of the slot. Only the context
+ * and error tracker of the slot may be used here.
+ */
+static int signing_slot_job(void *job_ctx, size_t worker, size_t job) {
+	SIGNING_SLOT *slot = (SIGNING_SLOT*)job_ctx;
+	VARIABLE_IS_NOT_USED(worker);
+	VARIABLE_IS_NOT_USED(job);
+
+	return KSITOOL_BlockSigner_closeAndSign(slot->err, slot->ctx, slot->aggr_round->block_signer);
+}
+
+/**
+ * Formats the round number as "r/rounds", or just "r" if the count of rounds is
+ * not known in advance (see --input-list).
+ */
+static const char *KT_SIGN_roundToString(size_t r, size_t rounds, char *buf, size_t buf_len) {
+	if (rounds == 0) KSI_snprintf(buf, buf_len, "%zu", r + 1);
+	else KSI_snprintf(buf, buf_len, "%zu/%zu", r + 1, rounds);
+	return buf;
+}
+
+/**
+ * Reads the next entry to be signed from the input list. If state is not NULL,
+ * the files that are unchanged since they were signed are skipped and counted
+ * in skipped. The entry is set to NULL at the end of the list.
+ */
+static int KT_SIGN_nextListEntry(ERR_TRCKR *err, INPUT_LIST *list, SIGN_STATE *state, KSI_HashAlgorithm algo, const char **entry, size_t *skipped) {
+	int res = KT_UNKNOWN_ERROR;
+	const char *dir = NULL;
+
+	for (;;) {
+		res = INPUT_LIST_next(list, entry);
+
+		/* Subdirectories that can not be read are skipped by the directory walker. */
+		while ((dir = INPUT_LIST_nextSkipped(list)) != NULL) {
+			print_warnings("Warning: Unable to read directory '%s', skipped.\n", dir);
+		}
+
+		if (res == KT_INDEX_OVF) {
+			ERR_TRCKR_ADD(err, res, "Error: Entry %zu in the input list is too long.", INPUT_LIST_getCount(list) + 1);
+			goto cleanup;
+		}
+		if (res != KT_OK && *INPUT_LIST_getErrorPath(list) != '\0') {
+			ERR_TRCKR_ADD(err, res, "Error: Unable to read directory '%s'.", INPUT_LIST_getErrorPath(list));
+			goto cleanup;
+		}
+		ERR_CATCH_MSG(err, res, "Error: Unable to read the input list.");
+
+		if (*entry == NULL) break;
+
+		if (strcmp(*entry, "-") == 0) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Entry %zu in the input list is stdin (-), which can not be used in the input list.", INPUT_LIST_getCount(list));
+			goto cleanup;
+		}
+
+		if (state != NULL && !is_imprint(*entry)) {
+			int status = SIGN_STATE_NEW;
+
+			res = SIGN_STATE_check(state, *entry, (int)algo, &status);
+			ERR_CATCH_MSG(err, res, "Error: Unable to look up '%s' from the state file.", *entry);
+
+			if (status == SIGN_STATE_UNCHANGED) {
+				(*skipped)++;
+				continue;
+			}
+		}
+
+		break;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Replaces the values of parameters i and input with the next count entries
+ * from the input list. Hash imprints are added to i, so that they are extracted
+ * as imprints (see -i), and file paths to input. The rounds of the previous
+ * batch that are still in flight hold copies of their input names (see
+ * INPUT_INDEX_copyRange). If state is not NULL, the files that are unchanged
+ * since they were signed are skipped and counted in skipped. The parameter of
+ * every entry is recorded in order (0 for i, 1 for input), so that the inputs
+ * are indexed in the order of the list (see INPUT_INDEX_updateInOrder). The
+ * buffer of the order is grown as needed.
+ */
+static int KT_SIGN_loadInputList(PARAM_SET *set, ERR_TRCKR *err, INPUT_LIST *list, SIGN_STATE *state, KSI_HashAlgorithm algo, size_t count, int *loaded, size_t *skipped, unsigned char **order, size_t *order_max) {
+	int res = KT_UNKNOWN_ERROR;
+	int in_count = 0;
+	int n = 0;
+	const char *entry = NULL;
+	const char *names[] = {"i", "input"};
+	size_t k = 0;
+
+	if (set == NULL || err == NULL || list == NULL || loaded == NULL || skipped == NULL || order == NULL || order_max == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	*loaded = 0;
+
+	/**
+	 * At the end of the list the values of the last batch are kept, as the output
+	 * names of its rounds in flight depend on the count of inputs in the set
+	 * (see how_is_output_saved_to).
+	 */
+	res = KT_SIGN_nextListEntry(err, list, state, algo, &entry, skipped);
+	if (res != KT_OK || entry == NULL) goto cleanup;
+
+	for (k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+		res = PARAM_SET_getValueCount(set, names[k], INPUT_LIST_SOURCE, PRIORITY_CMD, &in_count);
+		if (res != PST_OK) goto cleanup;
+
+		for (n = in_count - 1; n >= 0; n--) {
+			res = PARAM_SET_clearValue(set, names[k], INPUT_LIST_SOURCE, PRIORITY_CMD, n);
+			if (res != PST_OK) goto cleanup;
+		}
+	}
+
+	n = 0;
+	while (entry != NULL) {
+		k = is_imprint(entry) ? 0 : 1;
+
+		if ((size_t)n == *order_max) {
+			size_t order_new = (*order_max == 0) ? 1024 : *order_max * 2;
+			unsigned char *tmp = (unsigned char*)realloc(*order, order_new);
+
+			if (tmp == NULL) {
+				ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+				goto cleanup;
+			}
+			*order = tmp;
+			*order_max = order_new;
+		}
+
+		res = PARAM_SET_add(set, names[k], entry, INPUT_LIST_SOURCE, PRIORITY_CMD);
+		ERR_CATCH_MSG(err, res, "Error: Unable to add entry %zu from the input list.", INPUT_LIST_getCount(list));
+		(*order)[n] = (unsigned char)k;
+		n++;
+
+		if ((size_t)n == count) break;
+
+		res = KT_SIGN_nextListEntry(err, list, state, algo, &entry, skipped);
+		if (res != KT_OK) goto cleanup;
+	}
+
+	*loaded = n;
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Counts the entries of the input list file in advance and fails if signing
+ * them would take more than max-aggr-rounds rounds, so that nothing is signed.
+ * A list read from stdin can not be read twice and is checked while signing.
+ */
+static int KT_SIGN_checkInputListSize(PARAM_SET *set, ERR_TRCKR *err, const char *list_name, SIGN_STATE *state, KSI_HashAlgorithm algo, size_t max_tree_inputs) {
+	int res = KT_UNKNOWN_ERROR;
+	INPUT_LIST *list = NULL;
+	const char *entry = NULL;
+	int max_aggr_rounds = 0;
+	size_t count = 0;
+	size_t skipped = 0;
+
+	if (set == NULL || err == NULL || list_name == NULL || max_tree_inputs == 0) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = PARAM_SET_getObj(set, "max-aggr-rounds", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_aggr_rounds);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = INPUT_LIST_open(list_name, &list);
+	ERR_CATCH_MSG(err, res, "Error: Unable to open the input list '%s'.", list_name);
+
+	for (;;) {
+		res = KT_SIGN_nextListEntry(err, list, state, algo, &entry, &skipped);
+		if (res != KT_OK) goto cleanup;
+
+		if (entry == NULL) break;
+		count++;
+	}
+
+	if ((count + max_tree_inputs - 1) / max_tree_inputs > (size_t)max_aggr_rounds) {
+		ERR_TRCKR_ADD(err, res = KT_AGGR_LVL_LIMIT_TOO_SMALL, "Error: Too much inputs in the input list! Permitted rounds is %i.", max_aggr_rounds);
+		goto cleanup;
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	INPUT_LIST_close(list);
+
+	return res;
+}
+
+/**
+ * Starts walking the directory trees specified with -r and returns the files
+ * found as an input list, so that the traversal overlaps with the signing.
+ */
+static int KT_SIGN_openDirWalker(PARAM_SET *set, ERR_TRCKR *err, INPUT_LIST **list) {
+	int res = KT_UNKNOWN_ERROR;
+	DIR_WALKER *walker = NULL;
+	int walk_threads = WALK_THREADS_DEFAULT;
+	KSI_uint64_t min_size = 0;
+	KSI_uint64_t max_size = 0;
+	int count = 0;
+	int i = 0;
+
+	if (set == NULL || err == NULL || list == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = PARAM_SET_getObj(set, "walk-threads", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&walk_threads);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = PARAM_SET_getObj(set, "min-size", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&min_size);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = PARAM_SET_getObj(set, "max-size", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_size);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = DIR_WALKER_new((size_t)walk_threads, &walker);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create directory walker.");
+
+	DIR_WALKER_setSizeLimits(walker, min_size, max_size);
+
+	res = PARAM_SET_getValueCount(set, "r", NULL, PST_PRIORITY_NONE, &count);
+	if (res != PST_OK) goto cleanup;
+
+	for (i = 0; i < count; i++) {
+		char *dir = NULL;
+
+		res = PARAM_SET_getStr(set, "r", NULL, PST_PRIORITY_NONE, i, &dir);
+		if (res != PST_OK) goto cleanup;
+
+		res = DIR_WALKER_addRoot(walker, dir);
+		ERR_CATCH_MSG(err, res, "Error: Unable to add directory '%s'.", dir);
+	}
+
+	res = PARAM_SET_getValueCount(set, "glob", NULL, PST_PRIORITY_NONE, &count);
+	if (res != PST_OK) goto cleanup;
+
+	for (i = 0; i < count; i++) {
+		char *pattern = NULL;
+
+		res = PARAM_SET_getStr(set, "glob", NULL, PST_PRIORITY_NONE, i, &pattern);
+		if (res != PST_OK) goto cleanup;
+
+		res = DIR_WALKER_addPattern(walker, pattern);
+		ERR_CATCH_MSG(err, res, "Error: Unable to add file name pattern '%s'.", pattern);
+	}
+
+	res = DIR_WALKER_start(walker);
+	ERR_CATCH_MSG(err, res, "Error: Unable to start directory walker.");
+
+	res = INPUT_LIST_fromWalker(walker, list);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create input list.");
+	walker = NULL;
+
+	res = KT_OK;
+
+cleanup:
+
+	DIR_WALKER_free(walker);
+
+	return res;
+}
+
+/**
+ * Returns the hash algorithm specified with -H, received from the aggregator or
+ * the default algorithm. Note that the algorithm has no effect on the inputs that
+ * are hash imprints.
+ */
+static int KT_SIGN_getHashAlgorithm(PARAM_SET *set, KSI_HashAlgorithm remote_algo, KSI_HashAlgorithm *algo) {
+	int res = KT_UNKNOWN_ERROR;
+
+	if (set == NULL || algo == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (PARAM_SET_isSetByName(set, "H")) {
+		res = PARAM_SET_getObjExtended(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, NULL, (void**)algo);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+	} else {
+		*algo = (KSI_isHashAlgorithmSupported(remote_algo)) ? remote_algo : KSI_getHashAlgorithmByName("default");
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Removes the input files that have not changed since they were signed and
+ * recorded in the state file from the index. Hash imprints and stdin are always
+ * signed. The inputs are looked up from the index in a single pass, as getting
+ * and clearing the values of the parameter set one by one takes quadratic time.
+ */
+static int KT_SIGN_skipUnchangedInputs(ERR_TRCKR *err, INPUT_INDEX *inputs, SIGN_STATE *state, KSI_HashAlgorithm algo, size_t *skipped) {
+	int res = KT_UNKNOWN_ERROR;
+	size_t in_count = 0;
+	size_t n = 0;
+	size_t count = 0;
+	unsigned char *isRemoved = NULL;
+
+	if (err == NULL || inputs == NULL || state == NULL || skipped == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	in_count = INPUT_INDEX_getCount(inputs);
+
+	isRemoved = (unsigned char*)KSI_calloc(in_count + 1, 1);
+	if (isRemoved == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	for (n = 0; n < in_count; n++) {
+		const char *fname = INPUT_INDEX_getName(inputs, n);
+		int status = SIGN_STATE_NEW;
+
+		/* Everything after -- (parameter input) is a file. */
+		if (INPUT_INDEX_getParam(inputs, n) == 0 && (strcmp(fname, "-") == 0 || is_imprint(fname))) continue;
+
+		res = SIGN_STATE_check(state, fname, (int)algo, &status);
+		ERR_CATCH_MSG(err, res, "Error: Unable to look up '%s' from the state file.", fname);
+
+		if (status != SIGN_STATE_UNCHANGED) continue;
+
+		isRemoved[n] = 1;
+		count++;
+	}
+
+	res = INPUT_INDEX_removeInputs(inputs, isRemoved);
+	ERR_CATCH_MSG(err, res, "Error: Unable to remove the unchanged inputs.");
+
+	print_debug("Skipped %zu unchanged files recorded in the state file.\n", count);
+
+	*skipped = count;
+	res = KT_OK;
+
+cleanup:
+
+	KSI_free(isRemoved);
+
+	return res;
+}
+
+/**
+ * Creates the journal (see --journal) or opens the journal of the job to be
+ * resumed (see --resume). The job is identified by the input names and the
+ * hash algorithm.
+ */
+static int KT_SIGN_openJournal(PARAM_SET *set, ERR_TRCKR *err, KSI_HashAlgorithm remote_algo, const INPUT_INDEX *inputs, SIGN_JOURNAL **journal) {
+	int res = KT_UNKNOWN_ERROR;
+	int d = 0;
+	int in_count = 0;
+	int n = 0;
+	int isResume = 0;
+	char *journal_name = NULL;
+	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+	KSI_uint64_t fingerprint = 0;
+	SIGN_JOURNAL *tmp = NULL;
+
+	if (set == NULL || err == NULL || inputs == NULL || journal == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	d = PARAM_SET_isSetByName(set, "d");
+	isResume = PARAM_SET_isSetByName(set, "resume");
+
+	res = PARAM_SET_getStr(set, isResume ? "resume" : "journal", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &journal_name);
+	if (res != PST_OK) goto cleanup;
+
+	res = KT_SIGN_getHashAlgorithm(set, remote_algo, &algo);
+	if (res != KT_OK) goto cleanup;
+
+	in_count = (int)INPUT_INDEX_getCount(inputs);
+
+	for (n = 0; n < in_count; n++) {
+		fingerprint = SIGN_JOURNAL_addToFingerprint(fingerprint, INPUT_INDEX_getName(inputs, (size_t)n));
+	}
+
+	if (isResume) {
+		size_t round = 0;
+		size_t input = 0;
+
+		print_progressDesc(d, "Loading journal... ");
+		res = SIGN_JOURNAL_open(journal_name, &tmp);
+		if (res == KT_INVALID_INPUT_FORMAT) {
+			ERR_TRCKR_ADD(err, res, "Error: '%s' is not a valid journal.", journal_name);
+			goto cleanup;
+		}
+		ERR_CATCH_MSG(err, res, "Error: Unable to open journal '%s'.", journal_name);
+		print_progressResult(res);
+
+		if (!SIGN_JOURNAL_isSameJob(tmp, (size_t)in_count, (int)algo, fingerprint)) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Journal '%s' is recorded for different inputs or hash algorithm.", journal_name);
+			goto cleanup;
+		}
+
+		SIGN_JOURNAL_getResumePoint(tmp, &round, &input);
+		print_debug("%zu rounds with %zu inputs are saved according to the journal.\n", round, input);
+	} else {
+		if (SMART_FILE_doFileExist(journal_name)) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Journal '%s' already exists. Use --resume to continue the job.", journal_name);
+			goto cleanup;
+		}
+
+		res = SIGN_JOURNAL_create(journal_name, (size_t)in_count, (int)algo, fingerprint, &tmp);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create journal '%s'.", journal_name);
+	}
+
+	*journal = tmp;
+	tmp = NULL;
+	res = KT_OK;
+
+cleanup:
+
+	print_progressResult(res);
+	SIGN_JOURNAL_close(tmp);
+
+	return res;
+}
+
+/**
+ * Reserves the names of the new signature files of the round (see SMART_FILE
+ * mode 'i') by creating the files and records them in the journal before the
+ * signatures are saved. The inputs that got a name in a round that was not
+ * finished by the previous run of the job keep it, so that the resumed job
+ * overwrites the files instead of saving the signatures next to them.
+ */
+static int KT_SIGN_reserveOutputNames(PARAM_SET *set, ERR_TRCKR *err, SIGNING_SLOT *slot) {
+	int res = KT_UNKNOWN_ERROR;
+	SIGNING_AGGR_ROUND *aggr_round = NULL;
+	int how_to_save = OUTPUT_UNKNOWN;
+	const char *mode = NULL;
+	const char *name = NULL;
+	SMART_FILE *file = NULL;
+	size_t n = 0;
+
+	if (set == NULL || err == NULL || slot == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	aggr_round = slot->aggr_round;
+
+	how_to_save = how_is_output_saved_to_index(set, slot->inputs);
+
+	res = get_smart_file_mode(err, how_to_save, &mode);
+	if (res != KT_OK) goto cleanup;
+
+	/* Other output files have the same names in every run. */
+	if (slot->journal == NULL || slot->bundle != NULL || strchr(mode, 'i') == NULL) {
+		res = KT_OK;
+		goto cleanup;
+	}
+
+	/* The names reserved by the previous run must not be given to the other inputs. */
+	for (n = 0; n < aggr_round->hash_count; n++) {
+		name = SIGN_JOURNAL_getReservedName(slot->journal, slot->input_offset + n);
+		if (name == NULL || SMART_FILE_doFileExist(name)) continue;
+
+		res = SMART_FILE_open(name, "wb", &file);
+		if (res != SMART_FILE_OK) {
+			ERR_TRCKR_ADD(err, res, "Error: Unable to reserve the signature file '%s'. %s", name, KSITOOL_errToString(res));
+			goto cleanup;
+		}
+		SMART_FILE_close(file);
+		file = NULL;
+	}
+
+	for (n = 0; n < aggr_round->hash_count; n++) {
+		char save_to[1024] = "";
+
+		name = SIGN_JOURNAL_getReservedName(slot->journal, slot->input_offset + n);
+
+		if (name == NULL) {
+			res = KT_SIGN_getSignatureFileName(err, slot->inputs, how_to_save, (int)(slot->input_offset + n), slot->name_tag, save_to, sizeof(save_to));
+			if (res != KT_OK) goto cleanup;
+
+			res = SMART_FILE_open(save_to, mode, &file);
+			if (res != SMART_FILE_OK) {
+				ERR_TRCKR_ADD(err, res, "Error: Unable to reserve the signature file '%s'. %s", save_to, KSITOOL_errToString(res));
+				goto cleanup;
+			}
+			name = SMART_FILE_getFname(file);
+		}
+
+		res = SIGNING_AGGR_ROUND_setOutputName(aggr_round, n, name);
+		ERR_CATCH_MSG(err, res, "Error: Unable to store the name of the signature file.");
+
+		SMART_FILE_close(file);
+		file = NULL;
+	}
+
+	res = SIGN_JOURNAL_start(slot->journal, slot->round, slot->input_offset, aggr_round->hash_count, aggr_round->fname_out);
+	ERR_CATCH_MSG(err, res, "Error: Unable to write the journal.");
+
+	aggr_round->hasReservedNames = 1;
+	res = KT_OK;
+
+cleanup:
+
+	SMART_FILE_close(file);
+
+	return res;
+}
+
+static int KT_SIGN_saveRound(PARAM_SET *set, ERR_TRCKR *err, SIGNING_SLOT *slot, int tree_size_1) {
+	int res = KT_UNKNOWN_ERROR;
+	int save_res = KT_UNKNOWN_ERROR;
+	int prgrs = 0;
+
+	if (set == NULL || err == NULL || slot == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	prgrs = PARAM_SET_isSetByName(set, "show-progress");
+
+	if (!prgrs && !tree_size_1) print_debug("\n");
+
+	res = KT_SIGN_reserveOutputNames(set, err, slot);
+	if (res != KT_OK) goto cleanup;
+
+	save_res = KT_SIGN_saveToOutput(set, err, slot->ctx, slot->inputs, slot->aggr_round, (int)slot->input_offset, slot->state, slot->name_tag, slot->dedupe, slot->bundle, slot->writer);
+
+	/* The round is recorded after its signatures are saved, so that it is not signed again (see --resume). */
+	if (slot->journal != NULL) {
+		res = SIGN_JOURNAL_record(slot->journal, slot->round, slot->input_offset, slot->aggr_round->hash_count,
+				save_res == KT_OK ? SIGN_JOURNAL_SAVED : SIGN_JOURNAL_FAILED);
+		ERR_CATCH_MSG(err, res, "Error: Unable to write the journal.");
+	}
+
+	if (save_res != KT_OK) {
+		res = save_res;
+		goto cleanup;
+	}
+
+	res = KT_SIGN_dump(NULL, set, err, slot->aggr_round);
+	if (res != KT_OK) goto cleanup;
+	if (prgrs) print_debug("\n");
+
+	if (!tree_size_1 || (tree_size_1 && prgrs)) print_debug("\n");
+	KSI_MetaData_free(slot->mdata);
+	slot->mdata = NULL;
+
+	SIGNING_AGGR_ROUND_releaseHandles(slot->aggr_round);
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+static int KT_SIGN_finishRound(PARAM_SET *set, ERR_TRCKR *err, SIGNING_SLOT *slot, size_t rounds) {
+	int res = KT_UNKNOWN_ERROR;
+	int d = 0;
+	char round_nr[64];
+
+	if (set == NULL || err == NULL || slot == NULL || !slot->isBusy) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	d = PARAM_SET_isSetByName(set, "d");
+
+	print_progressDesc(d, "Waiting for the signature of the local aggregation tree %s... ", KT_SIGN_roundToString(slot->round, rounds, round_nr, sizeof(round_nr)));
+
+	res = THREAD_POOL_wait(slot->pool);
+	slot->isBusy = 0;
+	if (res != KT_OK) {
+		ERR_TRCKR_append(err, slot->err);
+		ERR_TRCKR_reset(slot->err);
+		ERR_CATCH_MSG(err, res, "Error: Unable to complete and sign the local aggregation tree %s.", round_nr);
+	}
+
+	print_progressResult(res);
+
+	res = KT_SIGN_saveRound(set, err, slot, 0);
+	if (res != KT_OK) goto cleanup;
+
+cleanup:
+
+	return res;
+}
+
+static int KT_SIGN_performSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, SMART_FILE *logfile, KSI_HashAlgorithm remote_algo, size_t max_tree_inputs, size_t rounds, INPUT_INDEX *inputs, INPUT_LIST *list, SIGN_STATE *state, MULTI_HASH *multi, const INPUT_DEDUPE *dedupe, BUNDLE *bundle, SIGN_JOURNAL *journal) {
+	int res = KT_UNKNOWN_ERROR;
+	int d = 0;
+	int prgrs = 0;
+	int in_count = 0;
+	size_t divider = 1;
+	char *signed_data_out = NULL;
+	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+	COMPOSITE extra;
+	KSI_OctetString *mask_iv = NULL;
+	int isMetadata = 0;
+	int isMasking = 0;
+	KSI_DataHash *prev_leaf = NULL;
+	int tree_size_1 = 0;
+	KSI_BlockSignerHandle *hndl = NULL;
+	size_t i = 0;
+	size_t r = 0;
+	size_t n = 0;
+	KSI_DataHash *hash = NULL;
+	int threads = 1;
+	int isPipelined = 0;
+	int max_inflight = 1;
+	size_t inflight = 1;
+	PARALLEL_HASHER *parallel_hasher = NULL;
+	int save_threads = 1;
+	SIGNATURE_WRITER *writer = NULL;
+	SIGNING_SLOT **slots = NULL;
+	int max_aggr_rounds = 0;
+	size_t rounds_total = 0;
+	size_t round_offset = 0;
+	size_t batch_size = 0;
+	unsigned char *list_order = NULL;
+	size_t list_order_max = 0;
+	size_t skipped = 0;
+	char round_nr[64];
+	int target_round_ms = 0;
+	int isAdaptive = 0;
+	ROUND_SIZER sizer;
+	size_t next_round_size = 0;
+	size_t resume_round = 0;
+	size_t resume_input = 0;
+	size_t started = 0;
+
+	if (set == NULL || err == NULL || inputs == NULL || max_tree_inputs == 0 || rounds == 0) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/**
+	 * Read main parameters from the set.
+	 */
+	d = PARAM_SET_isSetByName(set, "d");
+	prgrs = PARAM_SET_isSetByName(set, "show-progress");
+
+	in_count = (int)INPUT_INDEX_getCount(inputs);
+
+	/* With deduplication only the inputs with a unique hash value are added to the trees. */
+	if (dedupe != NULL) in_count = (int)dedupe->unique_count;
+
+	res = PARAM_SET_getStr(set, "data-out", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &signed_data_out);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = PARAM_SET_getObj(set, "threads", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&threads);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = PARAM_SET_getObj(set, "save-threads", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&save_threads);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = PARAM_SET_getObj(set, "max-inflight-rounds", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_inflight);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = PARAM_SET_getObj(set, "max-aggr-rounds", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&max_aggr_rounds);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	res = PARAM_SET_getObj(set, "target-round-ms", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&target_round_ms);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	/**
+	 * With adaptive round size, rounds is the minimum count of rounds and up to
+	 * max-aggr-rounds rounds may be used, so the total count is not known.
+	 */
+	isAdaptive = PARAM_SET_isSetByName(set, "target-round-ms") && list == NULL && max_aggr_rounds > 1;
+	ROUND_SIZER_init(&sizer, max_tree_inputs, (KSI_uint64_t)target_round_ms);
+
+	isPipelined = PARAM_SET_isSetByName(set, "pipeline") && (rounds > 1 || isAdaptive);
+
+	/**
+	 * When the inputs are read from the input list, the total count of rounds is
+	 * not known and rounds is the count of rounds read from the list at once.
+	 */
+	if (list != NULL) {
+		batch_size = (rounds > INT_MAX / max_tree_inputs) ? INT_MAX : rounds * max_tree_inputs;
+	} else if (!isAdaptive) {
+		rounds_total = rounds;
+	}
+
+	res = KT_SIGN_getHashAlgorithm(set, remote_algo, &algo);
+	if (res != KT_OK) goto cleanup;
+
+	if (multi != NULL) algo = multi->algo[multi->current];
+
+	/**
+	 * Skip the rounds saved by the previous run of the job. The rounds keep their
+	 * numbers, so the metadata sequence numbers are the same as in a single run.
+	 */
+	if (journal != NULL) {
+		SIGN_JOURNAL_getResumePoint(journal, &resume_round, &resume_input);
+
+		if (resume_input >= (size_t)in_count) {
+			print_debug("All the %zu rounds recorded in the journal are saved.\n", resume_round);
+			res = KT_OK;
+			goto cleanup;
+		}
+
+		if (resume_round > 0) {
+			print_debug("Resuming at round %zu, %zu inputs are signed in the previous rounds.\n", resume_round + 1, resume_input);
+
+			/* The previous run may have used rounds of different size (see --target-round-ms). */
+			rounds = ((size_t)in_count - resume_input + max_tree_inputs - 1) / max_tree_inputs;
+			if (!isAdaptive) rounds_total = resume_round + rounds;
+		}
+	}
+
+	/**
+	 * Configure extra parameter for OBJ extractor.
+	 */
+	extra.ctx = ctx;
+	extra.err = err;
+	extra.h_alg = &algo;
+	extra.fname_out = signed_data_out;
+
+	/**
+	 * Extract initial value for masking mask.
+	 */
+	res = PARAM_SET_getObjExtended(set, "mask", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&extra, (void**)&mask_iv);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to get initial value for masking.");
+		goto cleanup;
+	}
+
+	/**
+	 * Analyze parameter to determine if masking is going to be performed and
+	 * if metadata is embedded to the signature.
+	 */
+	isMetadata = PARAM_SET_isSetByName(set, "mdata,mdata-cli-id");
+	isMasking = PARAM_SET_isSetByName(set, "mask");
+
+	inflight = (size_t)max_inflight < rounds ? (size_t)max_inflight : rounds;
+
+	/**
+	 * Extract previous leaf hash value.
+	 */
+	if (isMasking) {
+		if (PARAM_SET_isSetByName(set, "prev-leaf")) {
+			res = PARAM_SET_getObjExtended(set, "prev-leaf", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&extra, (void**)&prev_leaf);
+			if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+		} else {
+			res = KSI_DataHash_createZero(ctx, algo, &prev_leaf);
+			ERR_CATCH_MSG(err, res, "Error: Unable to create zero hash.");
+		}
+	}
+
+	if (list == NULL && rounds == 1 && in_count == 1 && !isMasking && !isMetadata) tree_size_1 = 1;
+
+	/**
+	 * Create a slot for every aggregation round that can be in flight. If only
+	 * a single round is in flight, it is signed synchronously with the main
+	 * context.
+	 */
+	slots = (SIGNING_SLOT**)KSI_calloc(inflight, sizeof(SIGNING_SLOT*));
+	if (slots == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	/**
+	 * Create worker threads for writing the signature files. The rounds are
+	 * saved one at a time, so the workers are shared by all the slots. Durable
+	 * output files are always committed by the writer.
+	 */
+	if ((save_threads > 1 || PARAM_SET_isSetByName(set, "durable")) && bundle == NULL) {
+		res = SIGNATURE_WRITER_new((size_t)save_threads, PARAM_SET_isSetByName(set, "durable"), &writer);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create worker threads for saving the signatures.");
+	}
+
+	for (n = 0; n < inflight; n++) {
+		res = SIGNING_SLOT_new(set, err, ctx, logfile, inflight > 1, max_tree_inputs, algo, isMasking ? prev_leaf : NULL, isMasking ? mask_iv : NULL, &slots[n]);
+		if (res != KT_OK) goto cleanup;
+		slots[n]->state = state;
+		slots[n]->name_tag = (multi != NULL) ? KSI_getHashAlgorithmName(algo) : NULL;
+		slots[n]->dedupe = dedupe;
+		slots[n]->bundle = bundle;
+		slots[n]->writer = writer;
+		slots[n]->journal = journal;
+		slots[n]->inputs = inputs;
+	}
+
+	/**
+	 * Create worker threads for hashing the input files. Note that there is no
+	 * reason to use more workers than there are inputs in the round. In pipelined
+	 * mode the inputs of the next round are hashed in the background while the
+	 * current round is being signed, so at least one worker is needed. When
+	 * signing with multiple hash algorithms or with deduplication, the inputs
+	 * are already hashed.
+	 */
+	if (multi == NULL && dedupe == NULL && ((threads > 1 && (in_count > 1 || list != NULL)) || isPipelined)) {
+		size_t workers = (size_t)threads < max_tree_inputs ? (size_t)threads : max_tree_inputs;
+
+		res = PARALLEL_HASHER_new(workers, algo, max_tree_inputs, &parallel_hasher);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create worker threads for hashing.");
+	}
+
+
+	/**
+	 * Perform local aggregation. If the inputs are read from the input list, the
+	 * list is processed in batches of rounds. Every round in flight keeps a copy
+	 * of its inputs, so the next batch is loaded without waiting for the rounds
+	 * of the previous batch to be saved.
+	 */
+	do {
+		size_t batch_rounds = isAdaptive ? (size_t)max_aggr_rounds : rounds;
+
+		if (list != NULL) {
+			res = KT_SIGN_loadInputList(set, err, list, state, algo, batch_size, &in_count, &skipped, &list_order, &list_order_max);
+			if (res != KT_OK) goto cleanup;
+
+			/**
+			 * The rounds in flight use their own copies of the names. Imprints and
+			 * file paths are kept in different parameters, but signed in the order
+			 * of the list, so the rounds and the metadata sequence numbers do not
+			 * depend on the kind of the entries.
+			 */
+			res = INPUT_INDEX_updateInOrder(inputs, set, list_order, list_order_max);
+			ERR_CATCH_MSG(err, res, "Error: Unable to index the inputs.");
+
+			if (in_count == 0) break;
+
+			batch_rounds = ((size_t)in_count + max_tree_inputs - 1) / max_tree_inputs;
+
+			/* A list file is counted in advance, stdin and -r only while reading. */
+			if (round_offset + batch_rounds > (size_t)max_aggr_rounds) {
+				ERR_TRCKR_ADD(err, res = KT_AGGR_LVL_LIMIT_TOO_SMALL, "Error: Too much inputs in the input list! Permitted rounds is %i.", max_aggr_rounds);
+				goto cleanup;
+			}
+		}
+
+		i = 0;
+
+		if (resume_round > 0) {
+			i = resume_input;
+			round_offset = resume_round;
+			batch_rounds = isAdaptive ? ((size_t)max_aggr_rounds > resume_round ? (size_t)max_aggr_rounds - resume_round : 1) : rounds;
+		}
+
+		for (r = 0; r < batch_rounds && i < (size_t)in_count; r++) {
+			size_t tree_input = 0;
+			size_t to_be_signed_in_round = ((size_t)in_count - i < max_tree_inputs) ? (size_t)in_count - i : max_tree_inputs;
+			SIGNING_SLOT *slot = slots[started++ % inflight];
+			SIGNING_AGGR_ROUND *aggr_round = slot->aggr_round;
+			KSI_BlockSigner *bs = aggr_round->block_signer;
+			KSI_uint64_t round_start = getTimeInMicros();
+			KSI_uint64_t sign_start = 0;
+
+			/**
+			 * The size of a pipelined round is chosen when its hashing is started.
+			 */
+			if (isAdaptive) {
+				to_be_signed_in_round = (next_round_size > 0) ? next_round_size : ROUND_SIZER_next(&sizer, (size_t)in_count - i, batch_rounds - r);
+				next_round_size = 0;
+			}
+
+			/**
+			 * Slots are used in round-robin order, so a busy slot holds the oldest
+			 * round in flight. Finish it to keep the output order deterministic.
+			 */
+			if (slot->isBusy) {
+				res = KT_SIGN_finishRound(set, err, slot, rounds_total);
+				if (res != KT_OK) goto cleanup;
+			}
+
+			res = KSI_BlockSigner_reset(bs);
+			ERR_CATCH_MSG(err, res, "Error: Unable to reset Block Signer.");
+
+			res = SIGNING_AGGR_ROUND_resetAndClean(aggr_round);
+			ERR_CATCH_MSG(err, res, "Error: Unable to reset SIGNING_AGGR_ROUND struct.");
+
+			/**
+			 * Extract the metadata if requested by the user. If not return NULL and
+			 * metadata is not embedded to the signature.
+			 */
+			res = KT_SIGN_getMetadata(set, err, slot->ctx, round_offset + r, &slot->mdata);
+			ERR_CATCH_MSG(err, res, "Error: Unable to construct metadata structure.");
+
+
+			if (prgrs || in_count > 1 || list != NULL) {
+				print_debug("Signing %zu files in round %s.%s\n", to_be_signed_in_round, KT_SIGN_roundToString(round_offset + r, rounds_total, round_nr, sizeof(round_nr)), prgrs ? "" : "\n");
+			}
+
+			if (parallel_hasher != NULL) {
+				if (!isPipelined || r == 0) {
+					res = KT_SIGN_startParallelHashing(set, err, inputs, parallel_hasher, state, algo, i, to_be_signed_in_round);
+					if (res != KT_OK) goto cleanup;
+				}
+
+				/* Imprints and the inputs taken from the state file are not hashed. */
+				if (!prgrs && parallel_hasher->file_count > 0) print_progressDesc(d, "Hashing %zu inputs with %zu threads... ", parallel_hasher->file_count, parallel_hasher->worker_count);
+
+				res = KT_SIGN_waitParallelHashing(err, parallel_hasher);
+				if (res != KT_OK) goto cleanup;
+
+				if (!prgrs && parallel_hasher->file_count > 0) print_progressResult(res);
+			}
+
+			if (list != NULL) {
+				res = INPUT_INDEX_copyRange(inputs, i, to_be_signed_in_round, &slot->round_inputs);
+				ERR_CATCH_MSG(err, res, "Error: Unable to copy the inputs of the round.");
+
+				slot->inputs = slot->round_inputs;
+				slot->input_offset = 0;
+			} else {
+				slot->input_offset = i;
+			}
+
+			for (tree_input = 0; tree_input < to_be_signed_in_round; tree_input++, i++) {
+				const char *fname = NULL;
+				KSI_HashAlgorithm hash_algo = KSI_HASHALG_INVALID_VALUE;
+				size_t input = (dedupe != NULL) ? dedupe->unique[i] : i;
+
+				if (!prgrs) print_progressDesc(d, "Extracting hash from input... ");
+
+				if (dedupe != NULL) {
+					const unsigned char *imprint = dedupe->imprints + input * KSI_MAX_IMPRINT_LEN;
+
+					res = KSI_DataHash_fromImprint(slot->ctx, imprint, KSI_getHashLength((KSI_HashAlgorithm)imprint[0]) + 1, &hash);
+					ERR_CATCH_MSG(err, res, "Error: Unable to create hash from imprint.");
+				} else {
+					res = KT_SIGN_getInputHash(set, err, ctx, slot->ctx, inputs, parallel_hasher, state, multi, &extra, i, tree_input, &hash);
+					if (res != KT_OK) goto cleanup;
+				}
+
+				if (!tree_size_1 && !prgrs) print_progressResult(res);
+
+				if (!tree_size_1 && !prgrs) print_progressDesc(d, "Add document hash %zu/%zu %s%s%sto the local aggregation tree... ",
+						tree_input + 1, to_be_signed_in_round,
+						(isMetadata && !isMasking) ? "with metadata " : "",
+						(!isMetadata && isMasking) ? "with enabled masking " : "",
+						(isMetadata && isMasking) ? "and metadata with enabled masking " : ""
+						);
+
+				KSI_DataHash_getHashAlg(hash, &hash_algo);
+				res = KSITOOL_BlockSigner_addLeaf(err, slot->ctx, bs, hash, 0, slot->mdata, &hndl);
+				ERR_CATCH_MSG(err, res, "Error: Unable to add a (%s) hash value to a local aggregation tree.", KSI_getHashAlgorithmName(hash_algo));
+
+				fname = INPUT_INDEX_getName(slot->inputs, (list != NULL) ? tree_input : input);
+				if (fname == NULL) {
+					ERR_TRCKR_ADD(err, res = KT_INDEX_OVF, "Error: Unable to get files name.");
+					goto cleanup;
+				}
+
+				res = SIGNING_AGGR_ROUND_append(aggr_round, hndl, hash, fname);
+				ERR_CATCH_MSG(err, res, "Error: Unable to add hash value and files name to local aggregation record.");
+				hndl = NULL;
+
+				/* The leaf of the tree keeps its own reference to the hash value. */
+				KSI_DataHash_free(hash);
+				hash = NULL;
+
+				if (!prgrs) print_progressResult(res);
+
+				if (prgrs && (i % divider == 0 || i + 1 >= (size_t)in_count || tree_input + 1 == to_be_signed_in_round)) {
+					PROGRESS_BAR_display((int)((tree_input + 1) * 100 / to_be_signed_in_round));
+
+					if (to_be_signed_in_round > 64) divider = to_be_signed_in_round / 64;
+					else divider = 1;
+				}
+
+			}
+
+
+			if ((!tree_size_1 || prgrs)) print_debug("\n");
+
+			/**
+			 * All the leaves of the current round are added to the tree. Start hashing
+			 * the inputs of the next round while the current round is being signed.
+			 */
+			if (isPipelined && i < (size_t)in_count) {
+				size_t to_be_signed_in_next_round = ((size_t)in_count - i < max_tree_inputs) ? (size_t)in_count - i : max_tree_inputs;
+
+				if (isAdaptive) {
+					to_be_signed_in_next_round = ROUND_SIZER_next(&sizer, (size_t)in_count - i, batch_rounds - r - 1);
+					next_round_size = to_be_signed_in_next_round;
+				}
+
+				res = KT_SIGN_startParallelHashing(set, err, inputs, parallel_hasher, state, algo, i, to_be_signed_in_next_round);
+				if (res != KT_OK) goto cleanup;
+			}
+
+			slot->round = round_offset + r;
+			KT_SIGN_roundToString(slot->round, rounds_total, round_nr, sizeof(round_nr));
+
+			if (slot->pool != NULL) {
+				/**
+				 * Sign the round in the background and continue with the next round.
+				 * The round is saved by KT_SIGN_finishRound.
+				 */
+				print_progressDesc(d, "Sending the local aggregation tree %s... ", round_nr);
+
+				res = THREAD_POOL_start(slot->pool, 1, signing_slot_job, slot);
+				ERR_CATCH_MSG(err, res, "Error: Unable to start signing the local aggregation tree.");
+				slot->isBusy = 1;
+
+				print_progressResult(res);
+				continue;
+			}
+
+			if (tree_size_1) print_progressDesc(d, "Creating signature from hash... ");
+			else print_progressDesc(d, "Signing the local aggregation tree %s... ", round_nr);
+
+			sign_start = getTimeInMicros();
+
+			res = KSITOOL_BlockSigner_closeAndSign(err, ctx, bs);
+			if (tree_size_1) {ERR_CATCH_MSG(err, res, "Error: Unable to create signature.");}
+			else {ERR_CATCH_MSG(err, res, "Error: Unable to complete and sign the local aggregation tree.");}
+
+			print_progressResult(res);
+
+			if (isAdaptive) {
+				KSI_uint64_t sign_us = getTimeInMicros() - sign_start;
+
+				res = KT_SIGN_saveRound(set, err, slot, tree_size_1);
+				if (res != KT_OK) goto cleanup;
+
+				ROUND_SIZER_update(&sizer, to_be_signed_in_round, getTimeInMicros() - round_start - sign_us, sign_us);
+				print_debug("Round of %zu inputs took %llu ms (signing %llu ms).\n", to_be_signed_in_round,
+						(unsigned long long)((getTimeInMicros() - round_start) / 1000), (unsigned long long)(sign_us / 1000));
+				continue;
+			}
+
+			res = KT_SIGN_saveRound(set, err, slot, tree_size_1);
+			if (res != KT_OK) goto cleanup;
+		}
+
+		/* Adaptive rounds are smaller than the maximum, so the permitted rounds may run out. */
+		if (isAdaptive && i < (size_t)in_count) {
+			ERR_TRCKR_ADD(err, res = KT_AGGR_LVL_LIMIT_TOO_SMALL, "Error: Too much inputs! Permitted rounds is %i.", max_aggr_rounds);
+			goto cleanup;
+		}
+
+		round_offset += batch_rounds;
+	} while (list != NULL);
+
+	/**
+	 * Finish the rounds that are still in flight in the order they were started.
+	 */
+	for (n = 0; n < inflight; n++) {
+		SIGNING_SLOT *slot = slots[(started + n) % inflight];
+
+		if (slot->isBusy) {
+			res = KT_SIGN_finishRound(set, err, slot, rounds_total);
+			if (res != KT_OK) goto cleanup;
+		}
+	}
+
+	if (list != NULL && state != NULL) print_debug("Skipped %zu unchanged files recorded in the state file.\n", skipped);
+
+	KT_SIGN_printRoundMemory(slots, inflight);
+
+	res = KT_OK;
+
+cleanup:
+	PARALLEL_HASHER_free(parallel_hasher);
+	if (slots != NULL) {
+		for (n = 0; n < inflight; n++) SIGNING_SLOT_free(slots[n]);
+		KSI_free(slots);
+	}
+	SIGNATURE_WRITER_free(writer);
+	KSI_DataHash_free(hash);
+	KSI_DataHash_free(prev_leaf);
+	KSI_BlockSignerHandle_free(hndl);
+	KSI_OctetString_free(mask_iv);
+	free(list_order);
+
+	return res;
+}
+
+static int KT_SIGN_saveAsyncChunk(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, const INPUT_INDEX *inputs, SIGNING_AGGR_ROUND *chunk, size_t offset) {
+	int res = KT_UNKNOWN_ERROR;
+
+	if (set == NULL || err == NULL || ctx == NULL || inputs == NULL || chunk == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	res = KT_SIGN_saveToOutput(set, err, ctx, inputs, chunk, (int)offset, NULL, NULL, NULL, NULL, NULL);
+	if (res != KT_OK) goto cleanup;
+
+	res = KT_SIGN_dump(NULL, set, err, chunk);
+	if (res != KT_OK) goto cleanup;
+
+	res = SIGNING_AGGR_ROUND_resetAndClean(chunk);
+	ERR_CATCH_MSG(err, res, "Error: Unable to reset SIGNING_AGGR_ROUND struct.");
+
+cleanup:
+
+	return res;
+}
+
+static int KT_SIGN_performAsyncSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, const INPUT_INDEX *inputs) {
+	int res = KT_UNKNOWN_ERROR;
+	int d = 0;
+	int in_count = 0;
+	int window = 0;
+	char *signed_data_out = NULL;
+	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+	COMPOSITE extra;
+	KSI_AsyncService *as = NULL;
+	KSI_AsyncHandle *handle = NULL;
+	KSI_AggregationReq *req = NULL;
+	KSI_DataHash *hash = NULL;
+	KSI_DataHash *req_hash = NULL;
+	KSI_Signature *sig = NULL;
+	size_t *req_index = NULL;
+	SIGNING_AGGR_ROUND *chunks[2] = {NULL, NULL};
+	size_t received[2] = {0, 0};
+	size_t cur = 0;
+	size_t base = 0;
+	size_t next = 0;
+	size_t pending = 0;
+	size_t waiting = 0;
+	unsigned poll_delay = 0;
+
+	if (set == NULL || err == NULL || ctx == NULL || inputs == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/**
+	 * Read main parameters from the set.
+	 */
+	d = PARAM_SET_isSetByName(set, "d");
+
+	in_count = (int)INPUT_INDEX_getCount(inputs);
+
+	res = PARAM_SET_getStr(set, "data-out", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &signed_data_out);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	window = ASYNC_WINDOW_DEFAULT;
+	res = PARAM_SET_getObj(set, "async-window", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&window);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	if (PARAM_SET_isSetByName(set, "H")) {
+		res = PARAM_SET_getObjExtended(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, NULL, (void**)&algo);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+	} else {
+		algo = (KSI_isHashAlgorithmSupported(remote_algo)) ? remote_algo : KSI_getHashAlgorithmByName("default");
+	}
+
+	extra.ctx = ctx;
+	extra.err = err;
+	extra.h_alg = &algo;
+	extra.fname_out = signed_data_out;
+
+	/**
+	 * Configure the asynchronous signing service. The service keeps up to window
+	 * requests in its cache.
+	 */
+	res = TOOL_init_ksi_async_service(set, err, ctx, TOOL_ASYNC_SIGNING, window, &as);
+	if (res != KT_OK) goto cleanup;
+
+	/**
+	 * Responses may arrive in any order. Signatures are collected into two chunks
+	 * of window inputs. The oldest chunk is saved as soon as all its signatures
+	 * are received, so output files are named as with the block-signer.
+	 */
+	res = SIGNING_AGGR_ROUND_new((size_t)window, &chunks[0]);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create a record for asynchronous signing.");
+
+	res = SIGNING_AGGR_ROUND_new((size_t)window, &chunks[1]);
+	ERR_CATCH_MSG(err, res, "Error: Unable to create a record for asynchronous signing.");
+
+	print_debug("Signing %i inputs asynchronously with up to %i requests in flight.\n\n", in_count, window);
+
+	while (base < (size_t)in_count) {
+		/**
+		 * Keep the window full.
+		 */
+		while (next < (size_t)in_count && pending < (size_t)window && next < base + 2 * (size_t)window) {
+			SIGNING_AGGR_ROUND *chunk = chunks[(cur + (next - base) / window) % 2];
+			const char *fname = INPUT_INDEX_getName(inputs, next);
+
+			print_progressDesc(d, "Sending signing request for input %zu/%i... ", next + 1, in_count);
+
+			res = KT_SIGN_getInputHash(set, err, ctx, ctx, inputs, NULL, NULL, NULL, &extra, next, 0, &hash);
+			if (res != KT_OK) goto cleanup;
+
+			res = KSI_DataHash_clone(hash, &req_hash);
+			ERR_CATCH_MSG(err, res, "Error: Unable to clone hash value.");
+
+			res = KSI_AggregationReq_new(ctx, &req);
+			ERR_CATCH_MSG(err, res, "Error: Unable to create aggregation request.");
+
+			res = KSI_AggregationReq_setRequestHash(req, req_hash);
+			ERR_CATCH_MSG(err, res, "Error: Unable to set aggregation request hash.");
+			req_hash = NULL;
+
+			res = KSI_AsyncAggregationHandle_new(ctx, req, &handle);
+			ERR_CATCH_MSG(err, res, "Error: Unable to create asynchronous request handle.");
+			req = NULL;
+
+			/* Index of the input is needed to find the place of the signature when the response arrives. */
+			req_index = (size_t*)KSI_malloc(sizeof(size_t));
+			if (req_index == NULL) {
+				ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+				goto cleanup;
+			}
+			*req_index = next;
+
+			res = KSI_AsyncHandle_setRequestCtx(handle, (void*)req_index, KSI_free);
+			ERR_CATCH_MSG(err, res, "Error: Unable to set asynchronous request context.");
+			req_index = NULL;
+
+			res = KSITOOL_AsyncService_addRequest(err, ctx, as, handle);
+			ERR_CATCH_MSG(err, res, "Error: Unable to add asynchronous signing request.");
+			handle = NULL;
+
+			res = SIGNING_AGGR_ROUND_append(chunk, NULL, hash, fname);
+			ERR_CATCH_MSG(err, res, "Error: Unable to add hash value and files name to local aggregation record.");
+
+			KSI_DataHash_free(hash);
+			hash = NULL;
+
+			print_progressResult(res);
+
+			next++;
+			pending++;
+		}
+
+		/**
+		 * Send the requests and receive a response if one is available.
+		 */
+		res = KSITOOL_AsyncService_run(err, ctx, as, &handle, &waiting);
+		ERR_CATCH_MSG(err, res, "Error: Unable to run asynchronous signing service.");
+
+		if (handle != NULL) {
+			const void *tmp_index = NULL;
+			size_t index = 0;
+			size_t c = 0;
+
+			res = KSI_AsyncHandle_getRequestCtx(handle, &tmp_index);
+			if (res != KSI_OK || tmp_index == NULL) {
+				ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unexpected error. Unable to get asynchronous request context.");
+				goto cleanup;
+			}
+			index = *(const size_t*)tmp_index;
+
+			if (index < base || index >= next) {
+				ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unexpected error. Response to an unknown request.");
+				goto cleanup;
+			}
+
+			print_progressDesc(d, "Receiving signature for input %zu/%i... ", index + 1, in_count);
+
+			res = KSITOOL_AsyncHandle_getSignature(err, ctx, handle, &sig);
+			ERR_CATCH_MSG(err, res, "Error: Unable to create signature for input %zu.", index + 1);
+
+			c = (cur + (index - base) / window) % 2;
+			chunks[c]->signatures[(index - base) % window] = sig;
+			sig = NULL;
+			received[c]++;
+			pending--;
+
+			KSI_AsyncHandle_free(handle);
+			handle = NULL;
+			poll_delay = 0;
+
+			print_progressResult(res);
+		} else if (pending > 0) {
+			/* The service can only be polled, so back off until a response arrives. */
+			sleepWithBackoff(&poll_delay, ASYNC_POLL_MAX_MS);
+		}
+
+		/**
+		 * Save the oldest chunk when it is full (or holds the last inputs) and all
+		 * its signatures are received.
+		 */
+		if (chunks[cur]->hash_count > 0 && received[cur] == chunks[cur]->hash_count
+				&& (chunks[cur]->hash_count == (size_t)window || next == (size_t)in_count)) {
+			size_t saved = chunks[cur]->hash_count;
+
+			print_debug("\n");
+
+			res = KT_SIGN_saveAsyncChunk(set, err, ctx, inputs, chunks[cur], base);
+			if (res != KT_OK) goto cleanup;
+
+			print_debug("\n");
+
+			received[cur] = 0;
+			base += saved;
+			cur = (cur + 1) % 2;
+		}
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	KSI_free(req_index);
+	KSI_AsyncHandle_free(handle);
+	KSI_AggregationReq_free(req);
+	KSI_DataHash_free(req_hash);
+	KSI_DataHash_free(hash);
+	KSI_Signature_free(sig);
+	SIGNING_AGGR_ROUND_free(chunks[0]);
+	SIGNING_AGGR_ROUND_free(chunks[1]);
+	KSI_AsyncService_free(as);
+
+	return res;
+}
+
+/**
+ * Converts an entry of the hash stream to a hash value. If algo is valid, the
+ * entry is a raw digest. Otherwise it is a hash imprint (<alg>:<hash in hex>).
+ */
+static int KT_SIGN_getStreamHash(ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm algo, const unsigned char *entry, size_t entry_len, size_t nr, KSI_DataHash **hash) {
+	int res = KT_UNKNOWN_ERROR;
+
+	if (err == NULL || ctx == NULL || entry == NULL || hash == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	if (algo != KSI_HASHALG_INVALID_VALUE) {
+		res = KSI_DataHash_fromDigest(ctx, algo, entry, entry_len, hash);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create hash from entry %zu in the hash stream.", nr);
+	} else {
+		if (!is_imprint((const char*)entry)) {
+			ERR_TRCKR_ADD(err, res = KT_INVALID_INPUT_FORMAT, "Error: Entry %zu in the hash stream is not a valid hash imprint (<alg>:<hash in hex>).", nr);
+			goto cleanup;
+		}
+
+		res = get_hash_from_imprint(ctx, (const char*)entry, hash);
+		ERR_CATCH_MSG(err, res, "Error: Unable to create hash from entry %zu in the hash stream.", nr);
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Saves the signatures of a hash stream round either to already opened stdout
+ * or to the output directory as <nr>.ksig, where <nr> is the index of the entry
+ * in the stream (starting from 1).
+ */
+static int KT_SIGN_saveStreamRound(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, SIGNING_AGGR_ROUND *aggr_round, SMART_FILE *out, const char *out_dir, size_t first) {
+	int res = KT_UNKNOWN_ERROR;
+	size_t n = 0;
+	KSI_Signature *sig = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+
+	if (set == NULL || err == NULL || ctx == NULL || aggr_round == NULL || (out == NULL && out_dir == NULL)) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	for (n = 0; n < aggr_round->hash_count; n++) {
+		char real_output_name[1024] = "";
+
+		res = SIGNING_AGGR_ROUND_getSignature(aggr_round, n, &sig);
+		ERR_CATCH_MSG(err, res, "Error: Unable to extract signature.");
+
+		if (out != NULL) {
+			res = KSI_Signature_serialize(sig, &raw, &raw_len);
+			ERR_CATCH_MSG(err, res, "Error: Unable to serialize signature.");
+
+			res = SMART_FILE_write(out, (char*)raw, raw_len, NULL);
+			ERR_CATCH_MSG(err, res, "Error: Unable to write signature to stdout.");
+
+			KSI_snprintf(real_output_name, sizeof(real_output_name), "-");
+			KSI_free(raw);
+			raw = NULL;
+		} else {
+			char save_to_file[1024] = "";
+			size_t path_len = strlen(out_dir);
+
+			KSI_snprintf(save_to_file, sizeof(save_to_file), "%s%s%zu.ksig",
+					out_dir, (path_len != 0 && out_dir[path_len - 1] == '/') ? "" : "/", first + n + 1);
+
+			res = KSI_OBJ_saveSignature(err, ctx, sig, "wbi", save_to_file, real_output_name, sizeof(real_output_name));
+			ERR_CATCH_MSG(err, res, "Error: Unable to save signature.");
+
+			print_debug("Signature saved to '%s'.\n", real_output_name);
+		}
+
+		res = SIGNING_AGGR_ROUND_setOutputName(aggr_round, n, real_output_name);
+		ERR_CATCH_MSG(err, res, "Error: Unable to store the name of the signature file.");
+
+		KSI_Signature_free(sig);
+		sig = NULL;
+	}
+
+	/* Make the signatures of the round immediately available for the reader of stdout. */
+	if (out != NULL) {
+		res = SMART_FILE_flush(out);
+		ERR_CATCH_MSG(err, res, "Error: Unable to write signature to stdout.");
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	KSI_free(raw);
+	KSI_Signature_free(sig);
+
+	return res;
+}
+
+static int KT_SIGN_performStreamSigning(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ctx, KSI_HashAlgorithm remote_algo, size_t max_tree_inputs) {
+	int res = KT_UNKNOWN_ERROR;
+	int d = 0;
+	char *stream_name = NULL;
+	char *out_name = NULL;
+	int window = 0;
+	int isRaw = 0;
+	int isMasking = 0;
+	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
+	COMPOSITE extra;
+	KSI_OctetString *mask_iv = NULL;
+	KSI_DataHash *prev_leaf = NULL;
+	KSI_DataHash *hash = NULL;
+	KSI_BlockSignerHandle *hndl = NULL;
+	HASH_STREAM *stream = NULL;
+	SMART_FILE *out = NULL;
+	SIGNING_SLOT *slot = NULL;
+	char *names = NULL;
+	size_t r = 0;
+	size_t first = 0;
+	KSI_uint64_t deadline = 0;
+
+	if (set == NULL || err == NULL || ctx == NULL || max_tree_inputs == 0) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
+		goto cleanup;
+	}
+
+	/**
+	 * Read main parameters from the set.
+	 */
+	d = PARAM_SET_isSetByName(set, "d");
+	isRaw = PARAM_SET_isSetByName(set, "stream-raw");
+	isMasking = PARAM_SET_isSetByName(set, "mask");
+
+	res = PARAM_SET_getStr(set, "hash-stream", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &stream_name);
+	if (res != PST_OK) goto cleanup;
+
+	res = PARAM_SET_getStr(set, "o", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &out_name);
+	if (res != PST_OK) goto cleanup;
+
+	window = STREAM_WINDOW_DEFAULT;
+	res = PARAM_SET_getObj(set, "stream-window", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&window);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+
+	if (PARAM_SET_isSetByName(set, "H")) {
+		res = PARAM_SET_getObjExtended(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, NULL, (void**)&algo);
+		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+	} else {
+		algo = (KSI_isHashAlgorithmSupported(remote_algo)) ? remote_algo : KSI_getHashAlgorithmByName("default");
+	}
+
+	extra.ctx = ctx;
+	extra.err = err;
+	extra.h_alg = &algo;
+	extra.fname_out = NULL;
+
+	res = PARAM_SET_getObjExtended(set, "mask", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&extra, (void**)&mask_iv);
+	if (res != PST_OK && res != PST_PARAMETER_EMPTY) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to get initial value for masking.");
+		goto cleanup;
+	}
+
+	if (isMasking) {
+		if (PARAM_SET_isSetByName(set, "prev-leaf")) {
+			res = PARAM_SET_getObjExtended(set, "prev-leaf", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&extra, (void**)&prev_leaf);
+			if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+		} else {
+			res = KSI_DataHash_createZero(ctx, algo, &prev_leaf);
+			ERR_CATCH_MSG(err, res, "Error: Unable to create zero hash.");
+		}
+	}
+
+	/**
+	 * The rounds of the stream are signed one after another with the same
+	 * block-signer, so masking links every round with the previous one.
+	 */
+	res = SIGNING_SLOT_new(set, err, ctx, NULL, 0, max_tree_inputs, algo, isMasking ? prev_leaf : NULL, isMasking ? mask_iv : NULL, &slot);
+	if (res != KT_OK) goto cleanup;
+
+	/* Names of the hash values in the round, used for debug output and dump. */
+	names = (char*)KSI_calloc(max_tree_inputs, STREAM_NAME_LEN);
+	if (names == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_OUT_OF_MEMORY, NULL);
+		goto cleanup;
+	}
+
+	res = HASH_STREAM_open(stream_name, isRaw ? KSI_getHashLength(algo) : 0, &stream);
+	ERR_CATCH_MSG(err, res, "Error: Unable to open the hash stream '%s'.", stream_name);
+
+	if (strcmp(out_name, "-") == 0) {
+		res = SMART_FILE_open("-", "wbs", &out);
+		ERR_CATCH_MSG(err, res, "Error: Unable to open stdout.");
+	}
+
+	print_debug("Signing hash stream with up to %zu hashes per round and time window of %i ms.\n", max_tree_inputs, window);
+
+	for (;;) {
+		SIGNING_AGGR_ROUND *aggr_round = slot->aggr_round;
+		KSI_BlockSigner *bs = aggr_round->block_signer;
+		const unsigned char *entry = NULL;
+		size_t entry_len = 0;
+		long timeout = -1;
+		int isEof = 0;
+
+		/* Wait for the first hash of the round without time limit. */
+		if (aggr_round->hash_count > 0) {
+			KSI_uint64_t now = getTimeInMicros() / 1000;
+			timeout = now < deadline ? (long)(deadline - now) : 0;
+		}
+
+		res = HASH_STREAM_next(stream, timeout, &entry, &entry_len);
+		if (res == KT_INDEX_OVF) {
+			ERR_TRCKR_ADD(err, res, "Error: Entry %zu in the hash stream is too long.", HASH_STREAM_getCount(stream) + 1);
+			goto cleanup;
+		} else if (res == KT_INVALID_INPUT_FORMAT) {
+			ERR_TRCKR_ADD(err, res, "Error: The hash stream ends with an incomplete %s digest.", KSI_getHashAlgorithmName(algo));
+			goto cleanup;
+		}
+		ERR_CATCH_MSG(err, res, "Error: Unable to read the hash stream.");
+
+		isEof = HASH_STREAM_isEof(stream);
+
+		if (entry != NULL) {
+			char *name = names + aggr_round->hash_count * STREAM_NAME_LEN;
+
+			/* Start a new round. */
+			if (aggr_round->hash_count == 0) {
+				res = KSI_BlockSigner_reset(bs);
+				ERR_CATCH_MSG(err, res, "Error: Unable to reset Block Signer.");
+
+				res = SIGNING_AGGR_ROUND_resetAndClean(aggr_round);
+				ERR_CATCH_MSG(err, res, "Error: Unable to reset SIGNING_AGGR_ROUND struct.");
+
+				res = KT_SIGN_getMetadata(set, err, slot->ctx, r, &slot->mdata);
+				ERR_CATCH_MSG(err, res, "Error: Unable to construct metadata structure.");
+
+				deadline = getTimeInMicros() / 1000 + (KSI_uint64_t)window;
+			}
+
+			res = KT_SIGN_getStreamHash(err, slot->ctx, isRaw ? algo : KSI_HASHALG_INVALID_VALUE, entry, entry_len, HASH_STREAM_getCount(stream), &hash);
+			if (res != KT_OK) goto cleanup;
+
+			res = KSITOOL_BlockSigner_addLeaf(err, slot->ctx, bs, hash, 0, slot->mdata, &hndl);
+			ERR_CATCH_MSG(err, res, "Error: Unable to add entry %zu of the hash stream to a local aggregation tree.", HASH_STREAM_getCount(stream));
+
+			if (KSITOOL_DataHash_toString(hash, name, STREAM_NAME_LEN) == NULL) name[0] = '\0';
+
+			res = SIGNING_AGGR_ROUND_append(aggr_round, hndl, hash, name);
+			ERR_CATCH_MSG(err, res, "Error: Unable to add hash value to local aggregation record.");
+			hndl = NULL;
+
+			KSI_DataHash_free(hash);
+			hash = NULL;
+		}
+
+		/**
+		 * Close the round if the tree is full, the time window has expired or
+		 * there is nothing more to read.
+		 */
+		if (aggr_round->hash_count > 0 &&
+				(aggr_round->hash_count == max_tree_inputs || isEof || getTimeInMicros() / 1000 >= deadline)) {
+			print_progressDesc(d, "Signing %zu hashes in round %zu... ", aggr_round->hash_count, r + 1);
+
+			res = KSITOOL_BlockSigner_closeAndSign(err, slot->ctx, bs);
+			ERR_CATCH_MSG(err, res, "Error: Unable to complete and sign the local aggregation tree %zu.", r + 1);
+
+			print_progressResult(res);
+
+			res = KT_SIGN_saveStreamRound(set, err, slot->ctx, aggr_round, out, out_name, first);
+			if (res != KT_OK) goto cleanup;
+
+			res = KT_SIGN_dump(NULL, set, err, aggr_round);
+			if (res != KT_OK) goto cleanup;
+
+			first += aggr_round->hash_count;
+			r++;
+
+			KSI_MetaData_free(slot->mdata);
+			slot->mdata = NULL;
+
+			res = SIGNING_AGGR_ROUND_resetAndClean(aggr_round);
+			ERR_CATCH_MSG(err, res, "Error: Unable to reset SIGNING_AGGR_ROUND struct.");
+		}
+
+		if (isEof) break;
+	}
+
+	print_debug("Signed %zu hashes from the hash stream in %zu rounds.\n", first, r);
+	KT_SIGN_printRoundMemory(&slot, 1);
+	res = KT_OK;
+
+cleanup:
+
+	SMART_FILE_close(out);
+	HASH_STREAM_close(stream);
+	SIGNING_SLOT_free(slot);
+	KSI_free(names);
+	KSI_BlockSignerHandle_free(hndl);
+	KSI_DataHash_free(hash);
+	KSI_DataHash_free(prev_leaf);
+	KSI_OctetString_free(mask_iv);
+
+	return res;
+}
+
+static int generate_file_name(const INPUT_INDEX *inputs, size_t i, char *buf, size_t buf_len) {
+	int res = KT_UNKNOWN_ERROR;
+	const char *in_file_name = NULL;
+
+	in_file_name = INPUT_INDEX_getName(inputs, i);
+	if (in_file_name == NULL) {
+		res = KT_INVALID_ARGUMENT;
+		goto cleanup;
+	}
+
+	if (strcmp(in_file_name, "-") == 0 && INPUT_INDEX_getCount(inputs) == 1) {
+		KSI_snprintf(buf, buf_len, "stdin.ksig");
+	} else if (is_imprint(in_file_name)) {
+		char hash_algo[1024];
+		char *colon = NULL;
+
+		/* Search for the algorithm name. */
+		KSI_strncpy(hash_algo, in_file_name, sizeof(hash_algo));
+		colon = strchr(hash_algo, ':');
+
+		/* Create the file name from hash algorithm. */
+		if (colon != NULL) {
+			*colon = '\0';
+			KSI_snprintf(buf, buf_len, "%s.ksig", hash_algo);
+		} else {
+			KSI_snprintf(buf, buf_len, "hash_imprint.ksig");
+		}
+	} else {
+		KSI_snprintf(buf, buf_len, "%s.ksig", in_file_name);
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Inserts the tag into the file name before the extension (e.g. file.ksig is
+ * turned into file.SHA-256.ksig), or appends the tag if there is no extension.
+ */
+static const char *KT_SIGN_tagFileName(const char *fname, const char *tag, char *buf, size_t buf_len) {
+	const char *base = fname;
+	const char *ext = NULL;
+	const char *p = NULL;
+
+	/* Only the last dot in the last path component (not a leading one) starts the extension. */
+	for (p = fname; *p != '\0'; p++) {
+		if (*p == '/' || *p == '\\') {
+			base = p + 1;
+			ext = NULL;
+		} else if (*p == '.') {
+			ext = p;
+		}
+	}
+	if (ext == base) ext = NULL;
+
+	if (ext == NULL) {
+		KSI_snprintf(buf, buf_len, "%s.%s", fname, tag);
+	} else {
+		KSI_snprintf(buf, buf_len, "%.*s.%s%s", (int)(ext - fname), fname, tag, ext);
+	}
+
+	return buf;
+}
+
+/**
+ * Gets the name of the file the signature of the input with the given index of
+ * i,input is saved to.
+ */
+static int KT_SIGN_getSignatureFileName(ERR_TRCKR *err, const INPUT_INDEX *inputs, int how_to_save, int input, const char *name_tag, char *buf, size_t buf_len) {
+	int res = KT_UNKNOWN_ERROR;
+
+	if (get_output_file_name(err, inputs, how_to_save, (size_t)input, buf, buf_len, generate_file_name) == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unexpected error. Unable to get the file name to save the signature to.");
+		goto cleanup;
+	}
+
+	/* Signatures of different hash algorithms are saved to different files. */
+	if (name_tag != NULL && how_to_save != OUTPUT_TO_STDOUT) {
+		char tmp[1024];
+
+		KT_SIGN_tagFileName(buf, name_tag, tmp, sizeof(tmp));
+		KSI_strncpy(buf, tmp, buf_len);
+	}
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Saves the signature of the input with the given index of i,input. The name of
+ * the saved file is returned in \c real_output_name.
+ */
+static int KT_SIGN_saveSignatureOfInput(ERR_TRCKR *err, KSI_CTX *ksi, const INPUT_INDEX *inputs, KSI_Signature *sig, int how_to_save, const char *mode, int input, const char *name_tag, char *real_output_name, size_t real_output_name_len) {
+	int res = KT_UNKNOWN_ERROR;
+	char save_to_file[1024] = "";
+
+	res = KT_SIGN_getSignatureFileName(err, inputs, how_to_save, input, name_tag, save_to_file, sizeof(save_to_file));
+	if (res != KT_OK) goto cleanup;
+
+	res = KSI_OBJ_saveSignature(err, ksi, sig, mode, save_to_file, real_output_name, real_output_name_len);
+	ERR_CATCH_MSG(err, res, "Error: Unable to save signature.");
+
+	res = KT_OK;
+
+cleanup:
+
+	return res;
+}
+
+/**
+ * Adds the signature to the bundle. The entry is named after the input ('stdin'
+ * for -) and the tag is inserted into the name as into the output file names.
+ * If \c isAlias is set, the entry refers to the data of the previous entry that
+ * holds the same signature. If \c shared is not NULL, the signature is encoded
+ * against the shared block of its round (see --round-store). The path of the
+ * bundle is returned in \c real_output_name.
+ */
+static int KT_SIGN_addToBundle(ERR_TRCKR *err, BUNDLE *bundle, KSI_Signature *sig, const char *fname, const char *name_tag, int isAlias, const ROUND_STORE_SHARED *shared, char *real_output_name, size_t real_output_name_len) {
 	int res = KT_UNKNOWN_ERROR;
-	int d = 0;
-	int prgrs = 0;
-	int in_count = 0;
-	size_t divider = 1;
-	char *signed_data_out = NULL;
-	KSI_HashAlgorithm algo = KSI_HASHALG_INVALID_VALUE;
-	COMPOSITE extra;
-	KSI_OctetString *mask_iv = NULL;
-	int isMetadata = 0;
-	int isMasking = 0;
-	KSI_DataHash *prev_leaf = NULL;
-	SIGNING_AGGR_ROUND *aggr_round = NULL;
-	int tree_size_1 = 0;
-	KSI_BlockSigner *bs = NULL;
-	KSI_BlockSignerHandle *hndl = NULL;
-	KSI_LIST(KSI_BlockSignerHandle) *hndlList = NULL;
-	KSI_MetaData *mdata = NULL;
-	size_t i = 0;
-	size_t r = 0;
-	KSI_DataHash *hash = NULL;
-
-	if (set == NULL || err == NULL || max_tree_inputs == 0 || rounds == 0) {
-		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
-		goto cleanup;
+	char name[1024];
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
+	unsigned char *encoded = NULL;
+	size_t encoded_len = 0;
+	KSI_DataHash *hsh = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+
+	KSI_strncpy(name, strcmp(fname, "-") == 0 ? "stdin" : fname, sizeof(name));
+
+	if (name_tag != NULL) {
+		char tmp[1024];
+
+		KT_SIGN_tagFileName(name, name_tag, tmp, sizeof(tmp));
+		KSI_strncpy(name, tmp, sizeof(name));
 	}
 
-	/**
-	 * Read main parameters from the set.
-	 */
-	d = PARAM_SET_isSetByName(set, "d");
-	prgrs = PARAM_SET_isSetByName(set, "show-progress");
+	if (isAlias) {
+		res = BUNDLE_addAlias(bundle, name);
+	} else {
+		res = KSI_Signature_serialize(sig, &raw, &raw_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to serialize signature.");
 
-	res = PARAM_SET_getValueCount(set, "i,input", NULL, PST_PRIORITY_NONE, &in_count);
-	if (res != PST_OK) goto cleanup;
+		res = KSI_Signature_getDocumentHash(sig, &hsh);
+		ERR_CATCH_MSG(err, res, "Error: Unable to extract signature document hash.");
 
+		res = KSI_DataHash_getImprint(hsh, &imprint, &imprint_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to get hash imprint.");
 
-	res = PARAM_SET_getStr(set, "data-out", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &signed_data_out);
-	if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
+		if (shared != NULL) {
+			res = ROUND_STORE_encode(shared, raw, raw_len, &encoded, &encoded_len);
+			ERR_CATCH_MSG(err, res, "Error: Unable to encode signature '%s' for the round store.", name);
+		}
 
-	/**
-	 * Extract the hash algorithm. If not specified, set algorithm as default.
-	 * It must be noted that if hash is extracted from imprint, has algorithm has
-	 * no effect.
-	 */
-	if (PARAM_SET_isSetByName(set, "H")) {
-		res = PARAM_SET_getObjExtended(set, "H", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, NULL, (void**)&algo);
-		if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
-	} else {
-		algo = (KSI_isHashAlgorithmSupported(remote_algo)) ? remote_algo : KSI_getHashAlgorithmByName("default");
+		res = BUNDLE_add(bundle, name, imprint, imprint_len, encoded != NULL ? encoded : raw, encoded != NULL ? encoded_len : raw_len);
 	}
+	ERR_CATCH_MSG(err, res, "Error: Unable to write signature '%s' to the bundle '%s'.", name, BUNDLE_getFname(bundle));
 
-	/**
-	 * Configure extra parameter for OBJ extractor.
-	 */
-	extra.ctx = ctx;
-	extra.err = err;
-	extra.h_alg = &algo;
-	extra.fname_out = signed_data_out;
+	KSI_strncpy(real_output_name, BUNDLE_getFname(bundle), real_output_name_len);
+	res = KT_OK;
 
-	/**
-	 * Extract initial value for masking mask.
-	 */
-	res = PARAM_SET_getObjExtended(set, "mask", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&extra, (void**)&mask_iv);
-	if (res != PST_OK && res != PST_PARAMETER_EMPTY) {
-		ERR_TRCKR_ADD(err, res, "Error: Unable to get initial value for masking.");
-		goto cleanup;
-	}
+cleanup:
 
-	/**
-	 * Analyze parameter to determine if masking is going to be performed and
-	 * if metadata is embedded to the signature.
-	 */
-	isMetadata = PARAM_SET_isSetByName(set, "mdata,mdata-cli-id");
-	isMasking = PARAM_SET_isSetByName(set, "mask");
+	KSI_free(encoded);
+	KSI_free(raw);
 
-	/**
-	 * Extract previous leaf hash value.
-	 */
-	if (isMasking) {
-		if (PARAM_SET_isSetByName(set, "prev-leaf")) {
-			res = PARAM_SET_getObjExtended(set, "prev-leaf", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, (void*)&extra, (void**)&prev_leaf);
-			if (res != PST_OK && res != PST_PARAMETER_EMPTY) goto cleanup;
-		} else {
-			res = KSI_DataHash_createZero(ctx, algo, &prev_leaf);
-			ERR_CATCH_MSG(err, res, "Error: Unable to create zero hash.");
-		}
-	}
+	return res;
+}
+
+/**
+ * Records the signed file, so that it is skipped by the next run if it does not
+ * change. Stdin and hash imprints are not recorded.
+ */
+static int KT_SIGN_recordToState(ERR_TRCKR *err, SIGN_STATE *state, const char *fname, const unsigned char *imprint, size_t imprint_len, const char *sig_path) {
+	int res = KT_UNKNOWN_ERROR;
 
-	if (rounds == 1 && in_count == 1 && !isMasking && !isMetadata) tree_size_1 = 1;
+	if (state == NULL || strcmp(fname, "-") == 0 || is_imprint(fname)) return KT_OK;
 
+	res = SIGN_STATE_record(state, fname, imprint, imprint_len, sig_path);
+	ERR_CATCH_MSG(err, res, "Error: Unable to record '%s' in the state file.", fname);
 
-	res = SIGNING_AGGR_ROUND_new(max_tree_inputs, &aggr_round);
-	ERR_CATCH_MSG(err, res, "Error: Unable to create a record for aggregation round.");
+cleanup:
 
-	res = KSITOOL_KSI_BlockSigner_new(err, ctx, algo, isMasking ? prev_leaf : NULL, isMasking ? mask_iv : NULL, &bs);
-	ERR_CATCH_MSG(err, res, "Error: Unable to create KSI Block Signer.");
+	return res;
+}
 
+/**
+ * Commits the temporary files of the written batch (see --durable) up to the
+ * first failed job. The temporary files of the following jobs are removed, as
+ * the jobs are not reported. The committed jobs get the final file names and the
+ * first job that is not committed gets the error.
+ */
+static void KT_SIGN_commitWriting(SIGNATURE_WRITER *writer, size_t b) {
+	int res;
+	size_t n = 0;
+	size_t first = 0;
+	size_t failed = 0;
+
+	for (n = 0; n < writer->job_count[b] && writer->jobs[b][n].res == KT_OK; n++) {
+		res = DURABLE_BATCH_add(writer->durable, writer->jobs[b][n].real_output_name, writer->jobs[b][n].save_to, writer->isUnique);
+		if (res != KT_OK) {
+			SMART_FILE_remove(writer->jobs[b][n].real_output_name);
+			writer->jobs[b][n].res = res;
+			break;
+		}
+	}
+	first = n;
 
-	/**
-	 * Perform local aggregation.
-	 */
-	for (r = 0; r < rounds; r++) {
-		size_t tree_input = 0;
-		size_t to_be_signed_in_round = (((r + 1) * max_tree_inputs) < in_count) ? max_tree_inputs : in_count - (int)r * max_tree_inputs;
+	for (n = first; n < writer->job_count[b]; n++) {
+		if (writer->jobs[b][n].res == KT_OK) SMART_FILE_remove(writer->jobs[b][n].real_output_name);
+	}
 
-		res = KSI_BlockSigner_reset(bs);
-		ERR_CATCH_MSG(err, res, "Error: Unable to reset Block Signer.");
+	res = DURABLE_BATCH_commit(writer->durable, &failed);
 
-		res = SIGNING_AGGR_ROUND_resetAndClean(aggr_round);
-		ERR_CATCH_MSG(err, res, "Error: Unable to reset SIGNING_AGGR_ROUND struct.");
+	for (n = 0; n < failed; n++) {
+		KSI_strncpy(writer->jobs[b][n].real_output_name, DURABLE_BATCH_getFname(writer->durable, n), sizeof(writer->jobs[b][n].real_output_name));
+	}
 
-		/* Initialize a list for keeping hash handles. */
-		res = KSI_BlockSignerHandleList_new(&hndlList);
-		ERR_CATCH_MSG(err, res, "Error: Unable to create KSI Block Signer handle list.");
+	if (res != KT_OK) writer->jobs[b][failed].res = res;
 
-		/**
-		 * Extract the metadata if requested by the user. If not return NULL and
-		 * metadata is not embedded to the signature.
-		 */
-		res = KT_SIGN_getMetadata(set, err, ctx, r, &mdata);
-		ERR_CATCH_MSG(err, res, "Error: Unable to construct metadata structure.");
+	DURABLE_BATCH_reset(writer->durable);
+}
 
+/**
+ * Waits until the workers have written the pending batch and reports the results
+ * in the order of the jobs, so that the messages, the output file names of the
+ * round (see KT_SIGN_dump), the state file records and the progress are the same
+ * as when the signatures are saved by a single thread.
+ */
+static int KT_SIGN_finishWriting(ERR_TRCKR *err, SIGNATURE_WRITER *writer) {
+	int res = KT_UNKNOWN_ERROR;
+	size_t b = 1 - writer->current;
+	size_t n = 0;
+	SIGNING_AGGR_ROUND *aggr_round = writer->aggr_round;
+
+	res = THREAD_POOL_wait(writer->pool);
+	writer->isPending = 0;
+	if (res == KT_THREAD_ERROR || res == KT_OUT_OF_MEMORY) {
+		ERR_TRCKR_ADD(err, res, "Error: Unable to save the signatures in parallel.");
+		goto cleanup;
+	}
 
-		if (prgrs || in_count > 1) {
-			print_debug("Signing %zu files in round %zu/%zu.%s\n", to_be_signed_in_round, r + 1, rounds, prgrs ? "" : "\n");
-		}
+	if (writer->durable != NULL) KT_SIGN_commitWriting(writer, b);
 
-		for (tree_input = 0; tree_input < max_tree_inputs && i < in_count; tree_input++, i++) {
-			char *fname = NULL;
-			KSI_HashAlgorithm hash_algo = KSI_HASHALG_INVALID_VALUE;
+	for (n = 0; n < writer->job_count[b]; n++) {
+		SIGNATURE_WRITE_JOB *job = &writer->jobs[b][n];
+		const unsigned char *imprint = NULL;
+		size_t imprint_len = 0;
 
-			if (!prgrs) print_progressDesc(d, "Extracting hash from input... ");
+		if (job->res != KT_OK) {
+			ERR_TRCKR_ADD(err, res = job->res, "Error: %s", KSITOOL_errToString(job->res));
+			ERR_TRCKR_ADD(err, res, "Error: Unable to save signature file to '%s'.", job->save_to);
+			ERR_TRCKR_ADD(err, res, "Error: Unable to save signature.");
+			goto cleanup;
+		}
 
-			res = PARAM_SET_getObjExtended(set, "i,input", NULL, PST_PRIORITY_NONE, (int)i, &extra, (void**)&hash);
-			if (res != KT_OK) goto cleanup;
+		if (!job->isDuplicate) {
+			res = SIGNING_AGGR_ROUND_setOutputName(aggr_round, job->leaf, job->real_output_name);
+			ERR_CATCH_MSG(err, res, "Error: Unable to store the name of the signature file.");
+			if (!writer->prgrs) print_debug("Signature saved to '%s'.\n", job->real_output_name);
+		} else {
+			if (!writer->prgrs) print_debug("Signature saved to '%s' (same hash as '%s').\n", job->real_output_name, aggr_round->fname[job->leaf]);
+		}
 
-			if (!tree_size_1 && !prgrs) print_progressResult(res);
+		imprint = SIGNING_AGGR_ROUND_getImprint(aggr_round, job->leaf, &imprint_len);
+		res = KT_SIGN_recordToState(err, writer->state, job->fname, imprint, imprint_len, job->real_output_name);
+		if (res != KT_OK) goto cleanup;
 
-			if (!tree_size_1 && !prgrs) print_progressDesc(d, "Add document hash %zu/%zu %s%s%sto the local aggregation tree... ",
-					tree_input + 1, to_be_signed_in_round,
-					(isMetadata && !isMasking) ? "with metadata " : "",
-					(!isMetadata && isMasking) ? "with enabled masking " : "",
-					(isMetadata && isMasking) ? "and metadata with enabled masking " : ""
-					);
+		/* The last job of the leaf completes the input. */
+		if (job->isOwner) {
+			writer->count++;
+			if (writer->prgrs && (writer->count % writer->divider == 0 || writer->count + 1 >= writer->in_count)) {
+				PROGRESS_BAR_display((writer->count + 1) * 100 / writer->in_count);
+			}
+		}
+	}
 
-			KSI_DataHash_getHashAlg(hash, &hash_algo);
-			res = KSITOOL_BlockSigner_addLeaf(err, ctx, bs, hash, 0, mdata, &hndl);
-			ERR_CATCH_MSG(err, res, "Error: Unable to add a (%s) hash value to a local aggregation tree.", KSI_getHashAlgorithmName(hash_algo));
+	res = KT_OK;
 
-			res = KSI_BlockSignerHandleList_append(hndlList, hndl);
-			ERR_CATCH_MSG(err, res, "Error: Unable to append block-signer handle to the list.");
-			hndl = NULL;
+cleanup:
 
-			res = PARAM_SET_getStr(set, "i,input", NULL, PST_PRIORITY_NONE, (int)i, &fname);
-			ERR_CATCH_MSG(err, res, "Error: Unable to get files name.");
+	for (n = 0; n < writer->job_count[b]; n++) {
+		if (writer->jobs[b][n].isOwner) KSI_free(writer->jobs[b][n].raw);
+	}
+	writer->job_count[b] = 0;
 
-			res = SIGNING_AGGR_ROUND_append(aggr_round, hash, fname);
-			ERR_CATCH_MSG(err, res, "Error: Unable to add hash value and files name to local aggregation record.");
-			hash = NULL;
+	return res;
+}
 
-			if (!prgrs) print_progressResult(res);
+/**
+ * Finishes the pending batch and starts writing the batch being filled.
+ */
+static int KT_SIGN_submitWriting(ERR_TRCKR *err, SIGNATURE_WRITER *writer) {
+	int res = KT_UNKNOWN_ERROR;
 
-			if (prgrs && (i % divider == 0 || i + 1 >= in_count || tree_input + 1 == to_be_signed_in_round)) {
-				PROGRESS_BAR_display((int)((tree_input + 1) * 100 / to_be_signed_in_round));
+	if (writer->isPending) {
+		res = KT_SIGN_finishWriting(err, writer);
+		if (res != KT_OK) goto cleanup;
+	}
 
-				if (to_be_signed_in_round > 64) divider = to_be_signed_in_round / 64;
-				else divider = 1;
-			}
+	if (writer->job_count[writer->current] > 0) {
+		writer->current = 1 - writer->current;
 
+		res = THREAD_POOL_start(writer->pool, writer->job_count[1 - writer->current], signature_writer_job, writer);
+		if (res != KT_OK) {
+			ERR_TRCKR_ADD(err, res, "Error: Unable to start saving the signatures in parallel.");
+			goto cleanup;
 		}
+		writer->isPending = 1;
+	}
+
+	res = KT_OK;
 
+cleanup:
 
-		if ((!tree_size_1 || prgrs)) print_debug("\n");
+	return res;
+}
 
-		if (tree_size_1) print_progressDesc(d, "Creating signature from hash... ");
-		else print_progressDesc(d, "Signing the local aggregation tree %zu/%zu... ", r + 1, rounds);
+/**
+ * Returns 1 if a signature is queued to be written to the file, 0 otherwise.
+ */
+static int KT_SIGN_isWriteQueued(SIGNATURE_WRITER *writer, const char *save_to) {
+	size_t b = 0;
+	size_t n = 0;
 
-		res = KSITOOL_BlockSigner_closeAndSign(err, ctx, bs);
-		if (tree_size_1) {ERR_CATCH_MSG(err, res, "Error: Unable to create signature.");}
-		else {ERR_CATCH_MSG(err, res, "Error: Unable to complete and sign the local aggregation tree.");}
+	for (b = 0; b < 2; b++) {
+		if (b != writer->current && !writer->isPending) continue;
 
-		aggr_round->block_signer = bs;
-		aggr_round->bs_handleList = hndlList;
+		for (n = 0; n < writer->job_count[b]; n++) {
+			if (strcmp(writer->jobs[b][n].save_to, save_to) == 0) return 1;
+		}
+	}
 
-		print_progressResult(res);
-		if (!prgrs && !tree_size_1) print_debug("\n");
+	return 0;
+}
 
-		KT_SIGN_saveToOutput(set, err, ctx, aggr_round, (int)(r * max_tree_inputs));
+/**
+ * Chooses the name of a new signature file (see SMART_FILE mode 'i') before the
+ * job is queued, as the workers must not search for a free name concurrently. A
+ * name is taken if the file exists or is queued to be written. In the latter case
+ * the queued files are written first and the name is chosen again, so that the
+ * names are the same as when the signatures are saved by a single thread.
+ */
+static int KT_SIGN_reserveOutputName(ERR_TRCKR *err, SIGNATURE_WRITER *writer, char *save_to, size_t save_to_len) {
+	int res = KT_UNKNOWN_ERROR;
+	char buf[1024];
+	const char *name = NULL;
 
-		res = KT_SIGN_dump(NULL, set, err, aggr_round);
+	name = SMART_FILE_doFileExist(save_to) ? generate_not_existing_file_name(save_to, buf, sizeof(buf), 1) : save_to;
+
+	if (name != NULL && KT_SIGN_isWriteQueued(writer, name)) {
+		res = KT_SIGN_submitWriting(err, writer);
 		if (res != KT_OK) goto cleanup;
-		if (prgrs) print_debug("\n");
 
-		if (!tree_size_1 || (tree_size_1 && prgrs)) print_debug("\n");
-		KSI_MetaData_free(mdata);
-		mdata = NULL;
+		res = KT_SIGN_submitWriting(err, writer);
+		if (res != KT_OK) goto cleanup;
 
-		KSI_BlockSignerHandleList_free(hndlList);
-		hndlList = NULL;
+		name = SMART_FILE_doFileExist(save_to) ? generate_not_existing_file_name(save_to, buf, sizeof(buf), 1) : save_to;
 	}
 
+	if (name == NULL) {
+		ERR_TRCKR_ADD(err, res = KT_INDEX_OVF, "Error: Unable to generate a unique file name for '%s'.", save_to);
+		goto cleanup;
+	}
 
+	if (name != save_to) KSI_strncpy(save_to, name, save_to_len);
 	res = KT_OK;
 
 cleanup:
-	SIGNING_AGGR_ROUND_free(aggr_round);
-	KSI_DataHash_free(hash);
-	KSI_DataHash_free(prev_leaf);
-	KSI_BlockSigner_free(bs);
-	KSI_BlockSignerHandle_free(hndl);
-	KSI_BlockSignerHandleList_free(hndlList);
-	KSI_MetaData_free(mdata);
-	KSI_OctetString_free(mask_iv);
 
 	return res;
 }
 
-static int generate_file_name(PARAM_SET *set, ERR_TRCKR *err, const char *in_flags, const char *out_flags, int i, char *buf, size_t buf_len) {
+/**
+ * Waits for the workers and drops the jobs that are not reported.
+ */
+static void KT_SIGN_resetWriting(SIGNATURE_WRITER *writer) {
+	size_t b = 0;
+	size_t n = 0;
+
+	if (writer->isPending) {
+		THREAD_POOL_wait(writer->pool);
+		writer->isPending = 0;
+	}
+
+	for (b = 0; b < 2; b++) {
+		for (n = 0; n < writer->job_count[b]; n++) {
+			/* Only the written batch has temporary files that are not committed. */
+			if (writer->durable != NULL && b != writer->current && writer->jobs[b][n].res == KT_OK) SMART_FILE_remove(writer->jobs[b][n].real_output_name);
+			if (writer->jobs[b][n].isOwner) KSI_free(writer->jobs[b][n].raw);
+		}
+		writer->job_count[b] = 0;
+	}
+}
+
+/**
+ * Saves the signatures of the round to files with worker threads. As the KSI
+ * context is not thread safe, the signatures are extracted from the block-signer
+ * and serialized by the calling thread, while the workers are opening, writing
+ * and closing the files of the previous batch. Inputs with the same hash value
+ * (see --dedupe) are written from the same serialized signature.
+ */
+static int KT_SIGN_saveToOutputInParallel(PARAM_SET *set, ERR_TRCKR *err, const INPUT_INDEX *inputs, SIGNING_AGGR_ROUND *aggr_round, int offset, SIGN_STATE *state, const char *name_tag, const INPUT_DEDUPE *dedupe, SIGNATURE_WRITER *writer, int how_to_save) {
 	int res = KT_UNKNOWN_ERROR;
-	char *in_file_name = NULL;
-	int in_count = 0;
-	VARIABLE_IS_NOT_USED(out_flags);
-	VARIABLE_IS_NOT_USED(err);
+	size_t n = 0;
+	KSI_Signature *sig = NULL;
+	unsigned char *raw = NULL;
+	size_t raw_len = 0;
 
-	res = PARAM_SET_getValueCount(set, in_flags, NULL, PST_PRIORITY_NONE, &in_count);
-	if (res != PST_OK) goto cleanup;
+	writer->aggr_round = aggr_round;
+	writer->state = state;
+	writer->count = 0;
 
-	res = PARAM_SET_getStr(set, in_flags, NULL, PST_PRIORITY_NONE, i, &in_file_name);
-	if (res != PST_OK) goto cleanup;
+	for (n = 0; n < aggr_round->hash_count; n++) {
+		KSI_DataHash *hsh = NULL;
+		size_t input = (dedupe != NULL) ? dedupe->unique[offset + n] : (size_t)offset + n;
+		size_t dup = 0;
 
-	if (strcmp(in_file_name, "-") == 0 && in_count == 1) {
-		KSI_snprintf(buf, buf_len, "stdin.ksig");
-	} else if (is_imprint(in_file_name)) {
-		char hash_algo[1024];
-		char *colon = NULL;
+		res = SIGNING_AGGR_ROUND_getSignature(aggr_round, n, &sig);
+		ERR_CATCH_MSG(err, res, "Error: Unable to extract signature.");
 
-		/* Search for the algorithm name. */
-		KSI_strncpy(hash_algo, in_file_name, sizeof(hash_algo));
-		colon = strchr(hash_algo, ':');
+		res = KSI_Signature_getDocumentHash(sig, &hsh);
+		ERR_CATCH_MSG(err, res, "Error: Unable to extract signature document hash.");
 
-		/* Create the file name from hash algorithm. */
-		if (colon != NULL) {
-			*colon = '\0';
-			KSI_snprintf(buf, buf_len, "%s.ksig", hash_algo);
-		} else {
-			KSI_snprintf(buf, buf_len, "hash_imprint.ksig");
+		/* Verify that is it the correct signature. */
+		if (!SIGNING_AGGR_ROUND_isSameHash(aggr_round, n, hsh)) {
+			ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unexpected error. Signature data hash mismatch.");
+			goto cleanup;
 		}
-	} else {
-		KSI_snprintf(buf, buf_len, "%s.ksig", in_file_name);
+
+		res = KSI_Signature_serialize(sig, &raw, &raw_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to serialize signature.");
+
+		KSI_Signature_free(sig);
+		sig = NULL;
+
+		/* Every input with the same hash value gets the same signature. */
+		for (dup = input; dup != DEDUPE_NONE; dup = (dedupe != NULL) ? dedupe->next[dup] : DEDUPE_NONE) {
+			SIGNATURE_WRITE_JOB *job = NULL;
+			const char *fname = (dup != input) ? INPUT_INDEX_getName(inputs, dup) : aggr_round->fname[n];
+			char save_to[1024] = "";
+
+			if (aggr_round->hasReservedNames) {
+				KSI_strncpy(save_to, aggr_round->fname_out[n], sizeof(save_to));
+			} else {
+				res = KT_SIGN_getSignatureFileName(err, inputs, how_to_save, (int)dup, name_tag, save_to, sizeof(save_to));
+				if (res != KT_OK) goto cleanup;
+			}
+
+			/**
+			 * A new file gets a name that is neither on disk nor queued. A file
+			 * that is overwritten must not be written by two workers at once, so
+			 * the queued files are written first.
+			 */
+			if (writer->isUnique) {
+				res = KT_SIGN_reserveOutputName(err, writer, save_to, sizeof(save_to));
+				if (res != KT_OK) goto cleanup;
+			} else if (KT_SIGN_isWriteQueued(writer, save_to)) {
+				res = KT_SIGN_submitWriting(err, writer);
+				if (res != KT_OK) goto cleanup;
+
+				res = KT_SIGN_submitWriting(err, writer);
+				if (res != KT_OK) goto cleanup;
+			}
+
+			if (writer->job_count[writer->current] == writer->job_count_max) {
+				res = KT_SIGN_submitWriting(err, writer);
+				if (res != KT_OK) goto cleanup;
+			}
+
+			job = &writer->jobs[writer->current][writer->job_count[writer->current]++];
+			job->raw = raw;
+			job->raw_len = raw_len;
+			job->isOwner = (dedupe == NULL || dedupe->next[dup] == DEDUPE_NONE);
+			KSI_strncpy(job->save_to, save_to, sizeof(job->save_to));
+			job->leaf = n;
+			job->fname = fname;
+			job->isDuplicate = (dup != input);
+			job->res = KT_UNKNOWN_ERROR;
+			job->real_output_name[0] = '\0';
+
+			if (job->isOwner) raw = NULL;
+		}
+	}
+
+	/* Start the last batch and wait until it is written. */
+	res = KT_SIGN_submitWriting(err, writer);
+	if (res != KT_OK) goto cleanup;
+
+	res = KT_SIGN_submitWriting(err, writer);
+	if (res != KT_OK) goto cleanup;
+
+	if (state != NULL) {
+		res = SIGN_STATE_flush(state);
+		ERR_CATCH_MSG(err, res, "Error: Unable to write the state file.");
 	}
 
 	res = KT_OK;
 
 cleanup:
 
+	/* The workers may still be using the data of the leaf that is not queued completely. */
+	KT_SIGN_resetWriting(writer);
+	KSI_free(raw);
+	KSI_Signature_free(sig);
+
 	return res;
 }
 
-static int KT_SIGN_saveToOutput(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, SIGNING_AGGR_ROUND *aggr_round, int offset) {
+static int KT_SIGN_saveToOutput(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, const INPUT_INDEX *inputs, SIGNING_AGGR_ROUND *aggr_round, int offset, SIGN_STATE *state, const char *name_tag, const INPUT_DEDUPE *dedupe, BUNDLE *bundle, SIGNATURE_WRITER *writer) {
 	int res = PST_UNKNOWN_ERROR;
 	int in_count = 0;
 	int divider = 0;
@@ -985,7 +4622,11 @@ static int KT_SIGN_saveToOutput(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, SI
 	int n = 0;
 	int count = 0;
 	KSI_Signature *sig = NULL;
-	char *real_output_name_copy = NULL;
+	const unsigned char *imprint = NULL;
+	size_t imprint_len = 0;
+	ROUND_STORE_SHARED shared;
+	const ROUND_STORE_SHARED *round_shared = NULL;
+	unsigned char *shared_raw = NULL;
 
 	if (set == NULL || err == NULL || ksi == NULL || aggr_round == NULL) {
 		ERR_TRCKR_ADD(err, res = KT_INVALID_ARGUMENT, NULL);
@@ -1000,60 +4641,109 @@ static int KT_SIGN_saveToOutput(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, SI
 
 	prgrs = PARAM_SET_isSetByName(set, "show-progress");
 
-	how_to_save = how_is_output_saved_to(set, "i,input", "o");
+	/* The unchanged inputs may be removed from the index (see --state). */
+	how_to_save = how_is_output_saved_to_index(set, inputs);
 
 	res = get_smart_file_mode(err, how_to_save, &mode);
 	if (res != KT_OK) goto cleanup;
 
+	/* The files are created already (see KT_SIGN_reserveOutputNames). */
+	if (aggr_round->hasReservedNames) mode = "wb";
+
 	if (prgrs) print_debug("Saving %i files.\n", in_count);
 
+	if (writer != NULL && bundle == NULL && how_to_save != OUTPUT_TO_STDOUT) {
+		writer->mode = mode;
+		writer->isUnique = strchr(mode, 'i') != NULL;
+		writer->prgrs = prgrs;
+		writer->divider = divider;
+		writer->in_count = in_count;
+
+		res = KT_SIGN_saveToOutputInParallel(set, err, inputs, aggr_round, offset, state, name_tag, dedupe, writer, how_to_save);
+		goto cleanup;
+	}
+
+	/**
+	 * In the round store format the elements of the first signature of the
+	 * round are written once as the shared block and all the signatures of the
+	 * round refer to the elements they have in common with it.
+	 */
+	if (bundle != NULL && PARAM_SET_isSetByName(set, "round-store") && aggr_round->hash_count > 0) {
+		size_t shared_raw_len = 0;
+
+		res = SIGNING_AGGR_ROUND_getSignature(aggr_round, 0, &sig);
+		ERR_CATCH_MSG(err, res, "Error: Unable to extract signature.");
+
+		res = KSI_Signature_serialize(sig, &shared_raw, &shared_raw_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to serialize signature.");
+
+		KSI_Signature_free(sig);
+		sig = NULL;
+
+		res = ROUND_STORE_getBody(shared_raw, shared_raw_len, &shared.data, &shared.data_len);
+		ERR_CATCH_MSG(err, res, "Error: Unable to parse serialized signature.");
+
+		res = BUNDLE_addData(bundle, shared.data, shared.data_len, &shared.offset);
+		ERR_CATCH_MSG(err, res, "Error: Unable to write the shared block of the round to the bundle '%s'.", BUNDLE_getFname(bundle));
+
+		round_shared = &shared;
+	}
+
 	for (n = 0; n < aggr_round->hash_count; n++) {
-		char save_to_file[1024] = "";
 		char real_output_name[1024] = "";
-		size_t real_out_name_size = 0;
 		KSI_DataHash *hsh = NULL;
-		KSI_BlockSignerHandle *hndl = NULL;
+		size_t input = (dedupe != NULL) ? dedupe->unique[offset + count] : (size_t)(offset + count);
+		size_t dup = 0;
 
-		/* Get the handle from the list. */
-		res = KSI_BlockSignerHandleList_elementAt(aggr_round->bs_handleList, n, &hndl);
-		ERR_CATCH_MSG(err, res, "Error: Unable to extract block signer leaf handle from the list.");
-
-		/* Get KSI signature from block-signer handle. */
-		res = KSI_BlockSignerHandle_getSignature(hndl, &sig);
+		/* Get KSI signature from block-signer handle or from the round. */
+		res = SIGNING_AGGR_ROUND_getSignature(aggr_round, n, &sig);
 		ERR_CATCH_MSG(err, res, "Error: Unable to extract signature.");
 
 		res = KSI_Signature_getDocumentHash(sig, &hsh);
 		ERR_CATCH_MSG(err, res, "Error: Unable to extract signature document hash.");
 
 		/* Verify that is it the correct signature. */
-		if (!KSI_DataHash_equals(aggr_round->hash_values[n], hsh)) {
+		if (!SIGNING_AGGR_ROUND_isSameHash(aggr_round, n, hsh)) {
 			ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unexpected error. Signature data hash mismatch.");
 			goto cleanup;
 		}
 
-		if (get_output_file_name(set, err, "i,input", "o", how_to_save, offset + count, save_to_file, sizeof(save_to_file), generate_file_name) == NULL) {
-			ERR_TRCKR_ADD(err, res = KT_UNKNOWN_ERROR, "Error: Unexpected error. Unable to get the file name to save the signature to.");
-			goto cleanup;
+		if (bundle != NULL) {
+			res = KT_SIGN_addToBundle(err, bundle, sig, aggr_round->fname[n], name_tag, 0, round_shared, real_output_name, sizeof(real_output_name));
+		} else if (aggr_round->hasReservedNames) {
+			res = KSI_OBJ_saveSignature(err, ksi, sig, mode, aggr_round->fname_out[n], real_output_name, sizeof(real_output_name));
+			ERR_CATCH_MSG(err, res, "Error: Unable to save signature.");
+		} else {
+			res = KT_SIGN_saveSignatureOfInput(err, ksi, inputs, sig, how_to_save, mode, (int)input, name_tag, real_output_name, sizeof(real_output_name));
 		}
+		if (res != KT_OK) goto cleanup;
 
-		res = KSI_OBJ_saveSignature(err, ksi, sig, mode, save_to_file, real_output_name, sizeof(real_output_name));
-		ERR_CATCH_MSG(err, res, "Error: Unable to save signature.");
+		res = SIGNING_AGGR_ROUND_setOutputName(aggr_round, (size_t)n, real_output_name);
+		ERR_CATCH_MSG(err, res, "Error: Unable to store the name of the signature file.");
+		if (!prgrs) print_debug("Signature saved to '%s'.\n", real_output_name);
 
-		real_out_name_size = sizeof(char) * (strlen(real_output_name) + 1);
+		imprint = SIGNING_AGGR_ROUND_getImprint(aggr_round, (size_t)n, &imprint_len);
+		res = KT_SIGN_recordToState(err, state, aggr_round->fname[n], imprint, imprint_len, real_output_name);
+		if (res != KT_OK) goto cleanup;
 
-		real_output_name_copy = (char*)KSI_malloc(real_out_name_size);
-		if (real_output_name_copy == NULL) {
-			res = KT_OUT_OF_MEMORY;
-			goto cleanup;
-		}
+		/* Every input with the same hash value gets the same signature. */
+		for (dup = (dedupe != NULL) ? dedupe->next[input] : DEDUPE_NONE; dup != DEDUPE_NONE; dup = dedupe->next[dup]) {
+			const char *dup_fname = INPUT_INDEX_getName(inputs, dup);
 
-		PST_strncpy(real_output_name_copy, real_output_name, real_out_name_size);
-		aggr_round->fname_out[n] = real_output_name_copy;
-		if (!prgrs) print_debug("Signature saved to '%s'.\n", real_output_name);
+			if (bundle != NULL) {
+				res = KT_SIGN_addToBundle(err, bundle, sig, dup_fname, name_tag, 1, round_shared, real_output_name, sizeof(real_output_name));
+			} else {
+				res = KT_SIGN_saveSignatureOfInput(err, ksi, inputs, sig, how_to_save, mode, (int)dup, name_tag, real_output_name, sizeof(real_output_name));
+			}
+			if (res != KT_OK) goto cleanup;
+			if (!prgrs) print_debug("Signature saved to '%s' (same hash as '%s').\n", real_output_name, aggr_round->fname[n]);
+
+			res = KT_SIGN_recordToState(err, state, dup_fname, imprint, imprint_len, real_output_name);
+			if (res != KT_OK) goto cleanup;
+		}
 
 		KSI_Signature_free(sig);
 		sig = NULL;
-		real_output_name_copy = NULL;
 
 		count++;
 		if (prgrs && (count % divider == 0 || count + 1 >= in_count)) {
@@ -1062,11 +4752,22 @@ static int KT_SIGN_saveToOutput(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, SI
 
 	}
 
+	/* The signatures of the round can be read from the bundle even if the run is interrupted later. */
+	if (bundle != NULL) {
+		res = BUNDLE_commit(bundle);
+		ERR_CATCH_MSG(err, res, "Error: Unable to write the index of the signature bundle '%s'.", BUNDLE_getFname(bundle));
+	}
+
+	if (state != NULL) {
+		res = SIGN_STATE_flush(state);
+		ERR_CATCH_MSG(err, res, "Error: Unable to write the state file.");
+	}
+
 	res = KT_OK;
 
 cleanup:
 
-	KSI_free(real_output_name_copy);
+	KSI_free(shared_raw);
 	KSI_Signature_free(sig);
 
 	return res;
@@ -1098,17 +4799,11 @@ static int KT_SIGN_dump(KSI_CTX *ksi, PARAM_SET *set, ERR_TRCKR *err, SIGNING_AG
 	if (in_count > 1) print_result("Signatures from aggregation round: %i\n\n", i);
 
 	for (n = 0; n < aggr_round->hash_count; n++) {
-		KSI_BlockSignerHandle *hndl = NULL;
-
-		/* Get the handle from the list. */
-		res = KSI_BlockSignerHandleList_elementAt(aggr_round->bs_handleList, n, &hndl);
-		ERR_CATCH_MSG(err, res, "Error: Unable to extract block signer leaf handle from the list.");
-
-		res = KSI_BlockSignerHandle_getSignature(hndl, &sig);
+		res = SIGNING_AGGR_ROUND_getSignature(aggr_round, n, &sig);
 		ERR_CATCH_MSG(err, res, "Error: Unable to get signature to dump its content.");
 
 		print_result("Document : '%s'\n", aggr_round->fname[n]);
-		print_result("Signature: '%s'\n", aggr_round->fname_out[n]);
+		print_result("Signature: '%s'\n", aggr_round->fname_out[n] != NULL ? aggr_round->fname_out[n] : "-");
 		OBJPRINT_signatureDump(ksi, sig, dump_flags, print_result);
 		KSI_Signature_free(sig);
 		sig = NULL;
@@ -1125,20 +4820,51 @@ cleanup:
 }
 
 
-KSI_uint64_t getTimeInMicros(void) {
-	KSI_uint64_t t = 0;
+/**
+ * Returns the peak resident set size of the process in KiB or 0 if it is not
+ * available.
+ */
+static size_t getPeakMemoryInKiB(void) {
 #ifdef _WIN32
-	SYSTEMTIME t2;
-	KSI_uint64_t time_ms;
-	GetSystemTime(&t2);
-	time_ms = (KSI_uint64_t)time(NULL) * 1000 + t2.wMilliseconds;
-	t = time_ms * (KSI_uint64_t)1000;
+	return 0;
 #else
-	struct timeval tv;
-	gettimeofday(&tv,NULL);
-	t = (KSI_uint64_t)tv.tv_sec * 1000000 + (KSI_uint64_t)tv.tv_usec;
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#  ifdef __APPLE__
+	/* Reported in bytes. */
+	return (size_t)usage.ru_maxrss / 1024;
+#  else
+	return (size_t)usage.ru_maxrss;
+#  endif
 #endif
-	return t;
+}
+
+/**
+ * Prints the count of allocations made by the tool for the state of the
+ * aggregation rounds and the peak memory usage of the process (see -d). The
+ * allocations of libksi (e.g. the block-signer and the signatures) are not
+ * counted, but they are included in the peak memory usage.
+ */
+static void KT_SIGN_printRoundMemory(SIGNING_SLOT **slots, size_t count) {
+	size_t n = 0;
+	size_t allocs = 0;
+	size_t leaves = 0;
+	size_t blocks = 0;
+	size_t peak = getPeakMemoryInKiB();
+
+	for (n = 0; n < count; n++) {
+		const SIGNING_AGGR_ROUND *round = (slots[n] != NULL) ? slots[n]->aggr_round : NULL;
+
+		if (round == NULL) continue;
+		allocs += round->alloc_count;
+		leaves += round->hash_count_max;
+		blocks += round->name_block_count;
+	}
+
+	print_debug("Aggregation round state kept by the tool (libksi not included): %zu allocation(s) for %zu leaves, %zu KiB of output names.\n",
+			allocs, leaves, blocks * (SIGNING_AGGR_ROUND_NAME_BLOCK / 1024));
+	if (peak > 0) print_debug("Peak memory usage: %zu KiB.\n", peak);
 }
 
 static int KT_SIGN_getMetadata(PARAM_SET *set, ERR_TRCKR *err, KSI_CTX *ksi, size_t seq_offset, KSI_MetaData **mdata) {
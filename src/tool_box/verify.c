@@ -73,7 +73,7 @@ static int check_pipe_errors(PARAM_SET *set, ERR_TRCKR *err);
 static void signature_print_suggestions_for_publication_based_verification(PARAM_SET *set, ERR_TRCKR *err, int errCode, KSI_CTX *ksi,
 											KSI_Signature *sig, KSI_RuleVerificationResult *verRes, KSI_PublicationData *userPubData);
 
-#define PARAMS "{i}{x}{f}{d}{pub-str}{ver-int}{ver-cal}{ver-key}{ver-pub}{dump}{conf}{log}{h|help}"
+#define PARAMS "{i}{x}{f}{d}{pub-str}{ver-int}{ver-cal}{ver-key}{ver-pub}{dump}{conf}{log}{h|help}{digest-cache}{digest-cache-strict}{bundle}{export}"
 
 int verify_run(int argc, char **argv, char **envp) {
 	int res;
@@ -90,6 +90,7 @@ int verify_run(int argc, char **argv, char **envp) {
 	KSI_Signature *sig = NULL;
 	KSI_PolicyVerificationResult *result = NULL;
 	KSI_HashAlgorithm alg = KSI_HASHALG_INVALID_VALUE;
+	BUNDLE *bundle = NULL;
 
 	/**
 	 * Extract command line parameters and also add configuration specific parameters.
@@ -106,6 +107,11 @@ int verify_run(int argc, char **argv, char **envp) {
 	res = TASK_INITIALIZER_getServiceInfo(set, argc, argv, envp);
 	if (res != PST_OK) goto cleanup;
 
+	/* With --bundle the input is the name or hash imprint of an entry in the bundle, not a file. */
+	if (PARAM_SET_isSetByName(set, "bundle")) {
+		PARAM_SET_addControl(set, "{i}", isFormatOk_inputFile, NULL, NULL, extract_inputSignature);
+	}
+
 	res = TASK_INITIALIZER_check_analyze_report(set, task_set, 0.2, 0.1, &task);
 	if (res != KT_OK) goto cleanup;
 
@@ -121,6 +127,26 @@ int verify_run(int argc, char **argv, char **envp) {
 	extra.ctx = ksi;
 	extra.err = err;
 	extra.fname_out = NULL;
+	extra.bundle = NULL;
+	extra.isDigestCached = 0;
+
+	if (PARAM_SET_isSetByName(set, "bundle")) {
+		char *bundle_name = NULL;
+
+		res = PARAM_SET_getStr(set, "bundle", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &bundle_name);
+		if (res != PST_OK) goto cleanup;
+
+		print_progressDesc(d, "Reading bundle index... ");
+		res = BUNDLE_open(bundle_name, 0, &bundle);
+		if (res == KT_INVALID_INPUT_FORMAT) {
+			ERR_TRCKR_ADD(err, res, "Error: '%s' is not a valid signature bundle.", bundle_name);
+			goto cleanup;
+		}
+		ERR_CATCH_MSG(err, res, "Error: Unable to open signature bundle '%s'.", bundle_name);
+		print_progressResult(res);
+
+		extra.bundle = bundle;
+	}
 
 	print_progressDesc(d, "Reading signature... ");
 	res = PARAM_SET_getObjExtended(set, "i", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &extra, (void**)&sig);
@@ -140,6 +166,15 @@ int verify_run(int argc, char **argv, char **envp) {
 		res = PARAM_SET_getObjExtended(set, "f", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &extra, (void**)&hsh);
 		if (res != PST_OK) goto cleanup;
 		print_progressResult(res);
+
+		if (extra.isDigestCached) {
+			char *fname = NULL;
+
+			res = PARAM_SET_getStr(set, "f", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &fname);
+			if (res != PST_OK) goto cleanup;
+
+			print_debug("Document's hash is taken from the digest cache of '%s' and the file is not read. The cached hash is trusted.\n", fname);
+		}
 	}
 
 	/**
@@ -148,6 +183,25 @@ int verify_run(int argc, char **argv, char **envp) {
 	res = signature_verify(TASK_getID(task), set, err, &extra, ksi, sig, hsh, &result);
 	/* Fall through: if (res != KT_OK) goto cleanup; */
 
+	/**
+	 * Write the signature read from the bundle as a standard signature file.
+	 * Only a signature that passed the verification is exported.
+	 */
+	if (res == KT_OK && PARAM_SET_isSetByName(set, "export")) {
+		char *export_name = NULL;
+		char real_output_name[1024];
+
+		res = PARAM_SET_getStr(set, "export", NULL, PST_PRIORITY_HIGHEST, PST_INDEX_LAST, &export_name);
+		if (res != PST_OK) goto cleanup;
+
+		print_progressDesc(d, "Exporting signature... ");
+		res = KSI_OBJ_saveSignature(err, ksi, sig, "wbs", export_name, real_output_name, sizeof(real_output_name));
+		if (res != KT_OK) goto cleanup;
+		print_progressResult(res);
+
+		print_debug("Signature exported to '%s'.\n", real_output_name);
+	}
+
 	if (PARAM_SET_isSetByName(set, "dump")) {
 		int dump_flags = OBJPRINT_NONE;
 
@@ -190,6 +244,7 @@ cleanup:
 	KSI_DataHash_free(hsh);
 	KSI_Signature_free(sig);
 	KSI_PolicyVerificationResult_free(result);
+	BUNDLE_close(bundle);
 	ERR_TRCKR_free(err);
 	KSI_CTX_free(ksi);
 
@@ -215,7 +270,11 @@ char *verify_help_toString(char *buf, size_t len) {
 	PARAM_SET_setHelpText(set, "ver-key", NULL, "Perform key-based verification.");
 	PARAM_SET_setHelpText(set, "ver-pub", NULL, "Perform publication-based verification (use with -x to permit extending).");
 	PARAM_SET_setHelpText(set, "i", "<in.ksig>", "Signature file to be verified. Use '-' as file name to read the signature from stdin. Flag -i can be omitted when specifying the input. Without -i it is not possible to sign files that look like command-line parameters (e.g. -a, --option).");
+	PARAM_SET_setHelpText(set, "bundle", "<file>", "Read the signature from the signature bundle created by sign --bundle. The input (-i) is then the name of the entry (e.g. the name of the signed file) or the document hash imprint (<alg>:<hash in hex>) of the signature. Only the requested signature is read from the bundle.");
+	PARAM_SET_setHelpText(set, "export", "<file>", "Save the signature read from the bundle to the given file as a standard signature file. Use '-' as file name to redirect the signature to stdout. Only valid with --bundle.");
 	PARAM_SET_setHelpText(set, "f", "<data>", "Path to file to be hashed or data hash imprint to extract the hash value that is going to be verified. Hash format: <alg>:<hash in hex>. Use '-' as file name to read data to be hashed from stdin.");
+	PARAM_SET_setHelpText(set, "digest-cache", NULL, "Reuse the hash of the file (-f) cached in its extended attribute (user.ksi.<alg>) by sign or verify if the size, modification and change time of the file are unchanged, and cache the hash otherwise. The cache trusts everyone who can write the file, as they can also forge the cached hash.");
+	PARAM_SET_setHelpText(set, "digest-cache-strict", NULL, "Always hash the file (-f) and ignore the cached hash, but update the cache.");
 	PARAM_SET_setHelpText(set, "x", NULL, "Permit to use extender for publication-based verification.");
 	PARAM_SET_setHelpText(set, "pub-str", "<str>", "Publication string to verify with.");
 	PARAM_SET_setHelpText(set, "dump", "[G]", "Dump signature and document hash being verified in human-readable format to stdout. In verification report 'OK' means that the step is performed successfully, 'NA' means that it could not be performed as there was not enough information and 'FAILED' means that the verification was unsuccessful. To make signature dump suitable for processing with grep, use 'G' as argument.");
@@ -236,7 +295,7 @@ char *verify_help_toString(char *buf, size_t len) {
 			"ksi verify --ver-pub -i <in.ksig> [-f <data>] -P <URL> [--cnstr <oid=value>]...\n"
 			"[-x -X <URL> [--ext-user <user> --ext-key <key>]] [more_options]\\>\n\n\n");
 
-	ret = PARAM_SET_helpToString(set, "ver-int, ver-cal, ver-key, ver-pub,i,f,x,X,ext-user,ext-key,ext-hmac-alg,pub-str,P,cnstr,V,d,dump,conf,log", 1, 13, 80, buf + count, len - count);
+	ret = PARAM_SET_helpToString(set, "ver-int, ver-cal, ver-key, ver-pub,i,bundle,export,f,digest-cache,digest-cache-strict,x,X,ext-user,ext-key,ext-hmac-alg,pub-str,P,cnstr,V,d,dump,conf,log", 1, 13, 80, buf + count, len - count);
 
 cleanup:
 	if (res != PST_OK || ret == NULL) {
@@ -267,13 +326,15 @@ static int generate_tasks_set(PARAM_SET *set, TASK_SET *task_set) {
 	PARAM_SET_addControl(set, "{conf}", isFormatOk_inputFile, isContentOk_inputFileRestrictPipe, convertRepair_path, NULL);
 	PARAM_SET_addControl(set, "{log}", isFormatOk_path, NULL, convertRepair_path, NULL);
 	PARAM_SET_addControl(set, "{i}", isFormatOk_inputFile, isContentOk_inputFileWithPipe, convertRepair_path, extract_inputSignature);
+	PARAM_SET_addControl(set, "{bundle}", isFormatOk_inputFile, isContentOk_inputFileRestrictPipe, convertRepair_path, NULL);
+	PARAM_SET_addControl(set, "{export}", isFormatOk_path, NULL, convertRepair_path, NULL);
 	PARAM_SET_addControl(set, "{f}", isFormatOk_inputHash, isContentOk_inputHash, convertRepair_path, extract_inputHash);
-	PARAM_SET_addControl(set, "{d}{x}{ver-int}{ver-cal}{ver-key}{ver-pub}", isFormatOk_flag, NULL, NULL, NULL);
+	PARAM_SET_addControl(set, "{d}{x}{ver-int}{ver-cal}{ver-key}{ver-pub}{digest-cache}{digest-cache-strict}", isFormatOk_flag, NULL, NULL, NULL);
 	PARAM_SET_addControl(set, "{pub-str}", isFormatOk_pubString, NULL, NULL, extract_pubString);
 	PARAM_SET_addControl(set, "{dump}", NULL, isContentOk_dump_flag, NULL, extract_dump_flag);
 
 	PARAM_SET_setParseOptions(set, "i", PST_PRSCMD_HAS_VALUE | PST_PRSCMD_COLLECT_LOOSE_VALUES);
-	PARAM_SET_setParseOptions(set, "{x}{ver-int}{ver-cal}{ver-key}{ver-pub}", PST_PRSCMD_HAS_NO_VALUE);
+	PARAM_SET_setParseOptions(set, "{x}{ver-int}{ver-cal}{ver-key}{ver-pub}{digest-cache}{digest-cache-strict}", PST_PRSCMD_HAS_NO_VALUE);
 
 	/*						ID						DESC								MAN							ATL		FORBIDDEN											IGN	*/
 	TASK_SET_add(task_set,	ANC_BASED_DEFAULT,		"Verify.",							"i",						NULL,	"ver-int,ver-cal,ver-key,ver-pub,P,cnstr,pub-str",	NULL);
@@ -641,9 +702,17 @@ cleanup:
 static int check_pipe_errors(PARAM_SET *set, ERR_TRCKR *err) {
 	int res;
 
+	if (PARAM_SET_isSetByName(set, "export") && !PARAM_SET_isSetByName(set, "bundle")) {
+		ERR_TRCKR_ADD(err, res = KT_INVALID_CMD_PARAM, "Error: Export (--export) is only valid with signature bundle (--bundle).");
+		goto cleanup;
+	}
+
 	res = get_pipe_in_error(set, err, NULL, "i,f", NULL);
 	if (res != KT_OK) goto cleanup;
 
+	res = get_pipe_out_error(set, err, NULL, "export,log", "dump");
+	if (res != KT_OK) goto cleanup;
+
 cleanup:
 	return res;
 }
@@ -0,0 +1,76 @@
+#!/bin/bash
+
+#
+# Copyright 2013-2018 Guardtime, Inc.
+#
+# This file is part of the Guardtime client SDK.
+#
+# Licensed under the Apache License, Version 2.0 (the "License").
+# You may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+# express or implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# "Guardtime" and "KSI" are trademarks or registered trademarks of
+# Guardtime, Inc., and no license to trademarks is granted; Guardtime
+# reserves and retains all trademark rights.
+
+# Measures the time of signing and verifying large files with and without the
+# digest cache (--digest-cache). The aggregator is configured in test/test.cfg.
+#
+# Usage: test/benchmark-digest-cache.sh [<size in MiB>] [<count of files>]
+
+tool=src/ksi
+conf=test/test.cfg
+bench_dir=test/out/benchmark-digest-cache
+size_mb=${1:-1024}
+file_count=${2:-4}
+
+if [ ! -f $conf ] ; then
+	echo "Error: $conf is missing (see test/test.cfg.sample)." >&2
+	exit 1
+fi
+
+rm -rf $bench_dir 2> /dev/null
+mkdir -p $bench_dir
+
+# Create the input files. The modification time is moved to the past, as the
+# files modified during the last seconds are not cached.
+for i in $(seq 1 $file_count) ; do
+	dd if=/dev/urandom of=$bench_dir/file_$i bs=1M count=$size_mb status=none || exit 1
+	touch -d "1 minute ago" $bench_dir/file_$i
+done
+
+if ! setfattr -n user.ksi.test -v 1 $bench_dir/file_1 2> /dev/null ; then
+	echo "Warning: Extended attributes are not supported in $bench_dir, the cache is not used." >&2
+fi
+setfattr -x user.ksi.test $bench_dir/file_1 2> /dev/null
+
+# A function to run the command and print the elapsed wall-clock time.
+function measure() {
+	local desc=$1
+	shift
+	local start=$(date +%s.%N)
+	"$@" > /dev/null || { echo "Error: '$*' failed." >&2 ; exit 1 ; }
+	local end=$(date +%s.%N)
+	printf "%-48s %8.3f s\n" "$desc" $(echo "$end - $start" | bc)
+}
+
+echo "Signing and verifying $file_count files of $size_mb MiB."
+
+# Drop the page cache if possible, so that the first run reads the files from the disk.
+sync ; echo 3 > /proc/sys/vm/drop_caches 2> /dev/null
+
+measure "sign, no cache:" $tool sign --conf $conf -i $bench_dir/file_* -o $bench_dir
+measure "sign, --digest-cache (cache is filled):" $tool sign --conf $conf --digest-cache -i $bench_dir/file_* -o $bench_dir
+measure "sign, --digest-cache (cache is used):" $tool sign --conf $conf --digest-cache -i $bench_dir/file_* -o $bench_dir
+measure "sign, --digest-cache-strict:" $tool sign --conf $conf --digest-cache-strict -i $bench_dir/file_* -o $bench_dir
+
+measure "verify, no cache:" $tool verify --ver-int -i $bench_dir/file_1.ksig -f $bench_dir/file_1
+measure "verify, --digest-cache:" $tool verify --ver-int --digest-cache -i $bench_dir/file_1.ksig -f $bench_dir/file_1
+measure "verify, --digest-cache-strict:" $tool verify --ver-int --digest-cache-strict -i $bench_dir/file_1.ksig -f $bench_dir/file_1
+
+rm -rf $bench_dir
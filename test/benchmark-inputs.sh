@@ -0,0 +1,117 @@
+#!/bin/bash
+
+#
+# Copyright 2013-2018 Guardtime, Inc.
+#
+# This file is part of the Guardtime client SDK.
+#
+# Licensed under the Apache License, Version 2.0 (the "License").
+# You may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES, CONDITIONS, OR OTHER LICENSES OF ANY KIND, either
+# express or implied. See the License for the specific language governing
+# permissions and limitations under the License.
+# "Guardtime" and "KSI" are trademarks or registered trademarks of
+# Guardtime, Inc., and no license to trademarks is granted; Guardtime
+# reserves and retains all trademark rights.
+
+# Measures the time of signing a large count of small files given on the
+# command line. Every stage of signing reads the inputs by their index, so the
+# time should grow linearly with the count of inputs. If the path to an other
+# build of the tool is given, it is measured with the same inputs for comparison.
+# The aggregator is configured in test/test.cfg.
+#
+# As the time of signing is dominated by the network, the handling of the inputs
+# is also measured without contacting the aggregator: resolving the inputs (the
+# job stops as the inputs do not fit into a single round) and skipping the files
+# that are recorded in the state file (see --state) as unchanged.
+#
+# Usage: test/benchmark-inputs.sh [<count of files>] [<tool to compare with>]
+
+tool=src/ksi
+conf=test/test.cfg
+bench_dir=test/out/benchmark-inputs
+file_count=${1:-100000}
+baseline=$2
+
+if [ ! -f $conf ] ; then
+	echo "Error: $conf is missing (see test/test.cfg.sample)." >&2
+	exit 1
+fi
+
+rm -rf $bench_dir 2> /dev/null
+mkdir -p $bench_dir/in $bench_dir/out
+
+# Create the input files.
+for i in $(seq 1 $file_count) ; do
+	echo $i > $bench_dir/in/$i
+done
+
+# The size of the command line is limited by the size of the stack.
+ulimit -s unlimited 2> /dev/null || ulimit -s 65536 2> /dev/null
+
+# A function to run the command and print the elapsed wall-clock time.
+function measure() {
+	local desc=$1
+	shift
+	local start=$(date +%s.%N)
+	"$@" > /dev/null || { echo "Error: '$*' failed." >&2 ; exit 1 ; }
+	local end=$(date +%s.%N)
+	printf "%-48s %8.3f s\n" "$desc" $(echo "$end - $start" | bc)
+}
+
+# A function to run a command that must stop before anything is sent to the
+# aggregator and print the elapsed wall-clock time.
+function measure_offline() {
+	local desc=$1
+	shift
+	local start=$(date +%s.%N)
+	"$@" > /dev/null 2>&1
+	local end=$(date +%s.%N)
+	printf "%-48s %8.3f s\n" "$desc" $(echo "$end - $start" | bc)
+}
+
+# Enough rounds to sign all the files in trees of 256 leaves.
+rounds=$(( file_count / 256 + 1 ))
+
+echo "Signing $file_count files."
+
+if [ $file_count -gt 256 ] ; then
+	measure_offline "resolve inputs:" $tool sign --conf $conf --max-lvl 8 --max-aggr-rounds 1 -i $bench_dir/in/* -o $bench_dir/out
+	if [ -n "$baseline" ] ; then
+		measure_offline "resolve inputs, $baseline:" $baseline sign --conf $conf --max-lvl 8 --max-aggr-rounds 1 -i $bench_dir/in/* -o $bench_dir/out
+	fi
+
+	# Resolving a tenth of the inputs must take about a tenth of the time if the
+	# inputs are resolved in linear time (a hundredth if quadratic).
+	tenth=$(( file_count / 10 ))
+	if [ $tenth -gt 256 ] ; then
+		measure_offline "resolve inputs, $tenth files:" $tool sign --conf $conf --max-lvl 8 --max-aggr-rounds 1 -i $(seq -f "$bench_dir/in/%.0f" 1 $tenth) -o $bench_dir/out
+		if [ -n "$baseline" ] ; then
+			measure_offline "resolve inputs, $tenth files, $baseline:" $baseline sign --conf $conf --max-lvl 8 --max-aggr-rounds 1 -i $(seq -f "$bench_dir/in/%.0f" 1 $tenth) -o $bench_dir/out
+		fi
+	fi
+fi
+
+measure "sign:" $tool sign --conf $conf --max-lvl 8 --max-aggr-rounds $rounds -i $bench_dir/in/* -o $bench_dir/out
+rm -f $bench_dir/out/*
+
+if [ -n "$baseline" ] ; then
+	measure "sign, $baseline:" $baseline sign --conf $conf --max-lvl 8 --max-aggr-rounds $rounds -i $bench_dir/in/* -o $bench_dir/out
+	rm -f $bench_dir/out/*
+fi
+
+measure "sign --dedupe:" $tool sign --conf $conf --dedupe --max-lvl 8 --max-aggr-rounds $rounds -i $bench_dir/in/* -o $bench_dir/out
+rm -f $bench_dir/out/*
+
+# Every file is signed and recorded once, then all of them are skipped.
+measure "sign --state:" $tool sign --conf $conf --state $bench_dir/state --max-lvl 8 --max-aggr-rounds $rounds -i $bench_dir/in/* -o $bench_dir/out
+measure_offline "sign --state, all unchanged:" $tool sign --conf $conf --state $bench_dir/state --max-lvl 8 --max-aggr-rounds $rounds -i $bench_dir/in/* -o $bench_dir/out
+if [ -n "$baseline" ] ; then
+	measure_offline "sign --state, all unchanged, $baseline:" $baseline sign --conf $conf --state $bench_dir/state --max-lvl 8 --max-aggr-rounds $rounds -i $bench_dir/in/* -o $bench_dir/out
+fi
+
+rm -rf $bench_dir
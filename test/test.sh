@@ -19,6 +19,7 @@
 # reserves and retains all trademark rights.
 
 # Remove test output directories.
+chmod -R u+rwx test/out/sign/recursive-skip 2> /dev/null
 rm -rf test/out/sign 2> /dev/null
 rm -rf test/out/extend 2> /dev/null
 rm -rf test/out/extend-replace-existing 2> /dev/null
@@ -29,11 +30,37 @@ rm -rf test/out/tmp 2> /dev/null
 
 # Create test output directories.
 mkdir -p test/out/sign
+mkdir -p test/out/sign/input-list
+mkdir -p test/out/sign/input-list-mixed
+mkdir -p test/out/sign/input-list-file
+mkdir -p test/out/sign/input-list-nul
+mkdir -p test/out/sign/input-list-order
+mkdir -p test/out/sign/hash-stream
+mkdir -p test/out/sign/recursive
+mkdir -p test/out/sign/recursive-skip/locked
+mkdir -p test/out/sign/state
+mkdir -p test/out/sign/multi-hash
+mkdir -p test/out/sign/dedupe
+mkdir -p test/out/sign/adaptive
+mkdir -p test/out/sign/adaptive-rounds
+mkdir -p test/out/sign/bundle
+mkdir -p test/out/sign/save-threads
+mkdir -p test/out/sign/durable
+mkdir -p test/out/sign/journal
+mkdir -p test/out/sign/journal-resume
+mkdir -p test/out/sign/round-memory
 mkdir -p test/out/extend
 mkdir -p test/out/extend-replace-existing/
 mkdir -p test/out/pubfile
 mkdir -p test/out/fname
 mkdir -p test/out/mass_extend
+mkdir -p test/out/mass_extend/pubfile-max-age
+mkdir -p test/out/mass_extend/calendar-cache
+mkdir -p test/out/mass_extend/group
+mkdir -p test/out/mass_extend/async
+mkdir -p test/out/mass_extend/async-window
+mkdir -p test/out/mass_extend/groups
+mkdir -p test/out/mass_extend/to-time
 mkdir -p test/out/tmp
 
 # Create some test files to output directory.
@@ -49,6 +76,17 @@ cp test/resource/signature/ok-sig-2014-08-01.1.ksig test/out/fname/ok-sig
 cp test/resource/signature/ok-sig-2021-04-30.ksig test/out/extend-replace-existing/not-extended-1A.ksig
 cp test/resource/signature/ok-sig-2021-04-30.ksig test/out/extend-replace-existing/not-extended-1B.ksig
 cp test/resource/signature/ok-sig-2021-04-30.ksig test/out/extend-replace-existing/not-extended-2B.ksig
+cp test/resource/signature/ok-sig-2021-04-30.ksig test/out/extend-replace-existing/not-extended-durable.ksig
+cp test/resource/signature/ok-sig-2021-04-30.ksig test/out/mass_extend/group/same-1.ksig
+cp test/resource/signature/ok-sig-2021-04-30.ksig test/out/mass_extend/group/same-2.ksig
+cp test/resource/signature/ok-sig-2021-04-30.ksig test/out/mass_extend/group/same-3.ksig
+cp test/resource/signature/ok-sig-sha1-2016-05-26.ksig test/out/mass_extend/groups/sha1-1.ksig
+cp test/resource/signature/ok-sig-sha1-2016-05-26.ksig test/out/mass_extend/groups/sha1-2.ksig
+
+# A directory tree with a subdirectory that can not be read.
+cp test/resource/file/abcd test/out/sign/recursive-skip/abcd
+cp test/resource/file/abcx test/out/sign/recursive-skip/locked/abcx
+chmod 000 test/out/sign/recursive-skip/locked
 
 
 
@@ -63,6 +101,9 @@ else
 	tool=src/ksi
 fi
 
+# The tool for the tests that run it from a shell command (e.g. concurrently).
+export KSI_TOOL=$tool
+
 # Wait until shelltest next release that has macros and refactor it.
 cp test/test_suites/pipe.test test/out/tmp
 sed -i -- "s|{KSI_BIN}|$tool|g" test/out/tmp/pipe.test
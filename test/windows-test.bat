@@ -30,6 +30,17 @@ rmdir /S /Q test\out\tmp
 
 REM Create test output directories.
 mkdir test\out\sign
+mkdir test\out\sign\input-list
+mkdir test\out\sign\hash-stream
+mkdir test\out\sign\recursive
+mkdir test\out\sign\state
+mkdir test\out\sign\multi-hash
+mkdir test\out\sign\dedupe
+mkdir test\out\sign\adaptive
+mkdir test\out\sign\bundle
+mkdir test\out\sign\save-threads
+mkdir test\out\sign\durable
+mkdir test\out\sign\journal
 mkdir test\out\extend
 mkdir test\out\extend-replace-existing
 mkdir test\out\pubfile
@@ -50,6 +61,7 @@ rem copy /Y test\resource\signature\ok-sig-2014-08-01.1.ksig test\out\fname\ok-s
 rem copy /Y test\resource\signature\ok-sig-2021-04-30.ksig test\out\extend-replace-existing\not-extended-1A.ksig
 copy /Y test\resource\signature\ok-sig-2021-04-30.ksig test\out\extend-replace-existing\not-extended-1B.ksig
 copy /Y test\resource\signature\ok-sig-2021-04-30.ksig test\out\extend-replace-existing\not-extended-2B.ksig
+copy /Y test\resource\signature\ok-sig-2021-04-30.ksig test\out\extend-replace-existing\not-extended-durable.ksig
 
 REM Define KSI_CONF for temporary testing.
 setlocal